@@ -43,6 +43,9 @@ static ink_mutex insert_mutex;
 Continuation *aio_err_callbck = 0;
 RecInt cache_config_threads_per_disk = 12;
 RecInt api_config_threads_per_disk = 12;
+RecInt cache_config_aio_read_deadline = 20;
+RecInt cache_config_aio_write_deadline = 500;
+RecInt cache_config_aio_read_write_ratio = 1;
 int thread_is_created = 0;
 
 
@@ -156,10 +159,37 @@ ink_aio_init(ModuleVersion v)
   RecRegisterRawStat(aio_rsb, RECT_PROCESS,
                      "proxy.process.cache.KB_write_per_sec",
                      RECD_FLOAT, RECP_NULL, (int) AIO_STAT_KB_WRITE_PER_SEC, aio_stats_cb);
+  RecRegisterRawStat(aio_rsb, RECT_PROCESS, "proxy.process.cache.aio.read.queue_time_avg_msec",
+                     RECD_FLOAT, RECP_NULL, (int) AIO_STAT_READ_QUEUE_TIME, RecRawStatSyncMHrTimeAvg);
+  RecRegisterRawStat(aio_rsb, RECT_PROCESS, "proxy.process.cache.aio.read.queue_time_1ms",
+                     RECD_COUNTER, RECP_NULL, (int) AIO_STAT_READ_QUEUE_TIME_1MS, RecRawStatSyncCount);
+  RecRegisterRawStat(aio_rsb, RECT_PROCESS, "proxy.process.cache.aio.read.queue_time_10ms",
+                     RECD_COUNTER, RECP_NULL, (int) AIO_STAT_READ_QUEUE_TIME_10MS, RecRawStatSyncCount);
+  RecRegisterRawStat(aio_rsb, RECT_PROCESS, "proxy.process.cache.aio.read.queue_time_100ms",
+                     RECD_COUNTER, RECP_NULL, (int) AIO_STAT_READ_QUEUE_TIME_100MS, RecRawStatSyncCount);
+  RecRegisterRawStat(aio_rsb, RECT_PROCESS, "proxy.process.cache.aio.read.queue_time_1s",
+                     RECD_COUNTER, RECP_NULL, (int) AIO_STAT_READ_QUEUE_TIME_1S, RecRawStatSyncCount);
+  RecRegisterRawStat(aio_rsb, RECT_PROCESS, "proxy.process.cache.aio.read.queue_time_inf",
+                     RECD_COUNTER, RECP_NULL, (int) AIO_STAT_READ_QUEUE_TIME_INF, RecRawStatSyncCount);
+  RecRegisterRawStat(aio_rsb, RECT_PROCESS, "proxy.process.cache.aio.write.queue_time_avg_msec",
+                     RECD_FLOAT, RECP_NULL, (int) AIO_STAT_WRITE_QUEUE_TIME, RecRawStatSyncMHrTimeAvg);
+  RecRegisterRawStat(aio_rsb, RECT_PROCESS, "proxy.process.cache.aio.write.queue_time_1ms",
+                     RECD_COUNTER, RECP_NULL, (int) AIO_STAT_WRITE_QUEUE_TIME_1MS, RecRawStatSyncCount);
+  RecRegisterRawStat(aio_rsb, RECT_PROCESS, "proxy.process.cache.aio.write.queue_time_10ms",
+                     RECD_COUNTER, RECP_NULL, (int) AIO_STAT_WRITE_QUEUE_TIME_10MS, RecRawStatSyncCount);
+  RecRegisterRawStat(aio_rsb, RECT_PROCESS, "proxy.process.cache.aio.write.queue_time_100ms",
+                     RECD_COUNTER, RECP_NULL, (int) AIO_STAT_WRITE_QUEUE_TIME_100MS, RecRawStatSyncCount);
+  RecRegisterRawStat(aio_rsb, RECT_PROCESS, "proxy.process.cache.aio.write.queue_time_1s",
+                     RECD_COUNTER, RECP_NULL, (int) AIO_STAT_WRITE_QUEUE_TIME_1S, RecRawStatSyncCount);
+  RecRegisterRawStat(aio_rsb, RECT_PROCESS, "proxy.process.cache.aio.write.queue_time_inf",
+                     RECD_COUNTER, RECP_NULL, (int) AIO_STAT_WRITE_QUEUE_TIME_INF, RecRawStatSyncCount);
   memset(&aio_reqs, 0, MAX_DISKS_POSSIBLE * sizeof(AIO_Reqs *));
   ink_mutex_init(&insert_mutex, NULL);
 
   IOCORE_ReadConfigInteger(cache_config_threads_per_disk, "proxy.config.cache.threads_per_disk");
+  IOCORE_ReadConfigInteger(cache_config_aio_read_deadline, "proxy.config.cache.aio.read_deadline");
+  IOCORE_ReadConfigInteger(cache_config_aio_write_deadline, "proxy.config.cache.aio.write_deadline");
+  IOCORE_ReadConfigInteger(cache_config_aio_read_write_ratio, "proxy.config.cache.aio.read_write_ratio");
 }
 
 int
@@ -197,15 +227,17 @@ struct AIOThreadInfo:public Continuation
 };
 
 /* priority scheduling */
-/* Have 2 queues per file descriptor - A queue for http requests and another
-   for non-http (streaming) request. Each file descriptor has a lock
-   and condition variable associated with it. A dedicated number of threads
-   (THREADS_PER_DISK) wait on the condition variable associated with the
-   file descriptor. The cache threads try to put the request in the
-   appropriate queue. If they fail to acquire the lock, they put the
-   request in the atomic list. Requests are served in the order of
-   highest priority first. If both the queues are empty, the aio threads
-   check if there is any request on the other disks */
+/* Have 3 queues per file descriptor - a queue for non-http (streaming)
+   requests and one each for http reads and http writes. Each file
+   descriptor has a lock and condition variable associated with it. A
+   dedicated number of threads (THREADS_PER_DISK) wait on the condition
+   variable associated with the file descriptor. The cache threads try
+   to put the request in the appropriate queue. If they fail to acquire
+   the lock, they put the request in the atomic list. Non-http requests
+   are served in the order of highest priority first. Between the http
+   queues reads are preferred, so that cache hits do not wait behind
+   aggregation writes, within the limits set by the read/write ratio and
+   the deadlines of the two classes (see aio_next) */
 
 
 /* insert  an entry for file descriptor fildes into aio_reqs */
@@ -269,11 +301,10 @@ aio_insert(AIOCallback *op, AIO_Reqs *req)
 #endif
   if (op->aiocb.aio_reqprio == AIO_LOWEST_PRIORITY)     // http request
   {
-    AIOCallback *cb = (AIOCallback *) req->http_aio_todo.tail;
-    if (!cb)
-      req->http_aio_todo.push(op);
+    if (op->aiocb.aio_lio_opcode == LIO_WRITE)
+      req->http_write_todo.enqueue(op);
     else
-      req->http_aio_todo.insert(op, cb);
+      req->http_read_todo.enqueue(op);
   } else {
 
     AIOCallback *cb = (AIOCallback *) req->aio_todo.tail;
@@ -290,6 +321,66 @@ aio_insert(AIOCallback *op, AIO_Reqs *req)
   }
 }
 
+/* take the next request off the queues of req. Among http requests the
+   class whose oldest request is past its deadline goes first, otherwise
+   a write only goes once reads have moved read_write_ratio times the
+   bytes written, that write included */
+static AIOCallback *
+aio_next(AIO_Reqs *req, ink_hrtime now)
+{
+  AIOCallback *op = req->aio_todo.pop();
+  if (op)
+    return op;
+
+  AIOCallbackInternal *r = (AIOCallbackInternal *) req->http_read_todo.head;
+  AIOCallbackInternal *w = (AIOCallbackInternal *) req->http_write_todo.head;
+  bool write;
+  if (!r || !w) {
+    /* at most one class is backlogged, the ratio starts over */
+    req->read_bytes = 0;
+    req->write_bytes = 0;
+    write = !r;
+  } else {
+    bool read_late = now - r->queue_time > HRTIME_MSECONDS(cache_config_aio_read_deadline);
+    bool write_late = now - w->queue_time > HRTIME_MSECONDS(cache_config_aio_write_deadline);
+    if (read_late != write_late)
+      write = write_late;
+    else
+      write = req->read_bytes >= (req->write_bytes + w->aiocb.aio_nbytes) * cache_config_aio_read_write_ratio;
+  }
+  if (write) {
+    if ((op = req->http_write_todo.pop()))
+      req->write_bytes += op->aiocb.aio_nbytes;
+  } else {
+    if ((op = req->http_read_todo.pop()))
+      req->read_bytes += op->aiocb.aio_nbytes;
+  }
+  return op;
+}
+
+/* record how long an http request waited in its queue */
+static void
+aio_queue_time_stat(AIOCallback *op, ink_hrtime now)
+{
+  if (op->aiocb.aio_reqprio != AIO_LOWEST_PRIORITY)
+    return;
+  ink_hrtime t = now - ((AIOCallbackInternal *) op)->queue_time;
+  int id = (op->aiocb.aio_lio_opcode == LIO_WRITE) ? AIO_STAT_WRITE_QUEUE_TIME : AIO_STAT_READ_QUEUE_TIME;
+  /* the aio threads are not regular event threads, update the globals */
+  RecIncrGlobalRawStat(aio_rsb, id, t);
+  if (t <= HRTIME_MSECOND)
+    id += 1;
+  else if (t <= HRTIME_MSECONDS(10))
+    id += 2;
+  else if (t <= HRTIME_MSECONDS(100))
+    id += 3;
+  else if (t <= HRTIME_SECOND)
+    id += 4;
+  else
+    id += 5;
+  RecIncrGlobalRawStatCount(aio_rsb, id, 1);
+}
+
 /* move the request from the atomic list to the queue */
 static void
 aio_move(AIO_Reqs *req)
@@ -322,6 +413,7 @@ aio_queue_req(AIOCallbackInternal *op, int fromAPI = 0)
   AIO_Reqs *req = op->aio_req;
   op->link.next = NULL;;
   op->link.prev = NULL;
+  op->queue_time = ink_get_hrtime_internal();
 #ifdef AIO_STATS
   ink_atomic_increment((int *) &data->num_req, 1);
 #endif
@@ -487,8 +579,10 @@ aio_thread_main(void *arg)
       /* check if any pending requests on the atomic list */
       if (!INK_ATOMICLIST_EMPTY(my_aio_req->aio_temp_list))
         aio_move(my_aio_req);
-      if (!(op = my_aio_req->aio_todo.pop()) && !(op = my_aio_req->http_aio_todo.pop()))
+      ink_hrtime now = ink_get_hrtime_internal();
+      if (!(op = aio_next(my_aio_req, now)))
         break;
+      aio_queue_time_stat(op, now);
 #ifdef AIO_STATS
       num_requests--;
       current_req->queued--;
@@ -53,6 +53,7 @@ struct AIOCallbackInternal: public AIOCallback
   AIOCallback *first;
   AIO_Reqs *aio_req;
   ink_hrtime sleep_time;
+  ink_hrtime queue_time;        // when the request was queued, for deadlines
   int io_complete(int event, void *data);
   AIOCallbackInternal()
   {
@@ -84,7 +85,11 @@ AIOCallbackInternal::io_complete(int event, void *data)
 struct AIO_Reqs
 {
   Que(AIOCallback, link) aio_todo;       /* queue for holding non-http requests */
-  Que(AIOCallback, link) http_aio_todo;  /* queue for http requests */
+  Que(AIOCallback, link) http_read_todo;  /* queue for http reads */
+  Que(AIOCallback, link) http_write_todo; /* queue for http writes */
+  /* bytes moved by each http queue since both were last backlogged */
+  int64_t read_bytes;
+  int64_t write_bytes;
   /* Atomic list to temporarily hold the request if the
      lock for a particular queue cannot be acquired */
   InkAtomicList aio_temp_list;
@@ -94,7 +99,7 @@ struct AIO_Reqs
   volatile int pending;         /* number of outstanding requests on the disk */
   volatile int queued;          /* total number of aio_todo and http_todo requests */
   volatile int filedes;         /* the file descriptor for the requests */
-  volatile int requests_queued;
+  volatile int requests_queued; /* requests queued or on the disk */
 };
 
 #ifdef AIO_STATS
@@ -122,6 +127,19 @@ enum aio_stat_enum
   AIO_STAT_KB_READ_PER_SEC,
   AIO_STAT_WRITE_PER_SEC,
   AIO_STAT_KB_WRITE_PER_SEC,
+  // queue time average and histogram, one block per http request class
+  AIO_STAT_READ_QUEUE_TIME,
+  AIO_STAT_READ_QUEUE_TIME_1MS,
+  AIO_STAT_READ_QUEUE_TIME_10MS,
+  AIO_STAT_READ_QUEUE_TIME_100MS,
+  AIO_STAT_READ_QUEUE_TIME_1S,
+  AIO_STAT_READ_QUEUE_TIME_INF,
+  AIO_STAT_WRITE_QUEUE_TIME,
+  AIO_STAT_WRITE_QUEUE_TIME_1MS,
+  AIO_STAT_WRITE_QUEUE_TIME_10MS,
+  AIO_STAT_WRITE_QUEUE_TIME_100MS,
+  AIO_STAT_WRITE_QUEUE_TIME_1S,
+  AIO_STAT_WRITE_QUEUE_TIME_INF,
   AIO_STAT_COUNT
 };
 extern RecRawStatBlock *aio_rsb;
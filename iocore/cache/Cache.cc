@@ -32,6 +32,13 @@
 
 #include "I_Layout.h"
 
+#if TS_HAS_LIBZ
+#include <zlib.h>
+#endif
+#if TS_HAS_LZMA
+#include <lzma.h>
+#endif
+
 #ifdef HTTP_CACHE
 #include "HttpTransactCache.h"
 #include "HttpSM.h"
@@ -44,6 +51,8 @@
 #define USELESS_REENABLES       // allow them for now
 // #define VERIFY_JTEST_DATA
 
+#define LZMA_BASE_MEMLIMIT      (64 * 1024 * 1024)
+
 #define DOCACHE_CLEAR_DYN_STAT(x) \
 do { \
 	RecSetRawStatSum(rsb, x, 0); \
@@ -77,6 +86,15 @@ int cache_config_alt_rewrite_max_size = 4096;
 int cache_config_read_while_writer = 0;
 char cache_system_config_directory[PATH_NAME_MAX + 1];
 int cache_config_mutex_retry_delay = 2;
+int cache_config_tier_promote_hits = 2;
+int cache_config_admission_hits = 0;
+int cache_config_admission_window = 3600;
+int cache_config_compress = 0;
+int cache_config_dedup = 0;
+int cache_config_dedup_min_size = 4096;
+int cache_config_write_balance = 0;
+int cache_config_write_balance_latency = 100;
+int cache_config_write_balance_queue = 32;
 
 // Globals
 
@@ -105,6 +123,9 @@ ClassAllocator<CacheRemoveCont> cacheRemoveContAllocator("cacheRemoveCont");
 ClassAllocator<EvacuationKey> evacuationKeyAllocator("evacuationKey");
 int CacheVC::size_to_init = -1;
 CacheKey zero_key(0, 0);
+#ifdef HTTP_CACHE
+extern int url_hash_method;
+#endif
 
 void verify_cache_api() {
   ink_assert((int)TS_EVENT_CACHE_OPEN_READ == (int)CACHE_EVENT_OPEN_READ);
@@ -274,6 +295,7 @@ CacheVC::do_io_pread(Continuation *c, int64_t nbytes, MIOBuffer *abuf, int64_t o
   vio.nbytes = nbytes;
   vio.vc_server = this;
   seek_to = offset;
+  f.pread = 1;
   ink_assert(c->mutex->thread_holding);
   if (!trigger && !recursive)
     trigger = c->mutex->thread_holding->schedule_imm_local(this);
@@ -375,6 +397,32 @@ bool CacheVC::set_data(int i, void *data)
 }
 
 #ifdef HTTP_CACHE
+// content types which are compressed already
+static const char *incompressible_types[] = {
+  "image/", "audio/", "video/", "application/zip", "application/gzip", "application/x-gzip",
+  "application/x-bzip2", "application/x-xz", "application/x-7z-compressed", "application/x-rar-compressed",
+  "application/pdf", "application/ogg", "application/font-woff", NULL
+};
+
+static bool
+http_body_compressible(HTTPHdr *response)
+{
+  int len = 0;
+  const char *value = response->value_get(MIME_FIELD_CONTENT_ENCODING, MIME_LEN_CONTENT_ENCODING, &len);
+  if (value && !(len == 8 && !strncasecmp(value, "identity", 8)))
+    return false;
+  if (!(value = response->value_get(MIME_FIELD_CONTENT_TYPE, MIME_LEN_CONTENT_TYPE, &len)))
+    return true;
+  if (len >= 13 && !strncasecmp(value, "image/svg+xml", 13))
+    return true;
+  for (const char **t = incompressible_types; *t; t++) {
+    int l = strlen(*t);
+    if (len >= l && !strncasecmp(value, *t, l))
+      return false;
+  }
+  return true;
+}
+
 void
 CacheVC::get_http_info(CacheHTTPInfo ** ainfo)
 {
@@ -398,6 +446,7 @@ CacheVC::set_http_info(CacheHTTPInfo *ainfo)
   }
   alternate.copy_shallow(ainfo);
   ainfo->clear();
+  f.compress = cache_config_compress && http_body_compressible(alternate.response_get());
 }
 #endif
 
@@ -498,6 +547,75 @@ Vol::close_read(CacheVC *cont)
 
 // Cache Processor
 
+// Open the file or device of a storage span for the cache; a directory
+// gets a cache.db file of the span's size.  Returns the fd or -1.
+static int
+open_span(Span *sd, char *path, int pathlen)
+{
+  int opts = O_RDWR;
+  ink_strlcpy(path, sd->pathname, pathlen);
+  if (!sd->file_pathname) {
+#if !defined(_WIN32)
+    if (config_volumes.num_http_volumes && config_volumes.num_stream_volumes) {
+      Warning("It is suggested that you use raw disks if streaming and http are in the same cache");
+    }
+#endif
+    ink_strlcat(path, "/cache.db", pathlen);
+    opts |= O_CREAT;
+  }
+  opts |= _O_ATTRIB_OVERLAPPED;
+#ifdef O_DIRECT
+  opts |= O_DIRECT;
+#endif
+#ifdef O_DSYNC
+  opts |= O_DSYNC;
+#endif
+
+  int fd = open(path, opts, 0644);
+  int blocks = sd->blocks;
+  if (fd < 0) {
+    Warning("cache unable to open '%s': %s", path, strerror(errno));
+    return -1;
+  }
+#if defined (_WIN32)
+  aio_completion_port.register_handle((void *) fd, 0);
+#endif
+  if (!sd->file_pathname) {
+    if (ftruncate(fd, ((uint64_t) blocks) * STORE_BLOCK_SIZE) < 0) {
+      Warning("unable to truncate cache file '%s' to %d blocks", path, blocks);
+#if defined(_WIN32)
+      /* We can do a specific check for FAT32 systems on NT,
+       * to print a specific warning */
+      if ((((uint64_t) blocks) * STORE_BLOCK_SIZE) > (1 << 32)) {
+        Warning("If you are using a FAT32 file system, please ensure that cachesize"
+                "specified in storage.config, does not exceed 4GB!. ");
+      }
+#endif
+      close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+// Start reading (or clearing) the header of the disk on span sd.
+static void
+open_disk(CacheDisk *d, Span *sd, char *path, int fd, bool clear)
+{
+  int blocks = sd->blocks;
+  int sector_size = sd->hw_sector_size;
+  if (sector_size < cache_config_force_sector_size)
+    sector_size = cache_config_force_sector_size;
+  if (sd->hw_sector_size <= 0 || sector_size > STORE_BLOCK_SIZE) {
+    Warning("bad hardware sector size %d, resetting to %d", sector_size, STORE_BLOCK_SIZE);
+    sector_size = STORE_BLOCK_SIZE;
+  }
+  off_t skip = ROUND_TO_STORE_BLOCK((sd->offset < START_POS ? START_POS + sd->alignment : sd->offset));
+  blocks = blocks - ROUND_TO_STORE_BLOCK(sd->offset + skip);
+  d->tier = sd->tier;
+  d->open(path, blocks, skip, sector_size, fd, clear);
+}
+
 int
 CacheProcessor::start(int)
 {
@@ -516,7 +634,6 @@ CacheProcessor::start_internal(int flags)
   fix = !!(flags & PROCESSOR_FIX);
   int i;
   start_done = 0;
-  int diskok = 1;
 
   /* read the config file and create the data structures corresponding
      to the file */
@@ -530,62 +647,13 @@ CacheProcessor::start_internal(int flags)
   for (i = 0; i < theCacheStore.n_disks; i++) {
     sd = theCacheStore.disk[i];
     char path[PATH_MAX];
-    int opts = O_RDWR;
-    ink_strlcpy(path, sd->pathname, sizeof(path));
-    if (!sd->file_pathname) {
-#if !defined(_WIN32)
-      if (config_volumes.num_http_volumes && config_volumes.num_stream_volumes) {
-        Warning("It is suggested that you use raw disks if streaming and http are in the same cache");
-      }
-#endif
-      ink_strlcat(path, "/cache.db", sizeof(path));
-      opts |= O_CREAT;
+    int fd = open_span(sd, path, sizeof(path));
+    if (fd >= 0) {
+      gdisks[gndisks] = NEW(new CacheDisk());
+      Debug("cache_hosting", "Disk: %d, blocks: %d", gndisks, (int) sd->blocks);
+      open_disk(gdisks[gndisks], sd, path, fd, clear);
+      gndisks++;
     }
-    opts |= _O_ATTRIB_OVERLAPPED;
-#ifdef O_DIRECT
-    opts |= O_DIRECT;
-#endif
-#ifdef O_DSYNC
-    opts |= O_DSYNC;
-#endif
-
-    int fd = open(path, opts, 0644);
-    int blocks = sd->blocks;
-    if (fd > 0) {
-#if defined (_WIN32)
-      aio_completion_port.register_handle((void *) fd, 0);
-#endif
-      if (!sd->file_pathname) {
-        if (ftruncate(fd, ((uint64_t) blocks) * STORE_BLOCK_SIZE) < 0) {
-          Warning("unable to truncate cache file '%s' to %d blocks", path, blocks);
-          diskok = 0;
-#if defined(_WIN32)
-          /* We can do a specific check for FAT32 systems on NT,
-           * to print a specific warning */
-          if ((((uint64_t) blocks) * STORE_BLOCK_SIZE) > (1 << 32)) {
-            Warning("If you are using a FAT32 file system, please ensure that cachesize"
-                    "specified in storage.config, does not exceed 4GB!. ");
-          }
-#endif
-        }
-      }
-      if (diskok) {
-        gdisks[gndisks] = NEW(new CacheDisk());
-        Debug("cache_hosting", "Disk: %d, blocks: %d", gndisks, blocks);
-        int sector_size = sd->hw_sector_size;
-        if (sector_size < cache_config_force_sector_size)
-          sector_size = cache_config_force_sector_size;
-        if (sd->hw_sector_size <= 0 || sector_size > STORE_BLOCK_SIZE) {
-          Warning("bad hardware sector size %d, resetting to %d", sector_size, STORE_BLOCK_SIZE);
-          sector_size = STORE_BLOCK_SIZE;
-        }
-        off_t skip = ROUND_TO_STORE_BLOCK((sd->offset < START_POS ? START_POS + sd->alignment : sd->offset));
-        blocks = blocks - ROUND_TO_STORE_BLOCK(sd->offset + skip);
-        gdisks[gndisks]->open(path, blocks, skip, sector_size, fd, clear);
-        gndisks++;
-      }
-    } else
-      Warning("cache unable to open '%s': %s", path, strerror(errno));
   }
 
   if (gndisks == 0) {
@@ -702,6 +770,69 @@ CacheProcessor::diskInitialized()
   }
 }
 
+#ifdef HTTP_CACHE
+// The URL digest is the cache key, so a cache must keep being looked up
+// with the url_hash_method it was filled with. Volumes written before the
+// header recorded it (minor version 0) were filled with MD5 or MMH,
+// whichever was configured: MMH unless the configuration says MD5.
+static int
+vol_url_hash_method(Vol *d)
+{
+  if (d->header->version.ink_minor >= 1)
+    return d->header->url_hash_method;
+  return url_hash_method == 0 ? 0 : 1;
+}
+
+static bool
+vol_is_empty(Vol *d)
+{
+  return d->header->write_pos == d->start && !d->header->phase && !d->header->cycle;
+}
+
+static void
+vol_url_hash_method_set(Vol *d, int method)
+{
+  if (!vol_is_empty(d) && vol_url_hash_method(d) != method)
+    Warning("cache volume '%s' was filled with url_hash_method %d, its documents will not be found",
+            d->hash_id, vol_url_hash_method(d));
+  d->header->version.ink_minor = CACHE_DB_MINOR_VERSION;
+  d->header->url_hash_method = method;
+}
+
+static void
+cache_url_hash_method_init()
+{
+  int i, method = url_hash_method;
+
+  for (i = 0; i < gnvol; i++) {
+    if (!vol_is_empty(gvol[i])) {
+      method = vol_url_hash_method(gvol[i]);
+      break;
+    }
+  }
+  if (method != url_hash_method) {
+    Warning("cache was filled with proxy.config.cache.url_hash_method %d, not the configured %d; "
+            "clear the cache to switch", method, url_hash_method);
+    url_hash_method = method;
+  }
+  for (i = 0; i < gnvol; i++)
+    vol_url_hash_method_set(gvol[i], method);
+  Debug("cache_init", "url_hash_method = %d", url_hash_method);
+}
+#endif
+
+static RamCache *
+new_vol_ram_cache()
+{
+  switch (cache_config_ram_cache_algorithm) {
+    default:
+    case RAM_CACHE_ALGORITHM_CLFUS:
+      return new_RamCacheCLFUS();
+    case RAM_CACHE_ALGORITHM_LRU:
+      return new_RamCacheLRU();
+  }
+}
+
 void
 CacheProcessor::cacheInitialized()
 {
@@ -763,17 +894,11 @@ CacheProcessor::cacheInitialized()
           (unsigned int) caches_ready, gnvol);
     int64_t ram_cache_bytes = 0;
     if (gnvol) {
-      for (i = 0; i < gnvol; i++) {
-        switch (cache_config_ram_cache_algorithm) {
-          default:
-          case RAM_CACHE_ALGORITHM_CLFUS:
-            gvol[i]->ram_cache = new_RamCacheCLFUS();
-            break;
-          case RAM_CACHE_ALGORITHM_LRU:
-            gvol[i]->ram_cache = new_RamCacheLRU();
-            break;
-        }
-      }
+#ifdef HTTP_CACHE
+      cache_url_hash_method_init();
+#endif
+      for (i = 0; i < gnvol; i++)
+        gvol[i]->ram_cache = new_vol_ram_cache();
       if (cache_config_ram_cache_size == AUTO_SIZE_RAM_CACHE) {
         Debug("cache_init", "CacheProcessor::cacheInitialized - cache_config_ram_cache_size == AUTO_SIZE_RAM_CACHE");
         for (i = 0; i < gnvol; i++) {
@@ -874,6 +999,23 @@ CacheProcessor::cacheInitialized()
 #endif
           break;
       }
+      switch (cache_config_compress) {
+        default:
+          Fatal("unknown cache compression type: %d", cache_config_compress);
+        case CACHE_COMPRESSION_NONE:
+        case CACHE_COMPRESSION_FASTLZ:
+          break;
+        case CACHE_COMPRESSION_LIBZ:
+#if ! TS_HAS_LIBZ
+          Fatal("libz not available for cache compression");
+#endif
+          break;
+        case CACHE_COMPRESSION_LIBLZMA:
+#if ! TS_HAS_LZMA
+          Fatal("lzma not available for cache compression");
+#endif
+          break;
+      }
 
       GLOBAL_CACHE_SET_DYN_STAT(cache_ram_cache_bytes_total_stat, ram_cache_bytes);
       GLOBAL_CACHE_SET_DYN_STAT(cache_bytes_total_stat, total_cache_bytes);
@@ -990,6 +1132,9 @@ vol_clear_init(Vol *d)
   d->header->cycle = 0;
   d->header->create_time = time(NULL);
   d->header->dirty = 0;
+#ifdef HTTP_CACHE
+  d->header->url_hash_method = url_hash_method;
+#endif
   d->sector_size = d->header->sector_size = d->disk->hw_sector_size;
   *d->footer = *d->header;
 }
@@ -1534,9 +1679,15 @@ Vol::dir_init_done(int event, void *data)
     eventProcessor.schedule_in(this, HRTIME_MSECONDS(5), ET_CALL);
     return EVENT_CONT;
   } else {
-    int vol_no = ink_atomic_increment(&gnvol, 1);
-    ink_assert(!gvol[vol_no]);
-    gvol[vol_no] = this;
+    // fill the next free slot before counting it: gvol[0 .. gnvol) is
+    // walked without a lock, the atomic operations order the stores
+    for (;;) {
+      int vol_no = gnvol;
+      if (ink_atomic_cas_ptr((pvvoidp) &gvol[vol_no], NULL, this)) {
+        ink_atomic_increment(&gnvol, 1);
+        break;
+      }
+    }
     SET_HANDLER(&Vol::aggWrite);
     if (fd == -1)
       cache->vol_initialized(0);
@@ -1546,8 +1697,10 @@ Vol::dir_init_done(int event, void *data)
   }
 }
 
-void
-build_vol_hash_table(CacheHostRecord *cp)
+// Build the key to volume table over the volumes of cp on the given
+// storage tier (or all of them if tier < 0) and install it in *table.
+static void
+build_vol_hash_table(CacheHostRecord *cp, int tier, unsigned short **table)
 {
   int num_vols = cp->num_vols;
   unsigned int *mapping = (unsigned int *) xmalloc(sizeof(unsigned int) * num_vols);
@@ -1562,7 +1715,7 @@ build_vol_hash_table(CacheHostRecord *cp)
   int map = 0;
   // initialize number of elements per vol
   for (i = 0; i < num_vols; i++) {
-    if (DISK_BAD(cp->vols[i]->disk)) {
+    if (DISK_BAD(cp->vols[i]->disk) || (tier >= 0 && cp->vols[i]->disk->tier != tier)) {
       bad_vols++;
       continue;
     }
@@ -1575,10 +1728,10 @@ build_vol_hash_table(CacheHostRecord *cp)
 
   if (!num_vols) {
     // all the disks are corrupt,
-    if (cp->vol_hash_table) {
-      new_Freer(cp->vol_hash_table, CACHE_MEM_FREE_TIMEOUT);
+    if (*table) {
+      new_Freer(*table, CACHE_MEM_FREE_TIMEOUT);
     }
-    cp->vol_hash_table = NULL;
+    *table = NULL;
     xfree(mapping);
     xfree(p);
     return;
@@ -1622,12 +1775,46 @@ build_vol_hash_table(CacheHostRecord *cp)
 
   // install new table
 
-  if (cp->vol_hash_table) {
-    new_Freer(cp->vol_hash_table, CACHE_MEM_FREE_TIMEOUT);
+  if (*table) {
+    new_Freer(*table, CACHE_MEM_FREE_TIMEOUT);
   }
   xfree(mapping);
   xfree(p);
-  cp->vol_hash_table = ttable;
+  *table = ttable;
+}
+
+// Tiered storage: when both tiers have good volumes, documents are
+// hashed onto the slow tier only and the fast tier gets a table of its
+// own for the copies promoted into it (see tier_read_hit).
+void
+build_vol_hash_table(CacheHostRecord *cp)
+{
+  int i, nfast = 0, nslow = 0;
+
+  for (i = 0; i < cp->num_vols; i++) {
+    if (DISK_BAD(cp->vols[i]->disk))
+      continue;
+    if (cp->vols[i]->disk->tier == STORE_TIER_FAST)
+      nfast++;
+    else
+      nslow++;
+  }
+  bool tiered = nfast && nslow;
+  build_vol_hash_table(cp, tiered ? STORE_TIER_SLOW : -1, &cp->vol_hash_table);
+  if (!tiered) {
+    if (cp->fast_vol_hash_table)
+      new_Freer(cp->fast_vol_hash_table, CACHE_MEM_FREE_TIMEOUT);
+    cp->fast_vol_hash_table = NULL;
+    return;
+  }
+  build_vol_hash_table(cp, STORE_TIER_FAST, &cp->fast_vol_hash_table);
+  for (i = 0; i < cp->num_vols; i++) {
+    Vol *d = cp->vols[i];
+    if (d->disk->tier != STORE_TIER_FAST && !d->tier_hits) {
+      d->tier_hits = (uint8_t *) xmalloc(TIER_HIT_TABLE_SIZE);
+      memset(d->tier_hits, 0, TIER_HIT_TABLE_SIZE);
+    }
+  }
 }
 
 
@@ -1637,77 +1824,165 @@ Cache::vol_initialized(bool result)
   ink_atomic_increment(&total_initialized_vol, 1);
   if (result)
     ink_atomic_increment(&total_good_nvol, 1);
-  if (total_nvol == total_initialized_vol)
+  // volumes of a disk added at run time come in after the cache is open
+  if (total_nvol == total_initialized_vol && ready == CACHE_INITIALIZING)
     open_done();
 }
 
+// Set while a disk is added or the volumes of a removed one are dropped,
+// the two rewrite gdisks and gvol.
+static volatile int cache_disk_adding = 0;
+
+// Wait for the volumes of an offline disk to stop writing to it: once
+// the disk is bad they start no aggregation writes and no directory
+// syncs, so it is enough that none is in progress. Until then the disk
+// cannot be added back. The volumes are then dropped from gvol and,
+// once nothing can be looking them up any more, their directory and RAM
+// cache are freed. The Vol itself is kept, the host tables and any
+// CacheVC still open on it may point to it.
+struct CacheDiskQuiesce;
+typedef int (CacheDiskQuiesce::*CacheDiskQuiesceHandler) (int, void *);
+
+struct CacheDiskQuiesce: public Continuation
+{
+  CacheDisk *disk;
+  Vol **vols;
+  int nvols;
+
+  int mainEvent(int event, void *data);
+  int freeEvent(int event, void *data);
+
+  CacheDiskQuiesce(CacheDisk *d)
+    : Continuation(new_ProxyMutex()), disk(d), vols(NULL), nvols(0)
+  {
+    SET_HANDLER((CacheDiskQuiesceHandler) & CacheDiskQuiesce::mainEvent);
+  }
+  ~CacheDiskQuiesce()
+  {
+    if (vols)
+      xfree(vols);
+  }
+};
+
 int
-AIO_Callback_handler::handle_disk_failure(int event, void *data)
+CacheDiskQuiesce::mainEvent(int event, void *data)
 {
-  (void) event;
-  /* search for the matching file descriptor */
-  if (!CacheProcessor::cache_ready)
-    return EVENT_DONE;
-  int disk_no = 0;
-  int good_disks = 0;
-  AIOCallback *cb = (AIOCallback *) data;
-  for (; disk_no < gndisks; disk_no++) {
-    CacheDisk *d = gdisks[disk_no];
+  NOWARN_UNUSED(event);
+  NOWARN_UNUSED(data);
+  int i, n;
 
-    if (d->fd == cb->aiocb.aio_fildes) {
-      d->num_errors++;
+  for (i = 0; i < gnvol; i++) {
+    Vol *vol = gvol[i];
+    if (vol->disk != disk)
+      continue;
+    CACHE_TRY_LOCK(lock, vol->mutex, mutex->thread_holding);
+    if (!lock || vol->is_io_in_progress() || vol->dir_sync_in_progress) {
+      eventProcessor.schedule_in(this, HRTIME_MSECONDS(cache_config_mutex_retry_delay), ET_CALL);
+      return EVENT_CONT;
+    }
+  }
+  if (!ink_atomic_cas(&cache_disk_adding, 0, 1)) {
+    eventProcessor.schedule_in(this, HRTIME_MSECONDS(cache_config_mutex_retry_delay), ET_CALL);
+    return EVENT_CONT;
+  }
 
-      if (!DISK_BAD(d)) {
+  n = gnvol;
+  // shrink gvol as CacheDiskAdd grows it, readers may still hold the
+  // old array. The dropped volumes go at the end of the new one, so a
+  // reader which still has the old gnvol only sees volumes it could
+  // have seen before.
+  Vol **v = (Vol **) xmalloc(n * sizeof(Vol *));
+  int live = 0;
+  vols = (Vol **) xmalloc(n * sizeof(Vol *));
+  for (i = 0; i < n; i++) {
+    if (gvol[i]->disk == disk)
+      vols[nvols++] = gvol[i];
+    else
+      v[live++] = gvol[i];
+  }
+  memcpy(v + live, vols, nvols * sizeof(Vol *));
+  gnvol = live;
+  new_Freer(gvol, CACHE_MEM_FREE_TIMEOUT);
+  gvol = v;
+  cache_disk_adding = 0;
+
+  Debug("cache_init", "cache disk %s quiesced, %d volumes dropped", disk->path, nvols);
+  disk->quiescing = 0;
+  SET_HANDLER((CacheDiskQuiesceHandler) & CacheDiskQuiesce::freeEvent);
+  eventProcessor.schedule_in(this, CACHE_MEM_FREE_TIMEOUT, ET_CALL);
+  return EVENT_CONT;
+}
 
-        char message[128];
-        snprintf(message, sizeof(message), "Error accessing Disk %s", d->path);
-        Warning(message);
-        IOCORE_SignalManager(REC_SIGNAL_CACHE_WARNING, message);
-      } else if (!DISK_BAD_SIGNALLED(d)) {
+int
+CacheDiskQuiesce::freeEvent(int event, void *data)
+{
+  NOWARN_UNUSED(event);
+  NOWARN_UNUSED(data);
 
-        char message[128];
-        snprintf(message, sizeof(message), "too many errors accessing disk %s: declaring disk bad", d->path);
-        Warning(message);
-        IOCORE_SignalManager(REC_SIGNAL_CACHE_ERROR, message);
-        /* subtract the disk space that was being used from  the cache size stat */
-        // dir entries stat
-        int p;
-        uint64_t total_bytes_delete = 0;
-        uint64_t total_dir_delete = 0;
-        uint64_t used_dir_delete = 0;
-
-        for (p = 0; p < gnvol; p++) {
-          if (d->fd == gvol[p]->fd) {
-            total_dir_delete += gvol[p]->buckets * gvol[p]->segments * DIR_DEPTH;
-            used_dir_delete += dir_entries_used(gvol[p]);
-            total_bytes_delete = gvol[p]->len - vol_dirlen(gvol[p]);
-          }
-        }
+  while (nvols > 0) {
+    Vol *vol = vols[nvols - 1];
+    CACHE_TRY_LOCK(lock, vol->mutex, mutex->thread_holding);
+    if (!lock) {
+      eventProcessor.schedule_in(this, HRTIME_MSECONDS(cache_config_mutex_retry_delay), ET_CALL);
+      return EVENT_CONT;
+    }
+    vol->ram_cache->clear();
+    free(vol->raw_dir);
+    vol->raw_dir = NULL;
+    vol->dir = NULL;
+    vol->header = NULL;
+    vol->footer = NULL;
+    nvols--;
+  }
+  delete this;
+  return EVENT_DONE;
+}
 
-        RecIncrGlobalRawStat(cache_rsb, cache_bytes_total_stat, -total_bytes_delete);
-        RecIncrGlobalRawStat(cache_rsb, cache_bytes_total_stat, -total_dir_delete);
-        RecIncrGlobalRawStat(cache_rsb, cache_bytes_total_stat, -cache_direntries_used_stat);
+// Take a disk out of service: drop its space from the stats and its
+// volumes from the key to volume tables, and stop them writing to it.
+static void
+cache_disk_offline(CacheDisk *d)
+{
+  uint64_t total_bytes_delete = 0;
+  uint64_t total_dir_delete = 0;
+  uint64_t used_dir_delete = 0;
 
-        if (theCache) {
-          rebuild_host_table(theCache);
-        }
-        if (theStreamCache) {
-          rebuild_host_table(theStreamCache);
-        }
-      }
-      if (good_disks)
-        return EVENT_DONE;
+  for (int p = 0; p < gnvol; p++) {
+    if (gvol[p]->disk == d) {
+      total_dir_delete += gvol[p]->buckets * gvol[p]->segments * DIR_DEPTH;
+      used_dir_delete += dir_entries_used(gvol[p]);
+      total_bytes_delete += gvol[p]->len - vol_dirlen(gvol[p]);
     }
+  }
 
-    if (!DISK_BAD(d))
-      good_disks++;
+  RecIncrGlobalRawStat(cache_rsb, cache_bytes_total_stat, -total_bytes_delete);
+  RecIncrGlobalRawStat(cache_rsb, cache_direntries_total_stat, -total_dir_delete);
+  RecIncrGlobalRawStat(cache_rsb, cache_direntries_used_stat, -used_dir_delete);
 
+  if (theCache) {
+    rebuild_host_table(theCache);
+  }
+  if (theStreamCache) {
+    rebuild_host_table(theStreamCache);
+  }
+  d->quiescing = 1;
+  eventProcessor.schedule_imm(NEW(new CacheDiskQuiesce(d)), ET_CALL);
+}
+
+// Disable the caches which have no volume left.
+static void
+cache_check_volumes()
+{
+  int good_disks = 0;
+
+  for (int i = 0; i < gndisks; i++) {
+    if (!DISK_BAD(gdisks[i]))
+      good_disks++;
   }
   if (!good_disks) {
     Warning("all disks are bad, cache disabled");
     CacheProcessor::cache_ready = 0;
-    delete cb;
-    return EVENT_DONE;
+    return;
   }
 
   if (theCache && !theCache->hosttable->gen_host_rec.vol_hash_table) {
@@ -1725,6 +2000,40 @@ AIO_Callback_handler::handle_disk_failure(int event, void *data)
     CacheProcessor::cache_ready &= caches_ready;
     Warning("all volumes for mixt cache are corrupt, mixt cache disabled");
   }
+}
+
+int
+AIO_Callback_handler::handle_disk_failure(int event, void *data)
+{
+  (void) event;
+  /* search for the matching file descriptor */
+  if (!CacheProcessor::cache_ready)
+    return EVENT_DONE;
+  AIOCallback *cb = (AIOCallback *) data;
+  for (int disk_no = 0; disk_no < gndisks; disk_no++) {
+    CacheDisk *d = gdisks[disk_no];
+
+    if (d->fd == cb->aiocb.aio_fildes) {
+      d->num_errors++;
+
+      if (!DISK_BAD(d)) {
+
+        char message[128];
+        snprintf(message, sizeof(message), "Error accessing Disk %s", d->path);
+        Warning(message);
+        IOCORE_SignalManager(REC_SIGNAL_CACHE_WARNING, message);
+      } else if (!DISK_BAD_SIGNALLED(d)) {
+
+        char message[128];
+        snprintf(message, sizeof(message), "too many errors accessing disk %s: declaring disk bad", d->path);
+        Warning(message);
+        IOCORE_SignalManager(REC_SIGNAL_CACHE_ERROR, message);
+        cache_disk_offline(d);
+        cache_check_volumes();
+      }
+      break;
+    }
+  }
   delete cb;
   return EVENT_DONE;
 }
@@ -1823,6 +2132,63 @@ CacheVC::dead(int event, Event *e)
 
 #define STORE_COLLISION 1
 
+// Replace buf with a copy of the document with the data decompressed.
+// This only needs the CacheVC's lock, so handleReadDone calls it before
+// taking the volume lock. The checksum covers the compressed data, so it
+// is verified here.
+static bool
+decompress_doc(Ptr<IOBufferData> &buf)
+{
+  Doc *doc = (Doc *) buf->data();
+  if (doc->data_len() < sizeof(uint32_t))
+    return false;
+  if (cache_config_enable_checksum && doc->checksum != DOC_NO_CHECKSUM) {
+    uint32_t checksum = 0;
+    for (char *b = doc->hdr(); b < (char *) doc + doc->len; b++)
+      checksum += *b;
+    if (checksum != doc->checksum)
+      return false;
+  }
+  uint32_t raw_len = doc->raw_data_len(), len = doc->prefix_len() + raw_len;
+  char *z = doc->data() + sizeof(uint32_t);
+  uint32_t zlen = doc->data_len() - sizeof(uint32_t);
+  Ptr<IOBufferData> data = new_IOBufferData(iobuffer_size_to_index(len, MAX_BUFFER_SIZE_INDEX), MEMALIGNED);
+  char *b = data->data() + doc->prefix_len();
+  switch (doc->compression) {
+    default:
+      return false;
+    case CACHE_COMPRESSION_FASTLZ:
+      if ((int) raw_len != fastlz_decompress(z, zlen, b, raw_len))
+        return false;
+      break;
+#if TS_HAS_LIBZ
+    case CACHE_COMPRESSION_LIBZ: {
+      uLongf l = raw_len;
+      if (Z_OK != uncompress((Bytef *) b, &l, (Bytef *) z, zlen) || l != raw_len)
+        return false;
+      break;
+    }
+#endif
+#if TS_HAS_LZMA
+    case CACHE_COMPRESSION_LIBLZMA: {
+      size_t ipos = 0, opos = 0;
+      uint64_t memlimit = raw_len * 2 + LZMA_BASE_MEMLIMIT;
+      if (LZMA_OK != lzma_stream_buffer_decode(&memlimit, 0, NULL, (uint8_t *) z, &ipos, zlen,
+                                               (uint8_t *) b, &opos, raw_len) || opos != raw_len)
+        return false;
+      break;
+    }
+#endif
+  }
+  memcpy(data->data(), doc, doc->prefix_len());
+  Doc *d = (Doc *) data->data();
+  d->len = len;
+  d->compression = CACHE_COMPRESSION_NONE;
+  d->checksum = DOC_NO_CHECKSUM;
+  buf = data;
+  return true;
+}
+
 #ifdef HTTP_CACHE
 static void unmarshal_helper(Doc *doc, Ptr<IOBufferData> &buf, int &okay) {
   char *tmp = doc->hdr();
@@ -1852,6 +2218,10 @@ CacheVC::handleReadDone(int event, Event *e)
   else
     if (is_io_in_progress())
       return EVENT_CONT;
+  // a document that fails to decompress is still compressed below
+  if (io.ok() && buf && ((Doc *) buf->data())->magic == DOC_MAGIC &&
+      ((Doc *) buf->data())->compression != CACHE_COMPRESSION_NONE)
+    decompress_doc(buf);
   {
     MUTEX_TRY_LOCK(lock, vol->mutex, mutex->thread_holding);
     if (!lock)
@@ -1898,6 +2268,12 @@ CacheVC::handleReadDone(int event, Event *e)
           okay = 0;
         }
       }
+      if (okay && doc->compression != CACHE_COMPRESSION_NONE) {
+        Note("cache: decompression error for [%" PRIu64 " %" PRIu64 "] len %d, compression %d, disk %s, offset %" PRIu64,
+             doc->first_key.b[0], doc->first_key.b[1], doc->len, doc->compression, vol->path, io.aiocb.aio_offset);
+        doc->magic = DOC_CORRUPT;
+        okay = 0;
+      }
       bool http_copy_hdr = false;
 #ifdef HTTP_CACHE
       http_copy_hdr = cache_config_ram_cache_compress && !f.doc_from_ram_cache &&
@@ -1989,6 +2365,9 @@ CacheVC::handleRead(int event, Event *e)
   SET_HANDLER(&CacheVC::handleReadDone);
   ink_assert(ink_aio_read(&io) >= 0);
   CACHE_DEBUG_INCREMENT_DYN_STAT(cache_pread_count_stat);
+  if (f.pread) {
+    CACHE_SUM_DYN_STAT(cache_read_seek_disk_bytes_stat, io.aiocb.aio_nbytes);
+  }
   return EVENT_CONT;
 
 LramHit: {
@@ -2014,7 +2393,7 @@ Cache::lookup(Continuation *cont, CacheKey *key, CacheFragType type, char *hostn
     return ACTION_RESULT_DONE;
   }
 
-  Vol *vol = key_to_vol(key, hostname, host_len);
+  Vol *vol = key_to_read_vol(key, hostname, host_len, this_ethread());
   ProxyMutex *mutex = cont->mutex;
   CacheVC *c = new_CacheVC(cont);
   SET_CONTINUATION_HANDLER(c, &CacheVC::openReadStartHead);
@@ -2145,7 +2524,7 @@ Cache::remove(Continuation *cont, CacheKey *key, CacheFragType type,
 
   CACHE_TRY_LOCK(lock, cont->mutex, this_ethread());
   ink_assert(lock);
-  Vol *vol = key_to_vol(key, hostname, host_len);
+  Vol *vol = key_to_read_vol(key, hostname, host_len, this_ethread());
   // coverity[var_decl]
   Dir result;
   dir_clear(&result);           // initialized here, set result empty so we can recognize missed lock
@@ -2168,6 +2547,79 @@ Cache::remove(Continuation *cont, CacheKey *key, CacheFragType type,
   else
     return &c->_action;
 }
+
+// Tiered storage: delete the fast tier copy of a document. The copy is
+// only ever a single fragment under its first key, so the directory
+// entries are all there is to remove.
+static int
+tier_evict_dir(CacheKey *key, Vol *vol)
+{
+  Dir dir, *last_collision = NULL;
+  int n = 0;
+
+  while (dir_probe(key, vol, &dir, &last_collision)) {
+    if (!dir_head(&dir))
+      continue;
+    dir_delete(key, vol, &dir);
+    last_collision = NULL;
+    n++;
+  }
+  return n;
+}
+
+// Called with the fast tier volume locked: evict the keys left on
+// tier_evict_pending, then tell whether dir, the copy of key found
+// earlier, is still in the directory. A reader checks this once it has
+// read the copy, so it never serves a copy evicted after its probe.
+bool
+tier_copy_valid(CacheKey *key, Vol *vol, Dir *dir)
+{
+  ProxyMutex *mutex = vol->mutex;
+  EvacuationKey *k = (EvacuationKey *) ink_atomiclist_popall(&vol->tier_evict_pending);
+  while (k) {
+    EvacuationKey *next = k->link.next;
+    if (tier_evict_dir(&k->key, vol)) {
+      CACHE_INCREMENT_DYN_STAT(cache_tier_evict_stat);
+    }
+    evacuationKeyAllocator.free(k);
+    k = next;
+  }
+  if (!key)
+    return false;
+  Dir d, *last_collision = NULL;
+  while (dir_probe(key, vol, &d, &last_collision))
+    if (dir_offset(&d) == dir_offset(dir))
+      return true;
+  return false;
+}
+
+// Called with the slow tier volume locked as a writer or remover of
+// c->first_key closes. If the fast tier volume is busy the key is left
+// on its tier_evict_pending list for tier_copy_valid, which runs before
+// the fast tier is probed or a copy read from it is served.
+void
+tier_evict(CacheVC *c)
+{
+  Vol *vol = c->vol->cache->key_to_fast_vol(&c->first_key);
+  if (!vol)
+    return;
+  ProxyMutex *mutex = c->mutex;
+  {
+    CACHE_TRY_LOCK(lock, vol->mutex, mutex->thread_holding);
+    if (lock) {
+      tier_copy_valid(NULL, vol, NULL);
+      if (tier_evict_dir(&c->first_key, vol)) {
+        Debug("cache_tier", "evicted %X from fast tier", c->first_key.word(0));
+        CACHE_INCREMENT_DYN_STAT(cache_tier_evict_stat);
+      }
+      return;
+    }
+  }
+  EvacuationKey *k = evacuationKeyAllocator.alloc();
+  k->key = c->first_key;
+  ink_atomiclist_push(&vol->tier_evict_pending, k);
+}
+
 // CacheVConnection
 
 CacheVConnection::CacheVConnection()
@@ -2259,6 +2711,22 @@ cplist_update()
   }
 }
 
+// Without a volume.config all of a disk is volume 0, for http, split
+// into blocks of at most MAX_VOL_SIZE.
+static void
+create_default_volume(CacheDisk *d)
+{
+  uint64_t free_space = d->free_space * STORE_BLOCK_SIZE;
+  int vols = (free_space / MAX_VOL_SIZE) + 1;
+  for (int p = 0; p < vols; p++) {
+    off_t b = d->free_space / (vols - p);
+    Debug("cache_hosting", "blocks = %d\n", b);
+    DiskVolBlock *dpb = d->create_volume(0, b, CACHE_HTTP_TYPE);
+    ink_assert(dpb && dpb->len == (uint64_t)b);
+  }
+  ink_assert(d->free_space == 0);
+}
+
 int
 cplist_reconfigure()
 {
@@ -2283,17 +2751,8 @@ cplist_reconfigure()
         Note("Clearing Disk: %s", gdisks[i]->path);
         gdisks[i]->delete_all_volumes();
       }
-      if (gdisks[i]->cleared) {
-        uint64_t free_space = gdisks[i]->free_space * STORE_BLOCK_SIZE;
-        int vols = (free_space / MAX_VOL_SIZE) + 1;
-        for (int p = 0; p < vols; p++) {
-          off_t b = gdisks[i]->free_space / (vols - p);
-          Debug("cache_hosting", "blocks = %d\n", b);
-          DiskVolBlock *dpb = gdisks[i]->create_volume(0, b, CACHE_HTTP_TYPE);
-          ink_assert(dpb && dpb->len == (uint64_t)b);
-        }
-        ink_assert(gdisks[i]->free_space == 0);
-      }
+      if (gdisks[i]->cleared)
+        create_default_volume(gdisks[i]);
 
       ink_assert(gdisks[i]->header->num_volumes == 1);
       DiskVol **dp = gdisks[i]->disk_vols;
@@ -2535,6 +2994,263 @@ rebuild_host_table(Cache *cache)
   }
 }
 
+// Adding a disk to the running cache.  The disk is opened, given the
+// default volume layout and its volumes initialized in the background,
+// then the volumes are put in the key to volume tables.  Only the
+// default layout (no volume.config) is supported.
+struct CacheDiskAdd;
+typedef int (CacheDiskAdd::*CacheDiskAddHandler) (int, void *);
+
+struct CacheDiskAdd: public Continuation
+{
+  CacheDisk *disk;
+  CacheVol *cp;
+  Vol **vols;
+  int nvols;
+
+  int diskOpened(int event, void *data);
+  int volsInitialized(int event, void *data);
+  int done();
+
+  CacheDiskAdd(CacheDisk *d)
+    : Continuation(new_ProxyMutex()), disk(d), cp(NULL), vols(NULL), nvols(0)
+  {
+    SET_HANDLER((CacheDiskAddHandler) & CacheDiskAdd::diskOpened);
+  }
+  ~CacheDiskAdd()
+  {
+    if (vols)
+      xfree(vols);
+  }
+};
+
+int
+CacheDiskAdd::diskOpened(int event, void *data)
+{
+  NOWARN_UNUSED(event);
+  NOWARN_UNUSED(data);
+  CacheDisk *d = disk;
+  int i;
+
+  if (DISK_BAD(d)) {
+    Warning("unable to open cache disk %s", d->path);
+    return done();
+  }
+  for (cp = cp_list.head; cp; cp = cp->link.next) {
+    if (cp->vol_number == 0)
+      break;
+  }
+  if (!cp)
+    return done();
+
+  if (d->header->num_volumes != 1 || d->disk_vols[0]->vol_number != 0) {
+    Note("Clearing Disk: %s", d->path);
+    d->delete_all_volumes();
+  }
+  if (d->cleared)
+    create_default_volume(d);
+  d->sync();
+
+  // grow the disk arrays, readers may still hold the old ones
+  int n = gndisks;
+  CacheDisk **disks = (CacheDisk **) xmalloc((n + 1) * sizeof(CacheDisk *));
+  memcpy(disks, gdisks, n * sizeof(CacheDisk *));
+  disks[n] = d;
+  for (CacheVol *c = cp_list.head; c; c = c->link.next) {
+    DiskVol **dv = (DiskVol **) xmalloc((n + 1) * sizeof(DiskVol *));
+    memcpy(dv, c->disk_vols, n * sizeof(DiskVol *));
+    dv[n] = (c == cp) ? d->disk_vols[0] : NULL;
+    new_Freer(c->disk_vols, CACHE_MEM_FREE_TIMEOUT);
+    c->disk_vols = dv;
+  }
+  new_Freer(gdisks, CACHE_MEM_FREE_TIMEOUT);
+  gdisks = disks;
+  gndisks = n + 1;
+
+  DiskVol *dp = d->disk_vols[0];
+  nvols = dp->num_volblocks;
+  Vol **v = (Vol **) xmalloc((gnvol + nvols) * sizeof(Vol *));
+  memset(v, 0, (gnvol + nvols) * sizeof(Vol *));
+  memcpy(v, gvol, gnvol * sizeof(Vol *));
+  new_Freer(gvol, CACHE_MEM_FREE_TIMEOUT);
+  gvol = v;
+
+  vols = (Vol **) xmalloc(nvols * sizeof(Vol *));
+  ink_atomic_increment(&theCache->total_nvol, nvols);
+  DiskVolBlockQueue *q = dp->dpb_queue.head;
+  for (i = 0; q; q = q->link.next, i++) {
+    Vol *vol = vols[i] = NEW(new Vol());
+    vol->disk = d;
+    vol->fd = d->fd;
+    vol->cache = theCache;
+    vol->cache_vol = cp;
+    vol->ram_cache = new_vol_ram_cache();
+    theCache->cache_size += q->b->len;
+    vol->init(d->path, q->b->len, q->b->offset, d->cleared || q->new_block);
+  }
+  ink_assert(i == nvols);
+
+  SET_HANDLER((CacheDiskAddHandler) & CacheDiskAdd::volsInitialized);
+  eventProcessor.schedule_in(this, HRTIME_MSECONDS(5), ET_CALL);
+  return EVENT_DONE;
+}
+
+int
+CacheDiskAdd::volsInitialized(int event, void *data)
+{
+  NOWARN_UNUSED(event);
+  NOWARN_UNUSED(data);
+  int i;
+
+  if (theCache->total_initialized_vol < theCache->total_nvol) {
+    eventProcessor.schedule_in(this, HRTIME_MSECONDS(5), ET_CALL);
+    return EVENT_CONT;
+  }
+  for (i = 0; i < nvols; i++) {
+    if (vols[i]->fd < 0) {
+      Warning("unable to initialize cache disk %s", disk->path);
+      SET_DISK_BAD(disk);
+      return done();
+    }
+  }
+
+  for (i = 0; i < nvols; i++) {
+    Vol *vol = vols[i];
+#ifdef HTTP_CACHE
+    vol_url_hash_method_set(vol, url_hash_method);
+#endif
+    // the RAM caches of the other volumes keep their size until restart
+    int64_t ram_cache_bytes;
+    if (cache_config_ram_cache_size == AUTO_SIZE_RAM_CACHE)
+      ram_cache_bytes = vol_dirlen(vol);
+    else
+      ram_cache_bytes = (int64_t) (((double) (int64_t) (vol->len >> STORE_BLOCK_SHIFT) / theCache->cache_size) *
+                                   cache_config_ram_cache_size);
+    vol->ram_cache->init(ram_cache_bytes, vol);
+
+    int64_t vol_total_cache_bytes = vol->len - vol_dirlen(vol);
+    int64_t vol_total_direntries = vol->buckets * vol->segments * DIR_DEPTH;
+    int64_t vol_used_direntries = dir_entries_used(vol);
+    RecIncrGlobalRawStat(cp->vol_rsb, cache_ram_cache_bytes_total_stat, ram_cache_bytes);
+    RecIncrGlobalRawStat(cp->vol_rsb, cache_bytes_total_stat, vol_total_cache_bytes);
+    RecIncrGlobalRawStat(cp->vol_rsb, cache_direntries_total_stat, vol_total_direntries);
+    RecIncrGlobalRawStat(cp->vol_rsb, cache_direntries_used_stat, vol_used_direntries);
+    RecIncrGlobalRawStat(cache_rsb, cache_ram_cache_bytes_total_stat, ram_cache_bytes);
+    RecIncrGlobalRawStat(cache_rsb, cache_bytes_total_stat, vol_total_cache_bytes);
+    RecIncrGlobalRawStat(cache_rsb, cache_direntries_total_stat, vol_total_direntries);
+    RecIncrGlobalRawStat(cache_rsb, cache_direntries_used_stat, vol_used_direntries);
+  }
+
+  Vol **v = (Vol **) xmalloc((cp->num_vols + nvols) * sizeof(Vol *));
+  memcpy(v, cp->vols, cp->num_vols * sizeof(Vol *));
+  memcpy(v + cp->num_vols, vols, nvols * sizeof(Vol *));
+  new_Freer(cp->vols, CACHE_MEM_FREE_TIMEOUT);
+  cp->vols = v;
+  cp->size += disk->disk_vols[0]->size;
+  cp->num_vols += nvols;
+
+  // a new host table picks up the volumes; the existing volumes keep
+  // nearly all of their keys (see build_vol_hash_table)
+  eventProcessor.schedule_imm(NEW(new CacheHostTableConfig(&theCache->hosttable)));
+  Note("cache disk %s online, %d volumes", disk->path, nvols);
+  return done();
+}
+
+// A disk which failed is not freed, its aio may still be completing.
+int
+CacheDiskAdd::done()
+{
+  cache_disk_adding = 0;
+  mutex.clear();
+  delete this;
+  return EVENT_DONE;
+}
+
+int
+CacheProcessor::add_disk(const char *path, int64_t size, int tier)
+{
+  if (!CacheProcessor::cache_ready || !theCache || theCache->ready != CACHE_INITIALIZED) {
+    Warning("cache disk %s not added: the cache is not running", path);
+    return -1;
+  }
+  if (config_volumes.num_volumes != 0) {
+    Warning("cache disk %s not added: only supported without volume.config volumes", path);
+    return -1;
+  }
+  if (!ink_atomic_cas(&cache_disk_adding, 0, 1)) {
+    Warning("cache disk %s not added: another disk is being added", path);
+    return -1;
+  }
+
+  bool clear = false;
+  for (int i = 0; i < gndisks; i++) {
+    int len = strlen(path);
+    if (strncmp(gdisks[i]->path, path, len) || (gdisks[i]->path[len] && strcmp(gdisks[i]->path + len, "/cache.db")))
+      continue;
+    if (!DISK_BAD(gdisks[i])) {
+      Warning("cache disk %s not added: already in use", path);
+      cache_disk_adding = 0;
+      return -1;
+    }
+    if (gdisks[i]->quiescing) {
+      Warning("cache disk %s not added: its old volumes are still writing to it", path);
+      cache_disk_adding = 0;
+      return -1;
+    }
+    // the volumes of the offline disk may still be read
+    clear = true;
+  }
+
+  const char *err;
+  char name[PATH_MAX];
+  Span *sd = NEW(new Span);
+  ink_strlcpy(name, path, sizeof(name));
+  if (!(err = sd->init(name, size)) && sd->blocks * STORE_BLOCK_SIZE < MIN_VOL_SIZE)
+    err = "smaller than a volume block";
+  if (err) {
+    Warning("cache disk %s not added: %s", path, err);
+    delete sd;
+    cache_disk_adding = 0;
+    return -1;
+  }
+  sd->tier = tier;
+
+  int fd = open_span(sd, name, sizeof(name));
+  if (fd < 0) {
+    delete sd;
+    cache_disk_adding = 0;
+    return -1;
+  }
+  CacheDisk *d = NEW(new CacheDisk());
+  d->open_cont = NEW(new CacheDiskAdd(d));
+  Note("adding cache disk %s, %" PRId64 " blocks", name, sd->blocks);
+  open_disk(d, sd, name, fd, clear);
+  delete sd;
+  return 0;
+}
+
+int
+CacheProcessor::remove_disk(const char *path)
+{
+  int len = strlen(path);
+
+  for (int i = 0; i < gndisks; i++) {
+    CacheDisk *d = gdisks[i];
+    if (strncmp(d->path, path, len) || (d->path[len] && strcmp(d->path + len, "/cache.db")))
+      continue;
+    if (DISK_BAD(d))
+      continue;
+    // signalled, so that errors from reads in progress are not reported
+    d->num_errors = cache_config_max_disk_errors + 1;
+    Note("cache disk %s offline", d->path);
+    cache_disk_offline(d);
+    cache_check_volumes();
+    return 0;
+  }
+  Warning("cache disk %s not removed: not in use", path);
+  return -1;
+}
+
 // if generic_host_rec.vols == NULL, what do we do???
 Vol *
 Cache::key_to_vol(CacheKey *key, char *hostname, int host_len)
@@ -2569,6 +3285,115 @@ Cache::key_to_vol(CacheKey *key, char *hostname, int host_len)
     return host_rec->vols[0];
 }
 
+// The fast tier volume for a key, NULL unless storage is tiered. The
+// fast tier is shared by all hosting records: promotion and eviction
+// only know the key.
+Vol *
+Cache::key_to_fast_vol(CacheKey *key)
+{
+  unsigned short *hash_table = hosttable->gen_host_rec.fast_vol_hash_table;
+
+  if (!hash_table)
+    return NULL;
+  uint32_t h = (key->word(2) >> DIR_TAG_WIDTH) % VOL_HASH_TABLE_SIZE;
+  return hosttable->gen_host_rec.vols[hash_table[h]];
+}
+
+// Write balancing: the second volume choice for a key, from bits of the
+// key that neither key_to_vol() nor the directory use. NULL if balancing
+// is off or both choices are the same volume.
+Vol *
+Cache::key_to_alt_vol(CacheKey *key, char *hostname, int host_len)
+{
+  if (!cache_config_write_balance)
+    return NULL;
+
+  CacheHostRecord *host_rec = &hosttable->gen_host_rec;
+
+  if (hosttable->m_numEntries > 0 && host_len) {
+    CacheHostResult res;
+    hosttable->Match(hostname, host_len, &res);
+    if (res.record && res.record->vol_hash_table)
+      host_rec = res.record;
+  }
+  unsigned short *hash_table = host_rec->vol_hash_table;
+  if (!hash_table)
+    return NULL;
+  uint32_t h = (key->word(2) >> DIR_TAG_WIDTH) % VOL_HASH_TABLE_SIZE;
+  uint32_t h2 = (key->word(3) >> DIR_TAG_WIDTH) % VOL_HASH_TABLE_SIZE;
+  if (hash_table[h] == hash_table[h2])
+    return NULL;
+  return host_rec->vols[hash_table[h2]];
+}
+
+// A volume is busy while more requests wait for its disk than the disk
+// should queue, its aggregation buffer is backing up, or its writes take
+// longer than the latency limit: the current one, or recent ones on
+// average.
+static bool
+vol_busy(Vol *vol)
+{
+  ink_hrtime now = ink_get_hrtime_internal();
+  ink_hrtime limit = HRTIME_MSECONDS(cache_config_write_balance_latency);
+  AIO_Reqs *req = vol->io.aio_req;
+
+  if (req && req->requests_queued > cache_config_write_balance_queue)
+    return true;
+  if (vol->agg_todo_size > cache_config_agg_write_backlog / 2)
+    return true;
+  if (vol->is_io_in_progress() && now - vol->io.queue_time > limit)
+    return true;
+  return vol->agg_write_latency > limit && now - vol->agg_write_time < HRTIME_SECONDS(10);
+}
+
+// 1 if vol has a document or a writer for key, 0 if not, -1 if vol is locked.
+static int
+vol_has_key(Vol *vol, CacheKey *key, EThread *t)
+{
+  Dir dir, *last_collision = NULL;
+  CACHE_TRY_LOCK(lock, vol->mutex, t);
+
+  if (!lock)
+    return -1;
+  return vol->open_read(key) || dir_probe(key, vol, &dir, &last_collision);
+}
+
+// The volume to look for key in: the first choice, unless only the
+// alternate volume has it.
+Vol *
+Cache::key_to_read_vol(CacheKey *key, char *hostname, int host_len, EThread *t)
+{
+  Vol *vol = key_to_vol(key, hostname, host_len);
+  Vol *alt = key_to_alt_vol(key, hostname, host_len);
+
+  if (alt && !vol_has_key(vol, key, t) && vol_has_key(alt, key, t) > 0)
+    return alt;
+  return vol;
+}
+
+// The volume to write key to. A document already in one of its two
+// volumes is rewritten there, so that updates and readers find it; a new
+// one goes to the alternate volume if the first choice is busy and the
+// alternate is not. When in doubt, the first choice.
+Vol *
+Cache::key_to_write_vol(CacheKey *key, char *hostname, int host_len, ProxyMutex *mutex)
+{
+  Vol *vol = key_to_vol(key, hostname, host_len);
+  Vol *alt = key_to_alt_vol(key, hostname, host_len);
+
+  if (!alt || vol_has_key(vol, key, mutex->thread_holding))
+    return vol;
+  int alt_has = vol_has_key(alt, key, mutex->thread_holding);
+  if (alt_has > 0)
+    return alt;
+  if (alt_has < 0 || !vol_busy(vol) || vol_busy(alt))
+    return vol;
+  Debug("cache_balance", "write to %s instead of busy %s", alt->hash_id, vol->hash_id);
+  vol = alt;
+  CACHE_INCREMENT_DYN_STAT(cache_write_balance_stat);
+  return vol;
+}
+
 static void reg_int(const char *str, int stat, RecRawStatBlock *rsb, const char *prefix, RecRawStatSyncCb sync_cb=RecRawStatSyncSum) {
   char stat_str[256];
   snprintf(stat_str, sizeof(stat_str), "%s.%s", prefix, str);
@@ -2623,12 +3448,29 @@ register_cache_stats(RecRawStatBlock *rsb, const char *prefix)
   REG_INT("frags_per_doc.3+", cache_three_plus_plus_fragment_document_count_stat);
   REG_INT("read_busy.success", cache_read_busy_success_stat);
   REG_INT("read_busy.failure", cache_read_busy_failure_stat);
+  REG_INT("read.seek.bytes", cache_read_seek_bytes_stat);
+  REG_INT("read.seek.disk_bytes", cache_read_seek_disk_bytes_stat);
   REG_INT("write_bytes_stat", cache_write_bytes_stat);
   REG_INT("vector_marshals", cache_hdr_vector_marshal_stat);
   REG_INT("hdr_marshals", cache_hdr_marshal_stat);
   REG_INT("hdr_marshal_bytes", cache_hdr_marshal_bytes_stat);
   REG_INT("gc_bytes_evacuated", cache_gc_bytes_evacuated_stat);
   REG_INT("gc_frags_evacuated", cache_gc_frags_evacuated_stat);
+  REG_INT("tier.fast.read.success", cache_tier_fast_read_success_stat);
+  REG_INT("tier.slow.read.success", cache_tier_slow_read_success_stat);
+  REG_INT("tier.fast.read.fallback", cache_tier_fast_read_fallback_stat);
+  REG_INT("tier.promote.active", cache_tier_promote_active_stat);
+  REG_INT("tier.promote.success", cache_tier_promote_success_stat);
+  REG_INT("tier.promote.failure", cache_tier_promote_failure_stat);
+  REG_INT("tier.promote.bytes", cache_tier_promote_bytes_stat);
+  REG_INT("tier.evict", cache_tier_evict_stat);
+  REG_INT("admission.skipped", cache_admission_skipped_stat);
+  REG_INT("compress.bytes_in", cache_compress_bytes_in_stat);
+  REG_INT("compress.bytes_out", cache_compress_bytes_out_stat);
+  REG_INT("dedup.hits", cache_dedup_hit_stat);
+  REG_INT("dedup.bodies_written", cache_dedup_body_write_stat);
+  REG_INT("dedup.bytes_saved", cache_dedup_bytes_saved_stat);
+  REG_INT("write_balance.redirected", cache_write_balance_stat);
 }
 
 
@@ -2709,11 +3551,29 @@ ink_cache_init(ModuleVersion v)
   if (cache_config_target_fragment_size == 0)
     cache_config_target_fragment_size = DEFAULT_TARGET_FRAGMENT_SIZE;
 
-#ifdef HTTP_CACHE
-  extern int url_hash_method;
+  IOCORE_EstablishStaticConfigInt32(cache_config_tier_promote_hits, "proxy.config.cache.tiering.promote_hits");
+  Debug("cache_init", "proxy.config.cache.tiering.promote_hits = %d", cache_config_tier_promote_hits);
+  IOCORE_EstablishStaticConfigInt32(cache_config_admission_hits, "proxy.config.cache.admission.hits");
+  Debug("cache_init", "proxy.config.cache.admission.hits = %d", cache_config_admission_hits);
+  IOCORE_EstablishStaticConfigInt32(cache_config_admission_window, "proxy.config.cache.admission.window");
+  Debug("cache_init", "proxy.config.cache.admission.window = %d", cache_config_admission_window);
+  IOCORE_EstablishStaticConfigInt32(cache_config_compress, "proxy.config.cache.compress");
+  Debug("cache_init", "proxy.config.cache.compress = %d", cache_config_compress);
+  IOCORE_EstablishStaticConfigInt32(cache_config_dedup, "proxy.config.cache.dedup.enabled");
+  Debug("cache_init", "proxy.config.cache.dedup.enabled = %d", cache_config_dedup);
+  IOCORE_EstablishStaticConfigInt32(cache_config_dedup_min_size, "proxy.config.cache.dedup.min_size");
+  Debug("cache_init", "proxy.config.cache.dedup.min_size = %d", cache_config_dedup_min_size);
+  IOCORE_EstablishStaticConfigInt32(cache_config_write_balance, "proxy.config.cache.write_balance.enabled");
+  Debug("cache_init", "proxy.config.cache.write_balance.enabled = %d", cache_config_write_balance);
+  IOCORE_EstablishStaticConfigInt32(cache_config_write_balance_latency, "proxy.config.cache.write_balance.latency");
+  Debug("cache_init", "proxy.config.cache.write_balance.latency = %d", cache_config_write_balance_latency);
+  IOCORE_EstablishStaticConfigInt32(cache_config_write_balance_queue, "proxy.config.cache.write_balance.queue");
+  Debug("cache_init", "proxy.config.cache.write_balance.queue = %d", cache_config_write_balance_queue);
 
+#ifdef HTTP_CACHE
   //  # 0 - MD5 hash
   //  # 1 - MMH hash
+  //  # 2 - Murmur3 hash
   IOCORE_EstablishStaticConfigInt32(url_hash_method, "proxy.config.cache.url_hash_method");
   Debug("cache_init", "proxy.config.cache.url_hash_method = %d", url_hash_method);
 #endif
@@ -2775,7 +3635,8 @@ CacheProcessor::open_read(Continuation *cont, URL *url, CacheHTTPHdr *request,
 //----------------------------------------------------------------------------
 Action *
 CacheProcessor::open_write(Continuation *cont, int expected_size, URL *url,
-                           CacheHTTPHdr *request, CacheHTTPInfo *old_info, time_t pin_in_cache, CacheFragType type)
+                           CacheHTTPHdr *request, CacheHTTPInfo *old_info, time_t pin_in_cache, CacheFragType type,
+                           int admission_hits)
 {
 #ifdef CLUSTER_CACHE
   if (cache_clustering_enabled > 0) {
@@ -2794,7 +3655,7 @@ CacheProcessor::open_write(Continuation *cont, int expected_size, URL *url,
     }
   }
 #endif
-  return caches[type]->open_write(cont, url, request, old_info, pin_in_cache, type);
+  return caches[type]->open_write(cont, url, request, old_info, pin_in_cache, type, admission_hits);
 }
 
 //----------------------------------------------------------------------------
@@ -143,11 +143,44 @@ OpenDir::close_write(CacheVC *cont)
     signal_readers(0, 0);
     cont->od->vector.clear();
     THREAD_FREE(cont->od, openDirEntryAllocator, cont->mutex->thread_holding);
-  }
+  } else
+    wake_readers(cont->od, cont->mutex->thread_holding);
   cont->od = NULL;
   return 0;
 }
 
+// Hand the readers parked on od to signal_readers. They are called back
+// from the OpenDir continuation rather than from the writer's stack.
+void
+OpenDir::wake_readers(OpenDirEntry *od, EThread *t)
+{
+  ink_debug_assert(mutex->thread_holding == this_ethread());
+  if (!od->readers.head)
+    return;
+  delayed_readers.append(od->readers);
+  od->readers.clear();
+  t->schedule_imm(this);
+}
+
+// A parked reader that woke up on its own timeout takes itself off
+// whichever list it is still on.
+void
+OpenDir::cancel_wait(CacheVC *c)
+{
+  ink_debug_assert(mutex->thread_holding == this_ethread());
+  OpenDirEntry *od = open_read(&c->first_key);
+  c->f.open_read_timeout = 0;
+  if (od) {
+    for (CacheVC *r = od->readers.head; r; r = (CacheVC *) r->opendir_link.next) {
+      if (r == c) {
+        od->readers.remove(c);
+        return;
+      }
+    }
+  }
+  delayed_readers.remove(c);
+}
+
 OpenDirEntry *
 OpenDir::open_read(INK_MD5 *key)
 {
@@ -1015,8 +1048,11 @@ Lrestart:
     d->hit_evacuate_window = (d->data_blocks * cache_config_hit_evacuate_percent) / 100;
 #endif
 
-    if (DISK_BAD(d->disk))
+    if (DISK_BAD(d->disk)) {
+      // any write of a sync under way has completed, give up on the rest
+      d->dir_sync_in_progress = 0;
       goto Ldone;
+    }
 
     int headerlen = ROUND_TO_STORE_BLOCK(sizeof(VolHeaderFooter));
     size_t dirlen = vol_dirlen(d);
@@ -160,7 +160,11 @@ CacheDisk::openDone(int event, void *data)
 {
   NOWARN_UNUSED(data);
   NOWARN_UNUSED(event);
-  if (cacheProcessor.start_done) {
+  if (open_cont) {
+    SET_HANDLER(&CacheDisk::syncDone);
+    eventProcessor.schedule_imm(open_cont, ET_CALL);
+    return EVENT_DONE;
+  } else if (cacheProcessor.start_done) {
     SET_HANDLER(&CacheDisk::syncDone);
     cacheProcessor.diskInitialized();
     return EVENT_DONE;
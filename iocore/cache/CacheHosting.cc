@@ -880,6 +880,69 @@ ConfigVolumes::BuildListFromString(char *config_file_path, char *file_buf)
 
 
 
+/* Test that adding or losing a disk moves few keys between volumes */
+static int
+vol_hash_moved(unsigned short *a, unsigned short *b)
+{
+  int moved = 0;
+  for (int i = 0; i < VOL_HASH_TABLE_SIZE; i++)
+    if (a[i] != b[i])
+      moved++;
+  return moved;
+}
+
+REGRESSION_TEST(Cache_vol_hash) (RegressionTest * t, int atype, int *status) {
+  NOWARN_UNUSED(atype);
+  const int n = 8;
+  CacheDisk disks[n + 1];
+  CacheHostRecord rec;
+  unsigned short *before = (unsigned short *) xmalloc(VOL_HASH_TABLE_SIZE * sizeof(unsigned short));
+  char name[64];
+  int i, moved, ideal;
+
+  *status = REGRESSION_TEST_PASSED;
+  rec.vols = (Vol **) xmalloc((n + 1) * sizeof(Vol *));
+  for (i = 0; i <= n; i++) {
+    Vol *vol = rec.vols[i] = NEW(new Vol());
+    vol->disk = &disks[i];
+    vol->len = (off_t) 10 << 30;
+    snprintf(name, sizeof(name), "/dev/sd%c 16384:2621440", 'a' + i);
+    vol->hash_id_md5.encodeBuffer(name, strlen(name));
+  }
+  rec.num_vols = n;
+  build_vol_hash_table(&rec);
+  memcpy(before, rec.vol_hash_table, VOL_HASH_TABLE_SIZE * sizeof(unsigned short));
+
+  // the new disk should only take its share
+  rec.num_vols = n + 1;
+  build_vol_hash_table(&rec);
+  moved = vol_hash_moved(before, rec.vol_hash_table);
+  ideal = VOL_HASH_TABLE_SIZE / (n + 1);
+  rprintf(t, "add disk: %d of %d keys moved, %d needed\n", moved, VOL_HASH_TABLE_SIZE, ideal);
+  if (moved > ideal + ideal / 4)
+    *status = REGRESSION_TEST_FAILED;
+  memcpy(before, rec.vol_hash_table, VOL_HASH_TABLE_SIZE * sizeof(unsigned short));
+
+  // and only the keys of a lost disk should move
+  CacheDisk *lost = &disks[3];
+  SET_DISK_BAD(lost);
+  build_vol_hash_table(&rec);
+  moved = vol_hash_moved(before, rec.vol_hash_table);
+  rprintf(t, "lose disk: %d of %d keys moved, %d needed\n", moved, VOL_HASH_TABLE_SIZE, ideal);
+  if (moved > ideal + ideal / 4)
+    *status = REGRESSION_TEST_FAILED;
+  for (i = 0; i < VOL_HASH_TABLE_SIZE; i++) {
+    if (rec.vol_hash_table[i] == 3)
+      *status = REGRESSION_TEST_FAILED;
+  }
+
+  for (i = 0; i <= n; i++) {
+    rec.vols[i]->disk = NULL;
+    delete rec.vols[i];
+  }
+  xfree(before);
+}
+
 /* Test the cache volumeing with different configurations */
 #define MEGS_128 (128 * 1024 * 1024)
 #define ROUND_TO_VOL_SIZE(_x) (((_x) + (MEGS_128 - 1)) &~ (MEGS_128 - 1))
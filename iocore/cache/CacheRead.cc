@@ -24,11 +24,29 @@
 #include "P_Cache.h"
 
 #ifdef HTTP_CACHE
-#include "HttpCacheSM.h"      //Added to get the scope of HttpCacheSM object.
 #endif
 
 #define READ_WHILE_WRITER 1
 
+// Tiered storage: a read goes to the fast tier when its directory has an
+// entry for the key. openReadStartHead falls back to the slow tier if
+// the entry turns out not to be the document or has been evicted.
+static inline Vol *
+fast_tier_probe(Cache *cache, CacheKey *key, EThread *t)
+{
+  Vol *vol = cache->key_to_fast_vol(key);
+  if (!vol)
+    return NULL;
+  Dir result, *last_collision = NULL;
+  CACHE_TRY_LOCK(lock, vol->mutex, t);
+  if (!lock)
+    return NULL;
+  tier_copy_valid(NULL, vol, NULL);
+  if (dir_probe(key, vol, &result, &last_collision))
+    return vol;
+  return NULL;
+}
+
 Action *
 Cache::open_read(Continuation * cont, CacheKey * key, CacheFragType type, char *hostname, int host_len)
 {
@@ -38,11 +56,17 @@ Cache::open_read(Continuation * cont, CacheKey * key, CacheFragType type, char *
   }
   ink_assert(caches[type] == this);
 
-  Vol *vol = key_to_vol(key, hostname, host_len);
+  Vol *vol = key_to_read_vol(key, hostname, host_len, this_ethread());
+  Vol *slow_vol = NULL;
   Dir result, *last_collision = NULL;
   ProxyMutex *mutex = cont->mutex;
   OpenDirEntry *od = NULL;
   CacheVC *c = NULL;
+  if (Vol *fast_vol = fast_tier_probe(this, key, mutex->thread_holding)) {
+    slow_vol = vol;
+    vol = fast_vol;
+  }
+Lprobe:
   {
     CACHE_TRY_LOCK(lock, vol->mutex, mutex->thread_holding);
     if (!lock || (od = vol->open_read(key)) || dir_probe(key, vol, &result, &last_collision)) {
@@ -53,6 +77,7 @@ Cache::open_read(Continuation * cont, CacheKey * key, CacheFragType type, char *
       CACHE_INCREMENT_DYN_STAT(c->base_stat + CACHE_STAT_ACTIVE);
       c->first_key = c->key = c->earliest_key = *key;
       c->vol = vol;
+      c->slow_vol = slow_vol;
       c->frag_type = type;
       c->od = od;
     }
@@ -73,6 +98,13 @@ Cache::open_read(Continuation * cont, CacheKey * key, CacheFragType type, char *
     }
   }
 Lmiss:
+  if (slow_vol) {
+    // the fast tier entry has gone in the meantime
+    vol = slow_vol;
+    slow_vol = NULL;
+    last_collision = NULL;
+    goto Lprobe;
+  }
   CACHE_INCREMENT_DYN_STAT(cache_read_failure_stat);
   cont->handleEvent(CACHE_EVENT_OPEN_READ_FAILED, (void *) -ECACHE_NO_DOC);
   return ACTION_RESULT_DONE;
@@ -99,18 +131,24 @@ Cache::open_read(Continuation * cont, CacheKey * key, CacheHTTPHdr * request,
   }
   ink_assert(caches[type] == this);
 
-  Vol *vol = key_to_vol(key, hostname, host_len);
+  Vol *vol = key_to_read_vol(key, hostname, host_len, this_ethread());
+  Vol *slow_vol = NULL;
   Dir result, *last_collision = NULL;
   ProxyMutex *mutex = cont->mutex;
   OpenDirEntry *od = NULL;
   CacheVC *c = NULL;
-
+  if (Vol *fast_vol = fast_tier_probe(this, key, mutex->thread_holding)) {
+    slow_vol = vol;
+    vol = fast_vol;
+  }
+Lprobe:
   {
     CACHE_TRY_LOCK(lock, vol->mutex, mutex->thread_holding);
     if (!lock || (od = vol->open_read(key)) || dir_probe(key, vol, &result, &last_collision)) {
       c = new_CacheVC(cont);
       c->first_key = c->key = c->earliest_key = *key;
       c->vol = vol;
+      c->slow_vol = slow_vol;
       c->vio.op = VIO::READ;
       c->base_stat = cache_read_active_stat;
       CACHE_INCREMENT_DYN_STAT(c->base_stat + CACHE_STAT_ACTIVE);
@@ -139,12 +177,17 @@ Cache::open_read(Continuation * cont, CacheKey * key, CacheHTTPHdr * request,
     }
   }
 Lmiss:
+  if (slow_vol) {
+    // the fast tier entry has gone in the meantime
+    vol = slow_vol;
+    slow_vol = NULL;
+    last_collision = NULL;
+    goto Lprobe;
+  }
   CACHE_INCREMENT_DYN_STAT(cache_read_failure_stat);
   cont->handleEvent(CACHE_EVENT_OPEN_READ_FAILED, (void *) -ECACHE_NO_DOC);
   return ACTION_RESULT_DONE;
 Lwriter:
-  // this is a horrible violation of the interface and should be fixed (FIXME)
-  ((HttpCacheSM *)cont)->set_readwhilewrite_inprogress(true);
   SET_CONTINUATION_HANDLER(c, &CacheVC::openReadFromWriter);
   if (c->handleEvent(EVENT_IMMEDIATE, 0) == EVENT_DONE)
     return ACTION_RESULT_DONE;
@@ -211,9 +254,16 @@ CacheVC::openReadChooseWriter(int event, Event * e)
       vector.insert(write_vector->get(c));
     // check if all the writers who came before this reader have
     // set the http_info.
+    bool update_pending = false;
     for (w = (CacheVC *) od->writers.head; w; w = (CacheVC *) w->opendir_link.next) {
       if (w->start_time > start_time || w->closed < 0)
         continue;
+      // an update writer still waiting on the origin server leaves the
+      // alternate on disk untouched, read that rather than the writer
+      if (!w->closed && w->f.update && !w->alternate.valid()) {
+        update_pending = true;
+        continue;
+      }
       if (!w->closed && !cache_config_read_while_writer) {
         MUTEX_RELEASE(lock);
         return openReadFromWriterFailure(CACHE_EVENT_OPEN_READ_FAILED, (Event *) - err);
@@ -222,9 +272,11 @@ CacheVC::openReadChooseWriter(int event, Event * e)
         continue;
 
       if (!w->closed && !w->alternate.valid()) {
+        // park until the writer has its headers on disk
+        OpenDirEntry *wait_od = od;
         od = NULL;
         vector.clear(false);
-        VC_SCHED_LOCK_RETRY();
+        return wait_od->wait(this, WRITER_WAIT_TIMEOUT_MSEC);
       }
       // construct the vector from the writers.
       int alt_ndx = CACHE_ALT_INDEX_DEFAULT;
@@ -244,7 +296,7 @@ CacheVC::openReadChooseWriter(int event, Event * e)
     }
 
     if (!vector.count()) {
-      if (od->reading_vec) {
+      if (od->reading_vec || update_pending) {
         MUTEX_RELEASE(lock);
        // the writer(s) are reading the vector, so there is probably
         // an old vector. Since this reader came before any of the
@@ -260,9 +312,10 @@ CacheVC::openReadChooseWriter(int event, Event * e)
 #ifdef FIXME_NONMODULAR
     if (cache_config_select_alternate) {
       alternate_index = HttpTransactCache::SelectFromAlternates(&vector, &request, params);
-      if (alternate_index < 0)
+      if (alternate_index < 0) {
         MUTEX_RELEASE(lock);
         return openReadFromWriterFailure(CACHE_EVENT_OPEN_READ_FAILED, (Event *) - ECACHE_ALT_MISS);
+      }
     } else
 #endif
       alternate_index = 0;
@@ -312,13 +365,20 @@ CacheVC::openReadFromWriter(int event, Event * e)
 #ifndef READ_WHILE_WRITER
   return openReadFromWriterFailure(CACHE_EVENT_OPEN_READ_FAILED, (Event *) -err);
 #else
-  if (_action.cancelled) {
+  if (_action.cancelled && !f.open_read_timeout) {
     od = NULL; // only open for read so no need to close
     return free_CacheVC(this);
   }
   CACHE_TRY_LOCK(lock, vol->mutex, mutex->thread_holding);
   if (!lock)
     VC_SCHED_LOCK_RETRY();
+  if (f.open_read_timeout)
+    vol->open_dir.cancel_wait(this);
+  if (_action.cancelled) {
+    MUTEX_RELEASE(lock);
+    od = NULL;
+    return free_CacheVC(this);
+  }
   od = vol->open_read(&first_key); // recheck in case the lock failed
   if (!od) {
     MUTEX_RELEASE(lock);
@@ -361,9 +421,14 @@ CacheVC::openReadFromWriter(int event, Event * e)
     if (!cache_config_read_while_writer || frag_type != CACHE_FRAG_TYPE_HTTP)
       return openReadFromWriterFailure(CACHE_EVENT_OPEN_READ_FAILED, (Event *) - err);
     DDebug("cache_read_agg",
-          "%x: key: %X writer: closed:%d, fragment:%d, retry: %d",
-          this, first_key.word(1), write_vc->closed, write_vc->fragment, writer_lock_retry);
-    VC_SCHED_WRITER_RETRY();
+          "%x: key: %X writer: closed:%d, fragment:%d, waiting",
+          this, first_key.word(1), write_vc->closed, write_vc->fragment);
+    // the writer wakes us when its first fragment is written or it closes
+    CACHE_TRY_LOCK(wait_lock, vol->mutex, mutex->thread_holding);
+    OpenDirEntry *wait_od = wait_lock ? vol->open_read(&first_key) : NULL;
+    if (!wait_od)
+      VC_SCHED_WRITER_RETRY();
+    return wait_od->wait(this, WRITER_WAIT_TIMEOUT_MSEC);
   }
 
   CACHE_TRY_LOCK(writer_lock, write_vc->mutex, mutex->thread_holding);
@@ -523,6 +588,8 @@ CacheVC::openReadClose(int event, Event * e)
   CACHE_TRY_LOCK(lock, vol->mutex, mutex->thread_holding);
   if (!lock)
     VC_SCHED_LOCK_RETRY();
+  if (f.open_read_timeout)
+    vol->open_dir.cancel_wait(this);
 #ifdef HIT_EVACUATE
   if (f.hit_evacuate && dir_valid(vol, &first_dir) && closed > 0) {
     if (f.single_fragment)
@@ -624,21 +691,27 @@ CacheVC::openReadMain(int event, Event * e)
   int64_t bytes = doc->len - doc_pos;
   IOBufferBlock *b = NULL;
   if (seek_to) { // handle do_io_pread
-    if (seek_to >= (int)doc_len) {
+    if (seek_to >= (int64_t)doc_len) {
       vio.ndone = doc_len;
       return calluser(VC_EVENT_EOS);
     }
     Doc *first_doc = (Doc*)first_buf->data();
     Frag *first_frag = first_doc->frags();
     if (!f.single_fragment) {
-      // find the target fragment
-      int i = 0;
-      for (; i < (int)first_doc->nfrags(); i++)
-        if (seek_to < (int64_t)first_frag[i].offset) break;
-      if (i >= (int)first_doc->nfrags()) {
+      // find the target fragment, the last one starting at or before seek_to
+      int nfrags = (int)first_doc->nfrags();
+      if (!nfrags) {
         Warning("bad fragment header");
         return calluser(VC_EVENT_ERROR);
       }
+      int i = 0, j = nfrags;
+      while (i < j) {
+        int m = (i + j) / 2;
+        if ((int64_t)first_frag[m].offset <= seek_to)
+          i = m + 1;
+        else
+          j = m;
+      }
       // fragment is the current fragment
       // key is the next key (fragment + 1)
       if (i != fragment) {
@@ -661,6 +734,7 @@ CacheVC::openReadMain(int event, Event * e)
     vio.ndone = 0;
     seek_to = 0;
     ntodo = vio.ntodo();
+    bytes = doc->len - doc_pos;
   }
   if (ntodo <= 0)
     return EVENT_CONT;
@@ -675,6 +749,9 @@ CacheVC::openReadMain(int event, Event * e)
   vio.buffer.mbuf->append_block(b);
   vio.ndone += bytes;
   doc_pos += bytes;
+  if (f.pread) {
+    CACHE_SUM_DYN_STAT(cache_read_seek_bytes_stat, bytes);
+  }
   if (vio.ntodo() <= 0)
     return calluser(VC_EVENT_READ_COMPLETE);
   else {
@@ -687,7 +764,7 @@ CacheVC::openReadMain(int event, Event * e)
     return EVENT_CONT;
   }
 Lread: {
-    if ((uint32_t)vio.ndone >= doc_len)
+    if ((uint64_t)vio.ndone >= doc_len)
       // reached the end of the document and the user still wants more
       return calluser(VC_EVENT_EOS);
     last_collision = 0;
@@ -702,6 +779,8 @@ Lread: {
       SET_HANDLER(&CacheVC::openReadMain);
       VC_SCHED_LOCK_RETRY();
     }
+    if (f.open_read_timeout)
+      vol->open_dir.cancel_wait(this);
     if (dir_probe(&key, vol, &dir, &last_collision)) {
       SET_HANDLER(&CacheVC::openReadReadDone);
       int ret = do_read_call(&key);
@@ -723,8 +802,12 @@ Lread: {
               this, first_key.word(1), (int)vio.ndone);
         goto Lerror;
       }
-      DDebug("cache_read_agg", "%X: key: %X ReadMain retrying: %d", this, first_key.word(1), (int)vio.ndone);
+      DDebug("cache_read_agg", "%X: key: %X ReadMain waiting: %d", this, first_key.word(1), (int)vio.ndone);
       SET_HANDLER(&CacheVC::openReadMain);
+      // the writer wakes us when its next fragment is written or it closes
+      OpenDirEntry *cod = vol->open_read(&first_key);
+      if (cod)
+        return cod->wait(this, WRITER_WAIT_TIMEOUT_MSEC);
       VC_SCHED_WRITER_RETRY();
     }
     if (is_action_tag_set("cache"))
@@ -999,6 +1082,8 @@ CacheVC::openReadStartHead(int event, Event * e)
       goto Lread;
     if (f.lookup)
       goto Lookup;
+    if (slow_vol && !tier_copy_valid(&key, vol, &dir))
+      goto Ldone;
     earliest_dir = dir;
 #ifdef HTTP_CACHE
     CacheHTTPInfo *alternate_tmp;
@@ -1071,6 +1156,13 @@ CacheVC::openReadStartHead(int event, Event * e)
 
     first_buf = buf;
     vol->begin_read(this);
+    if (slow_vol) {
+      DDebug("cache_tier", "fast tier hit for %X", first_key.word(0));
+      CACHE_INCREMENT_DYN_STAT(cache_tier_fast_read_success_stat);
+    } else if (vol->tier_hits) {
+      CACHE_INCREMENT_DYN_STAT(cache_tier_slow_read_success_stat);
+      tier_read_hit(this);
+    }
 
     goto Lsuccess;
 
@@ -1100,6 +1192,22 @@ CacheVC::openReadStartHead(int event, Event * e)
     }
   }
 Ldone:
+  if (slow_vol && !f.lookup) {
+    // the fast tier copy is gone or unusable, start over on the slow tier
+    CACHE_DECREMENT_DYN_STAT(base_stat + CACHE_STAT_ACTIVE);
+    vol = slow_vol;
+    slow_vol = NULL;
+    CACHE_INCREMENT_DYN_STAT(base_stat + CACHE_STAT_ACTIVE);
+    CACHE_INCREMENT_DYN_STAT(cache_tier_fast_read_fallback_stat);
+    key = earliest_key = first_key;
+    buf = NULL;
+    last_collision = NULL;
+#ifdef HTTP_CACHE
+    vector.clear();
+    alternate.clear();
+#endif
+    return openReadStartHead(EVENT_IMMEDIATE, 0);
+  }
   if (!f.lookup) {
     CACHE_INCREMENT_DYN_STAT(cache_read_failure_stat);
     _action.continuation->handleEvent(CACHE_EVENT_OPEN_READ_FAILED, (void *) -err);
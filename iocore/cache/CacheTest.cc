@@ -275,6 +275,818 @@ CacheTestSM::CacheTestSM(const CacheTestSM &ao) : RegressionSM(ao) {
   SET_HANDLER(&CacheTestSM::event_handler);
 }
 
+#ifdef HTTP_CACHE
+static void
+cache_test_make_hdr(HTTPHdr *hdr, HTTPType type, const char *str)
+{
+  HTTPParser parser;
+  const char *end = str + strlen(str);
+
+  hdr->create(type);
+  http_parser_init(&parser);
+  if (type == HTTP_TYPE_REQUEST)
+    hdr->parse_req(&parser, &str, end, true);
+  else
+    hdr->parse_resp(&parser, &str, end, true);
+  http_parser_clear(&parser);
+}
+
+// Opens an HTTP read of a document while its writer is still filling it
+// in, and checks the reader gets the whole body from the writer.
+#define RWW_DOC_SIZE     (6 * 1024 * 1024)
+#define RWW_READ_AT      (3 * 1024 * 1024)
+
+struct CacheReadWhileWriterTest : public RegressionSM {
+  HTTPHdr request;
+  HTTPHdr response;
+  CacheHTTPInfo info;
+  CacheLookupHttpConfig params;
+  CacheVConnection *write_vc;
+  CacheVConnection *read_vc;
+  VIO *write_vio;
+  VIO *read_vio;
+  MIOBuffer *write_buf;
+  MIOBuffer *read_buf;
+  IOBufferReader *write_reader;
+  IOBufferReader *read_reader;
+  int64_t write_pos;
+  int64_t read_pos;
+  int save_read_while_writer;
+  bool read_opened;
+  bool read_pending;
+  bool read_closed;
+  bool failed;
+
+  static char body_byte(int64_t pos) { return (char)(pos % 253); }
+
+  void fill_write();
+  bool check_read();
+  void resume_write();
+  int maybe_done();
+  int event_handler(int event, void *data);
+
+  void run() {
+    MUTEX_LOCK(lock, mutex, this_ethread());
+    eventProcessor.schedule_imm(this);
+  }
+  RegressionSM *clone() { return new CacheReadWhileWriterTest(t); }
+
+  CacheReadWhileWriterTest(RegressionTest *t);
+  ~CacheReadWhileWriterTest();
+};
+
+CacheReadWhileWriterTest::CacheReadWhileWriterTest(RegressionTest *t) :
+  RegressionSM(t),
+  write_vc(0), read_vc(0), write_vio(0), read_vio(0), write_buf(0), read_buf(0),
+  write_reader(0), read_reader(0), write_pos(0), read_pos(0),
+  save_read_while_writer(cache_config_read_while_writer),
+  read_opened(false), read_pending(false), read_closed(false), failed(false)
+{
+  char buf[256];
+
+  snprintf(buf, sizeof(buf), "GET http://rww.cache.test/%" PRId64 " HTTP/1.1\r\n"
+           "Host: rww.cache.test\r\n\r\n", (int64_t)ink_get_hrtime());
+  cache_test_make_hdr(&request, HTTP_TYPE_REQUEST, buf);
+  cache_test_make_hdr(&response, HTTP_TYPE_RESPONSE, "HTTP/1.1 200 OK\r\n"
+           "Content-Type: application/octet-stream\r\n"
+           "Cache-Control: max-age=3600\r\n\r\n");
+  SET_HANDLER(&CacheReadWhileWriterTest::event_handler);
+}
+
+CacheReadWhileWriterTest::~CacheReadWhileWriterTest()
+{
+  ink_assert(!write_vc && !read_vc);
+  if (write_buf)
+    free_MIOBuffer(write_buf);
+  if (read_buf)
+    free_MIOBuffer(read_buf);
+  request.destroy();
+  response.destroy();
+}
+
+void
+CacheReadWhileWriterTest::fill_write()
+{
+  char b[4096];
+  int64_t towrite = RWW_DOC_SIZE - write_pos;
+  int64_t room = 65536 - write_reader->read_avail();
+
+  if (towrite > room)
+    towrite = room;
+  while (towrite > 0) {
+    int64_t l = towrite < (int64_t)sizeof(b) ? towrite : (int64_t)sizeof(b);
+    for (int64_t i = 0; i < l; i++)
+      b[i] = body_byte(write_pos + i);
+    write_buf->write(b, l);
+    write_pos += l;
+    towrite -= l;
+  }
+}
+
+bool
+CacheReadWhileWriterTest::check_read()
+{
+  char b[4096];
+  int64_t avail = read_reader->read_avail();
+
+  while (avail > 0) {
+    int64_t l = avail < (int64_t)sizeof(b) ? avail : (int64_t)sizeof(b);
+    read_reader->read(b, l);
+    for (int64_t i = 0; i < l; i++)
+      if (b[i] != body_byte(read_pos + i)) {
+        rprintf(t, "read while writer: body mismatch at %" PRId64 "\n", read_pos + i);
+        return false;
+      }
+    read_pos += l;
+    avail -= l;
+  }
+  return true;
+}
+
+// The writer was held at RWW_READ_AT until the read was opened.
+void
+CacheReadWhileWriterTest::resume_write()
+{
+  read_pending = false;
+  if (write_vc) {
+    fill_write();
+    write_vio->reenable();
+  }
+}
+
+int
+CacheReadWhileWriterTest::maybe_done()
+{
+  if (write_vc || read_vc || read_pending)
+    return EVENT_CONT;
+  cache_config_read_while_writer = save_read_while_writer;
+  if (!read_opened || !read_closed || read_pos != RWW_DOC_SIZE)
+    failed = true;
+  done(failed ? REGRESSION_TEST_FAILED : REGRESSION_TEST_PASSED);
+  delete this;
+  return EVENT_DONE;
+}
+
+int
+CacheReadWhileWriterTest::event_handler(int event, void *data)
+{
+  switch (event) {
+
+    case EVENT_IMMEDIATE:
+      cache_config_read_while_writer = 1;
+      cacheProcessor.open_write(this, RWW_DOC_SIZE, request.url_get(), &request, NULL);
+      return EVENT_DONE;
+
+    case CACHE_EVENT_OPEN_WRITE:
+      write_vc = (CacheVConnection *) data;
+      info.create();
+      info.request_set(&request);
+      info.response_set(&response);
+      info.request_sent_time_set(time(NULL));
+      info.response_received_time_set(time(NULL));
+      write_vc->set_http_info(&info);
+      write_buf = new_empty_MIOBuffer();
+      write_reader = write_buf->alloc_reader();
+      write_vio = write_vc->do_io_write(this, RWW_DOC_SIZE, write_reader);
+      return EVENT_DONE;
+
+    case CACHE_EVENT_OPEN_WRITE_FAILED:
+      rprintf(t, "read while writer: open_write failed %d\n", (int) -(intptr_t) data);
+      failed = true;
+      return maybe_done();
+
+    case VC_EVENT_WRITE_READY:
+      if (read_pending)
+        return EVENT_CONT;
+      if (!read_opened && write_vio->ndone >= RWW_READ_AT) {
+        read_opened = read_pending = true;
+        cacheProcessor.open_read(this, request.url_get(), &request, &params);
+        return EVENT_CONT;
+      }
+      fill_write();
+      write_vio->reenable();
+      return EVENT_CONT;
+
+    case VC_EVENT_WRITE_COMPLETE:
+      write_vc->do_io_close();
+      write_vc = 0;
+      return maybe_done();
+
+    case CACHE_EVENT_OPEN_READ:
+      if (!write_vc) {
+        rprintf(t, "read while writer: writer closed before the read opened\n");
+        failed = true;
+      }
+      read_vc = (CacheVConnection *) data;
+      read_buf = new_empty_MIOBuffer();
+      read_reader = read_buf->alloc_reader();
+      read_vio = read_vc->do_io_read(this, RWW_DOC_SIZE, read_buf);
+      resume_write();
+      return EVENT_DONE;
+
+    case CACHE_EVENT_OPEN_READ_FAILED:
+      rprintf(t, "read while writer: open_read failed %d\n", (int) -(intptr_t) data);
+      failed = true;
+      resume_write();
+      return maybe_done();
+
+    case VC_EVENT_READ_READY:
+      if (!check_read()) {
+        failed = true;
+        read_vc->do_io_close(1);
+        read_vc = 0;
+        return maybe_done();
+      }
+      read_vio->reenable();
+      return EVENT_CONT;
+
+    case VC_EVENT_READ_COMPLETE:
+      if (!check_read())
+        failed = true;
+      read_vc->do_io_close();
+      read_vc = 0;
+      read_closed = true;
+      return maybe_done();
+
+    case VC_EVENT_ERROR:
+    case VC_EVENT_EOS:
+      failed = true;
+      if (data == read_vio) {
+        read_vc->do_io_close(1);
+        read_vc = 0;
+      } else {
+        write_vc->do_io_close(1);
+        write_vc = 0;
+      }
+      return maybe_done();
+
+    default:
+      ink_assert(!"case");
+      break;
+  }
+  return EVENT_DONE;
+}
+
+// Writes an HTTP document, or reads one back and checks its body byte for
+// byte, or checks a write is refused admission. The document tests below
+// are sequences of these and of CacheTestStep, which sets the
+// configuration and checks the stats.
+enum { CACHE_HTTP_TEST_WRITE, CACHE_HTTP_TEST_READ, CACHE_HTTP_TEST_NOT_ADMITTED };
+
+struct CacheHttpDocTest : public RegressionSM {
+  int op;
+  char url[256];
+  char req_hdrs[256];     // extra request header lines
+  char resp_hdrs[256];    // extra response header lines
+  int64_t size;
+  int salt;               // varies the body, see body_byte
+  bool random_body;       // incompressible body
+  int admission_hits;     // passed to open_write
+  HTTPHdr request;
+  HTTPHdr response;
+  CacheHTTPInfo info;
+  CacheLookupHttpConfig params;
+  CacheVConnection *vc;
+  VIO *vio;
+  MIOBuffer *buf;
+  IOBufferReader *reader;
+  int64_t pos;
+  bool failed;
+
+  char body_byte(int64_t p) {
+    if (random_body) {
+      uint64_t x = (uint64_t)p + salt;
+      x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+      return (char)(x ^ (x >> 31));
+    }
+    return (char)((p + salt) % 253);
+  }
+  void fill_write();
+  bool check_read();
+  int finish(bool ok);
+  int event_handler(int event, void *data);
+
+  void run() {
+    MUTEX_LOCK(lock, mutex, this_ethread());
+    eventProcessor.schedule_imm(this);
+  }
+  RegressionSM *clone() {
+    return new CacheHttpDocTest(t, op, url, size, salt, req_hdrs, resp_hdrs, random_body, admission_hits);
+  }
+
+  CacheHttpDocTest(RegressionTest *t, int aop, const char *aurl, int64_t asize, int asalt = 0,
+                   const char *areq_hdrs = "", const char *aresp_hdrs = "", bool arandom_body = false,
+                   int aadmission_hits = -1);
+  ~CacheHttpDocTest();
+};
+
+CacheHttpDocTest::CacheHttpDocTest(RegressionTest *t, int aop, const char *aurl, int64_t asize, int asalt,
+                                   const char *areq_hdrs, const char *aresp_hdrs, bool arandom_body,
+                                   int aadmission_hits) :
+  RegressionSM(t), op(aop), size(asize), salt(asalt), random_body(arandom_body), admission_hits(aadmission_hits),
+  vc(0), vio(0), buf(0), reader(0), pos(0), failed(false)
+{
+  ink_strncpy(url, aurl, sizeof(url));
+  ink_strncpy(req_hdrs, areq_hdrs, sizeof(req_hdrs));
+  ink_strncpy(resp_hdrs, aresp_hdrs, sizeof(resp_hdrs));
+  SET_HANDLER(&CacheHttpDocTest::event_handler);
+}
+
+CacheHttpDocTest::~CacheHttpDocTest()
+{
+  ink_assert(!vc);
+  if (buf)
+    free_MIOBuffer(buf);
+  request.destroy();
+  response.destroy();
+}
+
+void
+CacheHttpDocTest::fill_write()
+{
+  char b[4096];
+  int64_t towrite = size - pos;
+  int64_t room = 65536 - reader->read_avail();
+
+  if (towrite > room)
+    towrite = room;
+  while (towrite > 0) {
+    int64_t l = towrite < (int64_t)sizeof(b) ? towrite : (int64_t)sizeof(b);
+    for (int64_t i = 0; i < l; i++)
+      b[i] = body_byte(pos + i);
+    buf->write(b, l);
+    pos += l;
+    towrite -= l;
+  }
+}
+
+bool
+CacheHttpDocTest::check_read()
+{
+  char b[4096];
+  int64_t avail = reader->read_avail();
+
+  while (avail > 0) {
+    int64_t l = avail < (int64_t)sizeof(b) ? avail : (int64_t)sizeof(b);
+    reader->read(b, l);
+    for (int64_t i = 0; i < l; i++)
+      if (b[i] != body_byte(pos + i)) {
+        rprintf(t, "%s: body mismatch at %d\n", url, (int)(pos + i));
+        return false;
+      }
+    pos += l;
+    avail -= l;
+  }
+  return true;
+}
+
+int
+CacheHttpDocTest::finish(bool ok)
+{
+  if (vc) {
+    vc->do_io_close(ok ? -1 : 1);
+    vc = 0;
+  }
+  done(ok && !failed ? REGRESSION_TEST_PASSED : REGRESSION_TEST_FAILED);
+  delete this;
+  return EVENT_DONE;
+}
+
+int
+CacheHttpDocTest::event_handler(int event, void *data)
+{
+  switch (event) {
+
+    case EVENT_IMMEDIATE: {
+      char hdr[1024];
+      snprintf(hdr, sizeof(hdr), "GET %s HTTP/1.1\r\n%s\r\n", url, req_hdrs);
+      cache_test_make_hdr(&request, HTTP_TYPE_REQUEST, hdr);
+      snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nCache-Control: max-age=3600\r\n%s\r\n", resp_hdrs);
+      cache_test_make_hdr(&response, HTTP_TYPE_RESPONSE, hdr);
+      if (op != CACHE_HTTP_TEST_READ)
+        cacheProcessor.open_write(this, size, request.url_get(), &request, NULL, 0, CACHE_FRAG_TYPE_HTTP,
+                                  admission_hits);
+      else
+        cacheProcessor.open_read(this, request.url_get(), &request, &params);
+      return EVENT_DONE;
+    }
+
+    case CACHE_EVENT_OPEN_WRITE:
+      vc = (CacheVConnection *) data;
+      if (op == CACHE_HTTP_TEST_NOT_ADMITTED) {
+        rprintf(t, "%s: write admitted\n", url);
+        return finish(false);
+      }
+      info.create();
+      info.request_set(&request);
+      info.response_set(&response);
+      info.request_sent_time_set(time(NULL));
+      info.response_received_time_set(time(NULL));
+      vc->set_http_info(&info);
+      buf = new_empty_MIOBuffer();
+      reader = buf->alloc_reader();
+      // as from a tunnel: a body that is all there is written on close
+      fill_write();
+      vio = vc->do_io_write(this, size, reader);
+      return EVENT_DONE;
+
+    case CACHE_EVENT_OPEN_READ: {
+      CacheHTTPInfo *cinfo = NULL;
+      vc = (CacheVConnection *) data;
+      vc->get_http_info(&cinfo);
+      // the alternate read must be the one with the response header lines
+      MIMEFieldIter iter;
+      for (MIMEField *f = response.iter_get_first(&iter); f; f = response.iter_get_next(&iter)) {
+        int nlen = 0, vlen = 0, clen = 0;
+        const char *name = f->name_get(&nlen), *value = f->value_get(&vlen);
+        const char *cvalue = cinfo ? cinfo->response_get()->value_get(name, nlen, &clen) : NULL;
+        if (!cvalue || clen != vlen || memcmp(cvalue, value, vlen)) {
+          char field[256];
+          snprintf(field, sizeof(field), "%.*s: %.*s", nlen, name, clen, cvalue ? cvalue : "");
+          rprintf(t, "%s: read the wrong alternate, %s\n", url, field);
+          return finish(false);
+        }
+      }
+      buf = new_empty_MIOBuffer();
+      reader = buf->alloc_reader();
+      vio = vc->do_io_read(this, size, buf);
+      return EVENT_DONE;
+    }
+
+    case CACHE_EVENT_OPEN_WRITE_FAILED:
+      if (op == CACHE_HTTP_TEST_NOT_ADMITTED && (intptr_t) data == -ECACHE_NOT_ADMITTED)
+        return finish(true);
+      // fall through
+    case CACHE_EVENT_OPEN_READ_FAILED:
+      rprintf(t, "%s: open failed %d\n", url, (int) -(intptr_t) data);
+      return finish(false);
+
+    case VC_EVENT_WRITE_READY:
+      fill_write();
+      vio->reenable();
+      return EVENT_CONT;
+
+    case VC_EVENT_WRITE_COMPLETE:
+      return finish(vio->ndone == size);
+
+    case VC_EVENT_READ_READY:
+      if (!check_read())
+        return finish(false);
+      vio->reenable();
+      return EVENT_CONT;
+
+    case VC_EVENT_READ_COMPLETE:
+      if (!check_read() || pos != size)
+        return finish(false);
+      if (vc->get_object_size() != size) {
+        rprintf(t, "%s: object size %d, wrote %d\n", url, (int) vc->get_object_size(), (int) size);
+        return finish(false);
+      }
+      return finish(true);
+
+    case VC_EVENT_ERROR:
+    case VC_EVENT_EOS:
+      rprintf(t, "%s: %s error at %d\n", url, op == CACHE_HTTP_TEST_WRITE ? "write" : "read", (int) pos);
+      return finish(false);
+
+    default:
+      ink_assert(!"case");
+      break;
+  }
+  return EVENT_DONE;
+}
+
+// Runs f between the steps of a test. f returns a REGRESSION_TEST_
+// status, or REGRESSION_TEST_INPROGRESS to be run again a little later
+// while it waits for the cache.
+#define CACHE_TEST_STEP_TRIES   100
+
+struct CacheTestStep : public RegressionSM {
+  int (*f)(RegressionTest *t);
+  int tries;
+
+  void step() {
+    int status = f(t);
+    if (status == REGRESSION_TEST_INPROGRESS && ++tries < CACHE_TEST_STEP_TRIES) {
+      eventProcessor.schedule_in(this, HRTIME_MSECONDS(100));
+      return;
+    }
+    done(status == REGRESSION_TEST_INPROGRESS ? REGRESSION_TEST_FAILED : status);
+    delete this;
+  }
+  int event_handler(int event, void *data) {
+    NOWARN_UNUSED(event);
+    NOWARN_UNUSED(data);
+    step();
+    return EVENT_DONE;
+  }
+  void run() {
+    MUTEX_LOCK(lock, mutex, this_ethread());
+    step();
+  }
+  RegressionSM *clone() { return new CacheTestStep(t, f); }
+
+  CacheTestStep(RegressionTest *t, int (*af)(RegressionTest *)) : RegressionSM(t), f(af), tries(0) {
+    SET_HANDLER(&CacheTestStep::event_handler);
+  }
+};
+
+// A cache stat summed over the event threads. RecGetRawStatSum adds these
+// to the global value, which already includes them once it is synced.
+static int64_t
+cache_test_stat(int id)
+{
+  int64_t sum = 0;
+  for (int i = 0; i < eventProcessor.n_ethreads; i++)
+    sum += raw_stat_get_tlp(cache_rsb, id, eventProcessor.all_ethreads[i])->sum;
+  return sum;
+}
+
+// Compression: a compressible document spanning several fragments is
+// stored compressed, except its short last fragment, which compresses but
+// would not save a disk block and is stored as is. A random body does not
+// compress and is stored as is.
+#define COMPRESS_DOC_SIZE   (3 * 1024 * 1024 + 100)
+#define RANDOM_DOC_SIZE     (2 * 1024 * 1024)
+
+static int cache_test_save_compress;
+static int64_t cache_test_compress_in;
+static int64_t cache_test_compress_out;
+
+static int
+cache_test_compress_on(RegressionTest *t)
+{
+  NOWARN_UNUSED(t);
+  cache_test_save_compress = cache_config_compress;
+  cache_config_compress = CACHE_COMPRESSION_FASTLZ;
+  cache_test_compress_in = cache_test_stat(cache_compress_bytes_in_stat);
+  cache_test_compress_out = cache_test_stat(cache_compress_bytes_out_stat);
+  return REGRESSION_TEST_PASSED;
+}
+
+static int
+cache_test_compress_off(RegressionTest *t)
+{
+  int64_t in = 0, out = 0;
+
+  cache_config_compress = cache_test_save_compress;
+  in = cache_test_stat(cache_compress_bytes_in_stat);
+  out = cache_test_stat(cache_compress_bytes_out_stat);
+  in -= cache_test_compress_in;
+  out -= cache_test_compress_out;
+  // every fragment of the compressible document went through compression
+  if (in < COMPRESS_DOC_SIZE || out * 4 > in) {
+    rprintf(t, "compression: %d bytes compressed to %d\n", (int) in, (int) out);
+    return REGRESSION_TEST_FAILED;
+  }
+  return REGRESSION_TEST_PASSED;
+}
+
+static RegressionSM *
+cache_compress_test(RegressionTest *t)
+{
+  char url[256], random_url[256];
+  int64_t now = (int64_t)ink_get_hrtime();
+
+  snprintf(url, sizeof(url), "http://compress.cache.test/%" PRId64, now);
+  snprintf(random_url, sizeof(random_url), "http://compress.cache.test/random/%" PRId64, now);
+  return r_sequential(
+    t,
+    new CacheTestStep(t, cache_test_compress_on),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_WRITE, url, COMPRESS_DOC_SIZE),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_WRITE, random_url, RANDOM_DOC_SIZE, 0, "", "", true),
+    new CacheTestStep(t, cache_test_compress_off),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_READ, url, COMPRESS_DOC_SIZE),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_READ, random_url, RANDOM_DOC_SIZE, 0, "", "", true),
+    NULL_PTR);
+}
+
+// Deduplication: two URLs with the same body share one stored body and
+// both read back. Two alternates of one URL with the same body keep a
+// body each, as alternates are told apart by their object key.
+#define DEDUP_DOC_SIZE      (64 * 1024)
+
+static int cache_test_save_dedup;
+static int64_t cache_test_dedup_hits;
+
+static int64_t
+cache_test_dedup_hits_since()
+{
+  int64_t hits = 0;
+  hits = cache_test_stat(cache_dedup_hit_stat);
+  return hits - cache_test_dedup_hits;
+}
+
+static int
+cache_test_dedup_on(RegressionTest *t)
+{
+  NOWARN_UNUSED(t);
+  cache_test_save_dedup = cache_config_dedup;
+  cache_config_dedup = 1;
+  cache_test_dedup_hits = 0;
+  cache_test_dedup_hits = cache_test_dedup_hits_since();
+  return REGRESSION_TEST_PASSED;
+}
+
+static int
+cache_test_dedup_shared(RegressionTest *t)
+{
+  if (cache_test_dedup_hits_since() != 1) {
+    rprintf(t, "dedup: %d hits for two URLs with one body\n", (int) cache_test_dedup_hits_since());
+    return REGRESSION_TEST_FAILED;
+  }
+  return REGRESSION_TEST_PASSED;
+}
+
+static int
+cache_test_dedup_off(RegressionTest *t)
+{
+  cache_config_dedup = cache_test_save_dedup;
+  // the alternates did not share
+  return cache_test_dedup_shared(t);
+}
+
+static RegressionSM *
+cache_dedup_test(RegressionTest *t)
+{
+  char url[256], other_url[256], alt_url[256];
+  int64_t now = (int64_t)ink_get_hrtime();
+  const char *en = "Accept-Language: en\r\n", *fr = "Accept-Language: fr\r\n";
+  const char *en_resp = "Vary: Accept-Language\r\nContent-Language: en\r\n";
+  const char *fr_resp = "Vary: Accept-Language\r\nContent-Language: fr\r\n";
+
+  snprintf(url, sizeof(url), "http://dedup.cache.test/%" PRId64, now);
+  snprintf(other_url, sizeof(other_url), "http://dedup.cache.test/other/%" PRId64, now);
+  snprintf(alt_url, sizeof(alt_url), "http://dedup.cache.test/alternates/%" PRId64, now);
+  return r_sequential(
+    t,
+    new CacheTestStep(t, cache_test_dedup_on),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_WRITE, url, DEDUP_DOC_SIZE, 7),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_WRITE, other_url, DEDUP_DOC_SIZE, 7),
+    new CacheTestStep(t, cache_test_dedup_shared),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_READ, url, DEDUP_DOC_SIZE, 7),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_READ, other_url, DEDUP_DOC_SIZE, 7),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_WRITE, alt_url, DEDUP_DOC_SIZE, 9, en, en_resp),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_WRITE, alt_url, DEDUP_DOC_SIZE, 9, fr, fr_resp),
+    new CacheTestStep(t, cache_test_dedup_off),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_READ, alt_url, DEDUP_DOC_SIZE, 9, en, en_resp),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_READ, alt_url, DEDUP_DOC_SIZE, 9, fr, fr_resp),
+    NULL_PTR);
+}
+
+// Tiered storage, when the cache has a fast tier: a document read
+// tiering.promote_hits times is copied into the fast tier and the next
+// read is served from there. Rewriting the document evicts the copy, so
+// the read after that gets the new body.
+#define TIER_DOC_SIZE       (16 * 1024)
+
+static bool cache_test_tiered;
+static int64_t cache_test_tier_fast_reads;
+static int64_t cache_test_tier_promoted;
+
+static int
+cache_test_tier_start(RegressionTest *t)
+{
+  CacheKey key;
+
+  rand_CacheKey(&key, this_ethread()->mutex);
+  cache_test_tiered = cache_config_tier_promote_hits > 0 &&
+    caches[CACHE_FRAG_TYPE_HTTP] && caches[CACHE_FRAG_TYPE_HTTP]->key_to_fast_vol(&key);
+  if (!cache_test_tiered) {
+    rprintf(t, "tiering: no fast tier, not checked\n");
+    return REGRESSION_TEST_NOT_RUN;
+  }
+  cache_test_tier_fast_reads = cache_test_stat(cache_tier_fast_read_success_stat);
+  cache_test_tier_promoted = cache_test_stat(cache_tier_promote_bytes_stat);
+  return REGRESSION_TEST_PASSED;
+}
+
+// the copy is entered in the fast tier once it is written
+static int
+cache_test_tier_promoted_wait(RegressionTest *t)
+{
+  NOWARN_UNUSED(t);
+  int64_t promoted = 0;
+
+  if (!cache_test_tiered)
+    return REGRESSION_TEST_NOT_RUN;
+  promoted = cache_test_stat(cache_tier_promote_bytes_stat);
+  return promoted > cache_test_tier_promoted ? REGRESSION_TEST_PASSED : REGRESSION_TEST_INPROGRESS;
+}
+
+static int
+cache_test_tier_fast_read(RegressionTest *t)
+{
+  int64_t fast_reads = 0;
+
+  if (!cache_test_tiered)
+    return REGRESSION_TEST_NOT_RUN;
+  fast_reads = cache_test_stat(cache_tier_fast_read_success_stat);
+  if (fast_reads - cache_test_tier_fast_reads != 1) {
+    rprintf(t, "tiering: %d fast tier reads after promotion\n", (int)(fast_reads - cache_test_tier_fast_reads));
+    return REGRESSION_TEST_FAILED;
+  }
+  return REGRESSION_TEST_PASSED;
+}
+
+static RegressionSM *
+cache_tier_test(RegressionTest *t)
+{
+  char url[256];
+  int hits = cache_config_tier_promote_hits > 0 ? cache_config_tier_promote_hits : 1;
+
+  snprintf(url, sizeof(url), "http://tier.cache.test/%" PRId64, (int64_t)ink_get_hrtime());
+  return r_sequential(
+    t,
+    new CacheTestStep(t, cache_test_tier_start),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_WRITE, url, TIER_DOC_SIZE),
+    r_sequential(t, hits, new CacheHttpDocTest(t, CACHE_HTTP_TEST_READ, url, TIER_DOC_SIZE)),
+    new CacheTestStep(t, cache_test_tier_promoted_wait),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_READ, url, TIER_DOC_SIZE),
+    new CacheTestStep(t, cache_test_tier_fast_read),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_WRITE, url, TIER_DOC_SIZE, 5),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_READ, url, TIER_DOC_SIZE, 5),
+    new CacheTestStep(t, cache_test_tier_fast_read),
+    NULL_PTR);
+}
+
+// Write admission: a new document is refused until it has been requested
+// admission.hits times, and the requests are halved once the admission
+// window has passed. A PUSH, which HttpSM opens with admission_hits 0, is
+// written on its first request.
+#define ADMISSION_HITS      3
+#define ADMISSION_DOC_SIZE  (8 * 1024)
+
+static int cache_test_save_admission_hits;
+static int cache_test_save_admission_window;
+
+static int
+cache_test_admission_on(RegressionTest *t)
+{
+  NOWARN_UNUSED(t);
+  cache_test_save_admission_hits = cache_config_admission_hits;
+  cache_test_save_admission_window = cache_config_admission_window;
+  cache_config_admission_hits = ADMISSION_HITS;
+  cache_config_admission_window = 3600;
+  return REGRESSION_TEST_PASSED;
+}
+
+// end the admission window of every volume now
+static int
+cache_test_admission_age(RegressionTest *t)
+{
+  NOWARN_UNUSED(t);
+  int status = REGRESSION_TEST_PASSED;
+
+  for (int i = 0; i < gnvol; i++) {
+    MUTEX_TRY_LOCK(lock, gvol[i]->mutex, this_ethread());
+    if (lock)
+      gvol[i]->admit_aging = 0;
+    else
+      status = REGRESSION_TEST_INPROGRESS;
+  }
+  return status;
+}
+
+static int
+cache_test_admission_off(RegressionTest *t)
+{
+  NOWARN_UNUSED(t);
+  cache_config_admission_hits = cache_test_save_admission_hits;
+  cache_config_admission_window = cache_test_save_admission_window;
+  return REGRESSION_TEST_PASSED;
+}
+
+static RegressionSM *
+cache_admission_test(RegressionTest *t)
+{
+  char url[256], push_url[256], aged_url[256];
+  int64_t now = (int64_t)ink_get_hrtime();
+
+  snprintf(url, sizeof(url), "http://admission.cache.test/%" PRId64, now);
+  snprintf(push_url, sizeof(push_url), "http://admission.cache.test/push/%" PRId64, now);
+  snprintf(aged_url, sizeof(aged_url), "http://admission.cache.test/aged/%" PRId64, now);
+  return r_sequential(
+    t,
+    new CacheTestStep(t, cache_test_admission_on),
+    r_sequential(t, ADMISSION_HITS - 1,
+                 new CacheHttpDocTest(t, CACHE_HTTP_TEST_NOT_ADMITTED, url, ADMISSION_DOC_SIZE)),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_WRITE, url, ADMISSION_DOC_SIZE),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_READ, url, ADMISSION_DOC_SIZE),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_WRITE, push_url, ADMISSION_DOC_SIZE, 0, "", "", false, 0),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_READ, push_url, ADMISSION_DOC_SIZE),
+    // two requests, halved to one by the end of the window
+    r_sequential(t, ADMISSION_HITS - 1,
+                 new CacheHttpDocTest(t, CACHE_HTTP_TEST_NOT_ADMITTED, aged_url, ADMISSION_DOC_SIZE)),
+    new CacheTestStep(t, cache_test_admission_age),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_NOT_ADMITTED, aged_url, ADMISSION_DOC_SIZE),
+    new CacheHttpDocTest(t, CACHE_HTTP_TEST_WRITE, aged_url, ADMISSION_DOC_SIZE),
+    new CacheTestStep(t, cache_test_admission_off),
+    NULL_PTR);
+}
+#endif
+
 EXCLUSIVE_REGRESSION_TEST(cache)(RegressionTest *t, int atype, int *pstatus) {
   NOWARN_UNUSED(atype);
   if (cacheProcessor.IsCacheEnabled() != CACHE_INITIALIZED) {
@@ -409,6 +1221,13 @@ EXCLUSIVE_REGRESSION_TEST(cache)(RegressionTest *t, int atype, int *pstatus) {
     replace_read_test.clone(),
     large_write_test.clone(),
     pread_test.clone(),
+#ifdef HTTP_CACHE
+    new CacheReadWhileWriterTest(t),
+    cache_compress_test(t),
+    cache_dedup_test(t),
+    cache_tier_test(t),
+    cache_admission_test(t),
+#endif
     NULL_PTR
     )->run(pstatus);
   return;
@@ -61,21 +61,29 @@ CacheVC::scanVol(int event, Event * e)
   Debug("cache_scan_truss", "inside %p:scanVol", this);
   if (_action.cancelled)
     return free_CacheVC(this);
-  CacheHostRecord *rec = &theCache->hosttable->gen_host_rec;
+  // a scan for a host covers the volumes that host is assigned to,
+  // otherwise every volume, host partitioned ones included
+  Vol **vols = gvol;
+  int nvols = gnvol;
   if (host_len) {
-    CacheHostResult res;
-    theCache->hosttable->Match(hostname, host_len, &res);
-    if (res.record)
-      rec = res.record;
+    CacheHostRecord *rec = &theCache->hosttable->gen_host_rec;
+    if (theCache->hosttable->m_numEntries > 0) {
+      CacheHostResult res;
+      theCache->hosttable->Match(hostname, host_len, &res);
+      if (res.record)
+        rec = res.record;
+    }
+    vols = rec->vols;
+    nvols = rec->num_vols;
   }
   if (!vol) {
-    if (!rec->num_vols)
+    if (!nvols)
       goto Ldone;
-    vol = rec->vols[0];
+    vol = vols[0];
   } else {
-    for (int i = 0; i < rec->num_vols - 1; i++)
-      if (vol == rec->vols[i]) {
-        vol = rec->vols[i + 1];
+    for (int i = 0; i < nvols - 1; i++)
+      if (vol == vols[i]) {
+        vol = vols[i + 1];
         goto Lcont;
       }
     goto Ldone;
@@ -185,7 +193,7 @@ CacheVC::scanObject(int event, Event * e)
     scan_vol_map = make_vol_map(vol);
     io.aiocb.aio_offset = next_in_map(vol, scan_vol_map, vol_offset_to_offset(vol, 0));
     if (io.aiocb.aio_offset >= (off_t)(vol->skip + vol->len))
-      goto Ldone;
+      goto Lvol_end;
     io.aiocb.aio_nbytes = SCAN_BUF_SIZE;
     io.aiocb.aio_buf = buf->data();
     io.action = this;
@@ -352,7 +360,22 @@ CacheVC::scanObject(int event, Event * e)
     scan_fix_buffer_offset = 0;
   }
 
-  if (io.aiocb.aio_offset >= vol->skip + vol->len) {
+Lvol_end:
+  if (fragment == 1 && io.aiocb.aio_offset >= vol->skip + vol->len && vol->agg_buf_pos) {
+    // the newest documents are still in the aggregation buffer, scan a
+    // copy of it as though it had been read from the write position
+    fragment = 2;
+    memcpy(buf->data(), vol->agg_buffer, vol->agg_buf_pos);
+    io.aiocb.aio_offset = vol->header->write_pos;
+    io.aiocb.aio_nbytes = vol->agg_buf_pos;
+    io.aiocb.aio_buf = buf->data();
+    io.aio_result = vol->agg_buf_pos;
+    scan_fix_buffer_offset = 0;
+    offset = 0;
+    mutex->thread_holding->schedule_in_local(this, HRTIME_MSECONDS(scan_msec_delay));
+    return EVENT_CONT;
+  }
+  if (fragment == 2 || io.aiocb.aio_offset >= vol->skip + vol->len) {
     SET_HANDLER(&CacheVC::scanVol);
     eventProcessor.schedule_in(this, HRTIME_MSECONDS(scan_msec_delay));
     return EVENT_CONT;
@@ -399,6 +422,8 @@ CacheVC::scanOpenWrite(int event, Event * e)
   NOWARN_UNUSED(event);
   Debug("cache_scan_truss", "inside %p:scanOpenWrite", this);
   cancel_trigger();
+  if (_action.cancelled)
+    return free_CacheVC(this);
   // get volume lock
   if (writer_lock_retry > SCAN_WRITER_LOCK_MAX_RETRY) {
     int r = _action.continuation->handleEvent(CACHE_EVENT_SCAN_OPERATION_BLOCKED, 0);
@@ -507,3 +532,152 @@ CacheVC::scanUpdateDone(int event, Event * e)
   }
 }
 
+
+#ifdef HTTP_CACHE
+struct CachePurge;
+
+// Cancelling a purge cancels its scan and frees it.
+struct CachePurgeAction: public Action
+{
+  virtual void cancel(Continuation * c = NULL);
+  Continuation *operator =(Continuation * acont)
+  {
+    return Action::operator =(acont);
+  }
+  CachePurge *purge;
+};
+
+/* Bulk invalidation: a background scan which deletes every alternate whose
+ * URL has a prefix, matches a regular expression or is for a host. The
+ * caller is called back with CACHE_EVENT_SCAN_DONE and the number of
+ * alternates deleted, or CACHE_EVENT_SCAN_FAILED. */
+struct CachePurge: public Continuation
+{
+  CachePurgeAction action;
+  Action *scan_action;
+  CachePurgeMatch match;
+  char *pattern;
+  int pattern_len;
+  pcre *regex;
+  pcre_extra *regex_extra;
+  int64_t purged;
+
+  int mainEvent(int event, void *data);
+  bool matches(HTTPInfo *alt);
+
+  CachePurge(Continuation *cont, CachePurgeMatch a_match, const char *a_pattern)
+    : Continuation(cont->mutex), scan_action(NULL), match(a_match), pattern(xstrdup(a_pattern)),
+      pattern_len(strlen(a_pattern)), regex(NULL), regex_extra(NULL), purged(0)
+  {
+    action = cont;
+    action.purge = this;
+    SET_HANDLER(&CachePurge::mainEvent);
+  }
+
+  ~CachePurge()
+  {
+    if (regex_extra)
+      regex_free_study(regex_extra);
+    if (regex)
+      pcre_free(regex);
+    xfree(pattern);
+  }
+};
+
+void
+CachePurgeAction::cancel(Continuation * c)
+{
+  ink_assert(!c || c == continuation);
+  ink_assert(!cancelled);
+  cancelled = true;
+  // the scan shares the purge's mutex, so it is not running now and will
+  // not call the purge again
+  if (purge->scan_action)
+    purge->scan_action->cancel();
+  delete purge;
+}
+
+bool
+CachePurge::matches(HTTPInfo *alt)
+{
+  URL *url = alt->request_get()->url_get();
+  char buf[2048];
+  char *s = buf;
+  int len = 0;
+  bool result = false;
+
+  if (match == CACHE_PURGE_HOST) {
+    const char *host = url->host_get(&len);
+    return host && !ptr_len_casecmp(host, len, pattern, pattern_len);
+  }
+  if (url->length_get() < (int) sizeof(buf))
+    url->string_get_buf(buf, sizeof(buf), &len);
+  else
+    s = url->string_get(NULL, &len);
+  if (match == CACHE_PURGE_URL_PREFIX)
+    result = len >= pattern_len && !memcmp(s, pattern, pattern_len);
+  else
+    result = pcre_exec(regex, regex_extra, s, len, 0, 0, NULL, 0) >= 0;
+  if (s != buf)
+    xfree(s);
+  return result;
+}
+
+int
+CachePurge::mainEvent(int event, void *data)
+{
+  switch (event) {
+  case CACHE_EVENT_SCAN:
+    return EVENT_CONT;
+  case CACHE_EVENT_SCAN_OBJECT:
+    if (!matches((HTTPInfo *) data))
+      return CACHE_SCAN_RESULT_CONTINUE;
+    purged++;
+    return CACHE_SCAN_RESULT_DELETE;
+  case CACHE_EVENT_SCAN_OPERATION_BLOCKED:
+    // the document is being written, leave it rather than stall the scan
+    Debug("cache_scan", "purge skipping a busy document");
+    return CACHE_SCAN_RESULT_CONTINUE;
+  case CACHE_EVENT_SCAN_OPERATION_FAILED:
+    return EVENT_CONT;
+  case CACHE_EVENT_SCAN_DONE:
+    if (data)  // a read error ended the scan early
+      event = CACHE_EVENT_SCAN_FAILED;
+    else
+      data = (void *) (intptr_t) purged;
+    break;
+  default:
+    break;
+  }
+  Debug("cache_scan", "purge of '%s' done, %" PRId64 " alternates deleted", pattern, purged);
+  action.continuation->handleEvent(event, data);
+  delete this;
+  return EVENT_DONE;
+}
+
+Action *
+CacheProcessor::purge(Continuation *cont, CachePurgeMatch match, const char *pattern, int KB_per_second)
+{
+  CachePurge *p = NEW(new CachePurge(cont, match, pattern));
+
+  if (match == CACHE_PURGE_URL_REGEX) {
+    const char *error = NULL;
+    int erroffset;
+    if ((p->regex = pcre_compile(pattern, 0, &error, &erroffset, NULL)))
+      p->regex_extra = regex_study(p->regex, &error);
+    if (error) {
+      Warning("cache purge: bad regular expression '%s': %s", pattern, error);
+      delete p;
+      cont->handleEvent(CACHE_EVENT_SCAN_FAILED, 0);
+      return ACTION_RESULT_DONE;
+    }
+  }
+  // a host's documents are only on the volumes the host is assigned to
+  Action *a = scan(p, match == CACHE_PURGE_HOST ? p->pattern : 0,
+                   match == CACHE_PURGE_HOST ? p->pattern_len : 0, KB_per_second);
+  if (a == ACTION_RESULT_DONE)
+    return ACTION_RESULT_DONE;
+  p->scan_action = a;
+  return &p->action;
+}
+#endif
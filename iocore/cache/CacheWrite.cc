@@ -23,11 +23,18 @@
 
 
 #include "P_Cache.h"
+#if TS_HAS_LIBZ
+#include <zlib.h>
+#endif
+#if TS_HAS_LZMA
+#include <lzma.h>
+#endif
 
 #define IS_POWER_2(_x) (!((_x)&((_x)-1)))
 #define UINT_WRAP_LTE(_x, _y) (((_y)-(_x)) < INT_MAX) // exploit overflow
 #define UINT_WRAP_GTE(_x, _y) (((_x)-(_y)) < INT_MAX) // exploit overflow
 #define UINT_WRAP_LT(_x, _y) (((_x)-(_y)) >= INT_MAX) // exploit overflow
+#define REQUIRED_COMPRESSION 0.9 // must get to this size or the rest of the document is not compressed
 
 // Given a key, finds the index of the alternate which matches
 // used to get the alternate which is actually present in the document
@@ -171,6 +178,8 @@ CacheVC::updateVector(int event, Event *e)
    The functions sets the length, offset, pinned, head and phase of vc->dir.
    */
 
+static void compress_fragment(CacheVC *vc);
+
 int
 CacheVC::handleWrite(int event, Event *e)
 {
@@ -185,7 +194,15 @@ CacheVC::handleWrite(int event, Event *e)
     frag_len = 0;
   set_agg_write_in_progress();
   POP_HANDLER;
-  agg_len = vol->round_to_approx_size(write_len + header_len + frag_len + sizeofDoc);
+  // the data was compressed before the volume lock was taken, keep it
+  // only if that saves disk blocks
+  if (compressed_buf) {
+    uint32_t prefix = header_len + frag_len + sizeofDoc;
+    if (!write_len || f.rewrite_resident_alt ||
+        vol->round_to_approx_size(compressed_len + prefix) >= vol->round_to_approx_size(write_len + prefix))
+      compressed_buf.clear();
+  }
+  agg_len = vol->round_to_approx_size((compressed_buf ? compressed_len : write_len) + header_len + frag_len + sizeofDoc);
   vol->agg_todo_size += agg_len;
   bool agg_error =
     (agg_len > AGG_SIZE || header_len + sizeofDoc > MAX_FRAG_SIZE ||
@@ -202,6 +219,7 @@ CacheVC::handleWrite(int event, Event *e)
     CACHE_INCREMENT_DYN_STAT(cache_write_backlog_failure_stat);
     CACHE_INCREMENT_DYN_STAT(base_stat + CACHE_STAT_FAILURE);
     vol->agg_todo_size -= agg_len;
+    compressed_buf.clear();
     io.aio_result = AIO_SOFT_FAILURE;
     if (event == EVENT_CALL)
       return EVENT_RETURN;
@@ -243,6 +261,143 @@ iobufferblock_memcpy(char *p, int len, IOBufferBlock *ab, int offset)
   return p;
 }
 
+#ifdef HTTP_CACHE
+// the key a body is stored under when deduplicated
+static void
+dedup_key(CacheKey *key, IOBufferBlock *b, int64_t offset, int64_t len)
+{
+  INK_DIGEST_CTX context;
+  ink_code_incr_md5_init(&context);
+  // keep the keys apart from URL keys
+  ink_code_incr_md5_update(&context, "\0dedup", 6);
+  for (; b && len > 0; b = b->next) {
+    int64_t bytes = (b->_end - b->_start) - offset;
+    if (bytes <= 0) {
+      offset = -bytes;
+      continue;
+    }
+    if (bytes > len)
+      bytes = len;
+    ink_code_incr_md5_update(&context, b->_start + offset, bytes);
+    len -= bytes;
+    offset = 0;
+  }
+  ink_code_incr_md5_final((char *) key, &context);
+}
+
+// whether len bytes of the chain from offset are those at p
+static bool
+iobufferblock_equal(IOBufferBlock *b, int64_t offset, const char *p, int64_t len)
+{
+  for (; b && len > 0; b = b->next) {
+    int64_t bytes = (b->_end - b->_start) - offset;
+    if (bytes <= 0) {
+      offset = -bytes;
+      continue;
+    }
+    if (bytes > len)
+      bytes = len;
+    if (memcmp(b->_start + offset, p, bytes))
+      return false;
+    p += bytes;
+    len -= bytes;
+    offset = 0;
+  }
+  return !len;
+}
+
+// whether another alternate of the document, written or being written,
+// has object key k: alternates are told apart by their object key, so
+// two of them cannot share a body
+static bool
+dedup_key_in_use(CacheVC *vc, CacheKey *k)
+{
+  if (get_alternate_index(vc->write_vector, *k) >= 0)
+    return true;
+  for (CacheVC *w = (CacheVC *) vc->od->writers.head; w; w = (CacheVC *) w->opendir_link.next)
+    if (w != vc && w->earliest_key == *k)
+      return true;
+  return false;
+}
+#endif
+
+// Compress the data of the fragment about to be written into
+// vc->compressed_buf, before the volume lock is taken for the write.
+// handleWrite stores the fragment as is unless that saves disk blocks,
+// and a fragment that does not compress well stops compression for the
+// rest of the document.
+static void
+compress_fragment(CacheVC *vc)
+{
+  Vol *vol = vc->vol;
+  vc->compressed_buf.clear();
+  if (!vc->f.compress || !vc->write_len)
+    return;
+  uint32_t len = vc->write_len, l = 0;
+  int ctype = cache_config_compress;
+  switch (ctype) {
+    default: return;
+    case CACHE_COMPRESSION_FASTLZ:
+      if (len < 16) return;
+      l = (uint32_t)((double)len * 1.05 + 66); break;
+#if TS_HAS_LIBZ
+    case CACHE_COMPRESSION_LIBZ: l = (uint32_t)compressBound(len); break;
+#endif
+#if TS_HAS_LZMA
+    case CACHE_COMPRESSION_LIBLZMA: l = len; break;
+#endif
+  }
+  // the data is usually in the first block, otherwise gather it
+  char *raw = vc->blocks->start() + vc->offset, *tmp = 0;
+  if (vc->blocks->end() - raw < (int64_t)len) {
+    raw = tmp = (char*)xmalloc(len);
+    iobufferblock_memcpy(raw, len, vc->blocks, vc->offset);
+  }
+  // the uncompressed length goes in front of the data, see Doc::raw_data_len
+  char *buf = (char*)xmalloc(l + sizeof(uint32_t)), *b = buf + sizeof(uint32_t);
+  *(uint32_t*)buf = len;
+  bool failed = false;
+  switch (ctype) {
+    case CACHE_COMPRESSION_FASTLZ:
+      if ((l = fastlz_compress(raw, len, b)) <= 0)
+        failed = true;
+      break;
+#if TS_HAS_LIBZ
+    case CACHE_COMPRESSION_LIBZ: {
+      uLongf ll = l;
+      if ((Z_OK != compress((Bytef*)b, &ll, (Bytef*)raw, len)))
+        failed = true;
+      l = (int)ll;
+      break;
+    }
+#endif
+#if TS_HAS_LZMA
+    case CACHE_COMPRESSION_LIBLZMA: {
+      size_t pos = 0, ll = l;
+      if (LZMA_OK != lzma_easy_buffer_encode(LZMA_PRESET_DEFAULT, LZMA_CHECK_NONE, NULL,
+                                             (uint8_t*)raw, len, (uint8_t*)b, &pos, ll))
+        failed = true;
+      l = (int)pos;
+      break;
+    }
+#endif
+  }
+  if (tmp)
+    xfree(tmp);
+  if (failed || l > REQUIRED_COMPRESSION * len) {
+    vc->f.compress = 0;
+    xfree(buf);
+    return;
+  }
+  vc->compressed_buf = new_xmalloc_IOBufferData(buf, l + sizeof(uint32_t));
+  vc->compressed_buf->_mem_type = DEFAULT_ALLOC;
+  vc->compressed_len = l + sizeof(uint32_t);
+  vc->compressed_type = ctype;
+  CACHE_SUM_DYN_STAT_THREAD(cache_compress_bytes_in_stat, len);
+  CACHE_SUM_DYN_STAT_THREAD(cache_compress_bytes_out_stat, l);
+  DDebug("cache_compress", "compressed %X fragment %d: %d -> %d", vc->key.word(0), vc->fragment, len, l);
+}
+
 EvacuationBlock *
 Vol::force_evacuate_head(Dir *evac_dir, int pinned)
 {
@@ -318,6 +473,8 @@ Vol::aggWriteDone(int event, Event *e)
     eventProcessor.schedule_in(this, HRTIME_MSECONDS(cache_config_mutex_retry_delay));
     return EVENT_CONT;
   }
+  agg_write_time = ink_get_hrtime_internal();
+  agg_write_latency += (agg_write_time - io.queue_time - agg_write_latency) / 8;
   if (io.ok()) {
     header->last_write_pos = header->write_pos;
     header->write_pos += io.aiocb.aio_nbytes;
@@ -489,7 +646,7 @@ CacheVC::evacuateDocDone(int event, Event *e)
           dir_lookaside_probe(&evac->earliest_key, vol, &dir_tmp, &eblock);
           if (eblock) {
             CacheVC *earliest_evac = eblock->earliest_evacuator;
-            earliest_evac->total_len += doc->data_len();
+            earliest_evac->total_len += doc->raw_data_len();
             if (earliest_evac->total_len == earliest_evac->doc_len) {
               dir_lookaside_fixup(&evac->earliest_key, vol);
               free_CacheVC(earliest_evac);
@@ -527,7 +684,7 @@ CacheVC::evacuateDocDone(int event, Event *e)
           DDebug("cache_evac", "evacuating earliest: %X %d", (int) doc->key.word(0), (int) dir_offset(&overwrite_dir));
           ink_debug_assert(dir_compare_tag(&overwrite_dir, &doc->key));
           ink_assert(b->earliest_evacuator == this);
-          total_len += doc->data_len();
+          total_len += doc->raw_data_len();
           first_key = doc->first_key;
           earliest_dir = dir;
           if (dir_probe(&first_key, vol, &dir, &last_collision) > 0) {
@@ -547,6 +704,103 @@ CacheVC::evacuateDocDone(int event, Event *e)
   return free_CacheVC(this);
 }
 
+// Tiered storage. Count reads of single fragment documents from a slow
+// tier volume; once a document has been read cache_config_tier_promote_hits
+// times it is copied into the fast tier volume for its key. The copy goes
+// through the aggregation buffer like an evacuated document and is entered
+// in the fast tier directory by tierPromoteDone. Counters are halved every
+// TIER_HIT_TABLE_SIZE reads so that only recent reads count.
+void
+tier_read_hit(CacheVC *c)
+{
+  Vol *vol = c->vol;
+  ProxyMutex *mutex = c->mutex;
+  ink_debug_assert(vol->mutex->thread_holding == this_ethread());
+
+  if (!cache_config_tier_promote_hits)
+    return;
+#ifdef HTTP_CACHE
+  // other alternates would have to be copied too
+  if (c->frag_type == CACHE_FRAG_TYPE_HTTP && c->vector.count() != 1)
+    return;
+#endif
+  if (++vol->tier_hits_count >= TIER_HIT_TABLE_SIZE) {
+    for (int i = 0; i < TIER_HIT_TABLE_SIZE; i++)
+      vol->tier_hits[i] >>= 1;
+    vol->tier_hits_count = 0;
+  }
+  uint8_t *hits = &vol->tier_hits[c->first_key.word(3) % TIER_HIT_TABLE_SIZE];
+  if (*hits < 255)
+    (*hits)++;
+  if (*hits < cache_config_tier_promote_hits)
+    return;
+  *hits = 0;
+
+  Vol *fast = vol->cache->key_to_fast_vol(&c->first_key);
+  if (!fast)
+    return;
+  Doc *doc = (Doc *) c->first_buf->data();
+  Dir dir, *last_collision = NULL;
+  CACHE_TRY_LOCK(lock, fast->mutex, mutex->thread_holding);
+  if (!lock || fast->agg_todo_size > cache_config_agg_write_backlog ||
+      dir_probe(&c->first_key, fast, &dir, &last_collision))
+    return;
+
+  CacheVC *p = new_CacheVC(fast);
+  p->base_stat = cache_tier_promote_active_stat;
+  {
+    Vol *vol = fast;
+    CACHE_INCREMENT_DYN_STAT(p->base_stat + CACHE_STAT_ACTIVE);
+  }
+  p->buf = new_IOBufferData(iobuffer_size_to_index(doc->len, MAX_BUFFER_SIZE_INDEX), MEMALIGNED);
+  memcpy(p->buf->data(), doc, doc->len);
+  p->vol = fast;
+  p->slow_vol = vol;
+  p->f.evacuator = 1;
+  p->first_key = p->key = c->first_key;
+  p->earliest_key = zero_key;
+  // agg_copy takes the directory entry of the copy from overwrite_dir
+  p->first_dir = p->overwrite_dir = c->dir;
+  dir_set_pinned(&p->overwrite_dir, 0);
+  p->agg_len = fast->round_to_approx_size(doc->len);
+  SET_CONTINUATION_HANDLER(p, &CacheVC::tierPromoteDone);
+  Debug("cache_tier", "promoting %X to fast tier, len %d", c->first_key.word(0), doc->len);
+  fast->agg_todo_size += p->agg_len;
+  fast->agg.enqueue(p);
+  if (!fast->is_io_in_progress())
+    fast->aggWrite(EVENT_NONE, 0);
+}
+
+// The copy is in the fast tier aggregation buffer. Enter it in the
+// directory unless the slow tier document changed in the meantime.
+int
+CacheVC::tierPromoteDone(int event, Event *e)
+{
+  NOWARN_UNUSED(e);
+  NOWARN_UNUSED(event);
+
+  ink_debug_assert(vol->mutex->thread_holding == this_ethread());
+  Doc *doc = (Doc *) buf->data();
+  if (dir_offset(&dir)) {
+    CACHE_TRY_LOCK(lock, slow_vol->mutex, mutex->thread_holding);
+    if (lock && !slow_vol->open_read(&first_key)) {
+      Dir slow_dir, *last_collision = NULL;
+      while (dir_probe(&first_key, slow_vol, &slow_dir, &last_collision)) {
+        if (dir_offset(&slow_dir) == dir_offset(&first_dir)) {
+          dir_insert(&first_key, vol, &dir);
+          CACHE_SUM_DYN_STAT(cache_tier_promote_bytes_stat, doc->len);
+          closed = 1;
+          break;
+        }
+      }
+    }
+  }
+  Debug("cache_tier", "promotion of %X %s", first_key.word(0), closed > 0 ? "done" : "dropped");
+  if (closed <= 0)
+    CACHE_INCREMENT_DYN_STAT(base_stat + CACHE_STAT_FAILURE);
+  return free_CacheVC(this);
+}
+
 static int
 evacuate_fragments(CacheKey *key, CacheKey *earliest_key, int force, Vol *vol)
 {
@@ -745,7 +999,8 @@ agg_copy(char *p, CacheVC *vc)
     Doc *doc = (Doc *) p;
     IOBufferBlock *res_alt_blk = 0;
 
-    uint32_t len = vc->write_len + vc->header_len + vc->frag_len + sizeofDoc;
+    uint32_t data_len = vc->compressed_buf ? vc->compressed_len : vc->write_len;
+    uint32_t len = data_len + vc->header_len + vc->frag_len + sizeofDoc;
     ink_assert(vc->frag_type != CACHE_FRAG_TYPE_HTTP || len != sizeofDoc);
     ink_debug_assert(vol->round_to_approx_size(len) == vc->agg_len);
     // update copy of directory entry for this document
@@ -761,10 +1016,12 @@ agg_copy(char *p, CacheVC *vc)
     doc->ftype = vc->frag_type;
     doc->flen = vc->frag_len;
     doc->total_len = vc->total_len;
-    doc->first_key = vc->first_key;
+    // a shared body is its own head, see CacheVC::openWriteDedup
+    doc->first_key = vc->f.dedup_body ? vc->key : vc->first_key;
     doc->sync_serial = vol->header->sync_serial;
     vc->write_serial = doc->write_serial = vol->header->write_serial;
     doc->checksum = DOC_NO_CHECKSUM;
+    doc->compression = vc->compressed_buf ? vc->compressed_type : CACHE_COMPRESSION_NONE;
     if (vc->pin_in_cache) {
       dir_set_pinned(&vc->dir, 1);
       doc->pinned = (uint32_t) (ink_get_based_hrtime() / HRTIME_SECOND) + vc->pin_in_cache;
@@ -821,7 +1078,7 @@ agg_copy(char *p, CacheVC *vc)
         memcpy(doc->hdr(), vc->header_to_write, vc->header_len);
       // the single fragment flag is not used in the write call.
       // putting it in for completeness.
-      vc->f.single_fragment = doc->single_fragment();
+      vc->f.single_fragment = doc->total_len && vc->write_len == doc->total_len;
     }
     // move data
     if (vc->write_len) {
@@ -835,6 +1092,10 @@ agg_copy(char *p, CacheVC *vc)
         iobufferblock_memcpy(doc->data(), vc->write_len, res_alt_blk, 0);
       else
 #endif
+      if (vc->compressed_buf) {
+        memcpy(doc->data(), vc->compressed_buf->data(), vc->compressed_len);
+        vc->compressed_buf.clear();
+      } else
         iobufferblock_memcpy(doc->data(), vc->write_len, vc->blocks, vc->offset);
 #ifdef VERIFY_JTEST_DATA
       if (f.use_first_key && header_len) {
@@ -973,6 +1234,25 @@ Vol::aggWrite(int event, void *e)
 
   cancel_trigger();
 
+  // the disk is out of service, fail the writers instead of writing to it
+  // (a last write for a directory sync already under way still goes).
+  // Evacuators are left queued, there is nothing to move their documents to.
+  if (DISK_BAD(disk) && !dir_sync_waiting) {
+    for (c = (CacheVC *) agg.head; c;) {
+      CacheVC *n = (CacheVC *) c->link.next;
+      if (!c->f.evacuator) {
+        agg.remove(c);
+        agg_todo_size -= c->agg_len;
+        c->io.aio_result = AIO_SOFT_FAILURE;
+        c->initial_thread->schedule_imm_signal(c, AIO_EVENT_DONE);
+      }
+      c = n;
+    }
+    while ((c = sync.dequeue()))
+      c->initial_thread->schedule_imm_signal(c, AIO_EVENT_DONE);
+    return EVENT_CONT;
+  }
+
 Lagain:
   // calculate length of aggregated write
   for (c = (CacheVC *) agg.head; c;) {
@@ -1192,8 +1472,18 @@ CacheVC::openWriteCloseHead(int event, Event *e)
     write_len = 0;
   else
     write_len = length;
+  compress_fragment(this);
 #ifdef HTTP_CACHE
   if (frag_type == CACHE_FRAG_TYPE_HTTP) {
+    if (cache_config_dedup && !fragment && !f.update && alternate.valid() && write_len &&
+        write_len >= (uint32_t) cache_config_dedup_min_size) {
+      // the content key is only taken as the object key by openWriteDedup
+      dedup_key(&key, blocks, offset, write_len);
+      buf.clear();
+      last_collision = NULL;
+      SET_HANDLER(&CacheVC::openWriteDedup);
+      return openWriteDedup(EVENT_IMMEDIATE, 0);
+    }
     SET_HANDLER(&CacheVC::updateVector);
     return updateVector(EVENT_IMMEDIATE, 0);
   } else {
@@ -1206,12 +1496,121 @@ CacheVC::openWriteCloseHead(int event, Event *e)
 #endif
 }
 
+#ifdef HTTP_CACHE
+/*
+  Deduplication of single fragment bodies.
+
+  The body is stored by itself under a key derived from its content
+  (earliest_key, which is also the alternate's object key) and the
+  vector is written without data. Another URL with the same body finds
+  the body under that key, checks that it has the same bytes and only
+  writes its vector. Another alternate of the same URL keeps its body
+  with its vector, as alternates are told apart by their object key. A shared body
+  has its own key as first_key, so evacuation treats it as a head and
+  just moves its directory entry. There is no reference count: once the
+  body is overwritten readers fail to find the earliest fragment and
+  drop the alternate from their vector, as for any other lost fragment,
+  and the next write of the body stores it again.
+*/
 int
-CacheVC::openWriteCloseDataDone(int event, Event *e)
+CacheVC::openWriteDedup(int event, Event *e)
 {
   NOWARN_UNUSED(e);
   int ret = 0;
 
+  cancel_trigger();
+  if (event == AIO_EVENT_DONE)
+    set_io_not_in_progress();
+  else if (is_io_in_progress())
+    return EVENT_CONT;
+  // a candidate read back: compare before taking the lock
+  bool found = false, same = false;
+  if (buf) {
+    Doc *doc = (Doc *) buf->data();
+    found = io.ok() && doc->magic == DOC_MAGIC && doc->key == key && !doc->hlen;
+    same = found && doc->data_len() == write_len && iobufferblock_equal(blocks, offset, doc->data(), write_len);
+  }
+  {
+    CACHE_TRY_LOCK(lock, vol->mutex, mutex->thread_holding);
+    if (!lock)
+      VC_SCHED_LOCK_RETRY();
+    if (!(earliest_key == key)) {
+      if (dedup_key_in_use(this, &key)) {
+        key = earliest_key;
+        SET_HANDLER(&CacheVC::updateVector);
+        ret = EVENT_RETURN;
+        goto Lcall;
+      }
+      earliest_key = key;
+      alternate.object_key_set(earliest_key);
+    }
+    if (buf) {
+      buf.clear();
+      if (found && dir_valid(vol, &dir)) {
+        // already stored, write only the vector. A body with the same
+        // key but other bytes is a digest collision: keep this one with
+        // the vector rather than store a second body under the key.
+        if (same) {
+          DDebug("cache_dedup", "body %X of %X shared, %d bytes", key.word(0), first_key.word(0), write_len);
+          CACHE_INCREMENT_DYN_STAT(cache_dedup_hit_stat);
+          CACHE_SUM_DYN_STAT(cache_dedup_bytes_saved_stat, write_len);
+          write_len = 0;
+        }
+        SET_HANDLER(&CacheVC::updateVector);
+        ret = EVENT_RETURN;
+        goto Lcall;
+      }
+    }
+    if (dir_probe(&key, vol, &dir, &last_collision)) {
+      ret = do_read_call(&key);
+      goto Lcall;
+    }
+    f.use_first_key = 0;
+    f.dedup_body = 1;
+    header_len = 0;
+    SET_HANDLER(&CacheVC::openWriteDedupDone);
+    ret = do_write_call();
+  }
+Lcall:
+  if (ret == EVENT_RETURN)
+    return handleEvent(AIO_EVENT_DONE, 0);
+  return ret;
+}
+
+int
+CacheVC::openWriteDedupDone(int event, Event *e)
+{
+  NOWARN_UNUSED(e);
+
+  cancel_trigger();
+  if (event == AIO_EVENT_DONE)
+    set_io_not_in_progress();
+  else if (is_io_in_progress())
+    return EVENT_CONT;
+  {
+    CACHE_TRY_LOCK(lock, vol->mutex, mutex->thread_holding);
+    if (!lock)
+      VC_SCHED_LOCK_RETRY();
+    f.dedup_body = 0;
+    f.use_first_key = 1;
+    // if the body could not be written, keep it with the vector
+    if (io.ok()) {
+      dir_insert(&key, vol, &dir);
+      DDebug("cache_dedup", "body %X of %X stored, %d bytes", key.word(0), first_key.word(0), write_len);
+      CACHE_INCREMENT_DYN_STAT(cache_dedup_body_write_stat);
+      write_len = 0;
+    }
+  }
+  SET_HANDLER(&CacheVC::updateVector);
+  return updateVector(EVENT_IMMEDIATE, 0);
+}
+#endif
+
+int
+CacheVC::openWriteCloseDataDone(int event, Event *e)
+{
+  NOWARN_UNUSED(e);
+
   if (event == AIO_EVENT_DONE)
     set_io_not_in_progress();
   else if (is_io_in_progress())
@@ -1244,19 +1643,16 @@ CacheVC::openWriteCloseDataDone(int event, Event *e)
     dir_insert(&key, vol, &dir);
     blocks = iobufferblock_skip(blocks, &offset, &length, write_len);
     next_CacheKey(&key, &key);
-    if (length) {
-      write_len = length;
-      if (write_len > MAX_FRAG_SIZE)
-        write_len = MAX_FRAG_SIZE;
-      if ((ret = do_write_call()) == EVENT_RETURN)
-        goto Lcallreturn;
-      return ret;
+    if (!length) {
+      f.data_done = 1;
+      return openWriteCloseHead(event, e); // must be called under vol lock from here
     }
-    f.data_done = 1;
-    return openWriteCloseHead(event, e); // must be called under vol lock from here
   }
-Lcallreturn:
-  return handleEvent(AIO_EVENT_DONE, 0);
+  write_len = length;
+  if (write_len > MAX_FRAG_SIZE)
+    write_len = MAX_FRAG_SIZE;
+  compress_fragment(this);
+  return do_write_lock_call();
 }
 
 int
@@ -1291,6 +1687,7 @@ CacheVC::openWriteClose(int event, Event *e)
       write_len = length;
       if (write_len > MAX_FRAG_SIZE)
         write_len = MAX_FRAG_SIZE;
+      compress_fragment(this);
       return do_write_lock_call();
     } else
       return openWriteCloseHead(event, e);
@@ -1347,6 +1744,9 @@ CacheVC::openWriteWriteDone(int event, Event *e)
     DDebug("cache_insert", "WriteDone: %X, %X, %d", key.word(0), first_key.word(0), write_len);
     blocks = iobufferblock_skip(blocks, &offset, &length, write_len);
     next_CacheKey(&key, &key);
+    // readers parked on this object can now see the new fragment
+    if (od)
+      vol->open_dir.wake_readers(od, mutex->thread_holding);
   }
   if (closed)
     return die();
@@ -1426,6 +1826,7 @@ Lagain:
     return openWriteClose(EVENT_NONE, NULL);
   }
   SET_HANDLER(&CacheVC::openWriteWriteDone);
+  compress_fragment(this);
   return do_write_lock_call();
 }
 
@@ -1473,6 +1874,46 @@ Lcallreturn:
 }
 
 #ifdef HTTP_CACHE
+// Write admission: a write of a document without a directory entry counts
+// as a request for its key in a two row count-min sketch, and the write
+// only goes ahead once the key has been requested admission_hits times.
+// The counters are halved every admission window so old requests fade out.
+// Called with the volume locked.
+static bool
+cache_write_admitted(CacheVC *c)
+{
+  int hits = c->admission_hits < 0 ? cache_config_admission_hits : c->admission_hits;
+  if (hits <= 1)
+    return true;
+  Vol *vol = c->vol;
+  ProxyMutex *mutex = c->mutex;
+  ink_hrtime now = ink_get_hrtime();
+  if (!vol->admit_sketch) {
+    vol->admit_sketch = (uint8_t *) xmalloc(2 * ADMIT_SKETCH_SIZE);
+    memset(vol->admit_sketch, 0, 2 * ADMIT_SKETCH_SIZE);
+    vol->admit_aging = now + HRTIME_SECONDS(cache_config_admission_window);
+  } else if (cache_config_admission_window > 0 && now >= vol->admit_aging) {
+    for (int i = 0; i < 2 * ADMIT_SKETCH_SIZE; i++)
+      vol->admit_sketch[i] >>= 1;
+    vol->admit_aging = now + HRTIME_SECONDS(cache_config_admission_window);
+  }
+  uint8_t *a = &vol->admit_sketch[c->first_key.word(0) % ADMIT_SKETCH_SIZE];
+  uint8_t *b = &vol->admit_sketch[ADMIT_SKETCH_SIZE + c->first_key.word(1) % ADMIT_SKETCH_SIZE];
+  // conservative update: only raise the counters to the new estimate
+  int n = *a < *b ? *a : *b;
+  if (n < 255) {
+    n++;
+    if (*a < n)
+      *a = n;
+    if (*b < n)
+      *b = n;
+  }
+  if (n >= hits)
+    return true;
+  CACHE_INCREMENT_DYN_STAT(cache_admission_skipped_stat);
+  return false;
+}
+
 // openWriteStartDone handles vector read (addition of alternates)
 // and lock misses
 int
@@ -1567,6 +2008,10 @@ Lcollision:
       // fail update because vector has been GC'd
       goto Lfailure;
     }
+    if (!cache_write_admitted(this)) {
+      err = ECACHE_NOT_ADMITTED;
+      goto Lreject;
+    }
   }
 Lsuccess:
   od->reading_vec = 0;
@@ -1577,6 +2022,7 @@ Lsuccess:
 
 Lfailure:
   CACHE_INCREMENT_DYN_STAT(base_stat + CACHE_STAT_FAILURE);
+Lreject:
   _action.continuation->handleEvent(CACHE_EVENT_OPEN_WRITE_FAILED, (void *) -err);
 Lcancel:
   if (od) {
@@ -1637,7 +2083,7 @@ Cache::open_write(Continuation *cont, CacheKey *key, CacheFragType frag_type,
   MUTEX_LOCK(lock, c->mutex, this_ethread());
   c->vio.op = VIO::WRITE;
   c->base_stat = cache_write_active_stat;
-  c->vol = key_to_vol(key, hostname, host_len);
+  c->vol = key_to_write_vol(key, hostname, host_len, mutex);
   Vol *vol = c->vol;
   CACHE_INCREMENT_DYN_STAT(c->base_stat + CACHE_STAT_ACTIVE);
   c->first_key = c->key = *key;
@@ -1690,7 +2136,7 @@ Cache::open_write(Continuation *cont, CacheKey *key, CacheFragType frag_type,
 // main entry point for writing of http documents
 Action *
 Cache::open_write(Continuation *cont, CacheKey *key, CacheHTTPInfo *info, time_t apin_in_cache,
-                  CacheKey *key1, CacheFragType type, char *hostname, int host_len)
+                  CacheKey *key1, CacheFragType type, char *hostname, int host_len, int admission_hits)
 {
   NOWARN_UNUSED(key1);
 
@@ -1719,7 +2165,7 @@ Cache::open_write(Continuation *cont, CacheKey *key, CacheHTTPInfo *info, time_t
   while (DIR_MASK_TAG(c->key.word(2)) == DIR_MASK_TAG(c->first_key.word(2)));
   c->earliest_key = c->key;
   c->frag_type = CACHE_FRAG_TYPE_HTTP;
-  c->vol = key_to_vol(key, hostname, host_len);
+  c->vol = key_to_write_vol(key, hostname, host_len, mutex);
   Vol *vol = c->vol;
   c->info = info;
   if (c->info && (uintptr_t) info != CACHE_ALLOW_MULTIPLE_WRITES) {
@@ -1762,6 +2208,7 @@ Cache::open_write(Continuation *cont, CacheKey *key, CacheHTTPInfo *info, time_t
     c->base_stat = cache_write_active_stat;
   CACHE_INCREMENT_DYN_STAT(c->base_stat + CACHE_STAT_ACTIVE);
   c->pin_in_cache = (uint32_t) apin_in_cache;
+  c->admission_hits = admission_hits;
 
   {
     CACHE_TRY_LOCK(lock, c->vol->mutex, cont->mutex->thread_holding);
@@ -1782,6 +2229,10 @@ Cache::open_write(Continuation *cont, CacheKey *key, CacheHTTPInfo *info, time_t
           goto Lfailure;
         }
         // document doesn't exist, begin write
+        if (!cache_write_admitted(c)) {
+          err = ECACHE_NOT_ADMITTED;
+          goto Lreject;
+        }
         goto Lmiss;
       } else {
         c->od->reading_vec = 1;
@@ -1807,6 +2258,7 @@ Lmiss:
 
 Lfailure:
   CACHE_INCREMENT_DYN_STAT(c->base_stat + CACHE_STAT_FAILURE);
+Lreject:
   cont->handleEvent(CACHE_EVENT_OPEN_WRITE_FAILED, (void *) -err);
   if (c->od) {
     c->openWriteCloseDir(EVENT_IMMEDIATE, 0);
@@ -114,11 +114,14 @@ struct CacheProcessor:public Processor
                            CacheLookupHttpConfig *params, CacheFragType frag_type = CACHE_FRAG_TYPE_HTTP);
   Action *open_write(Continuation *cont, int expected_size, URL *url,
                      CacheHTTPHdr *request, CacheHTTPInfo *old_info,
-                     time_t pin_in_cache = (time_t) 0, CacheFragType frag_type = CACHE_FRAG_TYPE_HTTP);
+                     time_t pin_in_cache = (time_t) 0, CacheFragType frag_type = CACHE_FRAG_TYPE_HTTP,
+                     int admission_hits = -1);
   Action *open_write_buffer(Continuation *cont, MIOBuffer *buf, URL *url,
                             CacheHTTPHdr *request, CacheHTTPHdr *response,
                             CacheFragType frag_type = CACHE_FRAG_TYPE_HTTP);
   Action *remove(Continuation *cont, URL *url, CacheFragType frag_type = CACHE_FRAG_TYPE_HTTP);
+  Action *purge(Continuation *cont, CachePurgeMatch match, const char *pattern,
+                int KB_per_second = SCAN_KB_PER_SECOND);
 
   Action *open_read_internal(int, Continuation *, MIOBuffer *, CacheURL *,
                              CacheHTTPHdr *, CacheLookupHttpConfig *,
@@ -133,6 +136,10 @@ struct CacheProcessor:public Processor
 
   static unsigned int IsCacheReady(CacheFragType type);
 
+  // Bring a storage span into the running cache, or take one out of it.
+  int add_disk(const char *path, int64_t size = 0, int tier = STORE_TIER_SLOW);
+  int remove_disk(const char *path);
+
   // private members
   void diskInitialized();
 
@@ -171,6 +178,8 @@ struct CacheVConnection:public VConnection
 #endif
 
   virtual bool is_ram_cache_hit() = 0;
+  virtual bool is_pread_capable() = 0;
+  virtual bool is_read_from_writer() = 0;
   virtual bool set_disk_io_priority(int priority) = 0;
   virtual int get_disk_io_priority() = 0;
   virtual bool set_pin_in_cache(time_t t) = 0;
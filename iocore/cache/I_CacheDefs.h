@@ -33,8 +33,8 @@
 #define CACHE_ALT_INDEX_DEFAULT     -1
 #define CACHE_ALT_REMOVED           -2
 
-#define CACHE_DB_MAJOR_VERSION      21
-#define CACHE_DB_MINOR_VERSION      0
+#define CACHE_DB_MAJOR_VERSION      22    // 22: alternates record an invalidation generation
+#define CACHE_DB_MINOR_VERSION      2     // 2: Doc data may be compressed, 1: header records url_hash_method
 
 #define CACHE_DIR_MAJOR_VERSION     18
 #define CACHE_DIR_MINOR_VERSION     0
@@ -102,6 +102,13 @@ enum CacheScanResult
   CACHE_SCAN_RESULT_RETRY
 };
 
+enum CachePurgeMatch
+{
+  CACHE_PURGE_URL_PREFIX,
+  CACHE_PURGE_URL_REGEX,
+  CACHE_PURGE_HOST
+};
+
 enum CacheDataType
 {
   CACHE_DATA_SIZE = VCONNECTION_CACHE_DATA_BASE,
@@ -37,6 +37,10 @@
 #define STORE_BLOCK_SHIFT      13
 #define DEFAULT_HW_SECTOR_SIZE 512
 
+// storage tiers, see "tier=" in storage.config
+#define STORE_TIER_SLOW        0
+#define STORE_TIER_FAST        1
+
 //
 // A Store is a place to store data.
 // Those on the same disk should be in a linked list.
@@ -51,6 +55,7 @@ struct Span
   int64_t offset;                 // used only if (file == true)
   int alignment;
   int disk_id;
+  int tier;                     // STORE_TIER_SLOW or STORE_TIER_FAST
   LINK(Span, link);
 
 private:
@@ -94,7 +99,7 @@ public:
            char *buf, int buflen);      // where to store the path
 
 Span():pathname(NULL), blocks(0), hw_sector_size(DEFAULT_HW_SECTOR_SIZE), file_pathname(false),
-       isRaw(true), offset(0), alignment(0), disk_id(0), is_mmapable_internal(false) {
+       isRaw(true), offset(0), alignment(0), disk_id(0), tier(STORE_TIER_SLOW), is_mmapable_internal(false) {
   }
   ~Span();
 };
@@ -223,7 +223,7 @@ LINK_FORWARD_DECLARATION(CacheVC, opendir_link) // forward declaration
 struct OpenDirEntry
 {
   DLL<CacheVC, Link_CacheVC_opendir_link> writers;       // list of all the current writers
-  DLL<CacheVC, Link_CacheVC_opendir_link> readers;         // list of all the current readers - not used
+  DLL<CacheVC, Link_CacheVC_opendir_link> readers;         // readers waiting for a writer to make progress
   CacheHTTPInfoVector vector;   // Vector for the http document. Each writer
                                 // maintains a pointer to this vector and
                                 // writes it down to disk.
@@ -257,6 +257,8 @@ struct OpenDir: public Continuation
   int close_write(CacheVC *c);
   OpenDirEntry *open_read(INK_MD5 *key);
   int signal_readers(int event, Event *e);
+  void wake_readers(OpenDirEntry *od, EThread *t);
+  void cancel_wait(CacheVC *c);
 
   OpenDir();
 };
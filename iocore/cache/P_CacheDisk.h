@@ -103,12 +103,16 @@ struct CacheDisk: public Continuation
   DiskVol *free_blocks;
   int num_errors;
   int cleared;
+  int tier;                     // STORE_TIER_SLOW or STORE_TIER_FAST
+  Continuation *open_cont;      // called back instead of the processor for a disk added at run time
+  int quiescing;                // the volumes of an offline disk may still be writing to it
 
   CacheDisk()
     : Continuation(new_ProxyMutex()), header(NULL),
       path(NULL), header_len(0), len(0), start(0), skip(0),
       num_usable_blocks(0), fd(-1), free_space(0), wasted_space(0),
-      disk_vols(NULL), free_blocks(NULL), num_errors(0), cleared(0)
+      disk_vols(NULL), free_blocks(NULL), num_errors(0), cleared(0), tier(STORE_TIER_SLOW),
+      open_cont(NULL), quiescing(0)
   { }
 
    ~CacheDisk();
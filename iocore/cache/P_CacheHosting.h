@@ -45,6 +45,8 @@ struct CacheHostRecord
       xfree(vols);
     if (vol_hash_table)
       xfree(vol_hash_table);
+    if (fast_vol_hash_table)
+      xfree(fast_vol_hash_table);
     if (cp)
       xfree(cp);
   }
@@ -55,12 +57,13 @@ struct CacheHostRecord
   volatile int num_vols;
   int num_initialized;
   unsigned short *vol_hash_table;
+  unsigned short *fast_vol_hash_table;  // fast tier volumes, if tiered
   CacheVol **cp;
   int num_cachevols;
 
   CacheHostRecord():
     type(0), vols(NULL), good_num_vols(0), num_vols(0),
-    num_initialized(0), vol_hash_table(0), cp(NULL), num_cachevols(0)
+    num_initialized(0), vol_hash_table(0), fast_vol_hash_table(0), cp(NULL), num_cachevols(0)
   { }
 
 };
@@ -153,7 +156,7 @@ struct CacheHostTableConfig: public Continuation
     (void) e;
     (void) event;
     CacheHostTable *t = NEW(new CacheHostTable((*ppt)->cache, (*ppt)->type));
-    CacheHostTable *old = (CacheHostTable *) ink_atomic_swap_ptr(&t, ppt);
+    CacheHostTable *old = (CacheHostTable *) ink_atomic_swap_ptr(ppt, t);
     new_Deleter(old, CACHE_MEM_FREE_TIMEOUT);
     return EVENT_DONE;
   }
@@ -60,6 +60,9 @@ struct EvacuationBlock;
 #define AIO_SOFT_FAILURE                -100000
 // retry read from writer delay
 #define WRITER_RETRY_DELAY  HRTIME_MSECONDS(50)
+// longest a reader parked on a writer sleeps before rechecking it; the
+// writer normally wakes it well before this
+#define WRITER_WAIT_TIMEOUT_MSEC  1000
 
 #define CACHE_READY(_x) (CacheProcessor::cache_ready & (1 << (_x)))
 
@@ -152,12 +155,29 @@ enum
   cache_three_plus_plus_fragment_document_count_stat,
   cache_read_busy_success_stat,
   cache_read_busy_failure_stat,
+  cache_read_seek_bytes_stat,
+  cache_read_seek_disk_bytes_stat,
   cache_gc_bytes_evacuated_stat,
   cache_gc_frags_evacuated_stat,
   cache_write_bytes_stat,
   cache_hdr_vector_marshal_stat,
   cache_hdr_marshal_stat,
   cache_hdr_marshal_bytes_stat,
+  cache_tier_fast_read_success_stat,
+  cache_tier_slow_read_success_stat,
+  cache_tier_fast_read_fallback_stat,
+  cache_tier_promote_active_stat,
+  cache_tier_promote_success_stat,
+  cache_tier_promote_failure_stat,
+  cache_tier_promote_bytes_stat,
+  cache_tier_evict_stat,
+  cache_admission_skipped_stat,
+  cache_compress_bytes_in_stat,
+  cache_compress_bytes_out_stat,
+  cache_dedup_hit_stat,
+  cache_dedup_body_write_stat,
+  cache_dedup_bytes_saved_stat,
+  cache_write_balance_stat,
   cache_stat_count
 };
 
@@ -227,6 +247,15 @@ extern int cache_config_hit_evacuate_percent;
 extern int cache_config_hit_evacuate_size_limit;
 #endif
 extern int cache_config_force_sector_size;
+extern int cache_config_tier_promote_hits;
+extern int cache_config_admission_hits;
+extern int cache_config_admission_window;
+extern int cache_config_compress;
+extern int cache_config_dedup;
+extern int cache_config_dedup_min_size;
+extern int cache_config_write_balance;
+extern int cache_config_write_balance_latency;
+extern int cache_config_write_balance_queue;
 extern int cache_config_target_fragment_size;
 extern int cache_config_mutex_retry_delay;
 
@@ -249,6 +278,14 @@ struct CacheVC: public CacheVConnection
     ink_assert(vio.op == VIO::READ);
     return !f.not_from_ram_cache;
   }
+  bool is_pread_capable()
+  {
+    return !f.read_from_writer_called;
+  }
+  bool is_read_from_writer()
+  {
+    return f.read_from_writer_called;
+  }
   int get_header(void **ptr, int *len)
   {
     if (first_buf.m_ptr) {
@@ -310,6 +347,8 @@ struct CacheVC: public CacheVConnection
   int openWriteCloseDir(int event, Event *e);
   int openWriteCloseHeadDone(int event, Event *e);
   int openWriteCloseHead(int event, Event *e);
+  int openWriteDedup(int event, Event *e);
+  int openWriteDedupDone(int event, Event *e);
   int openWriteCloseDataDone(int event, Event *e);
   int openWriteClose(int event, Event *e);
   int openWriteRemoveVector(int event, Event *e);
@@ -348,6 +387,7 @@ struct CacheVC: public CacheVConnection
   }
   int evacuateDocDone(int event, Event *e);
   int evacuateReadHead(int event, Event *e);
+  int tierPromoteDone(int event, Event *e);
 
   void cancel_trigger();
   virtual int64_t get_object_size();
@@ -393,6 +433,7 @@ struct CacheVC: public CacheVConnection
   Ptr<IOBufferData> first_buf;
   Ptr<IOBufferBlock> blocks; // data available to write
   Ptr<IOBufferBlock> writer_buf;
+  Ptr<IOBufferData> compressed_buf; // compressed write_len bytes of data for agg_copy
 
   OpenDirEntry *od;
   AIOCallbackInternal io;
@@ -421,16 +462,20 @@ struct CacheVC: public CacheVConnection
   int header_len;       // for communicating with agg_copy
   int frag_len;         // for communicating with agg_copy
   uint32_t write_len;     // for communicating with agg_copy
+  uint32_t compressed_len; // length of compressed_buf, for communicating with agg_copy
+  int compressed_type;  // CACHE_COMPRESSION_XX of compressed_buf, for communicating with agg_copy
   uint32_t agg_len;       // for communicating with aggWrite
   uint32_t write_serial;  // serial of the final write for SYNC
   Frag *frag;           // arraylist of fragment offset
   Frag integral_frags[INTEGRAL_FRAGS];
   Vol *vol;
+  Vol *slow_vol;        // tiered storage: slow tier vol behind a fast tier read or copy
   Dir *last_collision;
   Event *trigger;
   CacheKey *read_key;
   ContinuationHandler save_handler;
   uint32_t pin_in_cache;
+  int admission_hits;   // requests a new document needs before it is written, < 0 for the default
   ink_hrtime start_time;
   int base_stat;
   int recursive;
@@ -469,13 +514,16 @@ struct CacheVC: public CacheVConnection
       unsigned int update:1;
       unsigned int remove:1;
       unsigned int remove_aborted_writers:1;
-      unsigned int open_read_timeout:1; // UNUSED
+      unsigned int open_read_timeout:1; // waiting on OpenDirEntry::readers
       unsigned int data_done:1;
       unsigned int read_from_writer_called:1;
       unsigned int not_from_ram_cache:1;        // entire object was from ram cache
       unsigned int rewrite_resident_alt:1;
       unsigned int readers:1;
       unsigned int doc_from_ram_cache:1;
+      unsigned int pread:1;     // positioned with do_io_pread
+      unsigned int compress:1;  // try to compress the data written
+      unsigned int dedup_body:1; // writing a body under its content key
 #ifdef HIT_EVACUATE
       unsigned int hit_evacuate:1;
 #endif
@@ -521,6 +569,9 @@ int cache_write(CacheVC *, CacheHTTPInfoVector *);
 int get_alternate_index(CacheHTTPInfoVector *cache_vector, CacheKey key);
 #endif
 CacheVC *new_DocEvacuator(int nbytes, Vol *d);
+void tier_read_hit(CacheVC *c);
+void tier_evict(CacheVC *c);
+bool tier_copy_valid(CacheKey *key, Vol *vol, Dir *dir);
 
 // inline Functions
 
@@ -591,6 +642,7 @@ free_CacheVC(CacheVC *cont)
   cont->first_buf.clear();
   cont->blocks.clear();
   cont->writer_buf.clear();
+  cont->compressed_buf.clear();
   cont->alternate_index = CACHE_ALT_INDEX_DEFAULT;
   if (cont->frag && cont->frag != cont->integral_frags)
     xfree(cont->frag);
@@ -748,6 +800,9 @@ Vol::close_write(CacheVC *cont)
   stat_cache_vcs.remove(cont, cont->stat_link);
   ink_assert(!cont->stat_link.next && !cont->stat_link.prev);
 #endif
+  // a rewritten or removed document must not be read from the fast tier
+  if (tier_hits)
+    tier_evict(cont);
   return open_dir.close_write(cont);
 }
 
@@ -979,10 +1034,11 @@ struct Cache
   Action *open_write(Continuation *cont, CacheKey *key,
                      CacheHTTPInfo *old_info, time_t pin_in_cache = (time_t) 0,
                      CacheKey *key1 = NULL,
-                     CacheFragType type = CACHE_FRAG_TYPE_HTTP, char *hostname = 0, int host_len = 0);
+                     CacheFragType type = CACHE_FRAG_TYPE_HTTP, char *hostname = 0, int host_len = 0,
+                     int admission_hits = -1);
   Action *open_write(Continuation *cont, URL *url, CacheHTTPHdr *request,
                      CacheHTTPInfo *old_info, time_t pin_in_cache = (time_t) 0,
-                     CacheFragType type = CACHE_FRAG_TYPE_HTTP);
+                     CacheFragType type = CACHE_FRAG_TYPE_HTTP, int admission_hits = -1);
   static void generate_key(INK_MD5 *md5, URL *url, CacheHTTPHdr *request);
 #endif
 
@@ -994,6 +1050,10 @@ struct Cache
   int open_done();
 
   Vol *key_to_vol(CacheKey *key, char *hostname, int host_len);
+  Vol *key_to_fast_vol(CacheKey *key);
+  Vol *key_to_alt_vol(CacheKey *key, char *hostname, int host_len);
+  Vol *key_to_read_vol(CacheKey *key, char *hostname, int host_len, EThread *t);
+  Vol *key_to_write_vol(CacheKey *key, char *hostname, int host_len, ProxyMutex *mutex);
 
   Cache()
     : cache_read_done(0), total_good_nvol(0), total_nvol(0), ready(CACHE_INITIALIZING), cache_size(0),  // in store block size
@@ -1065,7 +1125,7 @@ Cache::generate_key(INK_MD5 *md5, URL *url, CacheHTTPHdr *request)
 
 TS_INLINE Action *
 Cache::open_write(Continuation *cont, CacheURL *url, CacheHTTPHdr *request,
-                  CacheHTTPInfo *old_info, time_t pin_in_cache, CacheFragType type)
+                  CacheHTTPInfo *old_info, time_t pin_in_cache, CacheFragType type, int admission_hits)
 {
   (void) request;
   INK_MD5 url_md5;
@@ -1073,7 +1133,7 @@ Cache::open_write(Continuation *cont, CacheURL *url, CacheHTTPHdr *request,
   int len;
   const char *hostname = url->host_get(&len);
 
-  return open_write(cont, &url_md5, old_info, pin_in_cache, NULL, type, (char *) hostname, len);
+  return open_write(cont, &url_md5, old_info, pin_in_cache, NULL, type, (char *) hostname, len, admission_hits);
 }
 #endif
 
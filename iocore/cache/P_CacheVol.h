@@ -54,6 +54,8 @@
 #define AIO_AGG_WRITE_IN_PROGRESS       -1
 #define AUTO_SIZE_RAM_CACHE             -1      // 1-1 with directory size
 #define DEFAULT_TARGET_FRAGMENT_SIZE    (1048576 - sizeofDoc) // 1MB
+#define TIER_HIT_TABLE_SIZE             16384   // promotion hit counters per slow tier vol
+#define ADMIT_SKETCH_SIZE               65536   // write admission counters per sketch row
 
 
 #define dir_offset_evac_bucket(_o) \
@@ -92,7 +94,7 @@ struct VolHeaderFooter
   uint32_t write_serial;
   uint32_t dirty;
   uint32_t sector_size;
-  uint32_t unused;                // pad out to 8 byte boundary
+  uint32_t url_hash_method;       // url_hash_method the keys were made with (minor version >= 1)
   uint16_t freelist[1];
 };
 
@@ -183,6 +185,21 @@ struct Vol: public Continuation
   int64_t first_fragment_offset;
   Ptr<IOBufferData> first_fragment_data;
 
+  // tiered storage, slow tier volumes only: read counts by key
+  uint8_t *tier_hits;
+  int tier_hits_count;
+  // fast tier volumes only: keys tier_evict could not evict yet
+  InkAtomicList tier_evict_pending;
+
+  // write admission: request counts of new documents, allocated on first use
+  uint8_t *admit_sketch;
+  ink_hrtime admit_aging;
+
+  // write balancing: moving average of aggregation write times, and when
+  // the last one completed
+  ink_hrtime agg_write_latency;
+  ink_hrtime agg_write_time;
+
   void cancel_trigger();
 
   int open_write(CacheVC *cont, int allow_if_writers, int max_writers);
@@ -253,8 +270,10 @@ struct Vol: public Continuation
       dir(0), buckets(0), recover_pos(0), prev_recover_pos(0), scan_pos(0), skip(0), start(0),
       len(0), data_blocks(0), hit_evacuate_window(0), agg_todo_size(0), agg_buf_pos(0), trigger(0),
       evacuate_size(0), disk(NULL), last_sync_serial(0), last_write_serial(0), recover_wrapped(false),
-      dir_sync_waiting(0), dir_sync_in_progress(0), writing_end_marker(0) {
+      dir_sync_waiting(0), dir_sync_in_progress(0), writing_end_marker(0), tier_hits(NULL), tier_hits_count(0),
+      admit_sketch(NULL), admit_aging(0), agg_write_latency(0), agg_write_time(0) {
     open_dir.mutex = mutex;
+    ink_atomiclist_init(&tier_evict_pending, "tier_evict_pending", offsetof(EvacuationKey, link.next));
 #if defined(_WIN32)
     agg_buffer = (char *) malloc(AGG_SIZE);
 #else
@@ -310,7 +329,8 @@ struct Doc
   INK_MD5 first_key;    // first key in document (http: vector)
   INK_MD5 key;
   uint32_t hlen;          // header length
-  uint32_t ftype:8;       // fragment type CACHE_FRAG_TYPE_XX
+  uint32_t ftype:4;       // fragment type CACHE_FRAG_TYPE_XX
+  uint32_t compression:4; // CACHE_COMPRESSION_XX of the data, 0 (none) in older documents
   uint32_t flen:24;       // fragment table length
   uint32_t sync_serial;
   uint32_t write_serial;
@@ -318,6 +338,7 @@ struct Doc
   uint32_t checksum;
 
   uint32_t data_len();
+  uint32_t raw_data_len();
   uint32_t prefix_len();
   int single_fragment();
   int no_data_in_fragment();
@@ -430,10 +451,17 @@ Doc::data_len()
   return len - sizeofDoc - hlen - flen;
 }
 
+// compressed data is preceded by its uncompressed length
+TS_INLINE uint32_t
+Doc::raw_data_len()
+{
+  return compression ? *(uint32_t *) data() : data_len();
+}
+
 TS_INLINE int
 Doc::single_fragment()
 {
-  return (total_len && (data_len() == total_len));
+  return (total_len && (raw_data_len() == total_len));
 }
 
 TS_INLINE uint32_t
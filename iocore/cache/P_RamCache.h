@@ -35,6 +35,8 @@ struct RamCache {
   virtual int fixup(INK_MD5 *key, uint32_t old_auxkey1, uint32_t old_auxkey2, uint32_t new_auxkey1, uint32_t new_auxkey2) = 0;
 
   virtual void init(int64_t max_bytes, Vol *vol) = 0;
+  // drops every entry and caches nothing from then on
+  virtual void clear() = 0;
   virtual ~RamCache() {};
 };
 
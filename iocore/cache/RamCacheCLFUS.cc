@@ -77,6 +77,7 @@ struct RamCacheCLFUS : public RamCache {
   int fixup(INK_MD5 *key, uint32_t old_auxkey1, uint32_t old_auxkey2, uint32_t new_auxkey1, uint32_t new_auxkey2);
 
   void init(int64_t max_bytes, Vol *vol);
+  void clear();
 
   // private
   Vol *vol; // for stats
@@ -138,6 +139,19 @@ void RamCacheCLFUS::init(int64_t abytes, Vol *avol) {
   resize_hashtable();
 }
 
+void RamCacheCLFUS::clear() {
+  max_bytes = 0;
+  while (lru[0].head)
+    destroy(lru[0].head);
+  while (lru[1].head)
+    destroy(lru[1].head);
+  xfree(bucket);
+  bucket = 0;
+  nbuckets = 0;
+  xfree(seen);
+  seen = 0;
+}
+
 #ifdef CHECK_ACOUNTING
 static void check_accounting(RamCacheCLFUS *c) {
   int64_t x = 0, xsize = 0, h = 0;
@@ -43,6 +43,7 @@ struct RamCacheLRU: public RamCache {
   int fixup(INK_MD5 *key, uint32_t old_auxkey1, uint32_t old_auxkey2, uint32_t new_auxkey1, uint32_t new_auxkey2);
 
   void init(int64_t max_bytes, Vol *vol);
+  void clear();
 
   // private
   uint16_t *seen;
@@ -98,6 +99,18 @@ RamCacheLRU::init(int64_t abytes, Vol *avol) {
   resize_hashtable();
 }
 
+void
+RamCacheLRU::clear() {
+  max_bytes = 0;
+  while (lru.head)
+    remove(lru.head);
+  xfree(bucket);
+  bucket = 0;
+  nbuckets = 0;
+  xfree(seen);
+  seen = 0;
+}
+
 int
 RamCacheLRU::get(INK_MD5 * key, Ptr<IOBufferData> *ret_data, uint32_t auxkey1, uint32_t auxkey2) {
   if (!max_bytes)
@@ -101,7 +101,7 @@ Store::sort()
     for (Span * sd = vec[i]; sd; sd = vec[i]) {
       vec[i] = vec[i]->link.next;
       for (int d = 0; d < n; d++) {
-        if (sd->disk_id == disk[d]->disk_id) {
+        if (sd->disk_id == disk[d]->disk_id && sd->tier == disk[d]->tier) {
           sd->link.next = disk[d];
           disk[d] = sd;
           goto Ldone;
@@ -298,13 +298,28 @@ Store::read_config(int fd)
     int len = e ? e - n : strlen(n);
     (void) len;
     int64_t size = -1;
-    while (e && *e && !ParseRules::is_digit(*e))
-      e++;
-    if (e && *e) {
-      if ((size = ink_atoi64(e)) <= 0) {
-        err = "error parsing size";
-        goto Lfail;
+    int tier = STORE_TIER_SLOW;
+    // the size and "tier=fast|slow" may follow the pathname in either order
+    while (e && *e) {
+      e += strspn(e, " \t\n");
+      if (!strncasecmp(e, "tier=", 5)) {
+        if (!strncasecmp(e + 5, "fast", 4))
+          tier = STORE_TIER_FAST;
+        else if (!strncasecmp(e + 5, "slow", 4))
+          tier = STORE_TIER_SLOW;
+        else {
+          err = "error parsing tier";
+          goto Lfail;
+        }
+      } else if (size < 0) {
+        while (*e && !ParseRules::is_digit(*e))
+          e++;
+        if (*e && (size = ink_atoi64(e)) <= 0) {
+          err = "error parsing size";
+          goto Lfail;
+        }
       }
+      e = strpbrk(e, " \t\n");
     }
 
     n[len] = 0;
@@ -321,6 +336,7 @@ Store::read_config(int fd)
       continue;
     }
     xfree(pp);
+    ns->tier = tier;
     n_dsstore++;
 
     // new Span
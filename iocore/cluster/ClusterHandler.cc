@@ -143,6 +143,7 @@ ClusterHandler::ClusterHandler()
     ifd(-1),
     active(false),
     on_stolen_thread(false),
+    vc_wakeup_pending(false),
     n_channels(0),
     channels(NULL),
     channel_data(NULL),
@@ -2099,6 +2100,15 @@ retry:
     lock.have_lock = false;
     return 1;
   } else {
+    //
+    // Write deferred until the write_list fills.  While the producer
+    // keeps supplying data, visit the VC every period rather than
+    // once per bucket rotation so the write_list fills at its pace.
+    //
+    if (ClusterVCWakeupEnabled && vc->write_list && s->enabled) {
+      cluster_set_priority(this, s, 1); // next bucket
+      cluster_reschedule(this, vc, s);
+    }
     return 0;
   }
 }
@@ -2418,6 +2428,8 @@ ClusterHandler::mainClusterEvent(int event, Event * e)
 {
   // Set global time
   current_time = ink_get_hrtime();
+  // this pass services the VCs moved to the current bucket
+  vc_wakeup_pending = false;
 
   if (CacheClusterMonitorEnabled) {
     if ((current_time - last_trace_dump) > HRTIME_SECONDS(CacheClusterMonitorIntervalSecs)) {
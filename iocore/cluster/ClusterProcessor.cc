@@ -381,6 +381,7 @@ int cluster_receive_buffer_size = 0;
 unsigned long cluster_sockopt_flags = 0;
 
 int RPC_only_CacheCluster = 0;
+int ClusterVCWakeupEnabled = 0;
 #endif
 
 int
@@ -677,6 +678,7 @@ ClusterProcessor::init()
   IOCORE_ReadConfigInteger(cluster_send_buffer_size, "proxy.config.cluster.send_buffer_size");
   IOCORE_ReadConfigInteger(cluster_sockopt_flags, "proxy.config.cluster.sock_option_flag");
   IOCORE_EstablishStaticConfigInt32(RPC_only_CacheCluster, "proxy.config.cluster.rpc_cache_cluster");
+  IOCORE_EstablishStaticConfigInt32(ClusterVCWakeupEnabled, "proxy.config.cluster.enable_vc_wakeup");
 
   int cluster_type = 0;
   IOCORE_ReadConfigInteger(cluster_type, "proxy.local.cluster.type");
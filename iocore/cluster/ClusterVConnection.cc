@@ -254,6 +254,69 @@ ClusterVConnection::do_io_close(int alerrno)
   ClusterVConnectionBase::do_io_close(alerrno);
 }
 
+VIO *
+ClusterVConnection::do_io_read(Continuation * acont, int64_t anbytes, MIOBuffer * abuffer)
+{
+  VIO *vio = ClusterVConnectionBase::do_io_read(acont, anbytes, abuffer);
+  schedule_now(&read);
+  return vio;
+}
+
+VIO *
+ClusterVConnection::do_io_write(Continuation * acont, int64_t anbytes, IOBufferReader * abuffer, bool owner)
+{
+  VIO *vio = ClusterVConnectionBase::do_io_write(acont, anbytes, abuffer, owner);
+  schedule_now(&write);
+  return vio;
+}
+
+void
+ClusterVConnection::reenable(VIO * vio)
+{
+  ClusterVConnectionBase::reenable(vio);
+  schedule_now((vio == &read.vio) ? &read : &write);
+}
+
+void
+ClusterVConnection::schedule_now(ClusterVConnState * s)
+{
+  //
+  // A VC enabled by its user waits in its bucket for the ClusterHandler
+  // to come around, up to a full bucket rotation for a VC that drifted
+  // to low priority while disabled.  With proxy.config.cluster.enable_vc_wakeup
+  // set, move the VC to the current bucket and, like
+  // ClusterState::IOComplete(), run the handler once immediate i/o
+  // completion events are allowed.  Only one such run is outstanding
+  // per handler pass, however often users reenable.
+  // A missed lock leaves the VC where it is.  A lock this thread already
+  // held means the user reenabled from within the handler, which is
+  // walking the bucket queues and will get to the VC itself.
+  //
+  ClusterHandler *ch = machine ? machine->clusterHandler : NULL;
+  if (!ClusterVCWakeupEnabled || !ch)
+    return;
+  MUTEX_TRY_LOCK(lock, ch->mutex, this_ethread());
+  if (!lock || ch->mutex->nthread_holding > 1)
+    return;
+  if (!s->queue || closed ||
+      channel <= 0 || channel >= ch->n_channels || ch->channels[channel] != this)
+    return;
+  if (!((s == &read) ? ch->read.do_iodone_event : ch->write.do_iodone_event))
+    return;
+  cluster_set_priority(ch, s, 1);
+  if (s == &read) {
+    ClusterVC_remove_read(this);
+    ClusterVC_enqueue_read(ch->read_vcs[ch->cur_vcs], this);
+  } else {
+    ClusterVC_remove_write(this);
+    ClusterVC_enqueue_write(ch->write_vcs[ch->cur_vcs], this);
+  }
+  if (!ch->vc_wakeup_pending) {
+    ch->vc_wakeup_pending = true;
+    eventProcessor.schedule_imm(ch, ET_CLUSTER);
+  }
+}
+
 int
 ClusterVConnection::startEvent(int event, Event * e)
 {
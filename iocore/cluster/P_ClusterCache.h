@@ -513,7 +513,10 @@ struct ClusterVConnection: public ClusterVConnectionBase
   ~ClusterVConnection();
   void free();                  // Destructor actions (we are using ClassAllocator)
 
+  virtual VIO *do_io_read(Continuation * c, int64_t nbytes, MIOBuffer * buf);
+  virtual VIO *do_io_write(Continuation * c, int64_t nbytes, IOBufferReader * buf, bool owner = false);
   virtual void do_io_close(int lerrno = -1);
+  virtual void reenable(VIO *);
 
   ClusterMachine *machine;
   //
@@ -540,6 +543,7 @@ struct ClusterVConnection: public ClusterVConnectionBase
   int was_remote_closed();
   void allow_remote_close();
   bool schedule_write();
+  void schedule_now(ClusterVConnState *);
   void set_type(int);
   ink_hrtime start_time;
   ink_hrtime last_activity_time;
@@ -593,6 +597,14 @@ struct ClusterVConnection: public ClusterVConnectionBase
   {
     return 0;
   }
+  bool is_pread_capable()
+  {
+    return false;
+  }
+  bool is_read_from_writer()
+  {
+    return false;
+  }
   virtual int get_header(void **ptr, int *len);
   virtual int set_header(void *ptr, int len);
   virtual int get_single_data(void **ptr, int *len);
@@ -433,6 +433,7 @@ struct ClusterHandler:public ClusterHandlerBase
 
   int32_t active;                 // handler currently running
   bool on_stolen_thread;
+  bool vc_wakeup_pending;       // a user enable has scheduled the handler
 
   struct ChannelData
   {
@@ -95,6 +95,9 @@ public:
   //   the IOBufferBlock is not fill()'ed until I/O actually occurs.  This
   //   kind of implies that you can only have one outstanding I/O per
   //   IOBufferBlock
+  // * For recvfrom_re with useReadCont false, a read that would block
+  //   returns ACTION_IO_ERROR without calling back; the caller is
+  //   expected to retry from its own periodic handler.
   // Callback:
   // * callback signature is: handleEvent(int event,CompletionEvent *cevent);
   //   where event is one of:
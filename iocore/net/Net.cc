@@ -124,6 +124,38 @@ register_net_stats()
   NET_CLEAR_DYN_STAT(socks_connections_currently_open_stat);
 #endif
 
+  RecRegisterRawStat(net_rsb, RECT_PROCESS,
+                     "proxy.process.ssl.session_cache.hits",
+                     RECD_INT, RECP_NULL, (int) ssl_session_cache_hit_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS,
+                     "proxy.process.ssl.session_cache.misses",
+                     RECD_INT, RECP_NULL, (int) ssl_session_cache_miss_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS,
+                     "proxy.process.ssl.session_cache.inserts",
+                     RECD_INT, RECP_NULL, (int) ssl_session_cache_insert_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS,
+                     "proxy.process.ssl.session_cache.evictions",
+                     RECD_INT, RECP_NULL, (int) ssl_session_cache_eviction_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS,
+                     "proxy.process.ssl.session_ticket.key_matches",
+                     RECD_INT, RECP_NULL, (int) ssl_session_ticket_key_match_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS,
+                     "proxy.process.ssl.session_ticket.key_misses",
+                     RECD_INT, RECP_NULL, (int) ssl_session_ticket_key_miss_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS,
+                     "proxy.process.ssl.ctx_cache.loads",
+                     RECD_INT, RECP_NULL, (int) ssl_ctx_load_stat, RecRawStatSyncSum);
+
+  RecRegisterRawStat(net_rsb, RECT_PROCESS,
+                     "proxy.process.ssl.ctx_cache.evictions",
+                     RECD_INT, RECP_NULL, (int) ssl_ctx_eviction_stat, RecRawStatSyncSum);
+
 }
 
 void
@@ -55,6 +55,14 @@ enum Net_Stats
   socks_connections_successful_stat,
   socks_connections_unsuccessful_stat,
   socks_connections_currently_open_stat,
+  ssl_session_cache_hit_stat,
+  ssl_session_cache_miss_stat,
+  ssl_session_cache_insert_stat,
+  ssl_session_cache_eviction_stat,
+  ssl_session_ticket_key_match_stat,
+  ssl_session_ticket_key_miss_stat,
+  ssl_ctx_load_stat,
+  ssl_ctx_eviction_stat,
   Net_Stat_Count
 };
 
@@ -114,6 +122,7 @@ do { \
 #include "P_SSLNetProcessor.h"
 #include "P_SSLNetAccept.h"
 #include "P_SSLCertLookup.h"
+#include "P_SSLSessionCache.h"
 
 #undef  NET_SYSTEM_MODULE_VERSION
 #define NET_SYSTEM_MODULE_VERSION makeModuleVersion(                    \
@@ -28,20 +28,93 @@
 
 #define PATH_NAME_MAX         511
 
+/**
+  A certificate from ssl_multicert.config selected by server name.
+  The SSL_CTX is only built the first time a handshake asks for it,
+  and may be dropped again when the context cache is over its limit.
+ */
+struct SSLCertEntry
+{
+  char *cert;
+  char *key;
+  SSL_CTX *ctx;
+  bool failed;                  // loading failed, don't retry on every handshake
+  LINK(SSLCertEntry, link);
+
+  SSLCertEntry(char *a_cert, char *a_key)
+    : cert(a_cert), key(a_key), ctx(NULL), failed(false)
+  { }
+  ~SSLCertEntry();
+};
+
+/**
+  Index of server names, exact and wildcard, over reversed labels.
+
+  Names are inserted as a trie keyed by label from the right, so
+  "www.example.com" is stored under com -> example -> www and the
+  wildcard "*.example.com" is attached to the example.com node. Once
+  all names are in, compile() lays the trie out as one flat array with
+  the children of every node contiguous and sorted, so a lookup is one
+  binary search per label and no allocation.
+ */
+class SSLNameIndex
+{
+public:
+  SSLNameIndex();
+  ~SSLNameIndex();
+
+  /// Add @a name (optionally "*.domain") mapping to @a value. Returns false on a malformed name.
+  bool insert(const char *name, int value);
+  void compile();
+  /// Returns the value for the best match of @a name, exact before wildcard, or -1.
+  int find(const char *name) const;
+
+private:
+  struct BuildNode;
+  struct Node
+  {
+    int label;                  // offset into labels
+    int label_len;
+    int exact;
+    int wildcard;
+    int first_child;
+    int nchildren;
+  };
+
+  BuildNode *build_child(Vec<BuildNode *> &children, const char *label, int len);
+  const Node *find_child(const Node * parent, const char *label, int len) const;
+
+  Vec<BuildNode *> build_roots;
+  Vec<Node> nodes;
+  Vec<char> labels;
+  int nroots;
+};
+
 class SSLCertLookup
 {
   bool buildTable();
-  const char *extractIPAndCert(matcher_line * line_info, char **addr, char **cert, char **priKey);
+  const char *extractIPAndCert(matcher_line * line_info, char **addr, char **cert, char **priKey, char **names);
   int addInfoToHash(char *strAddr, char *cert, char *serverPrivateKey);
+  int addInfoToNameIndex(char *names, char *cert, char *serverPrivateKey);
+  SSL_CTX *loadEntry(SSLCertEntry * entry);
 
   InkHashTable *SSLCertLookupHashTable;
   char config_file_path[PATH_NAME_MAX];
   SslConfigParams *param;
 
+  SSLNameIndex nameIndex;
+  Vec<SSLCertEntry *> entries;
+  Que(SSLCertEntry, link) lru;  // loaded entries, least recently used first
+  int loaded;
+  ink_mutex lru_mutex;
+
 public:
     bool multipleCerts;
+  bool hasServerNames;
   void init(SslConfigParams * param);
   SSL_CTX *findInfoInHash(char *strAddr);
+  /// Switch @a ssl to the context for @a servername, returns false if no certificate matches.
+  bool selectInfoForName(SSL * ssl, const char *servername);
     SSLCertLookup();
    ~SSLCertLookup();
 };
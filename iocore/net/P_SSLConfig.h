@@ -78,7 +78,8 @@ public:
   enum SSL_SESSION_CACHE_MODE
   {
     SSL_SESSION_CACHE_MODE_OFF = 0,
-    SSL_SESSION_CACHE_MODE_SERVER = 1
+    SSL_SESSION_CACHE_MODE_SERVER = 1,
+    SSL_SESSION_CACHE_MODE_SHARED = 2
   };
 
   SSL_TERMINATION_MODE getTerminationMode(void) const { return termMode; }
@@ -86,6 +87,7 @@ public:
   char *getConfigFilePath(void) const { return configFilePath; }
   char *getServerCertPathOnly(void) const { return serverCertPathOnly; }
   char *getServerKeyPathOnly(void) const { return serverKeyPathOnly; }
+  int getCtxCacheSize(void) const { return ssl_ctx_cache_size; }
 
   SslConfigParams();
   virtual ~SslConfigParams();
@@ -112,6 +114,11 @@ private:
   int sslAccelerator;
   int ssl_session_cache;
   int ssl_session_cache_size;
+  int ssl_session_cache_num_stripes;
+  char *sessionCachePath;
+  char *ticketKeyPath;
+  int ticket_key_reload_interval;
+  int ssl_ctx_cache_size;
 
   char *clientCertPath;
   char *clientKeyPath;
@@ -127,6 +134,7 @@ private:
 
   friend struct SSLNetProcessor;
   friend class SslConfig;
+  friend void ssl_session_cache_init(SslConfigParams *);
 };
 
 /////////////////////////////////////////////////////////////
@@ -0,0 +1,144 @@
+/** @file
+
+  Shared, persistent SSL session cache and session ticket keys.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#ifndef __P_SSLSESSIONCACHE_H__
+#define __P_SSLSESSIONCACHE_H__
+
+#include "libts.h"
+#include <openssl/ssl.h>
+
+struct SslConfigParams;
+
+#define SSL_SESSION_CACHE_MAGIC        0x53534c43      // 'SSLC'
+#define SSL_SESSION_CACHE_VERSION      1
+#define SSL_SESSION_CACHE_MAX_DATA     1024            // largest DER encoded session stored
+#define SSL_SESSION_CACHE_PROBE        8               // slots probed per lookup inside a stripe
+
+/**
+  One cached session. Slots are fixed size so the whole store is a
+  flat array that can live in a memory mapped file. A slot is free
+  when @c id_len is zero; writers clear @c id_len first and set it
+  last so a torn write after a crash is seen as a free slot.
+ */
+struct SSLSessionSlot
+{
+  uint32_t hash;
+  uint32_t expire;              // absolute wall clock time, seconds
+  uint16_t id_len;
+  uint16_t data_len;
+  unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+  unsigned char data[SSL_SESSION_CACHE_MAX_DATA];
+};
+
+/**
+  A stripe is a lock plus a run of slots. Sessions are assigned to a
+  stripe by their id hash, so concurrent handshakes contend only when
+  they land on the same stripe.
+ */
+struct SSLSessionStripe
+{
+  ink_mutex lock;
+  uint32_t nslots;
+  uint32_t pad;
+};
+
+struct SSLSessionCacheHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t nstripes;
+  uint32_t nslots;              // per stripe
+  uint32_t slot_size;
+  uint32_t stripe_size;
+};
+
+/**
+  Lock-striped session store backed by a shared file mapping.
+
+  The store is installed on every server SSL_CTX through the OpenSSL
+  external cache callbacks, so a session negotiated on one certificate
+  context can be resumed on any other and, since the mapping is a file,
+  after traffic_server restarts. Any process mapping the same file
+  shares the cache; the stripe locks are process shared.
+ */
+class SSLSessionCache
+{
+public:
+  SSLSessionCache();
+  ~SSLSessionCache();
+
+  /// Map @a path holding roughly @a nsessions entries split over @a nstripes locks.
+  bool attach(const char *path, int nsessions, int nstripes);
+  void detach();
+  bool is_attached() const { return header != NULL; }
+
+  /// Install the external cache callbacks on @a ctx.
+  void configure(SSL_CTX * ctx);
+
+  bool insert(const unsigned char *id, int id_len, const unsigned char *data, int data_len, uint32_t expire);
+  /// Copy the session for @a id into @a buf, returns the data length or 0 on miss.
+  int lookup(const unsigned char *id, int id_len, unsigned char *buf, int buf_len);
+  void remove(const unsigned char *id, int id_len);
+
+private:
+  SSLSessionStripe *stripe_for(uint32_t hash) const;
+  SSLSessionSlot *slot_at(SSLSessionStripe * stripe, uint32_t i) const;
+
+  SSLSessionCacheHeader *header;
+  char *base;
+  size_t size;
+  int fd;
+};
+
+/**
+  RFC 5077 session ticket key. The on disk format is the raw
+  concatenation of 48 byte keys: name, HMAC secret, AES key. The first
+  key in the file encrypts new tickets, the rest are only accepted for
+  decryption so that tickets issued before a rotation stay valid.
+ */
+struct SSLTicketKey
+{
+  unsigned char name[16];
+  unsigned char hmac_secret[16];
+  unsigned char aes_key[16];
+};
+
+struct SSLTicketKeyBlock
+{
+  unsigned num_keys;
+  time_t mtime;
+  SSLTicketKey keys[1];         // actually num_keys long
+};
+
+SSLTicketKeyBlock *ssl_ticket_key_block_read(const char *path);
+void ssl_ticket_key_block_free(SSLTicketKeyBlock * block);
+
+/// Install the ticket key callback on @a ctx if a key file is configured.
+void ssl_ticket_keys_configure(SSL_CTX * ctx);
+
+/// Load the session cache and ticket keys named in @a params, once per process.
+void ssl_session_cache_init(SslConfigParams * params);
+
+extern SSLSessionCache sslSessionCache;
+
+#endif
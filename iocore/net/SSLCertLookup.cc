@@ -31,17 +31,222 @@ SSLCertLookup sslCertLookup;
 #define SSL_IP_TAG "dest_ip"
 #define SSL_CERT_TAG "ssl_cert_name"
 #define SSL_PRIVATE_KEY_TAG "ssl_key_name"
+#define SSL_SERVER_NAME_TAG "ssl_server_name"
 const char *moduleName = "SSLCertLookup";
 
 const matcher_tags sslCertTags = {
-  NULL, NULL, SSL_IP_TAG, NULL, NULL, false
+  SSL_SERVER_NAME_TAG, NULL, SSL_IP_TAG, NULL, NULL, false
 };
 
+#define SSL_NAME_MAX 256
+
+struct SSLNameIndex::BuildNode
+{
+  char *label;
+  int len;
+  int exact;
+  int wildcard;
+  Vec<BuildNode *> children;
+
+  BuildNode(const char *l, int n)
+    : len(n), exact(-1), wildcard(-1)
+  {
+    label = (char *) xmalloc(n);
+    memcpy(label, l, n);
+  }
+  ~BuildNode()
+  {
+    xfree(label);
+    for (int i = 0; i < children.n; i++)
+      delete children[i];
+  }
+};
+
+static inline int
+ssl_label_cmp(const char *a, int alen, const char *b, int blen)
+{
+  int r = memcmp(a, b, alen < blen ? alen : blen);
+  return r ? r : alen - blen;
+}
+
+// Lower case @a name into @a buf without a trailing dot, returns the length or -1.
+static int
+ssl_normalize_name(const char *name, char *buf)
+{
+  int len = strlen(name);
+
+  if (len > 0 && name[len - 1] == '.')
+    len--;
+  if (len <= 0 || len >= SSL_NAME_MAX)
+    return -1;
+  for (int i = 0; i < len; i++)
+    buf[i] = ParseRules::ink_tolower(name[i]);
+  return len;
+}
+
+SSLNameIndex::SSLNameIndex()
+  : nroots(0)
+{
+}
+
+SSLNameIndex::~SSLNameIndex()
+{
+  for (int i = 0; i < build_roots.n; i++)
+    delete build_roots[i];
+}
+
+SSLNameIndex::BuildNode *
+SSLNameIndex::build_child(Vec<BuildNode *> &children, const char *label, int len)
+{
+  // Children are kept sorted while building so that a busy TLD with
+  // thousands of names does not make the build quadratic.
+  int lo = 0, hi = children.n;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    int r = ssl_label_cmp(children[mid]->label, children[mid]->len, label, len);
+    if (r == 0)
+      return children[mid];
+    if (r < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  BuildNode *node = NEW(new BuildNode(label, len));
+  children.insert(lo, node);
+  return node;
+}
+
+bool
+SSLNameIndex::insert(const char *name, int value)
+{
+  char buf[SSL_NAME_MAX];
+  int len = ssl_normalize_name(name, buf);
+  bool wildcard = false;
+  int start = 0;
+
+  if (len < 0)
+    return false;
+  if (len > 2 && buf[0] == '*' && buf[1] == '.') {
+    wildcard = true;
+    start = 2;
+  }
+
+  Vec<BuildNode *> *children = &build_roots;
+  BuildNode *node = NULL;
+  int end = len;
+  while (end > start) {
+    int dot = end - 1;
+    while (dot >= start && buf[dot] != '.')
+      dot--;
+    if (dot + 1 == end || memchr(buf + dot + 1, '*', end - dot - 1))
+      return false;             // empty label, or a wildcard not in the leftmost label
+    node = build_child(*children, buf + dot + 1, end - dot - 1);
+    children = &node->children;
+    end = dot;
+  }
+  if (!node)
+    return false;
+
+  // First entry in the config file wins, the same as for addresses.
+  int &slot = wildcard ? node->wildcard : node->exact;
+  if (slot < 0)
+    slot = value;
+  return true;
+}
+
+void
+SSLNameIndex::compile()
+{
+  // Breadth first so every node's children end up adjacent.
+  Vec<BuildNode *> order;
+
+  nodes.clear();
+  labels.clear();
+  nroots = build_roots.n;
+  for (int i = 0; i < build_roots.n; i++)
+    order.add(build_roots[i]);
+
+  for (int i = 0; i < order.n; i++) {
+    BuildNode *b = order[i];
+    Node &n = nodes.add();
+
+    n.label = labels.n;
+    n.label_len = b->len;
+    for (int j = 0; j < b->len; j++)
+      labels.add(b->label[j]);
+    n.exact = b->exact;
+    n.wildcard = b->wildcard;
+    n.first_child = order.n;
+    n.nchildren = b->children.n;
+    for (int j = 0; j < b->children.n; j++)
+      order.add(b->children[j]);
+  }
+
+  for (int i = 0; i < build_roots.n; i++)
+    delete build_roots[i];
+  build_roots.clear();
+}
+
+const SSLNameIndex::Node *
+SSLNameIndex::find_child(const Node * parent, const char *label, int len) const
+{
+  int lo = parent ? parent->first_child : 0;
+  int hi = lo + (parent ? parent->nchildren : nroots);
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    const Node & n = nodes[mid];
+    int r = ssl_label_cmp(&labels[n.label], n.label_len, label, len);
+    if (r == 0)
+      return &n;
+    if (r < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return NULL;
+}
+
+int
+SSLNameIndex::find(const char *name) const
+{
+  char buf[SSL_NAME_MAX];
+  int len = ssl_normalize_name(name, buf);
+  const Node *node = NULL;
+  int wildcard = -1;
+
+  if (len < 0 || nodes.n == 0)
+    return -1;
+
+  int end = len;
+  while (end > 0) {
+    int dot = end - 1;
+    while (dot >= 0 && buf[dot] != '.')
+      dot--;
+    // A wildcard covers exactly one more label.
+    if (dot < 0 && node)
+      wildcard = node->wildcard;
+    if ((node = find_child(node, buf + dot + 1, end - dot - 1)) == NULL)
+      return wildcard;
+    end = dot;
+  }
+  return node->exact >= 0 ? node->exact : wildcard;
+}
+
+SSLCertEntry::~SSLCertEntry()
+{
+  if (ctx)
+    SSL_CTX_free(ctx);
+  xfree(cert);
+  xfree(key);
+}
+
 SSLCertLookup::SSLCertLookup():
-param(NULL), multipleCerts(false)
+param(NULL), loaded(0), multipleCerts(false), hasServerNames(false)
 {
   SSLCertLookupHashTable = ink_hash_table_create(InkHashTableKeyType_String);
   *config_file_path = '\0';
+  ink_mutex_init(&lru_mutex, "SSLCertLookup");
 }
 
 void
@@ -49,6 +254,9 @@ SSLCertLookup::init(SslConfigParams * p)
 {
   param = p;
   multipleCerts = buildTable();
+  nameIndex.compile();
+  if (hasServerNames)
+    Note("%s indexed %d server name certificates", moduleName, entries.n);
 }
 
 bool
@@ -64,6 +272,7 @@ SSLCertLookup::buildTable()
   char *addr = NULL;
   char *sslCert = NULL;
   char *priKey = NULL;
+  char *names = NULL;
   matcher_line line_info;
   bool alarmAlready = false;
   char *configFilePath = NULL;
@@ -101,9 +310,9 @@ SSLCertLookup::buildTable()
                      moduleName, configFilePath, line_num, errPtr);
         IOCORE_SignalError(errBuf, alarmAlready);
       } else {
-        ink_assert(line_info.type == MATCH_IP);
+        ink_assert(line_info.type == MATCH_IP || line_info.type == MATCH_HOST);
 
-        errPtr = extractIPAndCert(&line_info, &addr, &sslCert, &priKey);
+        errPtr = extractIPAndCert(&line_info, &addr, &sslCert, &priKey, &names);
 
         if (errPtr != NULL) {
           snprintf(errBuf, 1024, "%s discarding %s entry at line %d : %s",
@@ -113,13 +322,20 @@ SSLCertLookup::buildTable()
           if (addr != NULL && sslCert != NULL) {
             addInfoToHash(addr, sslCert, priKey);
             ret = 1;
+          } else if (names != NULL && sslCert != NULL) {
+            // The entry owns the cert and key strings from here on.
+            addInfoToNameIndex(names, sslCert, priKey);
+            sslCert = NULL;
+            priKey = NULL;
           }
           xfree(sslCert);
           xfree(priKey);
           xfree(addr);
+          xfree(names);
           addr = NULL;
           sslCert = NULL;
           priKey = NULL;
+          names = NULL;
         }
       }                         // else
     }                           // if(*line != '\0' && *line != '#')
@@ -143,7 +359,7 @@ SSLCertLookup::buildTable()
 }
 
 const char *
-SSLCertLookup::extractIPAndCert(matcher_line * line_info, char **addr, char **cert, char **priKey)
+SSLCertLookup::extractIPAndCert(matcher_line * line_info, char **addr, char **cert, char **priKey, char **names)
 {
 //  ip_addr_t testAddr;
   char *label;
@@ -168,6 +384,12 @@ SSLCertLookup::extractIPAndCert(matcher_line * line_info, char **addr, char **ce
       }
     }
 
+    if (strcasecmp(label, SSL_SERVER_NAME_TAG) == 0) {
+      if (value != NULL) {
+        *names = xstrdup(value);
+      }
+    }
+
     if (strcasecmp(label, SSL_CERT_TAG) == 0) {
       if (value != NULL) {
         int buf_len = sizeof(char) * (strlen(value) + 1);
@@ -216,6 +438,106 @@ SSLCertLookup::addInfoToHash(char *strAddr, char *cert, char *serverPrivateKey)
   return (true);
 }
 
+int
+SSLCertLookup::addInfoToNameIndex(char *names, char *cert, char *serverPrivateKey)
+{
+  // Only record the names here, the SSL_CTX is built on first use so that
+  // a large ssl_multicert.config does not make startup read every key.
+  SSLCertEntry *entry = NEW(new SSLCertEntry(cert, serverPrivateKey));
+  char *tok_state = NULL;
+  bool added = false;
+
+  for (char *name = ink_strtok_r(names, ",", &tok_state); name; name = ink_strtok_r(NULL, ",", &tok_state)) {
+    if (nameIndex.insert(name, entries.n))
+      added = true;
+    else
+      Warning("%s ignoring malformed server name '%s' for %s", moduleName, name, cert);
+  }
+  if (!added) {
+    delete entry;
+    return (false);
+  }
+  entries.add(entry);
+  hasServerNames = true;
+  return (true);
+}
+
+SSL_CTX *
+SSLCertLookup::loadEntry(SSLCertEntry * entry)
+{
+#if (OPENSSL_VERSION_NUMBER >= 0x10000000L) // openssl returns a const SSL_METHOD now
+  const SSL_METHOD *meth = NULL;
+#else
+  SSL_METHOD *meth = NULL;
+#endif
+  meth = SSLv23_server_method();
+  SSL_CTX *ctx = SSL_CTX_new(meth);
+  if (!ctx) {
+    ssl_NetProcessor.logSSLError("Cannot create new server contex.");
+    return NULL;
+  }
+  if (ssl_NetProcessor.initSSLServerCTX(param, ctx, entry->cert, entry->key, false) != 0) {
+    SSL_CTX_free(ctx);
+    return NULL;
+  }
+  NET_SUM_GLOBAL_DYN_STAT(ssl_ctx_load_stat, 1);
+  return ctx;
+}
+
+bool
+SSLCertLookup::selectInfoForName(SSL * ssl, const char *servername)
+{
+  int i = nameIndex.find(servername);
+  if (i < 0)
+    return false;
+
+  SSLCertEntry *entry = entries[i];
+  SSL_CTX *ctx = NULL;
+  bool selected = false;
+  int limit = param ? param->getCtxCacheSize() : 0;
+
+  // The certificate and key are read from disk without the lock so that a
+  // miss does not stall every other handshake. Two handshakes missing on
+  // the same name may both load it, the second one just drops its copy.
+  ink_mutex_acquire(&lru_mutex);
+  bool load = !entry->ctx && !entry->failed;
+  ink_mutex_release(&lru_mutex);
+  if (load)
+    ctx = loadEntry(entry);
+
+  // The context is attached to the SSL while the lock is held so that a
+  // concurrent eviction can't free it first; SSL_set_SSL_CTX takes a reference.
+  ink_mutex_acquire(&lru_mutex);
+  if (entry->ctx) {
+    lru.remove(entry);
+    lru.enqueue(entry);
+  } else if (ctx) {
+    Debug("ssl", "loaded certificate %s for server name %s", entry->cert, servername);
+    entry->ctx = ctx;
+    ctx = NULL;
+    lru.enqueue(entry);
+    loaded++;
+    while (limit > 0 && loaded > limit) {
+      SSLCertEntry *victim = lru.dequeue();
+      SSL_CTX_free(victim->ctx);
+      victim->ctx = NULL;
+      loaded--;
+      NET_SUM_GLOBAL_DYN_STAT(ssl_ctx_eviction_stat, 1);
+    }
+  } else if (load && !entry->failed) {
+    Error("%s unable to load certificate %s for server name %s", moduleName, entry->cert, servername);
+    entry->failed = true;
+  }
+  if (entry->ctx) {
+    SSL_set_SSL_CTX(ssl, entry->ctx);
+    selected = true;
+  }
+  ink_mutex_release(&lru_mutex);
+  if (ctx)
+    SSL_CTX_free(ctx);
+  return selected;
+}
+
 SSL_CTX *
 SSLCertLookup::findInfoInHash(char *strAddr)
 {
@@ -231,4 +553,75 @@ SSLCertLookup::findInfoInHash(char *strAddr)
 SSLCertLookup::~SSLCertLookup()
 {
   ink_hash_table_destroy_and_xfree_values(SSLCertLookupHashTable);
+  for (int i = 0; i < entries.n; i++)
+    delete entries[i];
+  ink_mutex_destroy(&lru_mutex);
 }
+
+#if TS_HAS_TESTS
+REGRESSION_TEST(SSLNameIndex) (RegressionTest * t, int atype, int *pstatus) {
+  NOWARN_UNUSED(atype);
+  static const struct
+  {
+    const char *name;
+    int value;
+  } names[] = {
+    { "www.example.com", 0 },
+    { "*.example.com", 1 },
+    { "example.com", 2 },
+    { "*.a.example.com", 3 },
+    { "WWW.Example.Org.", 4 },
+    { "*.example.com", 5 },     // duplicate, the first one wins
+    { "com", 6 },
+  };
+  static const char *bad[] = { "", ".", "a..com", "www.*.com", "w*w.example.com", "*", "*." };
+  static const struct
+  {
+    const char *name;
+    int value;
+  } lookups[] = {
+    { "www.example.com", 0 },
+    { "mail.example.com", 1 },
+    { "MAIL.EXAMPLE.COM.", 1 },
+    { "example.com", 2 },
+    { "a.example.com", 1 },
+    { "b.a.example.com", 3 },
+    { "c.b.a.example.com", -1 },  // a wildcard only covers one label
+    { "x.y.example.com", -1 },
+    { "www.example.org", 4 },
+    { "example.org", -1 },
+    { "com", 6 },
+    { "org", -1 },
+    { "net", -1 },
+    { "", -1 },
+  };
+  SSLNameIndex index;
+  unsigned i;
+
+  *pstatus = REGRESSION_TEST_PASSED;
+  if (index.find("www.example.com") != -1) {
+    rprintf(t, "empty index matched\n");
+    *pstatus = REGRESSION_TEST_FAILED;
+  }
+  for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (!index.insert(names[i].name, names[i].value)) {
+      rprintf(t, "insert '%s' failed\n", names[i].name);
+      *pstatus = REGRESSION_TEST_FAILED;
+    }
+  }
+  for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    if (index.insert(bad[i], 99)) {
+      rprintf(t, "malformed name '%s' accepted\n", bad[i]);
+      *pstatus = REGRESSION_TEST_FAILED;
+    }
+  }
+  index.compile();
+  for (i = 0; i < sizeof(lookups) / sizeof(lookups[0]); i++) {
+    int value = index.find(lookups[i].name);
+    if (value != lookups[i].value) {
+      rprintf(t, "find '%s' returned %d, expected %d\n", lookups[i].name, value, lookups[i].value);
+      *pstatus = REGRESSION_TEST_FAILED;
+    }
+  }
+}
+#endif
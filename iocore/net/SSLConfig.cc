@@ -53,6 +53,7 @@ SslConfigParams::SslConfigParams()
     CACertFilename = CACertPath =
     clientCertPath = clientKeyPath =
     clientCACertFilename = clientCACertPath =
+    sessionCachePath = ticketKeyPath =
     serverKeyPathOnly = ncipherAccelLibPath = cswiftAccelLibPath = atallaAccelLibPath = broadcomAccelLibPath = NULL;
 
   clientCertLevel = client_verify_depth = verify_depth = clientVerify = sslAccelerator = 0;
@@ -63,6 +64,9 @@ SslConfigParams::SslConfigParams()
   ssl_accelerator_required = SSL_ACCELERATOR_REQ_NO;
   ssl_session_cache = SSL_SESSION_CACHE_MODE_SERVER;
   ssl_session_cache_size = 1024*20;
+  ssl_session_cache_num_stripes = 256;
+  ticket_key_reload_interval = 60;
+  ssl_ctx_cache_size = 0;
 }
 
 SslConfigParams::~SslConfigParams()
@@ -137,6 +141,14 @@ SslConfigParams::cleanup()
     xfree(broadcomAccelLibPath);
     broadcomAccelLibPath = NULL;
   }
+  if (sessionCachePath) {
+    xfree(sessionCachePath);
+    sessionCachePath = NULL;
+  }
+  if (ticketKeyPath) {
+    xfree(ticketKeyPath);
+    ticketKeyPath = NULL;
+  }
 
   clientCertLevel = client_verify_depth = verify_depth = clientVerify = sslAccelerator = 0;
   ssl_accept_port_number = -1;
@@ -295,6 +307,8 @@ SslConfigParams::initialize()
     xfree(cert_chain);
   }
 
+  IOCORE_ReadConfigInteger(ssl_ctx_cache_size, "proxy.config.ssl.server.multicert.ctx_cache.size");
+
   IOCORE_ReadConfigStringAlloc(multicert_config_file, "proxy.config.ssl.server.multicert.filename");
   if (multicert_config_file != NULL) {
     configFilePath = Layout::relative_to(Layout::get()->sysconfdir, multicert_config_file);
@@ -370,6 +384,23 @@ SslConfigParams::initialize()
   // SSL session cache configurations
   IOCORE_ReadConfigInteger(ssl_session_cache, "proxy.config.ssl.session_cache");
   IOCORE_ReadConfigInteger(ssl_session_cache_size, "proxy.config.ssl.session_cache.size");
+  IOCORE_ReadConfigInteger(ssl_session_cache_num_stripes, "proxy.config.ssl.session_cache.num_stripes");
+
+  char *session_cache_filename = NULL;
+  IOCORE_ReadConfigStringAlloc(session_cache_filename, "proxy.config.ssl.session_cache.filename");
+  if (session_cache_filename != NULL) {
+    sessionCachePath = Layout::relative_to(Layout::get()->runtimedir, session_cache_filename);
+    xfree(session_cache_filename);
+  }
+
+  // Session ticket keys, relative to the server certificate directory
+  char *ticket_key_filename = NULL;
+  IOCORE_ReadConfigStringAlloc(ticket_key_filename, "proxy.config.ssl.server.ticket_key.filename");
+  if (ticket_key_filename != NULL) {
+    ticketKeyPath = Layout::relative_to(serverCertPathOnly, ticket_key_filename);
+    xfree(ticket_key_filename);
+  }
+  IOCORE_ReadConfigInteger(ticket_key_reload_interval, "proxy.config.ssl.server.ticket_key.reload_interval");
 
   // ++++++++++++++++++++++++ Client part ++++++++++++++++++++
   client_verify_depth = 7;
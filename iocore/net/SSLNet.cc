@@ -84,6 +84,24 @@ end:
 }
 
 
+#if defined(SSL_CTRL_SET_TLSEXT_HOSTNAME)
+// Switch to the certificate configured for the TLS server name, if any,
+// before the handshake goes any further.
+static int
+ssl_servername_callback(SSL * ssl, int *ad, void *arg)
+{
+  NOWARN_UNUSED(ad);
+  NOWARN_UNUSED(arg);
+  const char *servername = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+
+  if (servername && sslCertLookup.hasServerNames) {
+    if (!sslCertLookup.selectInfoForName(ssl, servername))
+      Debug("ssl", "no certificate for server name %s, using the default", servername);
+  }
+  return SSL_TLSEXT_ERR_OK;
+}
+#endif
+
 void
 SSLNetProcessor::cleanup(void)
 {
@@ -144,6 +162,10 @@ SSLNetProcessor::reconfigure(void)
   SslConfigParams *param = sslTerminationConfig.acquire();
   ink_assert(param);
 
+  // The shared session cache and ticket keys outlive the SSL_CTXs
+  // built below, so they are only set up the first time through.
+  ssl_session_cache_init(param);
+
   ssl_mode = param->getTerminationMode();
   sslServerEnabled = ssl_mode & SslConfigParams::SSL_TERM_MODE_CLIENT;
 
@@ -330,7 +352,14 @@ SSLNetProcessor::initSSLServerCTX(SslConfigParams * param, SSL_CTX * lCtx,
     SSL_CTX_set_session_cache_mode(lCtx, SSL_SESS_CACHE_SERVER);
     SSL_CTX_sess_set_cache_size(lCtx, param->ssl_session_cache_size);
     break;
+  case SslConfigParams::SSL_SESSION_CACHE_MODE_SHARED:
+    sslSessionCache.configure(lCtx);
+    break;
   }
+  ssl_ticket_keys_configure(lCtx);
+#if defined(SSL_CTRL_SET_TLSEXT_HOSTNAME)
+  SSL_CTX_set_tlsext_servername_callback(lCtx, ssl_servername_callback);
+#endif
 
   //might want to make configurable at some point.
   verify_depth = param->verify_depth;
@@ -0,0 +1,552 @@
+/** @file
+
+  Shared, persistent SSL session cache and session ticket keys.
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include "ink_config.h"
+
+#include "P_Net.h"
+#include "I_Layout.h"
+#include <sys/mman.h>
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+
+SSLSessionCache sslSessionCache;
+
+static SSLTicketKeyBlock *volatile ssl_ticket_keys = NULL;
+static char *ssl_ticket_key_path = NULL;
+
+static inline uint32_t
+ssl_session_id_hash(const unsigned char *id, int len)
+{
+  // FNV-1a, session ids are random so this only needs to be cheap.
+  uint32_t h = 2166136261U;
+  for (int i = 0; i < len; i++) {
+    h ^= id[i];
+    h *= 16777619U;
+  }
+  return h;
+}
+
+SSLSessionCache::SSLSessionCache()
+  : header(NULL), base(NULL), size(0), fd(-1)
+{
+}
+
+SSLSessionCache::~SSLSessionCache()
+{
+  detach();
+}
+
+bool
+SSLSessionCache::attach(const char *path, int nsessions, int nstripes)
+{
+  SSLSessionCacheHeader h;
+
+  if (nstripes < 1)
+    nstripes = 1;
+  if (nsessions < nstripes * SSL_SESSION_CACHE_PROBE)
+    nsessions = nstripes * SSL_SESSION_CACHE_PROBE;
+
+  h.magic = SSL_SESSION_CACHE_MAGIC;
+  h.version = SSL_SESSION_CACHE_VERSION;
+  h.nstripes = nstripes;
+  h.nslots = (nsessions + nstripes - 1) / nstripes;
+  h.slot_size = sizeof(SSLSessionSlot);
+  h.stripe_size = INK_ALIGN(sizeof(SSLSessionStripe), 64) + h.nslots * h.slot_size;
+
+  size = INK_ALIGN(sizeof(SSLSessionCacheHeader), 64) + (size_t) h.nstripes * h.stripe_size;
+
+  if ((fd = ::open(path, O_RDWR | O_CREAT, 0640)) < 0) {
+    Warning("unable to open SSL session cache '%s': %s", path, strerror(errno));
+    return false;
+  }
+
+  struct stat s;
+  bool fresh = fstat(fd, &s) < 0 || (size_t) s.st_size != size;
+  if (fresh && ftruncate(fd, size) < 0) {
+    Warning("unable to size SSL session cache '%s': %s", path, strerror(errno));
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+
+  base = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == (char *) MAP_FAILED) {
+    Warning("unable to map SSL session cache '%s': %s", path, strerror(errno));
+    base = NULL;
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+
+  header = (SSLSessionCacheHeader *) base;
+  if (fresh || memcmp(header, &h, sizeof(h)) != 0) {
+    Note("initializing SSL session cache '%s' (%u stripes of %u sessions)", path, h.nstripes, h.nslots);
+    memset(base, 0, size);
+    *header = h;
+  } else {
+    Note("reusing SSL session cache '%s' (%u stripes of %u sessions)", path, h.nstripes, h.nslots);
+  }
+
+  // Lock state never survives a restart, whatever is in the file.
+  for (uint32_t i = 0; i < header->nstripes; i++) {
+    SSLSessionStripe *stripe = stripe_for(i);
+    ink_mutex_init(&stripe->lock, "SSLSessionStripe");
+    stripe->nslots = header->nslots;
+  }
+  return true;
+}
+
+void
+SSLSessionCache::detach()
+{
+  if (base) {
+    munmap(base, size);
+    base = NULL;
+    header = NULL;
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+SSLSessionStripe *
+SSLSessionCache::stripe_for(uint32_t hash) const
+{
+  return (SSLSessionStripe *) (base + INK_ALIGN(sizeof(SSLSessionCacheHeader), 64) +
+                               (size_t) (hash % header->nstripes) * header->stripe_size);
+}
+
+SSLSessionSlot *
+SSLSessionCache::slot_at(SSLSessionStripe * stripe, uint32_t i) const
+{
+  return (SSLSessionSlot *) ((char *) stripe + INK_ALIGN(sizeof(SSLSessionStripe), 64)) + (i % stripe->nslots);
+}
+
+bool
+SSLSessionCache::insert(const unsigned char *id, int id_len, const unsigned char *data, int data_len, uint32_t expire)
+{
+  if (!header || id_len <= 0 || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH || data_len > SSL_SESSION_CACHE_MAX_DATA)
+    return false;
+
+  uint32_t hash = ssl_session_id_hash(id, id_len);
+  uint32_t now = (uint32_t) time(NULL);
+  SSLSessionStripe *stripe = stripe_for(hash);
+  uint32_t start = hash / header->nstripes;
+  SSLSessionSlot *victim = NULL;
+  bool evicted = false;
+
+  ink_mutex_acquire(&stripe->lock);
+  for (uint32_t i = 0; i < SSL_SESSION_CACHE_PROBE; i++) {
+    SSLSessionSlot *slot = slot_at(stripe, start + i);
+    if (slot->id_len == 0 || slot->expire <= now ||
+        (slot->hash == hash && slot->id_len == id_len && memcmp(slot->id, id, id_len) == 0)) {
+      victim = slot;
+      evicted = false;
+      break;
+    }
+    // Otherwise push out whatever expires first.
+    if (!victim || slot->expire < victim->expire) {
+      victim = slot;
+      evicted = true;
+    }
+  }
+  victim->id_len = 0;
+  victim->hash = hash;
+  victim->expire = expire;
+  victim->data_len = data_len;
+  memcpy(victim->id, id, id_len);
+  memcpy(victim->data, data, data_len);
+  victim->id_len = id_len;
+  ink_mutex_release(&stripe->lock);
+
+  NET_SUM_GLOBAL_DYN_STAT(ssl_session_cache_insert_stat, 1);
+  if (evicted)
+    NET_SUM_GLOBAL_DYN_STAT(ssl_session_cache_eviction_stat, 1);
+  return true;
+}
+
+int
+SSLSessionCache::lookup(const unsigned char *id, int id_len, unsigned char *buf, int buf_len)
+{
+  int len = 0;
+
+  if (!header || id_len <= 0 || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH)
+    return 0;
+
+  uint32_t hash = ssl_session_id_hash(id, id_len);
+  uint32_t now = (uint32_t) time(NULL);
+  SSLSessionStripe *stripe = stripe_for(hash);
+  uint32_t start = hash / header->nstripes;
+
+  ink_mutex_acquire(&stripe->lock);
+  for (uint32_t i = 0; i < SSL_SESSION_CACHE_PROBE; i++) {
+    SSLSessionSlot *slot = slot_at(stripe, start + i);
+    if (slot->hash == hash && slot->id_len == id_len && memcmp(slot->id, id, id_len) == 0) {
+      if (slot->expire > now && slot->data_len <= buf_len) {
+        len = slot->data_len;
+        memcpy(buf, slot->data, len);
+      } else {
+        slot->id_len = 0;
+      }
+      break;
+    }
+  }
+  ink_mutex_release(&stripe->lock);
+
+  NET_SUM_GLOBAL_DYN_STAT(len ? ssl_session_cache_hit_stat : ssl_session_cache_miss_stat, 1);
+  return len;
+}
+
+void
+SSLSessionCache::remove(const unsigned char *id, int id_len)
+{
+  if (!header || id_len <= 0 || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH)
+    return;
+
+  uint32_t hash = ssl_session_id_hash(id, id_len);
+  SSLSessionStripe *stripe = stripe_for(hash);
+  uint32_t start = hash / header->nstripes;
+
+  ink_mutex_acquire(&stripe->lock);
+  for (uint32_t i = 0; i < SSL_SESSION_CACHE_PROBE; i++) {
+    SSLSessionSlot *slot = slot_at(stripe, start + i);
+    if (slot->hash == hash && slot->id_len == id_len && memcmp(slot->id, id, id_len) == 0) {
+      slot->id_len = 0;
+      break;
+    }
+  }
+  ink_mutex_release(&stripe->lock);
+}
+
+//
+// OpenSSL external session cache callbacks
+//
+
+static int
+ssl_session_new_cb(SSL * ssl, SSL_SESSION * sess)
+{
+  NOWARN_UNUSED(ssl);
+  unsigned char buf[SSL_SESSION_CACHE_MAX_DATA];
+  unsigned char *p = buf;
+  unsigned int id_len;
+  const unsigned char *id = SSL_SESSION_get_id(sess, &id_len);
+  int len = i2d_SSL_SESSION(sess, NULL);
+
+  if (len <= 0 || len > SSL_SESSION_CACHE_MAX_DATA) {
+    Debug("ssl_session_cache", "session of %d bytes not cached", len);
+    return 0;
+  }
+  i2d_SSL_SESSION(sess, &p);
+  sslSessionCache.insert(id, id_len, buf, len, (uint32_t) (SSL_SESSION_get_time(sess) + SSL_SESSION_get_timeout(sess)));
+  // We keep our own serialized copy, OpenSSL may free its reference.
+  return 0;
+}
+
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+static SSL_SESSION *
+ssl_session_get_cb(SSL * ssl, const unsigned char *id, int id_len, int *copy)
+#else
+static SSL_SESSION *
+ssl_session_get_cb(SSL * ssl, unsigned char *id, int id_len, int *copy)
+#endif
+{
+  NOWARN_UNUSED(ssl);
+  unsigned char buf[SSL_SESSION_CACHE_MAX_DATA];
+  const unsigned char *p = buf;
+  int len = sslSessionCache.lookup(id, id_len, buf, sizeof(buf));
+
+  *copy = 0;
+  if (len == 0)
+    return NULL;
+  return d2i_SSL_SESSION(NULL, &p, len);
+}
+
+static void
+ssl_session_remove_cb(SSL_CTX * ctx, SSL_SESSION * sess)
+{
+  NOWARN_UNUSED(ctx);
+  unsigned int id_len;
+  const unsigned char *id = SSL_SESSION_get_id(sess, &id_len);
+
+  sslSessionCache.remove(id, id_len);
+}
+
+void
+SSLSessionCache::configure(SSL_CTX * ctx)
+{
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+  SSL_CTX_sess_set_new_cb(ctx, ssl_session_new_cb);
+  SSL_CTX_sess_set_get_cb(ctx, ssl_session_get_cb);
+  SSL_CTX_sess_set_remove_cb(ctx, ssl_session_remove_cb);
+}
+
+//
+// RFC 5077 session tickets
+//
+
+SSLTicketKeyBlock *
+ssl_ticket_key_block_read(const char *path)
+{
+  struct stat s;
+  SSLTicketKeyBlock *block = NULL;
+  int fd = ::open(path, O_RDONLY);
+
+  if (fd < 0) {
+    Warning("unable to open SSL ticket key file '%s': %s", path, strerror(errno));
+    return NULL;
+  }
+  if (fstat(fd, &s) < 0 || s.st_size < (off_t) sizeof(SSLTicketKey) || (s.st_size % sizeof(SSLTicketKey)) != 0) {
+    Warning("SSL ticket key file '%s' must hold a multiple of %d bytes", path, (int) sizeof(SSLTicketKey));
+    ::close(fd);
+    return NULL;
+  }
+
+  unsigned num_keys = s.st_size / sizeof(SSLTicketKey);
+  block = (SSLTicketKeyBlock *) xmalloc(sizeof(SSLTicketKeyBlock) + (num_keys - 1) * sizeof(SSLTicketKey));
+  block->num_keys = num_keys;
+  block->mtime = s.st_mtime;
+  if (read(fd, block->keys, s.st_size) != s.st_size) {
+    Warning("short read on SSL ticket key file '%s'", path);
+    ssl_ticket_key_block_free(block);
+    block = NULL;
+  }
+  ::close(fd);
+  return block;
+}
+
+void
+ssl_ticket_key_block_free(SSLTicketKeyBlock * block)
+{
+  if (block) {
+    memset(block->keys, 0, block->num_keys * sizeof(SSLTicketKey));
+    xfree(block);
+  }
+}
+
+#if defined(SSL_CTX_set_tlsext_ticket_key_cb)
+static int
+ssl_callback_session_ticket(SSL * ssl, unsigned char *keyname, unsigned char *iv, EVP_CIPHER_CTX * cipher_ctx,
+                            HMAC_CTX * hctx, int enc)
+{
+  NOWARN_UNUSED(ssl);
+  SSLTicketKeyBlock *block = ssl_ticket_keys;
+
+  if (block == NULL)
+    return -1;
+
+  if (enc == 1) {
+    const SSLTicketKey & key = block->keys[0];
+    memcpy(keyname, key.name, sizeof(key.name));
+    RAND_pseudo_bytes(iv, EVP_MAX_IV_LENGTH);
+    EVP_EncryptInit_ex(cipher_ctx, EVP_aes_128_cbc(), NULL, key.aes_key, iv);
+    HMAC_Init_ex(hctx, key.hmac_secret, sizeof(key.hmac_secret), EVP_sha256(), NULL);
+    return 1;
+  }
+
+  for (unsigned i = 0; i < block->num_keys; i++) {
+    const SSLTicketKey & key = block->keys[i];
+    if (memcmp(keyname, key.name, sizeof(key.name)) == 0) {
+      HMAC_Init_ex(hctx, key.hmac_secret, sizeof(key.hmac_secret), EVP_sha256(), NULL);
+      EVP_DecryptInit_ex(cipher_ctx, EVP_aes_128_cbc(), NULL, key.aes_key, iv);
+      // OpenSSL checks the ticket HMAC after this returns, so this counts
+      // tickets naming one of our keys, not resumed sessions.
+      NET_SUM_GLOBAL_DYN_STAT(ssl_session_ticket_key_match_stat, 1);
+      // Tickets under a retired key are accepted once and reissued under the current one.
+      return i == 0 ? 1 : 2;
+    }
+  }
+  NET_SUM_GLOBAL_DYN_STAT(ssl_session_ticket_key_miss_stat, 1);
+  return 0;
+}
+#endif
+
+void
+ssl_ticket_keys_configure(SSL_CTX * ctx)
+{
+  if (ssl_ticket_keys == NULL)
+    return;
+#if defined(SSL_CTX_set_tlsext_ticket_key_cb)
+  SSL_CTX_set_tlsext_ticket_key_cb(ctx, ssl_callback_session_ticket);
+#else
+  NOWARN_UNUSED(ctx);
+  Warning("SSL ticket keys configured but this OpenSSL has no session ticket support");
+#endif
+}
+
+/**
+  Periodically checks the ticket key file and swaps in a new key block
+  when it changes. The replaced block is freed one period later, by then
+  no handshake can still be using it.
+ */
+struct SSLTicketKeyReloader:public Continuation
+{
+  SSLTicketKeyBlock *retired;
+
+  int mainEvent(int event, Event * e)
+  {
+    NOWARN_UNUSED(event);
+    NOWARN_UNUSED(e);
+    struct stat s;
+
+    ssl_ticket_key_block_free(retired);
+    retired = NULL;
+
+    if (stat(ssl_ticket_key_path, &s) < 0 || s.st_mtime == ssl_ticket_keys->mtime)
+      return EVENT_CONT;
+
+    SSLTicketKeyBlock *block = ssl_ticket_key_block_read(ssl_ticket_key_path);
+    if (block) {
+      Note("rotated SSL ticket keys from '%s' (%u keys)", ssl_ticket_key_path, block->num_keys);
+      retired = ssl_ticket_keys;
+      ssl_ticket_keys = block;
+    }
+    return EVENT_CONT;
+  }
+
+  SSLTicketKeyReloader()
+    : Continuation(new_ProxyMutex()), retired(NULL)
+  {
+    SET_HANDLER(&SSLTicketKeyReloader::mainEvent);
+  }
+};
+
+void
+ssl_session_cache_init(SslConfigParams * params)
+{
+  static bool initialized = false;
+
+  if (initialized)
+    return;
+  initialized = true;
+
+  if (params->ssl_session_cache == SslConfigParams::SSL_SESSION_CACHE_MODE_SHARED) {
+    if (!sslSessionCache.attach(params->sessionCachePath, params->ssl_session_cache_size,
+                                params->ssl_session_cache_num_stripes)) {
+      Warning("falling back to the per context SSL session cache");
+      params->ssl_session_cache = SslConfigParams::SSL_SESSION_CACHE_MODE_SERVER;
+    }
+  }
+
+  if (params->ticketKeyPath) {
+    ssl_ticket_keys = ssl_ticket_key_block_read(params->ticketKeyPath);
+    if (ssl_ticket_keys) {
+      ssl_ticket_key_path = xstrdup(params->ticketKeyPath);
+      if (params->ticket_key_reload_interval > 0)
+        eventProcessor.schedule_every(NEW(new SSLTicketKeyReloader), HRTIME_SECONDS(params->ticket_key_reload_interval));
+    }
+  }
+}
+
+#if TS_HAS_TESTS
+static void
+ssl_session_test_id(unsigned char *id, int n)
+{
+  for (int i = 0; i < SSL_MAX_SSL_SESSION_ID_LENGTH; i++)
+    id[i] = (unsigned char) (n * 31 + i);
+}
+
+static bool
+ssl_session_test_lookup(RegressionTest * t, SSLSessionCache & cache, int n, const char *data, const char *what)
+{
+  unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+  unsigned char buf[SSL_SESSION_CACHE_MAX_DATA];
+  int len;
+
+  ssl_session_test_id(id, n);
+  len = cache.lookup(id, sizeof(id), buf, sizeof(buf));
+  if (data ? (len != (int) strlen(data) || memcmp(buf, data, len) != 0) : len != 0) {
+    rprintf(t, "%s: session %d %s\n", what, n, len ? "found" : "not found");
+    return false;
+  }
+  return true;
+}
+
+REGRESSION_TEST(SSLSessionCache) (RegressionTest * t, int atype, int *pstatus) {
+  NOWARN_UNUSED(atype);
+  char path[] = "/tmp/ssl_session_cache_XXXXXX";
+  unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+  uint32_t now = (uint32_t) time(NULL);
+  char data[32];
+  bool ok = true;
+  int fd, i;
+
+  *pstatus = REGRESSION_TEST_FAILED;
+  if ((fd = mkstemp(path)) < 0) {
+    rprintf(t, "unable to create a temporary file\n");
+    return;
+  }
+  ::close(fd);
+
+  {
+    // one stripe, so a lookup probes every slot
+    SSLSessionCache cache;
+    if (!cache.attach(path, SSL_SESSION_CACHE_PROBE, 1)) {
+      rprintf(t, "attach '%s' failed\n", path);
+      unlink(path);
+      return;
+    }
+    ok = ssl_session_test_lookup(t, cache, 0, NULL, "empty cache") && ok;
+
+    ssl_session_test_id(id, 0);
+    cache.insert(id, sizeof(id), (const unsigned char *) "first", 5, now + 300);
+    ok = ssl_session_test_lookup(t, cache, 0, "first", "insert") && ok;
+    cache.insert(id, sizeof(id), (const unsigned char *) "second", 6, now + 300);
+    ok = ssl_session_test_lookup(t, cache, 0, "second", "replace") && ok;
+    cache.remove(id, sizeof(id));
+    ok = ssl_session_test_lookup(t, cache, 0, NULL, "remove") && ok;
+
+    ssl_session_test_id(id, 1);
+    cache.insert(id, sizeof(id), (const unsigned char *) "expired", 7, now - 1);
+    ok = ssl_session_test_lookup(t, cache, 1, NULL, "expiry") && ok;
+
+    // fill every slot, then one more pushes out the session expiring first
+    for (i = 0; i <= SSL_SESSION_CACHE_PROBE; i++) {
+      ssl_session_test_id(id, 10 + i);
+      snprintf(data, sizeof(data), "session %d", 10 + i);
+      cache.insert(id, sizeof(id), (const unsigned char *) data, strlen(data), now + 300 + i);
+    }
+    ok = ssl_session_test_lookup(t, cache, 10, NULL, "eviction") && ok;
+    for (i = 1; i <= SSL_SESSION_CACHE_PROBE; i++) {
+      snprintf(data, sizeof(data), "session %d", 10 + i);
+      ok = ssl_session_test_lookup(t, cache, 10 + i, data, "eviction") && ok;
+    }
+    cache.detach();
+
+    // the sessions are in the file, a second attach finds them
+    if (!cache.attach(path, SSL_SESSION_CACHE_PROBE, 1)) {
+      rprintf(t, "second attach '%s' failed\n", path);
+      ok = false;
+    } else {
+      for (i = 1; i <= SSL_SESSION_CACHE_PROBE; i++) {
+        snprintf(data, sizeof(data), "session %d", 10 + i);
+        ok = ssl_session_test_lookup(t, cache, 10 + i, data, "second attach") && ok;
+      }
+    }
+  }
+
+  unlink(path);
+  *pstatus = ok ? REGRESSION_TEST_PASSED : REGRESSION_TEST_FAILED;
+}
+#endif
@@ -419,7 +419,6 @@ UDPNetProcessor::recvfrom_re(Continuation * cont,
                              struct sockaddr * fromaddr, socklen_t *fromaddrlen,
                              IOBufferBlock * buf, int len, bool useReadCont, int timeout)
 {
-  (void) useReadCont;
   ink_assert(buf->write_avail() >= len);
   int actual;
   Event *event = completionUtil::create();
@@ -434,6 +433,10 @@ UDPNetProcessor::recvfrom_re(Continuation * cont,
     cont->handleEvent(NET_EVENT_DATAGRAM_READ_COMPLETE, event);
     completionUtil::destroy(event);
     return ACTION_RESULT_DONE;
+  } else if (!useReadCont && actual == -EAGAIN) {
+    // Caller polls on its own schedule; report "no data" without a callback.
+    completionUtil::destroy(event);
+    return ACTION_IO_ERROR;
   } else if (actual == 0 || (actual < 0 && actual == -EAGAIN)) {
     UDPReadContinuation *c = udpReadContAllocator.alloc();
     c->init_token(event);
@@ -276,7 +276,7 @@ RBNode::rebalanceAfterRemove(
           parent = n->_parent;
           d = NONE; // Cancel any leaf node logic
         } else {
-          if (wfc->_color == BLACK) {
+          if (wfc == BLACK) { // NIL safe, the far child may be missing
             w->getChild(near)->_color = BLACK;
             w->_color = RED;
             w->rotate(far);
@@ -536,7 +536,7 @@ IpMapBase<N>::mark(ArgType min, ArgType max, void* payload) {
       // Can only have left skew overlap, otherwise disjoint.
       // Clip if overlap.
       if (n->_max >= min) n->setMax(min_1);
-      else if (next(n) && n->_max <= max) {
+      else if (next(n) && next(n)->_max <= max) {
         // request region covers next span so we can re-use that node.
         x = next(n);
         x->setMin(min).setMax(max).setData(payload);
@@ -734,12 +734,12 @@ public:
 
   /// Construct with values.
   Ip4Node(
-    ArgType min, ///< Minimum address (network order).
-    ArgType max, ///< Maximum address (network order).
+    ArgType min, ///< Minimum address (host order).
+    ArgType max, ///< Maximum address (host order).
     void* data ///< Client data.
-  ) : Node(data), Ip4Span(ntohl(min), ntohl(max)) {
-    ink_inet_ip4_set(ink_inet_sa_cast(&_sa._min), min);
-    ink_inet_ip4_set(ink_inet_sa_cast(&_sa._max), max);
+  ) : Node(data), Ip4Span(min, max) {
+    ink_inet_ip4_set(ink_inet_sa_cast(&_sa._min), htonl(min));
+    ink_inet_ip4_set(ink_inet_sa_cast(&_sa._max), htonl(max));
   }
   /// @return The minimum value of the interval.
   virtual sockaddr const* min() {
@@ -1024,11 +1024,11 @@ IpMap::contains(sockaddr const* target, void** ptr) {
   bool zret = false;
   if (AF_INET == target->sa_family) {
     if (_m4) {
-      zret = _m4->contains(ntohl(ip4_addr(target)));
+      zret = _m4->contains(ntohl(ip4_addr(target)), ptr);
     }
   } else if (AF_INET6 == target->sa_family) {
     if (_m6) {
-      zret = _m6->contains(ink_inet_ip6_cast(target));
+      zret = _m6->contains(ink_inet_ip6_cast(target), ptr);
     }
   }
   return zret;
@@ -1042,17 +1042,17 @@ IpMap::mark(
 ) {
   ink_assert(min->sa_family == max->sa_family);
   if (AF_INET == min->sa_family) {
-    this->force4()->mark(ip4_addr(min), ip4_addr(max), data);
+    this->force4()->mark(ntohl(ip4_addr(min)), ntohl(ip4_addr(max)), data);
   } else if (AF_INET6 == min->sa_family) {
     if (!_m6) _m6 = new ts::detail::Ip6Map;
-    _m6->mark(ink_inet_ip6_cast(min), ink_inet_ip6_cast(max));
+    _m6->mark(ink_inet_ip6_cast(min), ink_inet_ip6_cast(max), data);
   }
   return *this;
 }
 
 IpMap&
 IpMap::mark(uint32_t min, uint32_t max, void* data) {
-  this->force4()->mark(min, max, data);
+  this->force4()->mark(ntohl(min), ntohl(max), data);
   return *this;
 }
 
@@ -1063,7 +1063,7 @@ IpMap::unmark(
 ) {
   ink_assert(min->sa_family == max->sa_family);
   if (AF_INET == min->sa_family) {
-    if (_m4) _m4->unmark(ip4_addr(min), ip4_addr(max));
+    if (_m4) _m4->unmark(ntohl(ip4_addr(min)), ntohl(ip4_addr(max)));
   } else if (AF_INET6 == min->sa_family) {
     if (_m6) _m6->unmark(ink_inet_ip6_cast(min), ink_inet_ip6_cast(max));
   }
@@ -1085,7 +1085,7 @@ IpMap::iterator::operator ++ () {
     // and if so, move to the v6 list (if it's there).
     Node* x = static_cast<Node*>(_node->_next);
     if (!x && _tree->_m4 && _tree->_m6 && _node == _tree->_m4->getTail())
-      x = _tree->_m6->getTail();
+      x = _tree->_m6->getHead();
     _node = x;
   }
   return *this;
@@ -1112,3 +1112,113 @@ IpMap::iterator::operator--() {
 //----------------------------------------------------------------------------
 //----------------------------------------------------------------------------
 
+//----------------------------------------------------------------------------
+namespace {
+  inline uint64_t ip6_half(uint8_t const* b) {
+    uint64_t zret = 0;
+    for ( int i = 0 ; i < 8 ; ++i ) zret = (zret << 8) | b[i];
+    return zret;
+  }
+}
+
+IpMapArray::~IpMapArray() {
+  this->clear();
+}
+
+void
+IpMapArray::clear() {
+  delete [] _max4;
+  delete [] _min4;
+  delete [] _data4;
+  delete [] _max6;
+  delete [] _min6;
+  delete [] _data6;
+  _max4 = _min4 = 0;
+  _max6 = _min6 = 0;
+  _data4 = _data6 = 0;
+  _n4 = _n6 = 0;
+}
+
+IpMapArray&
+IpMapArray::load(IpMap& map) {
+  int n4 = 0, n6 = 0;
+
+  this->clear();
+
+  // The map iterates in address order, so the arrays come out sorted.
+  for ( IpMap::iterator spot = map.begin(), limit = map.end() ; spot != limit ; ++spot ) {
+    if (AF_INET == spot->min()->sa_family) ++n4;
+    else if (AF_INET6 == spot->min()->sa_family) ++n6;
+  }
+
+  if (n4) {
+    _max4 = new uint32_t[n4];
+    _min4 = new uint32_t[n4];
+    _data4 = new void*[n4];
+  }
+  if (n6) {
+    _max6 = new Ip6Key[n6];
+    _min6 = new Ip6Key[n6];
+    _data6 = new void*[n6];
+  }
+
+  for ( IpMap::iterator spot = map.begin(), limit = map.end() ; spot != limit ; ++spot ) {
+    if (AF_INET == spot->min()->sa_family) {
+      _min4[_n4] = ntohl(ip4_addr(spot->min()));
+      _max4[_n4] = ntohl(ip4_addr(spot->max()));
+      _data4[_n4] = spot->data();
+      ++_n4;
+    } else if (AF_INET6 == spot->min()->sa_family) {
+      uint8_t const* lo = ink_inet_ip6_cast(spot->min())->sin6_addr.s6_addr;
+      uint8_t const* hi = ink_inet_ip6_cast(spot->max())->sin6_addr.s6_addr;
+      _min6[_n6]._hi = ip6_half(lo);
+      _min6[_n6]._lo = ip6_half(lo + 8);
+      _max6[_n6]._hi = ip6_half(hi);
+      _max6[_n6]._lo = ip6_half(hi + 8);
+      _data6[_n6] = spot->data();
+      ++_n6;
+    }
+  }
+  return *this;
+}
+
+bool
+IpMapArray::contains(uint32_t target, void** ptr) const {
+  uint32_t x = ntohl(target);
+  int l = 0, r = _n4;
+
+  // Find the first range that does not end before the target.
+  while (l < r) {
+    int m = (l + r) / 2;
+    if (_max4[m] < x) l = m + 1;
+    else r = m;
+  }
+  if (l < _n4 && _min4[l] <= x) {
+    if (ptr) *ptr = _data4[l];
+    return true;
+  }
+  return false;
+}
+
+bool
+IpMapArray::contains(sockaddr const* target, void** ptr) const {
+  if (AF_INET == target->sa_family) {
+    return this->contains(ip4_addr(target), ptr);
+  } else if (AF_INET6 == target->sa_family) {
+    uint8_t const* b = ink_inet_ip6_cast(target)->sin6_addr.s6_addr;
+    uint64_t hi = ip6_half(b);
+    uint64_t lo = ip6_half(b + 8);
+    int l = 0, r = _n6;
+
+    while (l < r) {
+      int m = (l + r) / 2;
+      if (_max6[m]._hi < hi || (_max6[m]._hi == hi && _max6[m]._lo < lo)) l = m + 1;
+      else r = m;
+    }
+    if (l < _n6 && (_min6[l]._hi < hi || (_min6[l]._hi == hi && _min6[l]._lo <= lo))) {
+      if (ptr) *ptr = _data6[l];
+      return true;
+    }
+  }
+  return false;
+}
@@ -430,4 +430,87 @@ IpMap::iterator::operator -> () {
 
 inline IpMap::IpMap() : _m4(0), _m6(0) {}
 
+/** Immutable, contiguous copy of an @c IpMap.
+
+    @c IpMap is the right structure for building a set of ranges but
+    every lookup chases tree node pointers. Once the ranges are final
+    they can be loaded in to this class, which keeps the disjoint
+    ranges in sorted arrays, IPv4 and IPv6 separately. The maximum
+    addresses are stored apart from the minimums and the client data
+    so that the binary search only touches one dense array.
+
+    Instances are not modified after @c load so they can be shared
+    without locking and replaced as a whole by swapping a pointer.
+*/
+class IpMapArray {
+public:
+  typedef IpMapArray self; ///< Self reference type.
+
+  IpMapArray(); ///< Default constructor.
+  ~IpMapArray(); ///< Destructor.
+
+  /** Copy the ranges of @a map.
+      Any previous contents are discarded.
+      @return This object.
+  */
+  self& load(
+    IpMap& map ///< Source map.
+  );
+
+  /** Test for membership.
+
+      @return @c true if the address is in the map, @c false if not.
+      If the address is in the map and @a ptr is not @c NULL, @c *ptr
+      is set to the client data for the address.
+  */
+  bool contains(
+    sockaddr const* target, ///< Search target value.
+    void **ptr = 0 ///< Client data return.
+  ) const;
+
+  /** Test for IPv4 membership.
+      @note Convenience overload for IPv4 addresses.
+      @return @c true if the address is in the map, @c false if not.
+  */
+  bool contains(
+    uint32_t target, ///< Search target (network order).
+    void **ptr = 0 ///< Client data return.
+  ) const;
+
+  /// @return The number of IPv4 ranges.
+  int getCount4() const { return _n4; }
+  /// @return The number of IPv6 ranges.
+  int getCount6() const { return _n6; }
+
+protected:
+  /// IPv6 address as a pair of host order integers, for fast compares.
+  struct Ip6Key {
+    uint64_t _hi;
+    uint64_t _lo;
+  };
+
+  /// Release the arrays.
+  void clear();
+
+  uint32_t* _max4; ///< IPv4 range maximums (host order), sorted.
+  uint32_t* _min4; ///< IPv4 range minimums (host order).
+  void** _data4; ///< IPv4 client data.
+  int _n4; ///< Number of IPv4 ranges.
+
+  Ip6Key* _max6; ///< IPv6 range maximums, sorted.
+  Ip6Key* _min6; ///< IPv6 range minimums.
+  void** _data6; ///< IPv6 client data.
+  int _n6; ///< Number of IPv6 ranges.
+
+private:
+  // Not copyable, the arrays are owned.
+  IpMapArray(self const&);
+  self& operator=(self const&);
+};
+
+inline IpMapArray::IpMapArray()
+  : _max4(0), _min4(0), _data4(0), _n4(0)
+  , _max6(0), _min6(0), _data6(0), _n6(0) {
+}
+
 # endif // TS_IP_MAP_HEADER
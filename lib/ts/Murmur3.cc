@@ -0,0 +1,205 @@
+/** @file
+
+  Incremental 128 bit MurmurHash3 (x64 variant).
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include <string.h>
+#include "ink_platform.h"
+#include "Murmur3.h"
+
+#define MURMUR3_C1 0x87c37b91114253d5ULL
+#define MURMUR3_C2 0x4cf5ad432745937fULL
+
+static inline uint64_t
+rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+fmix64(uint64_t k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+// Lower case the ASCII letters in eight bytes at once, leaving every
+//   other byte (including those >= 0x80) alone.
+static inline uint64_t
+tolower64(uint64_t x)
+{
+  const uint64_t ones = 0x0101010101010101ULL;
+  uint64_t heptets = x & (0x7f * ones);
+  uint64_t ge_A = heptets + (0x80 - 'A') * ones;
+  uint64_t gt_Z = heptets + (0x7f - 'Z') * ones;
+  uint64_t upper = (ge_A ^ gt_Z) & ~x & (0x80 * ones);
+  return x | (upper >> 2);
+}
+
+static inline char
+tolower8(char c)
+{
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline void
+mix_block(MURMUR3_CTX * context, uint64_t k1, uint64_t k2)
+{
+  uint64_t h1 = context->h1;
+  uint64_t h2 = context->h2;
+
+  k1 *= MURMUR3_C1;
+  k1 = rotl64(k1, 31);
+  k1 *= MURMUR3_C2;
+  h1 ^= k1;
+  h1 = rotl64(h1, 27);
+  h1 += h2;
+  h1 = h1 * 5 + 0x52dce729;
+
+  k2 *= MURMUR3_C2;
+  k2 = rotl64(k2, 33);
+  k2 *= MURMUR3_C1;
+  h2 ^= k2;
+  h2 = rotl64(h2, 31);
+  h2 += h1;
+  h2 = h2 * 5 + 0x38495ab5;
+
+  context->h1 = h1;
+  context->h2 = h2;
+}
+
+void
+ink_code_incr_murmur3_init(MURMUR3_CTX * context, uint32_t seed)
+{
+  context->h1 = seed;
+  context->h2 = seed;
+  context->length = 0;
+  context->buffer_size = 0;
+}
+
+template<bool lower> static inline void
+murmur3_update(MURMUR3_CTX * context, const char *input, int input_length)
+{
+  uint64_t k[2];
+
+  context->length += input_length;
+
+  // top up a partial block left over from the last update
+  if (context->buffer_size) {
+    int n = 16 - context->buffer_size;
+    if (n > input_length)
+      n = input_length;
+    for (int i = 0; i < n; i++)
+      context->buffer[context->buffer_size + i] = lower ? tolower8(input[i]) : input[i];
+    context->buffer_size += n;
+    input += n;
+    input_length -= n;
+    if (context->buffer_size < 16)
+      return;
+    memcpy(k, context->buffer, 16);
+    mix_block(context, k[0], k[1]);
+    context->buffer_size = 0;
+  }
+
+  for (; input_length >= 16; input += 16, input_length -= 16) {
+    memcpy(k, input, 16);
+    if (lower)
+      mix_block(context, tolower64(k[0]), tolower64(k[1]));
+    else
+      mix_block(context, k[0], k[1]);
+  }
+
+  for (int i = 0; i < input_length; i++)
+    context->buffer[i] = lower ? tolower8(input[i]) : input[i];
+  context->buffer_size = input_length;
+}
+
+void
+ink_code_incr_murmur3_update(MURMUR3_CTX * context, const char *input, int input_length)
+{
+  murmur3_update<false>(context, input, input_length);
+}
+
+void
+ink_code_incr_murmur3_update_tolower(MURMUR3_CTX * context, const char *input, int input_length)
+{
+  murmur3_update<true>(context, input, input_length);
+}
+
+void
+ink_code_incr_murmur3_final(char *sixteen_byte_hash_pointer, MURMUR3_CTX * context)
+{
+  uint64_t k1 = 0, k2 = 0;
+  uint64_t h[2];
+  const unsigned char *tail = context->buffer;
+
+  switch (context->buffer_size) {
+  case 15: k2 ^= ((uint64_t) tail[14]) << 48;
+  case 14: k2 ^= ((uint64_t) tail[13]) << 40;
+  case 13: k2 ^= ((uint64_t) tail[12]) << 32;
+  case 12: k2 ^= ((uint64_t) tail[11]) << 24;
+  case 11: k2 ^= ((uint64_t) tail[10]) << 16;
+  case 10: k2 ^= ((uint64_t) tail[9]) << 8;
+  case 9:
+    k2 ^= ((uint64_t) tail[8]);
+    k2 *= MURMUR3_C2;
+    k2 = rotl64(k2, 33);
+    k2 *= MURMUR3_C1;
+    context->h2 ^= k2;
+  case 8: k1 ^= ((uint64_t) tail[7]) << 56;
+  case 7: k1 ^= ((uint64_t) tail[6]) << 48;
+  case 6: k1 ^= ((uint64_t) tail[5]) << 40;
+  case 5: k1 ^= ((uint64_t) tail[4]) << 32;
+  case 4: k1 ^= ((uint64_t) tail[3]) << 24;
+  case 3: k1 ^= ((uint64_t) tail[2]) << 16;
+  case 2: k1 ^= ((uint64_t) tail[1]) << 8;
+  case 1:
+    k1 ^= ((uint64_t) tail[0]);
+    k1 *= MURMUR3_C1;
+    k1 = rotl64(k1, 31);
+    k1 *= MURMUR3_C2;
+    context->h1 ^= k1;
+  }
+
+  h[0] = context->h1 ^ context->length;
+  h[1] = context->h2 ^ context->length;
+  h[0] += h[1];
+  h[1] += h[0];
+  h[0] = fmix64(h[0]);
+  h[1] = fmix64(h[1]);
+  h[0] += h[1];
+  h[1] += h[0];
+  memcpy(sixteen_byte_hash_pointer, h, 16);
+}
+
+void
+ink_code_murmur3(const char *input, int len, char *sixteen_byte_hash, uint32_t seed)
+{
+  MURMUR3_CTX context;
+
+  ink_code_incr_murmur3_init(&context, seed);
+  ink_code_incr_murmur3_update(&context, input, len);
+  ink_code_incr_murmur3_final(sixteen_byte_hash, &context);
+}
@@ -0,0 +1,55 @@
+/** @file
+
+  Incremental 128 bit MurmurHash3 (x64 variant).
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#ifndef _Murmur3_h_
+#define	_Murmur3_h_
+
+#include "ink_port.h"
+#include "ink_apidefs.h"
+
+/**
+  MurmurHash3_x64_128, fed incrementally. The result does not depend
+  on how the input is split across updates, so a key can be hashed
+  straight out of its component strings without first being copied
+  into one buffer.
+
+  Like MMH, the value differs between big-endian and little-endian
+  machines.
+*/
+struct MURMUR3_CTX
+{
+  uint64_t h1;
+  uint64_t h2;
+  uint64_t length;
+  unsigned char buffer[16];
+  int buffer_size;
+};
+
+void inkcoreapi ink_code_incr_murmur3_init(MURMUR3_CTX * context, uint32_t seed = 0);
+void inkcoreapi ink_code_incr_murmur3_update(MURMUR3_CTX * context, const char *input, int input_length);
+/// As ink_code_incr_murmur3_update(), hashing ASCII letters as lower case.
+void inkcoreapi ink_code_incr_murmur3_update_tolower(MURMUR3_CTX * context, const char *input, int input_length);
+void inkcoreapi ink_code_incr_murmur3_final(char *sixteen_byte_hash_pointer, MURMUR3_CTX * context);
+void inkcoreapi ink_code_murmur3(const char *input, int len, char *sixteen_byte_hash, uint32_t seed = 0);
+
+#endif
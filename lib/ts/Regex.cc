@@ -24,14 +24,84 @@
 #include "libts.h"
 #include "Regex.h"
 
+#ifdef PCRE_STUDY_JIT_COMPILE
+// JIT compiled patterns run on a JIT stack rather than the machine
+//   stack.  PCRE's default is 32K, which deep patterns overflow, so each
+//   thread gets its own larger one on first use.
+static const int regex_jit_stack_min = 32 * 1024;
+static const int regex_jit_stack_max = 1024 * 1024;
+
+static void
+regex_jit_stack_free(void *stack)
+{
+  pcre_jit_stack_free((pcre_jit_stack *) stack);
+}
+
+static ink_thread_key
+regex_jit_stack_key()
+{
+  static ink_thread_key key;
+  static bool key_created = (ink_thread_key_create(&key, regex_jit_stack_free), true);
+
+  NOWARN_UNUSED(key_created);
+  return key;
+}
+
+static pcre_jit_stack *
+regex_jit_stack(void *data)
+{
+  NOWARN_UNUSED(data);
+  ink_thread_key key = regex_jit_stack_key();
+  pcre_jit_stack *stack = (pcre_jit_stack *) ink_thread_getspecific(key);
+
+  if (stack == NULL) {
+    stack = pcre_jit_stack_alloc(regex_jit_stack_min, regex_jit_stack_max);
+    ink_thread_setspecific(key, stack);
+  }
+  return stack;
+}
+#endif
+
+pcre_extra *
+regex_study(const pcre * re, const char **error)
+{
+  pcre_extra *extra;
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+  extra = pcre_study(re, PCRE_STUDY_JIT_COMPILE, error);
+  if (extra && (extra->flags & PCRE_EXTRA_EXECUTABLE_JIT))
+    pcre_assign_jit_stack(extra, regex_jit_stack, NULL);
+#else
+  extra = pcre_study(re, 0, error);
+#endif
+  return extra;
+}
+
+void
+regex_free_study(pcre_extra * extra)
+{
+#ifdef PCRE_STUDY_JIT_COMPILE
+  pcre_free_study(extra);
+#else
+  pcre_free(extra);
+#endif
+}
+
 DFA::~DFA()
 {
   dfa_pattern * p = _my_patterns;
   dfa_pattern * t = p;
   
+  if (_set_pe)
+    regex_free_study(_set_pe);
+  if (_set_re)
+    pcre_free(_set_re);
+  if (_set_group)
+    ink_free(_set_group);
+
   while(p) {
     if (p->_pe)
-      pcre_free(p->_pe);
+      regex_free_study(p->_pe);
     if (p->_re)
       pcre_free(p->_re);
     if(p->_p)
@@ -62,9 +132,10 @@ DFA::build(const char *pattern, REFlags flags)
     return NULL;
   }
   
-  ret->_pe = pcre_study(ret->_re, 0, &error);
+  ret->_pe = regex_study(ret->_re, &error);
   
   if (error) {
+    pcre_free(ret->_re);
     ink_free(ret);
     return NULL;
   }
@@ -116,9 +187,67 @@ DFA::compile(const char **patterns, int npatterns, REFlags flags)
     
   }
   
+  build_set(flags);
   return 0;
 }
 
+void
+DFA::build_set(REFlags flags)
+{
+  const char *error;
+  int erroffset;
+  int npatterns = 0, len = 0, groups = 0;
+  dfa_pattern *p;
+
+  for (p = _my_patterns; p; p = p->_next) {
+    int backrefs = 0, captures = 0;
+
+    // The wrapping groups renumber back references, and an unterminated
+    //   \Q would swallow the rest of the set, so such sets are matched
+    //   one pattern at a time
+    if (pcre_fullinfo(p->_re, NULL, PCRE_INFO_BACKREFMAX, &backrefs) != 0 || backrefs > 0 ||
+        pcre_fullinfo(p->_re, NULL, PCRE_INFO_CAPTURECOUNT, &captures) != 0 || strstr(p->_p, "\\Q"))
+      return;
+    npatterns++;
+    groups += captures + 1;
+    len += strlen(p->_p) + 3;
+  }
+  if (npatterns < 2 || groups >= DFA_SET_MAX_GROUPS)
+    return;
+
+  char *set = (char *) ink_malloc(len + 1);
+  char *s = set;
+  int group = 1;
+
+  _set_group = (int *) ink_malloc(sizeof(int) * npatterns);
+  for (p = _my_patterns; p; p = p->_next) {
+    int captures = 0;
+
+    pcre_fullinfo(p->_re, NULL, PCRE_INFO_CAPTURECOUNT, &captures);
+    s += snprintf(s, len + 1 - (s - set), "%s(%s)", (s == set) ? "" : "|", p->_p);
+    _set_group[_set_groups++] = group;
+    group += captures + 1;
+  }
+
+  if (flags & RE_CASE_INSENSITIVE)
+    _set_re = pcre_compile(set, PCRE_CASELESS|PCRE_ANCHORED, &error, &erroffset, NULL);
+  else
+    _set_re = pcre_compile(set, PCRE_ANCHORED, &error, &erroffset, NULL);
+  ink_free(set);
+
+  if (_set_re)
+    _set_pe = regex_study(_set_re, &error);
+  if (!_set_re || error) {
+    if (_set_re)
+      pcre_free(_set_re);
+    _set_re = NULL;
+    _set_pe = NULL;
+    ink_free(_set_group);
+    _set_group = NULL;
+    _set_groups = 0;
+  }
+}
+
 int
 DFA::match(const char *str)
 {
@@ -133,6 +262,20 @@ DFA::match(const char *str, int length)
   //int wspace[20];
   dfa_pattern * p = _my_patterns;
   
+  if (_set_re) {
+    int set_ovector[3 * DFA_SET_MAX_GROUPS];
+
+    rc = pcre_exec(_set_re, _set_pe, str, length, 0, 0, set_ovector, 3 * DFA_SET_MAX_GROUPS);
+    if (rc <= 0)
+      return -1;
+    // Exactly one alternative matched; find whose group it was
+    for (int i = 0; i < _set_groups && p; i++, p = p->_next) {
+      if (_set_group[i] < rc && set_ovector[2 * _set_group[i]] >= 0)
+        return p->_idx;
+    }
+    return -1;
+  }
+
   while(p) {
     rc = pcre_exec(p->_re, p->_pe, str, length , 0, 0, ovector, 30/*,wspace,20*/);
     if (rc > 0) {
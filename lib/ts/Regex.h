@@ -36,6 +36,14 @@ enum REFlags
   RE_CASE_INSENSITIVE = 1
 };
 
+// Study a compiled pattern for matching.  When the PCRE library has
+//   JIT support the pattern is also JIT compiled, and matches use a
+//   JIT stack private to the calling thread.  Returns NULL if there
+//   was nothing worth keeping (check *error to tell that apart from
+//   a failure).  Free the result with regex_free_study().
+pcre_extra *regex_study(const pcre * re, const char **error);
+void regex_free_study(pcre_extra * extra);
+
 typedef struct __pat {
   int _idx;
   pcre *_re;
@@ -44,10 +52,14 @@ typedef struct __pat {
   __pat * _next;
 } dfa_pattern;
 
+// Most capture groups a joined pattern set may have, which bounds
+//   the ovector DFA::match() keeps on the stack
+#define DFA_SET_MAX_GROUPS 64
+
 class DFA
 {
 public:
-  DFA():_my_patterns(0) {
+  DFA():_my_patterns(0), _set_re(0), _set_pe(0), _set_groups(0), _set_group(0) {
   }
   
   ~DFA();
@@ -60,7 +72,17 @@ public:
   int match(const char *str, int length);
 
 private:
+  void build_set(REFlags flags);
+
   dfa_pattern * _my_patterns;
+
+  // All of _my_patterns joined into one alternation, (p0)|(p1)|...,
+  //   so match() finds the first matching pattern with one pcre_exec().
+  //   _set_group[i] is the capture group that wraps the i'th pattern.
+  pcre *_set_re;
+  pcre_extra *_set_pe;
+  int _set_groups;
+  int *_set_group;
 };
 
 
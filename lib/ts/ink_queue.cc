@@ -48,6 +48,7 @@
 #include "ink_error.h"
 #include "ink_assert.h"
 #include "ink_resource.h"
+#include "ink_thread.h"
 
 
 #ifdef __x86_64__
@@ -103,6 +104,49 @@ inkcoreapi volatile int64_t freelist_allocated_mem = 0;
 //}
 
 
+#ifdef FREELIST_MAGAZINES
+/*
+ * Per-thread magazines, after Bonwick and Adams' "Magazines and Vmem".
+ * A magazine is an array of free items.  Each thread holds two of them
+ * for every freelist and allocates and frees out of those without any
+ * atomic operation.  Only when both are empty (or both are full) does
+ * the thread trade one with the freelist's depot, a single CAS for a
+ * whole magazine of items, and only when the depot has no full magazine
+ * does an allocation fall through to the global freelist.
+ *
+ * Items held in magazines and in the depot count as in use in the
+ * freelist statistics, just like those cached by ProxyAllocator.
+ */
+
+#define MAGAZINE_BYTES  (32 * 1024)     /* per magazine, bounds big types */
+#define MAGAZINE_ITEMS  32              /* most items in a magazine */
+
+typedef struct _InkMagazine
+{
+  struct _InkMagazine *next;    /* depot link, must be first */
+  uint32_t count;
+  void *items[1];
+} InkMagazine;
+
+typedef struct
+{
+  InkFreeList *fl;
+  InkMagazine *loaded;
+  InkMagazine *previous;
+} InkMagazinePair;
+
+typedef struct
+{
+  uint32_t size;
+  InkMagazinePair *pairs;       /* indexed by InkFreeList::magazine_id */
+} InkMagazineTable;
+
+static ink_thread_key magazine_key;
+static volatile int magazine_ids = 0;
+
+static void magazine_thread_exit(void *table);
+#endif
+
 void
 ink_freelist_init(InkFreeList * f,
                   const char *name, uint32_t type_size, uint32_t chunk_size, uint32_t offset, uint32_t alignment)
@@ -142,6 +186,20 @@ ink_freelist_init(InkFreeList * f,
   f->allocated = 0;
   f->allocated_base = 0;
   f->count_base = 0;
+
+#ifdef FREELIST_MAGAZINES
+  /* single-threaded, as above */
+  if (magazine_ids == 0)
+    ink_thread_key_create(&magazine_key, magazine_thread_exit);
+  f->magazine_id = ink_atomic_increment((int *) &magazine_ids, 1);
+  f->magazine_size = MAGAZINE_BYTES / type_size;
+  if (f->magazine_size > MAGAZINE_ITEMS)
+    f->magazine_size = MAGAZINE_ITEMS;
+  if (f->magazine_size < 2)
+    f->magazine_size = 0;
+  ink_atomiclist_init(&f->magazines_full, name, 0);
+  ink_atomiclist_init(&f->magazines_empty, name, 0);
+#endif
 }
 
 InkFreeList *
@@ -163,6 +221,11 @@ int fastmemtotal = 0;
 #if defined(INK_USE_MUTEX_FOR_FREELISTS)
 void *
 ink_freelist_new_wrap(InkFreeList * f)
+#elif defined(FREELIST_MAGAZINES)
+static void freelist_free(InkFreeList * f, void *item);
+
+static void *
+freelist_new(InkFreeList * f)
 #else /* !INK_USE_MUTEX_FOR_FREELISTS */
 void *
 ink_freelist_new(InkFreeList * f)
@@ -303,7 +366,11 @@ ink_freelist_new(InkFreeList * f)
         for (int j = 0; j < (int)type_size; j++)
           a[j] = str[j % 4];
 #endif
+#ifdef FREELIST_MAGAZINES
+        freelist_free(f, a);
+#else
         ink_freelist_free(f, a);
+#endif
 #ifdef MEMPROTECT
         if (f->type_size >= MEMPROTECT_SIZE) {
           a += type_size - page_size;
@@ -358,6 +425,9 @@ typedef volatile void *volatile_void_p;
 #if defined(INK_USE_MUTEX_FOR_FREELISTS)
 void
 ink_freelist_free_wrap(InkFreeList * f, void *item)
+#elif defined(FREELIST_MAGAZINES)
+static void
+freelist_free(InkFreeList * f, void *item)
 #else /* !INK_USE_MUTEX_FOR_FREELISTS */
 void
 ink_freelist_free(InkFreeList * f, void *item)
@@ -459,6 +529,127 @@ ink_freelist_free(InkFreeList * f, void *item)
 #endif
 }
 
+#ifdef FREELIST_MAGAZINES
+static InkMagazinePair *
+magazine_table_grow(InkMagazineTable * t, InkFreeList * f)
+{
+  uint32_t size = 64;
+
+  while (size <= f->magazine_id)
+    size *= 2;
+  if (!t) {
+    t = (InkMagazineTable *) ink_malloc(sizeof(InkMagazineTable));
+    t->size = 0;
+    t->pairs = NULL;
+    ink_thread_setspecific(magazine_key, t);
+  }
+  t->pairs = (InkMagazinePair *) ink_realloc(t->pairs, size * sizeof(InkMagazinePair));
+  memset(t->pairs + t->size, 0, (size - t->size) * sizeof(InkMagazinePair));
+  t->size = size;
+  return &t->pairs[f->magazine_id];
+}
+
+static inline InkMagazinePair *
+magazine_pair(InkFreeList * f)
+{
+  InkMagazineTable *t = (InkMagazineTable *) ink_thread_getspecific(magazine_key);
+  InkMagazinePair *p;
+
+  if (unlikely(!t || f->magazine_id >= t->size))
+    p = magazine_table_grow(t, f);
+  else
+    p = &t->pairs[f->magazine_id];
+  p->fl = f;
+  return p;
+}
+
+void *
+ink_freelist_new(InkFreeList * f)
+{
+  if (f->magazine_size) {
+    InkMagazinePair *p = magazine_pair(f);
+    InkMagazine *m = p->loaded;
+
+    if (likely(m && m->count))
+      return m->items[--m->count];
+    if (p->previous && p->previous->count) {
+      p->loaded = p->previous;
+      p->previous = m;
+      m = p->loaded;
+      return m->items[--m->count];
+    }
+    /* both empty: trade the previous one for a full one from the depot */
+    InkMagazine *full = (InkMagazine *) ink_atomiclist_pop(&f->magazines_full);
+    if (full) {
+      if (p->previous)
+        ink_atomiclist_push(&f->magazines_empty, p->previous);
+      p->previous = m;
+      p->loaded = full;
+      return full->items[--full->count];
+    }
+  }
+  return freelist_new(f);
+}
+
+void
+ink_freelist_free(InkFreeList * f, void *item)
+{
+  if (f->magazine_size) {
+    InkMagazinePair *p = magazine_pair(f);
+    InkMagazine *m = p->loaded;
+
+    if (unlikely(!m || m->count == f->magazine_size)) {
+      InkMagazine *prev = p->previous;
+      if (prev && prev->count < f->magazine_size) {
+        p->previous = m;
+        p->loaded = m = prev;
+      } else {
+        /* both full: hand the previous one to the depot for an empty one */
+        InkMagazine *empty = (InkMagazine *) ink_atomiclist_pop(&f->magazines_empty);
+        if (!empty) {
+          empty = (InkMagazine *) ink_malloc(sizeof(InkMagazine) + (f->magazine_size - 1) * sizeof(void *));
+          if (unlikely(!empty)) {
+            freelist_free(f, item);
+            return;
+          }
+          empty->count = 0;
+        }
+        if (prev)
+          ink_atomiclist_push(&f->magazines_full, prev);
+        p->previous = m;
+        p->loaded = m = empty;
+      }
+    }
+    m->items[m->count++] = item;
+    return;
+  }
+  freelist_free(f, item);
+}
+
+static void
+magazine_release(InkFreeList * f, InkMagazine * m)
+{
+  if (m)
+    ink_atomiclist_push(m->count ? &f->magazines_full : &f->magazines_empty, m);
+}
+
+/* An exiting thread leaves its magazines in the depots for the others. */
+static void
+magazine_thread_exit(void *table)
+{
+  InkMagazineTable *t = (InkMagazineTable *) table;
+
+  for (uint32_t i = 0; i < t->size; i++) {
+    if (t->pairs[i].fl) {
+      magazine_release(t->pairs[i].fl, t->pairs[i].loaded);
+      magazine_release(t->pairs[i].fl, t->pairs[i].previous);
+    }
+  }
+  ink_free(t->pairs);
+  ink_free(t);
+}
+#endif /* FREELIST_MAGAZINES */
+
 void
 ink_freelists_snap_baseline()
 {
@@ -60,6 +60,7 @@
 
 /* #define USE_SPINLOCK_FOR_FREELIST */
 /* #define CHECK_FOR_DOUBLE_FREE */
+/* #define NO_FREELIST_MAGAZINES */
 
 #ifdef __cplusplus
 extern "C"
@@ -121,6 +122,26 @@ extern "C"
 
   typedef void *void_p;
 
+  typedef struct
+  {
+#if defined(INK_USE_MUTEX_FOR_ATOMICLISTS)
+    ink_mutex inkatomiclist_mutex;
+#endif
+    volatile head_p head;
+    const char *name;
+    uint32_t offset;
+  } InkAtomicList;
+
+  /*
+    Unless the freelists are lock based, ink_freelist_new and
+    ink_freelist_free first go through per-thread magazines, trading
+    whole magazines with the freelist's depot (see ink_queue.cc).
+  */
+#if !defined(INK_USE_MUTEX_FOR_FREELISTS) && !defined(USE_SPINLOCK_FOR_FREELIST) && \
+  !defined(CHECK_FOR_DOUBLE_FREE) && !defined(NO_FREELIST_MAGAZINES)
+#define FREELIST_MAGAZINES
+#endif
+
   typedef struct
   {
 #if (defined(INK_USE_MUTEX_FOR_FREELISTS) || defined(CHECK_FOR_DOUBLE_FREE))
@@ -143,6 +164,10 @@ extern "C"
     const char *name;
     uint32_t type_size, chunk_size, count, allocated, offset, alignment;
     uint32_t allocated_base, count_base;
+#ifdef FREELIST_MAGAZINES
+    uint32_t magazine_id, magazine_size;     // magazine_size 0: no magazines
+    InkAtomicList magazines_full, magazines_empty;
+#endif
   } InkFreeList, *PInkFreeList;
 
   inkcoreapi extern volatile int64_t fastalloc_mem_in_use;
@@ -185,16 +210,6 @@ extern "C"
   void ink_freelists_dump_baselinerel(FILE * f);
   void ink_freelists_snap_baseline();
 
-  typedef struct
-  {
-#if defined(INK_USE_MUTEX_FOR_ATOMICLISTS)
-    ink_mutex inkatomiclist_mutex;
-#endif
-    volatile head_p head;
-    const char *name;
-    uint32_t offset;
-  } InkAtomicList;
-
 #if !defined(INK_QUEUE_NT)
 #define INK_ATOMICLIST_EMPTY(_x) (!(TO_PTR(FREELIST_POINTER((_x.head)))))
 #else
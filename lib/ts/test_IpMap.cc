@@ -0,0 +1,164 @@
+/** @file
+
+    IpMap / IpMapArray consistency check and lookup benchmark.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <ink_assert.h>
+#include "ink_hrtime.h"
+#include "IpMap.h"
+
+// Ranges shaped like a large ACL list: mostly small blocks with the
+// occasional wide one, overlapping freely. Later rules take precedence
+// in the map (painter's algorithm), so @a data is the rule index + 1.
+struct Rule {
+  uint32_t min;
+  uint32_t max;
+};
+
+static uint32_t
+rand32()
+{
+  return ((uint32_t) (random() & 0xffff) << 16) | (uint32_t) (random() & 0xffff);
+}
+
+static void
+make_rules(Rule *rules, int n)
+{
+  for (int i = 0; i < n; i++) {
+    uint32_t span = (i % 100 == 0) ? (rand32() & 0xffffff) : (rand32() & 0x3ff);
+    rules[i].min = rand32();
+    rules[i].max = (rules[i].min > 0xffffffffU - span) ? 0xffffffffU : rules[i].min + span;
+  }
+}
+
+// Last rule covering @a addr, the reference answer.
+static intptr_t
+brute(Rule *rules, int n, uint32_t addr)
+{
+  for (int i = n - 1; i >= 0; i--) {
+    if (rules[i].min <= addr && addr <= rules[i].max)
+      return i + 1;
+  }
+  return 0;
+}
+
+static void
+check(int n, int probes, bool verify)
+{
+  Rule *rules = (Rule *) malloc(sizeof(Rule) * n);
+  IpMap map;
+  IpMapArray array;
+  ink_hrtime t0, t1, t2;
+  int hits = 0;
+
+  make_rules(rules, n);
+  for (int i = 0; i < n; i++)
+    map.mark(htonl(rules[i].min), htonl(rules[i].max), (void *) (intptr_t) (i + 1));
+  array.load(map);
+
+  uint32_t *addrs = (uint32_t *) malloc(sizeof(uint32_t) * probes);
+  for (int i = 0; i < probes; i++) {
+    // Half the probes land inside a rule.
+    if (i & 1) {
+      Rule &r = rules[random() % n];
+      addrs[i] = r.min + (uint32_t) (random() % ((uint64_t) r.max - r.min + 1));
+    } else {
+      addrs[i] = rand32();
+    }
+  }
+
+  for (int i = 0; i < probes; i++) {
+    sockaddr_in sa;
+    void *a = 0, *m = 0;
+    bool in_a, in_m;
+
+    ink_inet_ip4_set(&sa, htonl(addrs[i]));
+    in_a = array.contains(htonl(addrs[i]), &a);
+    in_m = map.contains(ink_inet_sa_cast(&sa), &m);
+    ink_release_assert(in_a == in_m && a == m);
+    ink_release_assert(array.contains(ink_inet_sa_cast(&sa)) == in_a);
+    if (verify)
+      ink_release_assert((intptr_t) a == brute(rules, n, addrs[i]));
+  }
+
+  t0 = ink_get_hrtime_internal();
+  for (int i = 0; i < probes; i++) {
+    sockaddr_in sa;
+    ink_inet_ip4_set(&sa, htonl(addrs[i]));
+    hits += map.contains(ink_inet_sa_cast(&sa));
+  }
+  t1 = ink_get_hrtime_internal();
+  for (int i = 0; i < probes; i++)
+    hits += array.contains(htonl(addrs[i]));
+  t2 = ink_get_hrtime_internal();
+
+  printf("%d rules, %d ranges: IpMap %.1f ns/lookup, IpMapArray %.1f ns/lookup (%d hits)\n",
+         n, array.getCount4(), (double) (t1 - t0) / probes, (double) (t2 - t1) / probes, hits / 2);
+
+  free(addrs);
+  free(rules);
+}
+
+static void
+check6()
+{
+  IpMap map;
+  IpMapArray array;
+  sockaddr_in6 lo, hi, x;
+  void *data = 0;
+
+  memset(&lo, 0, sizeof(lo));
+  lo.sin6_family = AF_INET6;
+  inet_pton(AF_INET6, "2001:db8::", &lo.sin6_addr);
+  hi = lo;
+  inet_pton(AF_INET6, "2001:db8::ffff:ffff", &hi.sin6_addr);
+  map.mark(ink_inet_sa_cast(&lo), ink_inet_sa_cast(&hi), (void *) 6);
+  map.mark(htonl(0x0a000000), htonl(0x0affffff), (void *) 4);
+  array.load(map);
+
+  ink_release_assert(array.getCount4() == 1 && array.getCount6() == 1);
+  x = lo;
+  inet_pton(AF_INET6, "2001:db8::1:2", &x.sin6_addr);
+  ink_release_assert(array.contains(ink_inet_sa_cast(&x), &data) && data == (void *) 6);
+  inet_pton(AF_INET6, "2001:db8:0:1::", &x.sin6_addr);
+  ink_release_assert(!array.contains(ink_inet_sa_cast(&x)));
+  ink_release_assert(array.contains(htonl(0x0a010203), &data) && data == (void *) 4);
+  ink_release_assert(!array.contains(htonl(0x0b000000)));
+}
+
+int
+main(int argc, char **argv)
+{
+  (void) argc;
+  (void) argv;
+
+  srandom(1);
+  check6();
+  check(1000, 20000, true);
+  check(100000, 1000000, false);
+  printf("test_IpMap PASSED\n");
+  return 0;
+}
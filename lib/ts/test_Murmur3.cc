@@ -0,0 +1,148 @@
+/** @file
+
+    Murmur3 reference check, incremental consistency and digest benchmark.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <ink_assert.h>
+#include "ink_hrtime.h"
+#include "INK_MD5.h"
+#include "MMH.h"
+#include "Murmur3.h"
+
+// SMHasher's verification: hash keys {0}, {0,1}, ... {0..254} with
+//   seed 256 - len, then hash the concatenated results with seed 0.
+static void
+check_reference()
+{
+  unsigned char key[256];
+  char hashes[256 * 16];
+  char final[16];
+  uint32_t verification;
+
+  for (int i = 0; i < 256; i++) {
+    key[i] = (unsigned char) i;
+    ink_code_murmur3((char *) key, i, &hashes[i * 16], 256 - i);
+  }
+  ink_code_murmur3(hashes, sizeof(hashes), final);
+  verification = (uint32_t) (unsigned char) final[0] | ((uint32_t) (unsigned char) final[1] << 8) |
+    ((uint32_t) (unsigned char) final[2] << 16) | ((uint32_t) (unsigned char) final[3] << 24);
+  ink_release_assert(verification == 0x6384BA69);
+}
+
+// Any split of the input across updates gives the one-shot value, and
+//   update_tolower matches hashing a lower cased copy.
+static void
+check_incremental()
+{
+  char input[300], lower[300];
+  char one[16], incr[16];
+
+  for (int i = 0; i < (int) sizeof(input); i++) {
+    input[i] = (char) (random() & 0xff);
+    lower[i] = (input[i] >= 'A' && input[i] <= 'Z') ? tolower(input[i]) : input[i];
+  }
+
+  for (int len = 0; len <= (int) sizeof(input); len += 7) {
+    for (int trial = 0; trial < 20; trial++) {
+      MURMUR3_CTX c, cl;
+      char incr_lower[16], one_lower[16];
+      int done = 0;
+
+      ink_code_incr_murmur3_init(&c);
+      ink_code_incr_murmur3_init(&cl);
+      while (done < len) {
+        int n = random() % (len - done + 1);
+        ink_code_incr_murmur3_update(&c, input + done, n);
+        ink_code_incr_murmur3_update_tolower(&cl, input + done, n);
+        done += n;
+      }
+      ink_code_incr_murmur3_final(incr, &c);
+      ink_code_incr_murmur3_final(incr_lower, &cl);
+      ink_code_murmur3(input, len, one);
+      ink_code_murmur3(lower, len, one_lower);
+      ink_release_assert(memcmp(one, incr, 16) == 0);
+      ink_release_assert(memcmp(one_lower, incr_lower, 16) == 0);
+    }
+  }
+}
+
+// Cache key digests over URL sized inputs, the way URL.cc feeds them.
+static void
+bench(int len)
+{
+  const int loops = 200000;
+  char *input = (char *) malloc(len);
+  char digest[16];
+  ink_hrtime t0, t1, t2, t3;
+
+  for (int i = 0; i < len; i++)
+    input[i] = 'a' + (i % 26);
+
+  t0 = ink_get_hrtime_internal();
+  for (int l = 0; l < loops; l++) {
+    INK_DIGEST_CTX c;
+    input[0] = (char) l;
+    ink_code_incr_md5_init(&c);
+    ink_code_incr_md5_update(&c, input, len);
+    ink_code_incr_md5_final(digest, &c);
+  }
+  t1 = ink_get_hrtime_internal();
+  for (int l = 0; l < loops; l++) {
+    MMH_CTX c;
+    input[0] = (char) l;
+    ink_code_incr_MMH_init(&c);
+    ink_code_incr_MMH_update(&c, input, len);
+    ink_code_incr_MMH_final(digest, &c);
+  }
+  t2 = ink_get_hrtime_internal();
+  for (int l = 0; l < loops; l++) {
+    MURMUR3_CTX c;
+    input[0] = (char) l;
+    ink_code_incr_murmur3_init(&c);
+    ink_code_incr_murmur3_update(&c, input, len);
+    ink_code_incr_murmur3_final(digest, &c);
+  }
+  t3 = ink_get_hrtime_internal();
+
+  printf("%4d bytes: MD5 %.0f ns, MMH %.0f ns, Murmur3 %.0f ns\n", len,
+         (double) (t1 - t0) / loops, (double) (t2 - t1) / loops, (double) (t3 - t2) / loops);
+  free(input);
+}
+
+int
+main(int argc, char **argv)
+{
+  (void) argc;
+  (void) argv;
+
+  srandom(1);
+  check_reference();
+  check_incremental();
+  bench(40);
+  bench(200);
+  bench(1000);
+  printf("test_Murmur3 PASSED\n");
+  return 0;
+}
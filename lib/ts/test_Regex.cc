@@ -0,0 +1,212 @@
+/** @file
+
+    Regex study / JIT and DFA pattern set consistency check and benchmark.
+
+    @section license License
+
+    Licensed to the Apache Software Foundation (ASF) under one
+    or more contributor license agreements.  See the NOTICE file
+    distributed with this work for additional information
+    regarding copyright ownership.  The ASF licenses this file
+    to you under the Apache License, Version 2.0 (the
+    "License"); you may not use this file except in compliance
+    with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ink_assert.h>
+#include "ink_hrtime.h"
+#include "Regex.h"
+
+// Shaped like a large cache.config: url_regex rules, each tried
+//   against every request URL in turn (ControlMatcher's RegexMatcher).
+static const int n_url = 200;
+// Shaped like regex_map rules in remap.config, matched with captures.
+static const int n_host = 100;
+static const int n_subjects = 2000;
+
+struct Compiled {
+  pcre *re;
+  pcre_extra *plain;
+  pcre_extra *jit;
+};
+
+static void
+compile_all(Compiled *c, char **patterns, int n)
+{
+  const char *error;
+  int erroffset;
+
+  for (int i = 0; i < n; i++) {
+    c[i].re = pcre_compile(patterns[i], 0, &error, &erroffset, NULL);
+    ink_release_assert(c[i].re != NULL);
+    c[i].plain = pcre_study(c[i].re, 0, &error);
+    c[i].jit = regex_study(c[i].re, &error);
+  }
+}
+
+static void
+free_all(Compiled *c, int n)
+{
+  for (int i = 0; i < n; i++) {
+    if (c[i].plain)
+      pcre_free(c[i].plain);
+    if (c[i].jit)
+      regex_free_study(c[i].jit);
+    pcre_free(c[i].re);
+  }
+}
+
+// Run every pattern against every subject, as the config matchers do,
+//   returning the number of matches.
+static int
+scan(Compiled *c, int n, char **subjects, bool jit, int ovecsize, ink_hrtime *elapsed)
+{
+  int ovector[30];
+  int hits = 0;
+  ink_hrtime start = ink_get_hrtime_internal();
+
+  for (int s = 0; s < n_subjects; s++) {
+    int len = strlen(subjects[s]);
+    for (int i = 0; i < n; i++) {
+      if (pcre_exec(c[i].re, jit ? c[i].jit : c[i].plain, subjects[s], len, 0, 0, ovecsize ? ovector : NULL, ovecsize) >= 0)
+        hits++;
+    }
+  }
+  *elapsed = ink_get_hrtime_internal() - start;
+  return hits;
+}
+
+static void
+bench(const char *what, char **patterns, int n, char **subjects, int ovecsize)
+{
+  Compiled *c = (Compiled *) malloc(sizeof(Compiled) * n);
+  ink_hrtime plain_time, jit_time;
+  int plain_hits, jit_hits;
+
+  compile_all(c, patterns, n);
+  plain_hits = scan(c, n, subjects, false, ovecsize, &plain_time);
+  jit_hits = scan(c, n, subjects, true, ovecsize, &jit_time);
+  ink_release_assert(plain_hits == jit_hits && plain_hits > 0);
+
+  printf("%s, %d patterns: studied %.0f ns/lookup, regex_study %.0f ns/lookup (%d hits)\n", what, n,
+         (double) plain_time / n_subjects, (double) jit_time / n_subjects, jit_hits);
+  free_all(c, n);
+  free(c);
+}
+
+static char *
+format(const char *fmt, int a, int b)
+{
+  char buf[256];
+
+  snprintf(buf, sizeof(buf), fmt, a, b);
+  return strdup(buf);
+}
+
+static void
+check_config_lookups()
+{
+  char *url_patterns[n_url], *host_patterns[n_host], *urls[n_subjects], *hosts[n_subjects];
+
+  for (int i = 0; i < n_url; i++)
+    url_patterns[i] = format("^http://(www|img)\\.site%d\\.com/.*/[a-z]+%d\\.(jpg|gif|png)$", i, i % 7);
+  for (int i = 0; i < n_host; i++)
+    host_patterns[i] = format("^(.*)\\.cdn%d\\.example\\.(com|net)$", i, 0);
+  for (int s = 0; s < n_subjects; s++) {
+    urls[s] = format("http://www.site%d.com/static/images/thumb%d.jpg", random() % (2 * n_url), random() % 7);
+    hosts[s] = format("media%d.cdn%d.example.com", s, random() % (2 * n_host));
+  }
+
+  bench("cache.config url_regex", url_patterns, n_url, urls, 0);
+  bench("remap.config regex_map", host_patterns, n_host, hosts, 30);
+
+  for (int i = 0; i < n_url; i++)
+    free(url_patterns[i]);
+  for (int i = 0; i < n_host; i++)
+    free(host_patterns[i]);
+  for (int s = 0; s < n_subjects; s++) {
+    free(urls[s]);
+    free(hosts[s]);
+  }
+}
+
+// A DFA over a set of anchored patterns must pick the same (first)
+//   pattern as trying them one by one.
+static void
+check_dfa_set()
+{
+  static const char *tags[] = {
+    "http_cs", "http_ss", "http_tproxy", "http_trans", "http_hdrs", "http_seq", "http_redirect",
+    "cache_read", "cache_write", "cache_init", "cache.*agg", "dns(_srv)?", "hostdb", "ssl",
+    "[a-z]+_chunk", "url_rewrite(_regex)?", "remap", "log.*", "net_queue", "matcher"
+  };
+  static const char *subjects[] = {
+    "http_cs", "http_chunk", "cache_write", "cache_dir_agg", "dns_srv", "dns", "url_rewrite_regex",
+    "logging", "nothing", "http_trans_x", "Cache_read", ""
+  };
+  const int n_tags = sizeof(tags) / sizeof(tags[0]);
+  const int n_subj = sizeof(subjects) / sizeof(subjects[0]);
+  const int loops = 20000;
+  DFA set;
+  DFA one[n_tags];
+  ink_hrtime t0, t1, t2;
+  int hits = 0;
+
+  ink_release_assert(set.compile(tags, n_tags) == 0);
+  for (int i = 0; i < n_tags; i++)
+    ink_release_assert(one[i].compile(tags[i]) == 0);
+
+  for (int s = 0; s < n_subj; s++) {
+    int expect = -1;
+    for (int i = 0; i < n_tags && expect < 0; i++) {
+      if (one[i].match(subjects[s]) >= 0)
+        expect = i;
+    }
+    ink_release_assert(set.match(subjects[s]) == expect);
+  }
+
+  t0 = ink_get_hrtime_internal();
+  for (int l = 0; l < loops; l++) {
+    for (int s = 0; s < n_subj; s++) {
+      for (int i = 0; i < n_tags; i++) {
+        if (one[i].match(subjects[s]) >= 0) {
+          hits++;
+          break;
+        }
+      }
+    }
+  }
+  t1 = ink_get_hrtime_internal();
+  for (int l = 0; l < loops; l++) {
+    for (int s = 0; s < n_subj; s++)
+      hits += set.match(subjects[s]) >= 0;
+  }
+  t2 = ink_get_hrtime_internal();
+
+  printf("DFA, %d patterns: one by one %.0f ns/match, joined set %.0f ns/match (%d hits)\n", n_tags,
+         (double) (t1 - t0) / (loops * n_subj), (double) (t2 - t1) / (loops * n_subj), hits / 2);
+}
+
+int
+main(int argc, char **argv)
+{
+  (void) argc;
+  (void) argv;
+
+  srandom(1);
+  check_dfa_set();
+  check_config_lookups();
+  printf("test_Regex PASSED\n");
+  return 0;
+}
@@ -25,6 +25,7 @@
 #include <string.h>
 #include "ink_thread.h"
 #include "ink_queue.h"
+#include "ink_hrtime.h"
 #include "ink_unused.h" /* MAGIC_EDITING_TAG */
 
 
@@ -59,6 +60,12 @@ test(void *d)
     memset(m2, id, 64);
     memset(m3, id, 64);
 
+    // nobody else may have been handed the same items meanwhile
+    if (((char *) m1)[63] != (char) id || ((char *) m2)[63] != (char) id || ((char *) m3)[63] != (char) id) {
+      printf("item handed out twice\n");
+      exit(1);
+    }
+
     ink_freelist_free(flist, m1);
     ink_freelist_free(flist, m2);
     ink_freelist_free(flist, m3);
@@ -72,6 +79,102 @@ test(void *d)
 }
 
 
+// Allocation throughput as the thread count grows, with and without
+// the per-thread magazines. Half the items are freed by a different
+// thread than the one that allocated them, passed on over an atomic
+// list, as happens to objects moving between net and cache threads.
+
+#define BENCH_LOOPS 200000
+
+struct Bench
+{
+  InkFreeList *fl;
+  int nthreads;
+  InkAtomicList handoff[NTHREADS];
+};
+
+struct BenchThread
+{
+  Bench *b;
+  int id;
+};
+
+static void *
+bench_thread(void *d)
+{
+  BenchThread *t = (BenchThread *) d;
+  InkFreeList *fl = t->b->fl;
+  InkAtomicList *mine = &t->b->handoff[t->id];
+  InkAtomicList *next = &t->b->handoff[(t->id + 1) % t->b->nthreads];
+  void *m[4];
+
+  for (int l = 0; l < BENCH_LOOPS; l++) {
+    for (int i = 0; i < 4; i++)
+      m[i] = ink_freelist_new(fl);
+    ink_atomiclist_push(next, m[0]);
+    ink_atomiclist_push(next, m[1]);
+    ink_freelist_free(fl, m[2]);
+    ink_freelist_free(fl, m[3]);
+    for (int i = 0; i < 2; i++) {
+      void *x = ink_atomiclist_pop(mine);
+      if (x)
+        ink_freelist_free(fl, x);
+    }
+  }
+  return NULL;
+}
+
+static ink_hrtime
+bench(int nthreads, bool magazines)
+{
+  ink_thread threads[NTHREADS];
+  BenchThread args[NTHREADS];
+  Bench b;
+  void *x;
+
+  b.fl = ink_freelist_create("bench", 64, 256, 0, 8);
+#ifdef FREELIST_MAGAZINES
+  if (!magazines)
+    b.fl->magazine_size = 0;
+#else
+  (void) magazines;
+#endif
+  b.nthreads = nthreads;
+  for (int i = 0; i < nthreads; i++) {
+    ink_atomiclist_init(&b.handoff[i], "handoff", 0);
+    args[i].b = &b;
+    args[i].id = i;
+  }
+
+  ink_hrtime start = ink_get_hrtime_internal();
+  for (int i = 0; i < nthreads; i++)
+    threads[i] = ink_thread_create(bench_thread, &args[i]);
+  for (int i = 0; i < nthreads; i++)
+    ink_thread_join(threads[i]);
+  ink_hrtime elapsed = ink_get_hrtime_internal() - start;
+
+  for (int i = 0; i < nthreads; i++) {
+    while ((x = ink_atomiclist_pop(&b.handoff[i])))
+      ink_freelist_free(b.fl, x);
+  }
+  return elapsed;
+}
+
+static void
+bench_all()
+{
+  static const int nthreads[] = { 1, 4, 16, NTHREADS };
+
+  for (unsigned int i = 0; i < sizeof(nthreads) / sizeof(nthreads[0]); i++) {
+    ink_hrtime global = bench(nthreads[i], false);
+    ink_hrtime local = bench(nthreads[i], true);
+    printf("%2d threads: global freelist %d ns/op, magazines %d ns/op\n", nthreads[i],
+           (int) (global / ((ink_hrtime) nthreads[i] * BENCH_LOOPS * 8)),
+           (int) (local / ((ink_hrtime) nthreads[i] * BENCH_LOOPS * 8)));
+  }
+}
+
+
 int
 main(int argc, char *argv[])
 {
@@ -79,6 +182,8 @@ main(int argc, char *argv[])
   //void *status;
   int i;
 
+  bench_all();
+
   flist = ink_freelist_create("woof", 64, 256, 0, 8);
 
   for (i = 0; i < NTHREADS; i++) {
@@ -726,6 +726,13 @@ RecordElement RecordsConfig[] = {
   ,
   {RECT_CONFIG, "proxy.config.http.cache.max_stale_age", RECD_INT, "604800", RECU_DYNAMIC, RR_NULL, RECC_NULL, NULL, RECA_NULL}
   ,
+  {RECT_CONFIG, "proxy.config.http.cache.stale_while_revalidate", RECD_INT, "0", RECU_DYNAMIC, RR_NULL, RECC_INT, "[0-1]", RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.http.cache.stale_if_error", RECD_INT, "0", RECU_DYNAMIC, RR_NULL, RECC_INT, "[0-1]", RECA_NULL}
+  ,
+  //       # host and Surrogate-Key purges, relative to the runtime directory
+  {RECT_CONFIG, "proxy.config.http.cache.generations_filename", RECD_STRING, "cache_generations.db", RECU_RESTART_TS, RR_NULL, RECC_NULL, NULL, RECA_NULL}
+  ,
   {RECT_CONFIG, "proxy.config.http.cache.range.lookup", RECD_INT, "1", RECU_NULL, RR_NULL, RECC_NULL, NULL, RECA_NULL}
   ,
 
@@ -892,6 +899,10 @@ RecordElement RecordsConfig[] = {
   ,
   {RECT_CONFIG, "proxy.config.cluster.rpc_cache_cluster", RECD_INT, "0", RECU_NULL, RR_NULL, RECC_NULL, NULL, RECA_NULL}
   ,
+  // run the cluster handler when a user enables a cluster VC, rather than
+  // leaving the VC to wait for its bucket to come around
+  {RECT_CONFIG, "proxy.config.cluster.enable_vc_wakeup", RECD_INT, "0", RECU_DYNAMIC, RR_NULL, RECC_INT, "[0-1]", RECA_NULL}
+  ,
 
   //##################################################################
   //# Cluster interconnect load monitoring configuration options.
@@ -940,7 +951,8 @@ RecordElement RecordsConfig[] = {
   ,
   //  # 0 - MD5 hash
   //  # 1 - MMH hash
-  {RECT_CONFIG, "proxy.config.cache.url_hash_method", RECD_INT, "1", RECU_RESTART_TS, RR_NULL, RECC_NULL, NULL, RECA_NULL}
+  //  # 2 - Murmur3 hash
+  {RECT_CONFIG, "proxy.config.cache.url_hash_method", RECD_INT, "2", RECU_RESTART_TS, RR_NULL, RECC_NULL, NULL, RECA_NULL}
   ,
   //  # default the ram cache size to AUTO_SIZE (-1)
   //  # alternatively: 20971520 (20MB)
@@ -971,6 +983,41 @@ RecordElement RecordsConfig[] = {
   ,
   {RECT_CONFIG, "proxy.config.cache.target_fragment_size", RECD_INT, "1048576", RECU_DYNAMIC, RR_NULL, RECC_NULL, NULL, RECA_NULL}
   ,
+  //  # Tiered storage (storage.config "tier=fast"): the number of recent reads
+  //  # from the slow tier after which a document is copied into the fast tier.
+  //  # (0 disables promotion)
+  {RECT_CONFIG, "proxy.config.cache.tiering.promote_hits", RECD_INT, "2", RECU_DYNAMIC, RR_NULL, RECC_INT, "[0-255]", RECA_NULL}
+  ,
+  //  # Write admission: the number of requests a new document needs within
+  //  # about admission.window seconds before it is written to disk. Can be
+  //  # overridden per cache.config rule with cache-admission-hits.
+  //  # (0 or 1 writes every cacheable miss)
+  {RECT_CONFIG, "proxy.config.cache.admission.hits", RECD_INT, "0", RECU_DYNAMIC, RR_NULL, RECC_INT, "[0-255]", RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.cache.admission.window", RECD_INT, "3600", RECU_DYNAMIC, RR_NULL, RECC_STR, "^[0-9]+$", RECA_NULL}
+  ,
+  //  # Compress document data on disk, with the same codecs as
+  //  # proxy.config.cache.ram_cache.compress. Already compressed content
+  //  # types are written as is. (0 disables compression)
+  {RECT_CONFIG, "proxy.config.cache.compress", RECD_INT, "0", RECU_RESTART_TS, RR_NULL, RECC_INT, "[0-3]", RECA_NULL}
+  ,
+  //  # Store single fragment http bodies of at least dedup.min_size bytes
+  //  # under a key derived from their content, so that identical bodies
+  //  # of different URLs in a volume share one copy on disk.
+  {RECT_CONFIG, "proxy.config.cache.dedup.enabled", RECD_INT, "0", RECU_DYNAMIC, RR_NULL, RECC_INT, "[0-1]", RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.cache.dedup.min_size", RECD_INT, "4096", RECU_DYNAMIC, RR_NULL, RECC_STR, "^[0-9]+$", RECA_NULL}
+  ,
+  //  # Write balancing: a new document whose volume is busy is written to a
+  //  # second volume picked from its key, if that one is not. A volume is
+  //  # busy while its aggregation writes take longer than latency msec or
+  //  # more than queue requests wait for its disk.
+  {RECT_CONFIG, "proxy.config.cache.write_balance.enabled", RECD_INT, "0", RECU_DYNAMIC, RR_NULL, RECC_INT, "[0-1]", RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.cache.write_balance.latency", RECD_INT, "100", RECU_DYNAMIC, RR_NULL, RECC_STR, "^[0-9]+$", RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.cache.write_balance.queue", RECD_INT, "32", RECU_DYNAMIC, RR_NULL, RECC_STR, "^[0-9]+$", RECA_NULL}
+  ,
   //  # The maximum size of a document that will be stored in the cache.
   //  # (0 disables the maximum document size check)
   {RECT_CONFIG, "proxy.config.net.enable_ink_disk_io", RECD_INT, "0", RECU_RESTART_TS, RR_NULL, RECC_NULL, NULL, RECA_NULL}
@@ -989,6 +1036,17 @@ RecordElement RecordsConfig[] = {
   ,
   {RECT_CONFIG, "proxy.config.cache.threads_per_disk", RECD_INT, "8", RECU_DYNAMIC, RR_NULL, RECC_NULL, NULL, RECA_NULL}
   ,
+  //  # Disk scheduling of cache reads and writes: while both are queued,
+  //  # reads go first until they have moved read_write_ratio times the
+  //  # bytes written, the next write included, unless the oldest request
+  //  # of the other class has waited longer than its deadline (in
+  //  # milliseconds).
+  {RECT_CONFIG, "proxy.config.cache.aio.read_deadline", RECD_INT, "20", RECU_RESTART_TS, RR_NULL, RECC_STR, "^[0-9]+$", RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.cache.aio.write_deadline", RECD_INT, "500", RECU_RESTART_TS, RR_NULL, RECC_STR, "^[0-9]+$", RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.cache.aio.read_write_ratio", RECD_INT, "1", RECU_RESTART_TS, RR_NULL, RECC_INT, "[1-100]", RECA_NULL}
+  ,
   {RECT_CONFIG, "proxy.config.cache.aio_sleep_time", RECD_INT, "100", RECU_DYNAMIC, RR_NULL, RECC_NULL, NULL, RECA_NULL}
   ,
   {RECT_CONFIG, "proxy.config.cache.check_disk_idle", RECD_INT, "1", RECU_DYNAMIC, RR_NULL, RECC_NULL, NULL, RECA_NULL}
@@ -1314,6 +1372,9 @@ RecordElement RecordsConfig[] = {
   ,
   {RECT_CONFIG, "proxy.config.ssl.server.multicert.filename", RECD_STRING, "ssl_multicert.config", RECU_RESTART_TS, RR_NULL, RECC_NULL, NULL, RECA_NULL}
   ,
+  //       Maximum number of server name SSL contexts kept loaded, 0 for no limit
+  {RECT_CONFIG, "proxy.config.ssl.server.multicert.ctx_cache.size", RECD_INT, "0", RECU_RESTART_TS, RR_NULL, RECC_NULL, NULL, RECA_NULL}
+  ,
   {RECT_CONFIG, "proxy.config.ssl.server.private_key.filename", RECD_STRING, NULL, RECU_RESTART_TS, RR_NULL, RECC_STR, "^[^[:space:]]*$", RECA_NULL}
   ,
   {RECT_CONFIG, "proxy.config.ssl.server.private_key.path", RECD_STRING, NULL, RECU_RESTART_TS, RR_NULL, RECC_NULL, NULL, RECA_NULL}
@@ -1336,10 +1397,21 @@ RecordElement RecordsConfig[] = {
   ,
   {RECT_CONFIG, "proxy.config.ssl.client.CA.cert.path", RECD_STRING, NULL, RECU_RESTART_TS, RR_NULL, RECC_NULL, NULL, RECA_NULL}
   ,
-  {RECT_CONFIG, "proxy.config.ssl.session_cache", RECD_INT, "1", RECU_RESTART_TS, RR_NULL, RECC_NULL, NULL, RECA_NULL}
+  //       session_cache=0 no session cache
+  //       session_cache=1 per SSL_CTX OpenSSL cache
+  //       session_cache=2 shared cache in session_cache.filename, survives restarts
+  {RECT_CONFIG, "proxy.config.ssl.session_cache", RECD_INT, "1", RECU_RESTART_TS, RR_NULL, RECC_INT, "[0-2]", RECA_NULL}
   ,
   {RECT_CONFIG, "proxy.config.ssl.session_cache.size", RECD_INT, "20480", RECU_RESTART_TS, RR_NULL, RECC_NULL, NULL, RECA_NULL}
   ,
+  {RECT_CONFIG, "proxy.config.ssl.session_cache.num_stripes", RECD_INT, "256", RECU_RESTART_TS, RR_NULL, RECC_NULL, NULL, RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.ssl.session_cache.filename", RECD_STRING, "ssl_session.cache", RECU_RESTART_TS, RR_NULL, RECC_NULL, NULL, RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.ssl.server.ticket_key.filename", RECD_STRING, NULL, RECU_RESTART_TS, RR_NULL, RECC_STR, "^[^[:space:]]*$", RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.ssl.server.ticket_key.reload_interval", RECD_INT, "60", RECU_RESTART_TS, RR_NULL, RECC_NULL, NULL, RECA_NULL}
+  ,
 
   //##############################################################################
   //# ICP Configuration
@@ -1368,6 +1440,14 @@ RecordElement RecordsConfig[] = {
   ,
   {RECT_CONFIG, "proxy.config.icp.default_reply_port", RECD_INT, "0", RECU_DYNAMIC, RR_NULL, RECC_NULL, NULL, RECA_NULL}
   ,
+  {RECT_CONFIG, "proxy.config.icp.digest.enabled", RECD_INT, "0", RECU_DYNAMIC, RR_NULL, RECC_INT, "[0-1]", RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.icp.digest.rebuild_interval", RECD_INT, "300", RECU_DYNAMIC, RR_NULL, RECC_INT, "[1-86400]", RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.icp.digest.bits_per_entry", RECD_INT, "8", RECU_DYNAMIC, RR_NULL, RECC_INT, "[1-32]", RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.icp.digest.max_size", RECD_INT, "1048576", RECU_DYNAMIC, RR_NULL, RECC_NULL, NULL, RECA_NULL}
+  ,
 
   //############################################################################
   //#
@@ -1870,6 +1950,12 @@ RecordElement RecordsConfig[] = {
   ,
   {RECT_CONFIG, "proxy.config.prefetch.redirection", RECD_INT, "0", RECU_NULL, RR_NULL, RECC_NULL, NULL, RECA_NULL}
   ,
+  {RECT_CONFIG, "proxy.config.prefetch.max_fetches", RECD_INT, "64", RECU_NULL, RR_NULL, RECC_NULL, NULL, RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.prefetch.max_fetches_per_origin", RECD_INT, "4", RECU_NULL, RR_NULL, RECC_NULL, NULL, RECA_NULL}
+  ,
+  {RECT_CONFIG, "proxy.config.prefetch.max_queued_per_origin", RECD_INT, "256", RECU_NULL, RR_NULL, RECC_NULL, NULL, RECA_NULL}
+  ,
   //# Librecords based stats system (new as of v2.1.3)
   {RECT_CONFIG, "proxy.config.stat_api.max_stats_allowed", RECD_INT, "256", RECU_RESTART_TS, RR_NULL, RECC_INT, "[256-1000]", RECA_NULL}
   ,
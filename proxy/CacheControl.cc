@@ -54,6 +54,7 @@
 static const char modulePrefix[] = "[CacheControl]";
 
 # define TWEAK_CACHE_RESPONSES_TO_COOKIES "cache-responses-to-cookies"
+# define TWEAK_CACHE_ADMISSION_HITS "cache-admission-hits"
 
 static const char *CC_directive_str[CC_NUM_TYPES] = {
   "INVALID",
@@ -247,6 +248,8 @@ CacheControlRecord::Print()
     printf("\t\t  - " TWEAK_CACHE_RESPONSES_TO_COOKIES ":%d\n",
       cache_responses_to_cookies
     );
+  if (cache_admission_hits >= 0)
+    printf("\t\t  - " TWEAK_CACHE_ADMISSION_HITS ":%d\n", cache_admission_hits);
   ControlBase::Print();
 }
 
@@ -293,6 +296,20 @@ CacheControlRecord::Init(matcher_line * line_info)
         cache_responses_to_cookies = v;
       }
       used = true;
+    } else if (strcasecmp(label, TWEAK_CACHE_ADMISSION_HITS) == 0) {
+      char* ptr = 0;
+      int v = strtol(val, &ptr, 0);
+      if (!ptr || *ptr || v < 0 || v > 255) {
+        errBuf = static_cast<char*>(xmalloc(errBufLen * sizeof(char)));
+        snprintf(errBuf, errBufLen,
+          "Value for " TWEAK_CACHE_ADMISSION_HITS
+          " must be an integer in the range 0..255"
+        );
+        return errBuf;
+      } else {
+        cache_admission_hits = v;
+      }
+      used = true;
     }
 
     // Clip pair if used.
@@ -478,6 +495,9 @@ CacheControlRecord::UpdateMatch(CacheControlResult * result, RD * rdata)
   if (cache_responses_to_cookies >= 0)
     result->cache_responses_to_cookies = cache_responses_to_cookies;
 
+  if (match == true && cache_admission_hits >= 0)
+    result->cache_admission_hits = cache_admission_hits;
+
   if (match == true) {
     char crtc_debug[80];
     if (result->cache_responses_to_cookies >= 0)
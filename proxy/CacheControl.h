@@ -82,6 +82,7 @@ public:
   bool ignore_server_no_cache;
   bool ignore_client_cc_max_age;
   int cache_responses_to_cookies; ///< Override for caching cookied responses.
+  int cache_admission_hits; ///< Override for proxy.config.cache.admission.hits.
 //  bool cache_auth_content;
 
   // Data for internal use only
@@ -111,6 +112,7 @@ CacheControlResult::CacheControlResult()
     ignore_server_no_cache(false),
     ignore_client_cc_max_age(true),
     cache_responses_to_cookies(-1), // do not change value
+    cache_admission_hits(-1), // do not change value
     //cache_auth_content(false),
     reval_line(-1),
     never_line(-1),
@@ -128,6 +130,7 @@ public:
   CacheControlType directive;
   int time_arg;
   int cache_responses_to_cookies;
+  int cache_admission_hits;
   char *Init(matcher_line * line_info);
   inkcoreapi void UpdateMatch(CacheControlResult * result, RD * rdata);
   void Print();
@@ -136,7 +139,7 @@ public:
 inline
 CacheControlRecord::CacheControlRecord()
   : ControlBase(), directive(CC_INVALID), time_arg(0)
-                  , cache_responses_to_cookies(-1)
+                  , cache_responses_to_cookies(-1), cache_admission_hits(-1)
 {}
 
 //
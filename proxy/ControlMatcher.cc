@@ -82,6 +82,335 @@ HttpRequestData::get_client_ip()
   return src_ip;
 }
 
+//
+// int regexRequiredLiteral(const char* pattern, char* buf, int buf_len)
+//
+//   Finds the longest run of plain characters that every string
+//     matching pattern must contain and copies it, NUL terminated,
+//     into buf.  Only text outside of groups is considered and
+//     anything the scan does not understand ends the current run,
+//     so the result is always a substring of any match.
+//
+//   Returns the length of the literal, 0 if there is none worth
+//     checking for
+//
+#define REGEX_MIN_LITERAL 3
+// Escapes that stand alone: classes, assertions and control characters
+#define REGEX_SIMPLE_ESCAPES "dDsSwWhHvVbBAzZGRXKntrfae"
+
+int
+regexRequiredLiteral(const char *pattern, char *buf, int buf_len)
+{
+  char run[256];
+  int run_len = 0;
+  int best_len = 0;
+  int depth = 0;
+  const char *p = pattern;
+
+  // Alternation at the top level means no single literal is required.
+  //   Inline options (eg (?i)) and \Q..\E quoting change how the rest
+  //   of the pattern reads, so don't try to follow them
+  if (strstr(pattern, "(?") != NULL || strstr(pattern, "\\Q") != NULL) {
+    return 0;
+  }
+
+  while (true) {
+    bool literal = false;
+    char c = *p;
+
+    if (c == '\\' && p[1] != '\0') {
+      if (!isalnum((unsigned char) p[1])) {
+        c = p[1];
+        literal = (depth == 0);
+      } else if (!strchr(REGEX_SIMPLE_ESCAPES, p[1])) {
+        // \x41, \p{Lu}, \cA, octal and back references take operands
+        //   that must not be read as literal text
+        return 0;
+      }
+      p += 2;
+    } else if (c == '[') {
+      // Skip the whole character class
+      p++;
+      if (*p == '^')
+        p++;
+      if (*p == ']')
+        p++;
+      while (*p && *p != ']') {
+        if (*p == '\\' && p[1] != '\0')
+          p++;
+        p++;
+      }
+      if (*p)
+        p++;
+    } else if (c == '(') {
+      depth++;
+      p++;
+    } else if (c == ')') {
+      depth--;
+      p++;
+    } else if (c == '|') {
+      if (depth == 0) {
+        return 0;
+      }
+      p++;
+    } else if (c == '{') {
+      // Skip a {n,m} quantifier, otherwise the brace is just a literal
+      //   that we don't bother with
+      const char *q = p + 1;
+      while (isdigit((unsigned char) *q) || *q == ',')
+        q++;
+      p = (*q == '}' && q > p + 1) ? q + 1 : p + 1;
+    } else if (c == '\0' || c == '.' || c == '^' || c == '$' || c == '*' || c == '+' || c == '?') {
+      if (c != '\0')
+        p++;
+    } else {
+      literal = (depth == 0);
+      p++;
+    }
+
+    if (literal && (*p == '*' || *p == '?' || *p == '{')) {
+      // The character we just read is optional
+      literal = false;
+    }
+
+    if (literal && run_len < (int) sizeof(run) - 1) {
+      run[run_len++] = c;
+      // A repeated character is still required once but ends the run
+      if (*p != '+') {
+        continue;
+      }
+    }
+
+    if (run_len > best_len && run_len < buf_len) {
+      memcpy(buf, run, run_len);
+      buf[run_len] = '\0';
+      best_len = run_len;
+    }
+    run_len = 0;
+
+    if (c == '\0') {
+      break;
+    }
+  }
+
+  return best_len >= REGEX_MIN_LITERAL ? best_len : 0;
+}
+
+/*************************************************************
+ *   Begin class IpMatchTable
+ *************************************************************/
+
+IpMatchTable::IpMatchTable():
+entries(NULL), array_len(-1), num_entries(0), ranges(NULL), num_ranges(0), match_list(NULL)
+{
+}
+
+IpMatchTable::~IpMatchTable()
+{
+  xfree(entries);
+  xfree(ranges);
+  xfree(match_list);
+}
+
+void
+IpMatchTable::AllocateSpace(int num)
+{
+  ink_assert(array_len == -1);
+
+  entries = (Entry *) xmalloc(sizeof(Entry) * num);
+  array_len = num;
+  num_entries = 0;
+}
+
+void
+IpMatchTable::NewEntry(ip_addr_t addr1, ip_addr_t addr2, void *opaque_data)
+{
+  ink_assert(num_entries < array_len);
+  ink_assert(ranges == NULL);
+
+  entries[num_entries].min = addr1;
+  entries[num_entries].max = addr2;
+  entries[num_entries].opaque_data = opaque_data;
+  num_entries++;
+}
+
+struct IpMatchEvent
+{
+  uint64_t addr;
+  int idx;
+};
+
+static int
+cmp_ip_match_event(const void *a, const void *b)
+{
+  const IpMatchEvent *x = (const IpMatchEvent *) a;
+  const IpMatchEvent *y = (const IpMatchEvent *) b;
+
+  if (x->addr != y->addr)
+    return (x->addr < y->addr) ? -1 : 1;
+  return x->idx - y->idx;
+}
+
+//
+// void IpMatchTable::Compile()
+//
+//   Sweeps across the range boundaries in address order keeping the
+//     set of entries that cover the current piece of the address
+//     space, sorted by entry index.  Each piece gets a copy of that
+//     set; adjacent pieces with the same set are merged.
+//
+void
+IpMatchTable::Compile()
+{
+  IpMatchEvent *starts, *ends;
+  int *active;
+  int num_active = 0;
+  int match_len = 0;
+  int match_size;
+  int s = 0, e = 0;
+
+  if (num_entries <= 0) {
+    return;
+  }
+
+  // Ends are kept as max + 1, in 64 bits so they can't wrap
+  starts = (IpMatchEvent *) xmalloc(sizeof(IpMatchEvent) * num_entries);
+  ends = (IpMatchEvent *) xmalloc(sizeof(IpMatchEvent) * num_entries);
+  for (int i = 0; i < num_entries; i++) {
+    starts[i].addr = (uint64_t) entries[i].min;
+    starts[i].idx = i;
+    ends[i].addr = (uint64_t) entries[i].max + 1;
+    ends[i].idx = i;
+  }
+  qsort(starts, num_entries, sizeof(IpMatchEvent), cmp_ip_match_event);
+  qsort(ends, num_entries, sizeof(IpMatchEvent), cmp_ip_match_event);
+
+  active = (int *) xmalloc(sizeof(int) * num_entries);
+  ranges = (IpMatchRange *) xmalloc(sizeof(IpMatchRange) * num_entries * 2);
+  match_size = num_entries * 2;
+  match_list = (void **) xmalloc(sizeof(void *) * match_size);
+
+  while (s < num_entries || e < num_entries) {
+    uint64_t lo, next;
+
+    // The next boundary is the lowest pending start or end
+    if (e >= num_entries || (s < num_entries && starts[s].addr < ends[e].addr)) {
+      lo = starts[s].addr;
+    } else {
+      lo = ends[e].addr;
+    }
+
+    while (e < num_entries && ends[e].addr == lo) {
+      int idx = ends[e++].idx;
+      int j = 0;
+      while (active[j] != idx) {
+        j++;
+      }
+      memmove(active + j, active + j + 1, sizeof(int) * (num_active - j - 1));
+      num_active--;
+    }
+    while (s < num_entries && starts[s].addr == lo) {
+      int idx = starts[s++].idx;
+      int j = num_active;
+      while (j > 0 && active[j - 1] > idx) {
+        active[j] = active[j - 1];
+        j--;
+      }
+      active[j] = idx;
+      num_active++;
+    }
+
+    if (num_active == 0) {
+      continue;
+    }
+    // Something is still open so there must be an end pending
+    ink_assert(e < num_entries);
+    next = ends[e].addr;
+    if (s < num_entries && starts[s].addr < next) {
+      next = starts[s].addr;
+    }
+
+    // Extend the previous range if it ends right here with the same entries
+    if (num_ranges > 0) {
+      IpMatchRange *prev = ranges + num_ranges - 1;
+      if ((uint64_t) prev->max + 1 == lo && prev->count == num_active) {
+        int j;
+        for (j = 0; j < num_active; j++) {
+          if (match_list[prev->first + j] != entries[active[j]].opaque_data) {
+            break;
+          }
+        }
+        if (j == num_active) {
+          prev->max = (ip_addr_t) (next - 1);
+          continue;
+        }
+      }
+    }
+
+    if (match_len + num_active > match_size) {
+      while (match_len + num_active > match_size) {
+        match_size *= 2;
+      }
+      match_list = (void **) xrealloc(match_list, sizeof(void *) * match_size);
+    }
+
+    IpMatchRange *r = ranges + num_ranges++;
+    r->min = (ip_addr_t) lo;
+    r->max = (ip_addr_t) (next - 1);
+    r->first = match_len;
+    r->count = num_active;
+    for (int j = 0; j < num_active; j++) {
+      match_list[match_len++] = entries[active[j]].opaque_data;
+    }
+  }
+
+  xfree(active);
+  xfree(ends);
+  xfree(starts);
+}
+
+int
+IpMatchTable::Match(ip_addr_t addr, void ***matches)
+{
+  int lo = 0;
+  int hi = num_ranges - 1;
+
+  // Find the first range that does not end before addr
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (ranges[mid].max < addr) {
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  if (lo < num_ranges && ranges[lo].min <= addr) {
+    *matches = match_list + ranges[lo].first;
+    return ranges[lo].count;
+  }
+  return 0;
+}
+
+void
+IpMatchTable::Print(void (*f) (void *))
+{
+  for (int i = 0; i < num_ranges; i++) {
+    unsigned int lo = (unsigned int) ranges[i].min;
+    unsigned int hi = (unsigned int) ranges[i].max;
+    printf("\t\tRange %u.%u.%u.%u - %u.%u.%u.%u with %d entries\n",
+           (lo >> 24) & 0xff, (lo >> 16) & 0xff, (lo >> 8) & 0xff, lo & 0xff,
+           (hi >> 24) & 0xff, (hi >> 16) & 0xff, (hi >> 8) & 0xff, hi & 0xff, ranges[i].count);
+    for (int j = 0; j < ranges[i].count; j++) {
+      f(match_list[ranges[i].first + j]);
+    }
+  }
+}
+
+/*************************************************************
+ *   End class IpMatchTable
+ *************************************************************/
+
 /*************************************************************
  *   Begin class HostMatcher
  *************************************************************/
@@ -230,7 +559,7 @@ template<class Data, class Result> char *HostMatcher<Data, Result>::NewEntry(mat
 // RegexMatcher<Data,Result>::RegexMatcher()
 //
 template<class Data, class Result> RegexMatcher<Data, Result>::RegexMatcher(const char *name, const char *filename):
-re_array(NULL), re_str(NULL), data_array(NULL), array_len(-1), num_el(-1), matcher_name(name), file_name(filename)
+re_array(NULL), re_extra(NULL), re_literal(NULL), re_str(NULL), data_array(NULL), array_len(-1), num_el(-1), matcher_name(name), file_name(filename)
 {
 }
 
@@ -241,9 +570,14 @@ template<class Data, class Result> RegexMatcher<Data, Result>::~RegexMatcher()
 {
   for (int i = 0; i < num_el; i++) {
     pcre_free(re_array[i]);
+    if (re_extra[i])
+      regex_free_study(re_extra[i]);
+    xfree(re_literal[i].str);
     xfree(re_str[i]);
   }
   delete[]re_str;
+  xfree(re_literal);
+  xfree(re_extra);
   xfree(re_array);
   delete[]data_array;
 }
@@ -258,6 +592,8 @@ template<class Data, class Result> void RegexMatcher<Data, Result>::Print()
   printf("\tRegex Matcher with %d elements\n", num_el);
   for (int i = 0; i < num_el; i++) {
     printf("\t\tRegex: %s\n", re_str[i]);
+    if (re_literal[i].str)
+      printf("\t\t  Requires: %s\n", re_literal[i].str);
     data_array[i].Print();
   }
 }
@@ -273,6 +609,12 @@ template<class Data, class Result> void RegexMatcher<Data, Result>::AllocateSpac
   re_array = (pcre**) xmalloc(sizeof(pcre*) * num_entries);
   memset(re_array, 0, sizeof(pcre*) * num_entries);
 
+  re_extra = (pcre_extra**) xmalloc(sizeof(pcre_extra*) * num_entries);
+  memset(re_extra, 0, sizeof(pcre_extra*) * num_entries);
+
+  re_literal = (RegexLiteral *) xmalloc(sizeof(RegexLiteral) * num_entries);
+  memset(re_literal, 0, sizeof(RegexLiteral) * num_entries);
+
   data_array = NEW(new Data[num_entries]);
 
   re_str = NEW(new char *[num_entries]);
@@ -293,6 +635,8 @@ template<class Data, class Result> char *RegexMatcher<Data, Result>::NewEntry(ma
   char *pattern;
   const char *error;
   int erroffset;
+  char literal[256];
+  int literal_len;
 
   // Make sure space has been allocated
   ink_assert(num_el >= 0);
@@ -318,6 +662,16 @@ template<class Data, class Result> char *RegexMatcher<Data, Result>::NewEntry(ma
   }
   re_str[num_el] = xstrdup(pattern);
 
+  // Study (and where available JIT compile) the pattern; a NULL result
+  //   without an error just means studying found nothing useful
+  re_extra[num_el] = regex_study(re_array[num_el], &error);
+
+  literal_len = regexRequiredLiteral(pattern, literal, sizeof(literal));
+  if (literal_len > 0) {
+    re_literal[num_el].str = xstrdup(literal);
+    re_literal[num_el].len = literal_len;
+  }
+
   // Remove our consumed label from the parsed line
   line_info->line[0][line_info->dest_entry] = 0;
   line_info->num_el--;
@@ -332,6 +686,12 @@ template<class Data, class Result> char *RegexMatcher<Data, Result>::NewEntry(ma
     // There was a problem so undo the effects this function
     xfree(re_str[num_el]);
     re_str[num_el] = NULL;
+    xfree(re_literal[num_el].str);
+    re_literal[num_el].str = NULL;
+    if (re_extra[num_el]) {
+      regex_free_study(re_extra[num_el]);
+      re_extra[num_el] = NULL;
+    }
     pcre_free(re_array[num_el]);
     re_array[num_el] = NULL;
   }
@@ -342,12 +702,15 @@ template<class Data, class Result> char *RegexMatcher<Data, Result>::NewEntry(ma
 //
 // void RegexMatcher<Data,Result>::Match(RD* rdata, Result* result)
 //
-//   Coduncts a linear search through the regex array and
-//     updates arg result for each regex that matches arg URL
+//   Conducts a linear search through the regex array and
+//     updates arg result for each regex that matches arg URL.
+//     Regexes whose required literal is not in the URL are
+//     skipped without running pcre
 //
 template<class Data, class Result> void RegexMatcher<Data, Result>::Match(RD * rdata, Result * result)
 {
   char *url_str;
+  int url_len;
   int r;
 
   // Check to see there is any work to before we copy the
@@ -367,10 +730,14 @@ template<class Data, class Result> void RegexMatcher<Data, Result>::Match(RD * r
   // The function unescapifyStr() is already called in
   // HttpRequestData::get_string(); therefore, no need to call again here.
   // unescapifyStr(url_str);
+  url_len = strlen(url_str);
 
   for (int i = 0; i < num_el; i++) {
+    if (re_literal[i].str && (re_literal[i].len > url_len || strstr(url_str, re_literal[i].str) == NULL)) {
+      continue;
+    }
 
-    r = pcre_exec(re_array[i], NULL, url_str, strlen(url_str), 0, 0, NULL, 0);
+    r = pcre_exec(re_array[i], re_extra[i], url_str, url_len, 0, 0, NULL, 0);
     if (r > -1) {
       Debug("matcher", "%s Matched %s with regex at line %d", matcher_name, url_str, data_array[i].line_num);
       data_array[i].UpdateMatch(result, rdata);
@@ -400,10 +767,13 @@ Result > (name, filename)
 //
 //   Conducts a linear search through the regex array and
 //     updates arg result for each regex that matches arg host_regex
+//     Like RegexMatcher::Match, regexes whose required literal is
+//     not in the host are skipped
 //
 template<class Data, class Result> void HostRegexMatcher<Data, Result>::Match(RD * rdata, Result * result)
 {
   const char *url_str;
+  int url_len;
   int r;
 
   // Check to see there is any work to before we copy the
@@ -419,16 +789,23 @@ template<class Data, class Result> void HostRegexMatcher<Data, Result>::Match(RD
   if (url_str == NULL) {
     url_str = "";
   }
+  url_len = strlen(url_str);
+
   for (int i = 0; i < this->num_el; i++) {
-    r = pcre_exec(this->re_array[i], NULL, url_str, strlen(url_str), 0, 0, NULL, 0);
-    if (r != -1) {
+    if (this->re_literal[i].str &&
+        (this->re_literal[i].len > url_len || strstr(url_str, this->re_literal[i].str) == NULL)) {
+      continue;
+    }
+
+    r = pcre_exec(this->re_array[i], this->re_extra[i], url_str, url_len, 0, 0, NULL, 0);
+    if (r > -1) {
       Debug("matcher", "%s Matched %s with regex at line %d",
             this->matcher_name, url_str, this->data_array[i].line_num);
       this->data_array[i].UpdateMatch(result, rdata);
-    } else {
+    } else if (r < -1) {
       // An error has occured
-      Warning("error matching regex at line %d", this->data_array[i].line_num);
-    }
+      Warning("Error [%d] matching regex at line %d.", r, this->data_array[i].line_num);
+    } // else it's -1 which means no match was found.
   }
 }
 
@@ -436,7 +813,7 @@ template<class Data, class Result> void HostRegexMatcher<Data, Result>::Match(RD
 // IpMatcher<Data,Result>::IpMatcher()
 //
 template<class Data, class Result> IpMatcher<Data, Result>::IpMatcher(const char *name, const char *filename):
-ip_lookup(NULL),
+ip_table(NULL),
 data_array(NULL),
 array_len(-1),
 num_el(-1),
@@ -450,7 +827,7 @@ file_name(filename)
 //
 template<class Data, class Result> IpMatcher<Data, Result>::~IpMatcher()
 {
-  delete ip_lookup;
+  delete ip_table;
   delete[]data_array;
 }
 
@@ -462,7 +839,8 @@ template<class Data, class Result> void IpMatcher<Data, Result>::AllocateSpace(i
   // Should not have been allocated before
   ink_assert(array_len == -1);
 
-  ip_lookup = NEW(new IpLookup(matcher_name));
+  ip_table = NEW(new IpMatchTable);
+  ip_table->AllocateSpace(num_entries);
 
   data_array = NEW(new Data[num_entries]);
 
@@ -473,8 +851,8 @@ template<class Data, class Result> void IpMatcher<Data, Result>::AllocateSpace(i
 //
 // char* IpMatcher<Data,Result>::NewEntry(matcher_line* line_info)
 //
-//    Inserts a range the ip lookup table.
-//        Creates new table levels as needed
+//    Adds a range to the ip table.  The table can not be
+//        searched until Compile() is called
 //
 //    Returns NULL is all was OK.  On error returns, a malloc
 //     allocated error string which the CALLEE is responsible
@@ -522,31 +900,40 @@ template<class Data, class Result> char *IpMatcher<Data, Result>::NewEntry(match
     return errBuf;
   }
 
-  ip_lookup->NewEntry(addr1, addr2, cur_d);
+  ip_table->NewEntry(addr1, addr2, cur_d);
 
   num_el++;
   return NULL;
 }
 
 //
-// void IpMatcherData,Result>::Match(ip_addr_t addr, RD* rdata, Result* result)
+// void IpMatcher<Data,Result>::Compile()
+//
+//    Builds the lookup table once all the entries are in
+//
+template<class Data, class Result> void IpMatcher<Data, Result>::Compile()
+{
+  ip_table->Compile();
+}
+
+//
+// void IpMatcher<Data,Result>::Match(ip_addr_t addr, RD* rdata, Result* result)
+//
+//    addr is in network order
 //
 template<class Data, class Result>
   void IpMatcher<Data, Result>::Match(ip_addr_t addr, RD * rdata, Result * result)
 {
-  Data *cur;
-  bool found;
-  IpLookupState s;
+  void **matches;
+  int n;
 
-  found = ip_lookup->MatchFirst(addr, &s, (void **) &cur);
+  n = ip_table->Match(ntohl(addr), &matches);
 
-  while (found == true) {
+  for (int i = 0; i < n; i++) {
+    Data *cur = (Data *) matches[i];
 
     ink_assert(cur != NULL);
-
     cur->UpdateMatch(result, rdata);
-
-    found = ip_lookup->MatchNext(&s, (void **) &cur);
   }
 }
 
@@ -554,8 +941,8 @@ template<class Data, class Result>
 template<class Data, class Result> void IpMatcher<Data, Result>::Print()
 {
   printf("\tIp Matcher with %d elements\n", num_el);
-  if (ip_lookup != NULL) {
-    ip_lookup->Print(IpMatcher<Data, Result>::PrintFunc);
+  if (ip_table != NULL) {
+    ip_table->Print(IpMatcher<Data, Result>::PrintFunc);
   }
 }
 
@@ -818,6 +1205,10 @@ template<class Data, class Result> int ControlMatcher<Data, Result>::BuildTableF
 
   ink_assert(second_pass == numEntries);
 
+  if (ipMatch != NULL) {
+    ipMatch->Compile();
+  }
+
   if (is_debug_tag_set("matcher")) {
     Print();
   }
@@ -898,3 +1289,53 @@ template class HostMatcher<CongestionControlRecord, CongestionControlRule>;
 template class HostRegexMatcher<CongestionControlRecord, CongestionControlRule>;
 template class RegexMatcher<CongestionControlRecord, CongestionControlRule>;
 template class IpMatcher<CongestionControlRecord, CongestionControlRule>;
+
+#if TS_HAS_TESTS
+REGRESSION_TEST(ControlMatcher_RegexLiteral) (RegressionTest * t, int atype, int *pstatus) {
+  NOWARN_UNUSED(atype);
+  // Each pattern must match its subject, and the literal, if any, must
+  //   be in the subject or the prefilter would reject a real match
+  static const struct
+  {
+    const char *pattern;
+    const char *subject;
+    const char *literal;
+  } cases[] = {
+    { "www\\.example\\.com", "http://www.example.com/", "www.example.com" },
+    { "\\dfoo\\.com", "http://1foo.com/", "foo.com" },
+    { "^http://[a-z]+\\.cdn\\.net/", "http://img.cdn.net/a", ".cdn.net/" },
+    { "abc(def)+ghij", "abcdefdefghij", "ghij" },
+    { "abcd?efgh", "abcefgh", "efgh" },
+    { "ab|cd", "xcdx", NULL },
+    { "\\x41bcd", "Abcd", NULL },
+    { "\\x{41}bcd", "Abcd", NULL },
+    { "\\p{Lu}abcd", "Xabcd", NULL },
+    { "\\cAxyzw", "\001xyzw", NULL },
+    { "\\101bcd", "Abcd", NULL },
+    { "\\0101bcd", "\0101bcd", NULL },
+    { "(a)\\1bcd", "aabcd", NULL },
+    { "(?i)abcd", "ABCD", NULL },
+  };
+  char buf[256];
+
+  *pstatus = REGRESSION_TEST_PASSED;
+  for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    const char *error;
+    int erroffset;
+    pcre *re = pcre_compile(cases[i].pattern, 0, &error, &erroffset, NULL);
+    int len = regexRequiredLiteral(cases[i].pattern, buf, sizeof(buf));
+
+    if (!re || pcre_exec(re, NULL, cases[i].subject, strlen(cases[i].subject), 0, 0, NULL, 0) < 0) {
+      rprintf(t, "pattern '%s' does not match '%s'\n", cases[i].pattern, cases[i].subject);
+      *pstatus = REGRESSION_TEST_FAILED;
+    }
+    if (re)
+      pcre_free(re);
+    if (cases[i].literal ? (len == 0 || strcmp(buf, cases[i].literal) != 0) : len != 0) {
+      rprintf(t, "pattern '%s' gave literal '%s', expected '%s'\n", cases[i].pattern,
+              len ? buf : "", cases[i].literal ? cases[i].literal : "");
+      *pstatus = REGRESSION_TEST_FAILED;
+    }
+  }
+}
+#endif
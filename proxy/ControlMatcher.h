@@ -54,8 +54,10 @@
  *  Lookup Table Descriptions
  *  -------------------------
  *
- *   regex table - implemented as a linear list of regular expressions to
- *       match against
+ *   regex table - implemented as a list of studied regular expressions
+ *       to match against.  At build time the literal text each regex
+ *       requires (if any) is extracted, so a lookup only runs pcre on
+ *       the regexes whose literal occurs in the subject
  *
  *   host/domain table - The host domain table is logically implemented as
  *       tree, broken up at each partition in a hostname.  Three mechanism
@@ -67,10 +69,11 @@
  *       time, the fixed array is converted to a hash table
  *
  *   ip table - supports ip ranges.  A single ip address is treated as
- *       a range with the same beginning and end address.  The table is
- *       is devided up into a fixed number of  levels, indexed 8 bit
- *       boundaries, starting at the the high bit of the address.  Subsequent
- *       levels are allocated only when needed.
+ *       a range with the same beginning and end address.  Once all the
+ *       entries are read, the (possibly overlapping) ranges are compiled
+ *       into a sorted array of disjoint ranges, each with the list of
+ *       entries that cover it in file order.  A lookup is one binary
+ *       search.
  *
  ****************************************************************************/
 
@@ -157,6 +160,60 @@ public:
 };
 
 
+// Literal text a regex must contain for a match, used to skip pcre_exec
+struct RegexLiteral
+{
+  char *str;                    // NULL if nothing usable could be extracted
+  int len;
+};
+
+int regexRequiredLiteral(const char *pattern, char *buf, int buf_len);
+
+// A disjoint address range and the run of entries covering it
+struct IpMatchRange
+{
+  ip_addr_t min;                // host order
+  ip_addr_t max;
+  int first;                    // index into IpMatchTable::match_list
+  int count;
+};
+
+//
+// class IpMatchTable
+//
+//   Immutable form of a set of possibly overlapping ip ranges.  The
+//   address space is cut at every range boundary; each piece records
+//   every entry that covers it, in the order they were added, so
+//   walking a piece's list visits matches in config file order.
+//
+class IpMatchTable
+{
+public:
+  IpMatchTable();
+  ~IpMatchTable();
+  void AllocateSpace(int num_entries);
+  void NewEntry(ip_addr_t addr1, ip_addr_t addr2, void *opaque_data);
+  void Compile();
+  // Returns the number of entries matching addr (host order) and
+  //   sets *matches to them, in the order they were added
+  int Match(ip_addr_t addr, void ***matches);
+  void Print(void (*f) (void *));
+
+private:
+  struct Entry
+  {
+    ip_addr_t min;
+    ip_addr_t max;
+    void *opaque_data;
+  };
+  Entry *entries;
+  int array_len;
+  int num_entries;
+  IpMatchRange *ranges;
+  int num_ranges;
+  void **match_list;
+};
+
 template<class Data, class Result> class RegexMatcher {
 public:
   RegexMatcher(const char *name, const char *filename);
@@ -177,6 +234,8 @@ public:
 protected:
 #endif
   pcre** re_array;              // array of compiled regexs
+  pcre_extra **re_extra;        // study results for re_array
+  RegexLiteral *re_literal;     // required literal text for re_array
   char **re_str;                // array of uncompiled regex strings
   Data *data_array;             // data array.  Corresponds to re_array
   int array_len;                // length of the arrays (all three are the same length)
@@ -240,10 +299,11 @@ public:
     return data_array;
   };
 
+  void Compile();
+
   //private:
-  //void MatchArray(ip_addr_t addr, RD* rdata, Result* result, void* array);
   static void PrintFunc(void *opaque_data);
-  IpLookup *ip_lookup;          // Data structure to do lookups
+  IpMatchTable *ip_table;       // Data structure to do lookups
   Data *data_array;             // array of the data lements with in the table
   int array_len;                // size of the arrays
   int num_el;                   // number of elements in the table
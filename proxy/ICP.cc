@@ -71,6 +71,7 @@ HTTPHdr gclient_request;
 //                           header to use ICP.
 //        ICPProcessor.cc -- ICP external interface implementation.
 //        ICPStats.cc     -- ICP statistic callback registration.
+//        ICPDigest.cc    -- Cache digest construction, exchange and lookup.
 //
 //
 //  Class Overview:
@@ -123,6 +124,14 @@ HTTPHdr gclient_request;
 //      ICPHandlerCont : PeriodicCont -- Periodic which monitors incoming
 //                 ICP sockets and starts processing of the incoming ICP data.
 //
+//      ICPDigestCont : PeriodicCont -- Periodic which rebuilds the local
+//                 cache digest from the cache directory and sends it to
+//                 the peers.
+//
+//    ICPDigest -- Bloom filter summary of a cache directory.  Peers
+//                 which send us their digest are looked up locally
+//                 instead of being sent a query.
+//
 //    ICPPeerReadCont -- Implements the incoming data state machine.
 //                 Processes remote ICP query requests and passes query
 //                 responses to ICPRequestCont via a callout.
@@ -155,6 +164,7 @@ typedef int (ICPPeerReadCont::*ICPPeerReadContHandler) (int, void *);
 typedef int (ICPPeriodicCont::*ICPPeriodicContHandler) (int, void *);
 typedef int (ICPHandlerCont::*ICPHandlerContHandler) (int, void *);
 typedef int (ICPRequestCont::*ICPRequestContHandler) (int, void *);
+typedef int (ICPDigestCont::*ICPDigestContHandler) (int, void *);
 
 // Plugin freshness function
 PluginFreshnessCalcFunc pluginFreshnessCalcFunc = (PluginFreshnessCalcFunc) NULL;
@@ -772,6 +782,24 @@ ICPPeerReadCont::PeerReadStateMachine(PeerReadData * s, Event * e)
           break;                // move to next_state
         }
         //
+        // Cache digest chunks are not associated with a request,
+        // hand them to the sending peer for reassembly.
+        //
+        if (s->_rICPmsg->h.opcode == ICP_OP_DIGEST) {
+          ICP_INCREMENT_DYN_STAT(icp_digest_chunks_received_stat);
+          Peer *p = _ICPpr->FindPeer(&s->_sender.sin_addr, ntohs(s->_sender.sin_port));
+          if (p && (p->ReceiveDigestChunk(s->_rICPmsg) > 0)) {
+            ICP_INCREMENT_DYN_STAT(icp_digests_received_stat);
+            Debug("icp_digest", "Received digest generation %u from [%s:%d]",
+                  s->_rICPmsg->h.requestno, inet_ntoa(s->_sender.sin_addr), ntohs(s->_sender.sin_port));
+          }
+          s->_rICPmsg = NULL;
+          s->_buf = NULL;
+          s->_next_state = READ_NOT_ACTIVE;
+          RECORD_ICP_STATE_CHANGE(s, 0, READ_NOT_ACTIVE);
+          break;                // move to next_state
+        }
+        //
         // If this is a query message, redirect to
         // the query specific handlers.
         //
@@ -1060,7 +1088,8 @@ ICPRequestCont::ICPRequestCont(ICPProcessor * pr, Continuation * c, URL * u)
     _ICPpr(pr), _timeout(0),
     npending_actions(0), pendingActions(NULL),
     _sequence_number(0), _expected_replies(0),
-    _expected_replies_list(MAX_DEFINED_PEERS), _received_replies(0), _next_state(ICP_START)
+    _expected_replies_list(MAX_DEFINED_PEERS), _received_replies(0),
+    _digest_miss_list(MAX_DEFINED_PEERS), _digest_misses(0), _next_state(ICP_START)
 {
   memset((void *)&_ret_sockaddr, 0, sizeof(_ret_sockaddr));
   _ret_status = ICP_LOOKUP_FAILED;
@@ -1240,6 +1269,20 @@ ICPRequestCont::ICPStateMachine(int event, void *d)
               break;            // move to next_state
             }
           }
+          // A hit in a peer cache digest resolves the request
+          // without a query round trip.
+          Peer *dp = DigestLookup();
+          if (dp) {
+            _ICPpr->Unlock();
+
+            _ret_sockaddr.sin_addr.s_addr = (dp->GetIP())->s_addr;
+            _ret_sockaddr.sin_port = htons(((ParentSiblingPeer *) dp)->GetProxyPort());
+            _ret_status = ICP_LOOKUP_FOUND;
+            Debug("icp", "[ICP_START] digest HIT return [%s:%d]",
+                  inet_ntoa(_ret_sockaddr.sin_addr), ntohs(_ret_sockaddr.sin_port));
+            _next_state = ICP_OFF_TERMINATE;
+            break;              // move to next_state
+          }
           // Note pending ICP request
           _ICPpr->IncPendingQuery();
           _ICPpr->Unlock();
@@ -1313,6 +1356,12 @@ ICPRequestCont::ICPStateMachine(int event, void *d)
             SendPeers--;
             continue;
           }
+          if (_digest_miss_list.IsBitSet(P->GetPeerID())) {
+            // Peer digest says it does not have the object
+            ICP_SUM_DYN_STAT(icp_digest_queries_avoided_stat, 1);
+            SendPeers--;
+            continue;
+          }
           //
           // Send query request to Peers
           //
@@ -1355,8 +1404,18 @@ ICPRequestCont::ICPStateMachine(int event, void *d)
         Debug("icp", "[ICP_QUEUE_REQUEST] Id=%d expected replies=%d", _sequence_number, _expected_replies);
         if (!_expected_replies) {
           //
-          // Nothing to wait for, terminate ICP processing
+          // Nothing to wait for, terminate ICP processing.  If that
+          // is because every peer digest missed, resolve the request
+          // as an all miss reply would.
           //
+          if (_digest_misses && (_ICPpr->GetParentPeers() > 0)) {
+            Peer *p = FindUpParent();
+            if (p) {
+              _ret_sockaddr.sin_addr.s_addr = (p->GetIP())->s_addr;
+              _ret_sockaddr.sin_port = htons(((ParentSiblingPeer *) p)->GetProxyPort());
+              _ret_status = ICP_LOOKUP_FOUND;
+            }
+          }
           ICP_INCREMENT_DYN_STAT(icp_queries_no_expected_replies_stat);
           _next_state = ICP_DEQUEUE_REQUEST;
           break;                // move to next_state
@@ -1581,24 +1640,8 @@ ICPRequestCont::ICPResponseMessage(int event, ICPMsg_t * m, int ICPMsg_len, Peer
         // If parents exists, select one to resolve the request.
         //
         if (_ICPpr->GetParentPeers() > 0) {
-          // In cases where multiple parents exist, we use
-          // a round robin scheme.
-          Peer *p = NULL;
           // try to find an UP parent, if none, return ICP_LOOKUP_FAILED
-          {
-            int i;
-            for (i = 0; i < _ICPpr->GetParentPeers(); i++) {
-              p = _ICPpr->GetNthParentPeer(0, _ICPpr->GetStartingParentPeerBias());
-              // find an UP parent
-              if (p->isUp())
-                break;
-            }
-            // if no parent is selected, then return ICP_LOOKUP_FAILED
-            if (i >= _ICPpr->GetParentPeers()) {
-              Debug("icp", "None of the %d ICP parent(s) is up", _ICPpr->GetParentPeers());
-              p = NULL;
-            }
-          }
+          Peer *p = FindUpParent();
           if (p) {
             _ret_sockaddr.sin_addr.s_addr = (p->GetIP())->s_addr;
             _ret_sockaddr.sin_port = htons(((ParentSiblingPeer *) p)->GetProxyPort());
@@ -1628,6 +1671,63 @@ ICPRequestCont::ICPResponseMessage(int event, ICPMsg_t * m, int ICPMsg_len, Peer
   }
 }
 
+Peer *
+ICPRequestCont::FindUpParent()
+{
+  // In cases where multiple parents exist, we use
+  // a round robin scheme.
+  for (int i = 0; i < _ICPpr->GetParentPeers(); i++) {
+    Peer *p = _ICPpr->GetNthParentPeer(0, _ICPpr->GetStartingParentPeerBias());
+    // find an UP parent
+    if (p->isUp())
+      return p;
+  }
+  Debug("icp", "None of the %d ICP parent(s) is up", _ICPpr->GetParentPeers());
+  return NULL;
+}
+
+Peer *
+ICPRequestCont::DigestLookup()
+{
+  // Look the URL up in the cache digests of the send peers.  Returns
+  // the first peer whose digest hits, noting the peers whose digest
+  // misses in _digest_miss_list so they are not sent a query.
+  ICPConfigData *cfg = _ICPpr->GetConfig()->globalConfig();
+  if (!cfg->ICPDigestEnabled() || !_url->valid())
+    return NULL;
+
+  // A peer rebuilds its digest every rebuild_interval, ignore digests
+  // which have missed a couple of updates.
+  ink_hrtime since = ink_get_hrtime() - HRTIME_SECONDS(3 * cfg->ICPDigestRebuildInterval());
+  INK_MD5 md5;
+  _url->MD5_get(&md5);
+
+  int bias = _ICPpr->GetStartingSendPeerBias();
+  int SendPeers = _ICPpr->GetSendPeers();
+  int online = 0;
+  Peer *hit = NULL;
+  for (int n = 0; n < SendPeers; n++) {
+    Peer *P = _ICPpr->GetNthSendPeer(n, bias);
+    if (!P->IsOnline())
+      continue;
+    online++;
+    if (hit)
+      continue;
+    int res = P->DigestLookup(&md5, since);
+    if (res > 0) {
+      hit = P;
+    } else if (res == 0) {
+      _digest_miss_list.SetBit(P->GetPeerID());
+      _digest_misses++;
+    }
+  }
+  if (hit) {
+    ICP_INCREMENT_DYN_STAT(icp_digest_hits_stat);
+    ICP_SUM_DYN_STAT(icp_digest_queries_avoided_stat, online);
+  }
+  return hit;
+}
+
 //------------------------------------------------
 // Class ICPRequestCont static member functions
 //------------------------------------------------
@@ -1663,6 +1763,11 @@ ICPRequestCont::NetToHostICPMsg(ICPMsg_t * in, ICPMsg_t * out)
       out->un.miss.URL = (char *)((char *) (&in->h.shostid) + sizeof(in->h.shostid));
       break;
     }
+  case ICP_OP_DIGEST:
+    {
+      out->un.digest.data = (char *)((char *) (&in->h.shostid) + sizeof(in->h.shostid));
+      break;
+    }
   case ICP_OP_HIT_OBJ:
     {
       out->un.hitobj.URL = (char *)((char *) (&in->h.shostid) + sizeof(in->h.shostid));
@@ -1728,6 +1833,19 @@ ICPRequestCont::BuildICPMsg(ICPopcode_t op, unsigned int seqno,
     iov[1].iov_len = datalen;
     icpmsg->h.msglen = htons(iov[0].iov_len + iov[1].iov_len);
 
+  } else if (op == ICP_OP_DIGEST) {
+    icpmsg->un.digest.data = (char *) data;
+
+    mhdr->msg_iov = iov;
+    mhdr->msg_iovlen = 2;
+
+    iov[0].iov_base = (caddr_t) icpmsg;
+    iov[0].iov_len = sizeof(ICPMsgHdr_t);
+
+    iov[1].iov_base = (caddr_t) data;
+    iov[1].iov_len = datalen;
+    icpmsg->h.msglen = htons(iov[0].iov_len + iov[1].iov_len);
+
   } else {
     ink_release_assert(0);
     return 1;                   // failed
@@ -1852,7 +1970,7 @@ ICPProcessorExt icpProcessor(&icpProcessorInternal);
 ICPProcessor::ICPProcessor()
  : _l(0), _Initialized(0), _AllowIcpQueries(0),
    _PendingIcpQueries(0), _ICPConfig(0), _ICPPeriodic(0), _ICPHandler(0),
-   _mcastCB_handler(NULL), _PeriodicEvent(0), _ICPHandlerEvent(0),
+   _mcastCB_handler(NULL), _ICPDigest(0), _PeriodicEvent(0), _ICPHandlerEvent(0), _DigestEvent(0),
    _nPeerList(-1), _LocalPeer(0),
    _curSendPeer(0), _nSendPeerList(-1),
    _curRecvPeer(0), _nRecvPeerList(-1), _curParentPeer(0), _nParentPeerList(-1), _ValidPollData(0), _last_recv_peer_bias(0)
@@ -1881,6 +1999,12 @@ ICPProcessor::~ICPProcessor()
     _ICPHandlerEvent->cancel();
     Mutex_unlock(_ICPHandler->mutex, this_ethread());
   }
+
+  if (_ICPDigest) {
+    MUTEX_TAKE_LOCK(_ICPDigest->mutex, this_ethread());
+    _DigestEvent->cancel();
+    Mutex_unlock(_ICPDigest->mutex, this_ethread());
+  }
 }
 
 void
@@ -1946,6 +2070,12 @@ ICPProcessor::start()
   _ICPHandlerEvent = eventProcessor.schedule_every(_ICPHandler,
                                                    HRTIME_MSECONDS(ICPHandlerCont::ICP_HANDLER_INTERVAL), ET_ICP);
   //
+  // Start cache digest builder continuation
+  //
+  _ICPDigest = NEW(new ICPDigestCont(this));
+  SET_CONTINUATION_HANDLER(_ICPDigest, (ICPDigestContHandler) & ICPDigestCont::PeriodicEvent);
+  _DigestEvent = eventProcessor.schedule_every(_ICPDigest, HRTIME_MSECONDS(ICPDigestCont::PERIODIC_INTERVAL), ET_ICP);
+  //
   // Stale lookup data initializations
   //
   if (!gclient_request.valid()) {
@@ -2240,7 +2370,20 @@ ICPProcessor::SetupListenSockets()
   // the local peer UDP socket.
   //
   ParentSiblingPeer *pPS = (ParentSiblingPeer *) ((Peer *) _LocalPeer);
-
+  NetVCOptions options;
+
+  options.local_addr = pPS->GetIP()->s_addr;
+  options.local_port = pPS->GetPort();
+  options.ip_proto = NetVCOptions::USE_UDP;
+  options.addr_binding = NetVCOptions::INTF_ADDR;
+  options.port_binding = NetVCOptions::FIXED_PORT;
+  status = pPS->GetChan()->open(options);
+  if (status) {
+    Warning("ICP local socket setup failed, res=%d, ip=%u.%u.%u.%u:%d",
+            status, PRINT_IP(pPS->GetIP()->s_addr), pPS->GetPort());
+    REC_SignalWarning(REC_SIGNAL_CONFIG_ERROR, "ICP local socket setup failed");
+    return 1;                   // Failed
+  }
   pPS->GetChan()->setRemote(pPS->GetIP()->s_addr, pPS->GetPort());
   return 0;                     // Success
 }
@@ -75,7 +75,7 @@ typedef enum
   ICP_OP_MISS,                  // 03
   ICP_OP_ERR,                   // 04
   //
-  ICP_OP_UNUSED5,               // 05 unused
+  ICP_OP_DIGEST,                // 05 cache digest chunk (TS extension)
   ICP_OP_UNUSED6,               // 06 unused
   ICP_OP_UNUSED7,               // 07 unused
   ICP_OP_UNUSED8,               // 08 unused
@@ -123,6 +123,7 @@ typedef enum
 #define MAX_ICP_MSG_PAYLOAD_SIZE   (MAX_ICP_MSGSIZE - sizeof(ICPmsgHdr_t))
 #define MAX_ICP_QUERY_PAYLOAD_SIZE (MAX_ICP_MSG_PAYLOAD_SIZE - sizeof(uint32_t))
 #define MAX_DEFINED_PEERS	   64
+#define ICP_DIGEST_CHUNK_SIZE	   (8 * 1024)
 #define MSG_IOVECS 16
 
 //------------
@@ -169,6 +170,16 @@ typedef struct ICPHitObj
   char *data;                   // object data
 } ICPHitObj_t;
 
+//----------------------------------------------------------------
+// ICP Digest -- one chunk of a peer cache digest.
+//   requestno is the digest generation, optionflags the byte
+//   offset of the chunk and optiondata the total digest size.
+//----------------------------------------------------------------
+typedef struct ICPDigestChunk
+{
+  char *data;
+} ICPDigestChunk_t;
+
 //------------------------
 // ICP message descriptor
 //------------------------
@@ -182,6 +193,7 @@ typedef struct ICPMsg
     ICPHit_t hit;
     ICPMiss_t miss;
     ICPHitObj_t hitobj;
+    ICPDigestChunk_t digest;
   } un;
 } ICPMsg_t;
 
@@ -195,6 +207,7 @@ class ICPPeriodicCont;
 class ICPHandlerCont;
 class ICPPeerReadCont;
 class ICPRequestCont;
+class ICPDigestCont;
 
 typedef enum
 {
@@ -246,7 +259,8 @@ class ICPConfigData
 public:
     ICPConfigData():_icp_enabled(0), _icp_port(0), _icp_interface(0),
     _multicast_enabled(0), _icp_query_timeout(0), _cache_lookup_local(0),
-    _stale_lookup(0), _reply_to_unknown_peer(0), _default_reply_port(0)
+    _stale_lookup(0), _reply_to_unknown_peer(0), _default_reply_port(0),
+    _digest_enabled(0), _digest_rebuild_interval(0), _digest_bits_per_entry(0), _digest_max_size(0)
   {
   }
    ~ICPConfigData()
@@ -289,6 +303,22 @@ public:
   {
     return _default_reply_port;
   }
+  inline int ICPDigestEnabled()
+  {
+    return _digest_enabled;
+  }
+  inline int ICPDigestRebuildInterval()
+  {
+    return _digest_rebuild_interval;
+  }
+  inline int ICPDigestBitsPerEntry()
+  {
+    return _digest_bits_per_entry;
+  }
+  inline int ICPDigestMaxSize()
+  {
+    return _digest_max_size;
+  }
 
 private:
   //---------------------------------------------------------
@@ -303,6 +333,10 @@ private:
   int _stale_lookup;
   int _reply_to_unknown_peer;
   int _default_reply_port;
+  int _digest_enabled;
+  int _digest_rebuild_interval;  // seconds
+  int _digest_bits_per_entry;
+  int _digest_max_size;          // bytes
 };
 
 //----------------------------------------------------------------
@@ -486,6 +520,91 @@ private:
   PeerConfigData *_peer_cdata_current[MAX_DEFINED_PEERS + 1];
 };
 
+//------------------------------------------------------------------------
+// Class ICPDigest -- Bloom filter summary of the cache directory which
+//   peers exchange so a miss can be routed without an ICP query.
+//
+//   Directory entries only carry part of the cache key (segment, bucket
+//   and tag), so that is what is summarized; the volume geometries go
+//   along with the filter so a peer can derive the same triple from the
+//   URL key and probe once per geometry.
+//------------------------------------------------------------------------
+class ICPDigest:public RefCountObj
+{
+public:
+  ICPDigest();
+  ~ICPDigest();
+  void init(int nbytes, int nhashes);
+  int AddGeometry(int segments, int buckets);
+  void Add(int geometry, uint32_t segment, uint32_t bucket, uint32_t tag);
+  bool Lookup(INK_MD5 *);
+  double FalsePositiveRate();
+
+  int MarshalLength();
+  void Marshal(char *);
+  int Unmarshal(char *, int);
+
+  inline int GetSize()
+  {
+    return _nbits / 8;
+  }
+  inline int GetEntries()
+  {
+    return _nentries;
+  }
+
+  enum
+  {
+    DIGEST_VERSION = 1,
+    MAX_GEOMETRY = 16,
+    MAX_DIGEST_SIZE = 16 * 1024 * 1024
+  };
+
+private:
+  void Hash(uint64_t, uint32_t *, uint32_t *);
+
+  uint32_t _nbits;
+  int _nhashes;
+  int _nentries;
+  int _ngeometry;
+  uint32_t _segments[MAX_GEOMETRY];
+  uint32_t _buckets[MAX_GEOMETRY];
+  unsigned char *_bits;
+};
+
+//------------------------------------------------------------------------
+// Class ICPDigestImage -- Reassembles the chunks of a peer's digest.
+//   Chunks start at multiples of ICP_DIGEST_CHUNK_SIZE and only the last
+//   one may be shorter.  Each chunk is counted once however often it
+//   arrives, so the image is complete only when every chunk is in.
+//------------------------------------------------------------------------
+class ICPDigestImage
+{
+public:
+  ICPDigestImage();
+  ~ICPDigestImage();
+  int AddChunk(uint32_t generation, uint32_t offset, uint32_t total, const char *data, uint32_t len);
+  void Clear();
+
+  inline char *GetImage()
+  {
+    return _image;
+  }
+  inline uint32_t GetLength()
+  {
+    return _len;
+  }
+
+private:
+  char *_image;
+  uint32_t _len;
+  BitMap *_chunks;              // chunks received so far
+  uint32_t _nchunks;
+  uint32_t _received;
+  uint32_t _generation;
+  bool _done;                   // _generation is complete
+};
+
 //------------------------------------------------------------------------
 // Class Peer -- Internal structure representing ICP peers derived from
 //               configuration data (abstract base class).
@@ -502,11 +621,13 @@ class Peer:public RefCountObj
 {
 public:
   Peer(PeerType_t, ICPProcessor *, bool dynamic_peer = false);
-  virtual ~ Peer()
-  {
-  }
+  virtual ~ Peer();
   void LogRecvMsg(ICPMsg_t *, int);
 
+  // Cache digest received from this peer
+  int ReceiveDigestChunk(ICPMsg_t *);
+  int DigestLookup(INK_MD5 *, ink_hrtime);
+
   // Pure virtual functions
   virtual struct in_addr *GetIP() = 0;
   virtual int GetPort() = 0;
@@ -599,6 +720,14 @@ protected:
     int total_received;
     int dropped_replies;        // arrived after timeout
   } _stats;
+
+  //-----------------------------------------------
+  // Cache digest data, guarded by _digest_lock
+  //-----------------------------------------------
+  ink_mutex _digest_lock;
+  Ptr<ICPDigest> _digest;       // last complete digest
+  ink_hrtime _digest_time;      // when it completed
+  ICPDigestImage _digest_image; // chunks being reassembled
 };
 
 //------------------------------------------------
@@ -745,6 +874,7 @@ class ICPProcessor
   friend class ICPHandlerCont;  // Incoming msg periodic handler
   friend class ICPPeerReadCont; // Incoming ICP request handler
   friend class ICPRequestCont;  // Outgoing ICP request handler
+  friend class ICPDigestCont;   // Local cache digest builder
 
 public:
     ICPProcessor();
@@ -905,8 +1035,10 @@ private:
   ICPPeriodicCont *_ICPPeriodic;
   ICPHandlerCont *_ICPHandler;
   ICPHandlerCont *_mcastCB_handler;
+  ICPDigestCont *_ICPDigest;
   Event *_PeriodicEvent;
   Event *_ICPHandlerEvent;
+  Event *_DigestEvent;
 
   enum
   {
@@ -983,6 +1115,42 @@ private:
   int _peer_config_changed;
 };
 
+//---------------------------------------------------------------
+// ICPDigestCont -- Periodicly rebuild the local cache digest by
+//   walking the volume directories a few segments at a time and
+//   send it to the configured peers in ICP_OP_DIGEST chunks.
+//---------------------------------------------------------------
+class ICPDigestCont:public PeriodicCont
+{
+public:
+  enum
+  { PERIODIC_INTERVAL = 100 };
+  enum
+  { SEGMENTS_PER_EVENT = 64 };
+  enum
+  { CHUNKS_PER_EVENT = 16 };
+    ICPDigestCont(ICPProcessor *);
+   ~ICPDigestCont();
+  virtual int PeriodicEvent(int, Event *);
+
+private:
+  void StartBuild(ICPConfigData *);
+  int BuildDigest();
+  void FinishBuild();
+  void SendDigest();
+
+  Ptr<ICPDigest> _building;     // digest under construction
+  int _vol;                     // walk position in gvol[]
+  int _segment;
+  int _geometry;
+  ink_hrtime _last_build;
+
+  uint32_t _generation;
+  char *_image;                 // marshalled digest being sent
+  int _image_len;
+  int _send_offset;
+};
+
 //-----------------------------------------------------------------
 // ICPHandlerCont -- Periodic for incoming message processing
 //-----------------------------------------------------------------
@@ -1177,6 +1345,8 @@ private:
   } ICPstate_t;
   int ICPStateMachine(int, void *);
   int ICPResponseMessage(int, ICPMsg_t *, int, Peer *);
+  Peer *DigestLookup();
+  Peer *FindUpParent();
   void remove_from_pendingActions(Action *);
   void remove_all_pendingActions();
 
@@ -1209,6 +1379,8 @@ private:
   int _expected_replies;
   BitMap _expected_replies_list;
   int _received_replies;
+  BitMap _digest_miss_list;
+  int _digest_misses;
   ICPstate_t _next_state;
 };
 
@@ -1271,6 +1443,15 @@ enum
   icp_reload_read_aborts,
   icp_reload_write_aborts,
   icp_reload_successes,
+  icp_digest_builds_stat,
+  icp_digest_size_stat,
+  icp_digest_entries_stat,
+  icp_digest_false_positive_ppm_stat,
+  icp_digest_chunks_sent_stat,
+  icp_digest_chunks_received_stat,
+  icp_digests_received_stat,
+  icp_digest_hits_stat,
+  icp_digest_queries_avoided_stat,
   icp_stat_count
 };
 
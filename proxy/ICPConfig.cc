@@ -64,6 +64,10 @@
 //    proxy.config.icp.multicast_enabled INT (0=No 1=Yes)
 //    proxy.config.icp.query_timeout INT (seconds default is 2 secs)
 //    proxy.config.icp.lookup_local INT (default is cluster lookup)
+//    proxy.config.icp.digest.enabled INT (0=No 1=Yes)
+//    proxy.config.icp.digest.rebuild_interval INT (seconds default is 300)
+//    proxy.config.icp.digest.bits_per_entry INT (default is 8)
+//    proxy.config.icp.digest.max_size INT (bytes default is 1MB)
 //
 //  Example (1 parent and 1 sibling):
 //  ============================================
@@ -271,6 +275,14 @@ ICPConfigData::operator==(ICPConfigData & ICPData)
     return 0;
   if (ICPData._default_reply_port != _default_reply_port)
     return 0;
+  if (ICPData._digest_enabled != _digest_enabled)
+    return 0;
+  if (ICPData._digest_rebuild_interval != _digest_rebuild_interval)
+    return 0;
+  if (ICPData._digest_bits_per_entry != _digest_bits_per_entry)
+    return 0;
+  if (ICPData._digest_max_size != _digest_max_size)
+    return 0;
   return 1;
 }
 
@@ -401,6 +413,12 @@ ICPConfiguration::ICPConfiguration():_icp_config_callouts(0)
   ICP_EstablishStaticConfigInteger(_icp_cdata_current->_reply_to_unknown_peer,
                                    "proxy.config.icp.reply_to_unknown_peer");
   ICP_EstablishStaticConfigInteger(_icp_cdata_current->_default_reply_port, "proxy.config.icp.default_reply_port");
+  ICP_EstablishStaticConfigInteger(_icp_cdata_current->_digest_enabled, "proxy.config.icp.digest.enabled");
+  ICP_EstablishStaticConfigInteger(_icp_cdata_current->_digest_rebuild_interval,
+                                   "proxy.config.icp.digest.rebuild_interval");
+  ICP_EstablishStaticConfigInteger(_icp_cdata_current->_digest_bits_per_entry,
+                                   "proxy.config.icp.digest.bits_per_entry");
+  ICP_EstablishStaticConfigInteger(_icp_cdata_current->_digest_max_size, "proxy.config.icp.digest.max_size");
   UpdateGlobalConfig();         // sync working copy with current
 
   //**********************************************************
@@ -792,7 +810,8 @@ ICPConfiguration::icp_config_change_callback(void *data, void *value, int startu
 // Class Peer member functions (abstract base class)
 //-------------------------------------------------------
 Peer::Peer(PeerType_t t, ICPProcessor * icpPr, bool dynamic_peer):
-buf(NULL), notFirstRead(0), readAction(NULL), writeAction(NULL), _type(t), _next(0), _ICPpr(icpPr), _state(PEER_UP)
+buf(NULL), notFirstRead(0), readAction(NULL), writeAction(NULL), _type(t), _next(0), _ICPpr(icpPr), _state(PEER_UP),
+_digest_time(0)
 {
   notFirstRead = 0;
   if (dynamic_peer) {
@@ -802,6 +821,12 @@ buf(NULL), notFirstRead(0), readAction(NULL), writeAction(NULL), _type(t), _next
   memset((void *) &fromaddr, 0, sizeof(fromaddr));
   fromaddrlen = sizeof(fromaddr);
   _id = 0;
+  ink_mutex_init(&_digest_lock, "Peer digest");
+}
+
+Peer::~Peer()
+{
+  ink_mutex_destroy(&_digest_lock);
 }
 
 void
@@ -893,7 +918,7 @@ ParentSiblingPeer::RecvFrom_re(Continuation * cont, void *token,
   Peer *lp = _ICPpr->GetLocalPeer();
   Action *a = udpNet.recvfrom_re(cont, token,
                                  lp->GetRecvFD(), from, fromlen,
-                                 bufblock, size, true, 0);
+                                 bufblock, size, false, 0);
   return a;
 }
 
@@ -1043,7 +1068,7 @@ MultiCastPeer::RecvFrom_re(Continuation * cont, void *token,
   NOWARN_UNUSED(bufblock);
   Action *a = udpNet.recvfrom_re(cont, token,
                                  _recv_chan.fd, from, fromlen,
-                                 buf, len, true, 0);
+                                 buf, len, false, 0);
   return a;
 }
 
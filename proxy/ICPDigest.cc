@@ -0,0 +1,570 @@
+/** @file
+
+  ICP cache digests
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+#include "ink_unused.h"        /* MAGIC_EDITING_TAG */
+
+
+/****************************************************************************
+
+  ICPDigest.cc
+
+  Each node periodically summarizes its cache directory in a bloom
+  filter (ICPDigestCont) and sends it to its peers as a sequence of
+  ICP_OP_DIGEST messages.  The receiving side reassembles the chunks
+  per peer (Peer::ReceiveDigestChunk) and ICPRequestCont consults the
+  digests before sending any query (Peer::DigestLookup).
+
+  Digest image layout, all words in network byte order:
+
+    uint32_t version
+    uint32_t nbits
+    uint32_t nhashes
+    uint32_t nentries
+    uint32_t ngeometry
+    uint32_t segments, buckets      (ngeometry times)
+    char bits[nbits / 8]
+
+****************************************************************************/
+
+#include "Main.h"
+#include "P_EventSystem.h"
+#include "P_Cache.h"
+#include "P_Net.h"
+#include "P_RecProcess.h"
+#include "ICP.h"
+
+#include <math.h>
+
+#define DIGEST_HEADER_WORDS 5
+
+//------------------------------------------------------------------------
+// Class ICPDigest member functions
+//------------------------------------------------------------------------
+ICPDigest::ICPDigest()
+  : _nbits(0), _nhashes(0), _nentries(0), _ngeometry(0), _bits(NULL)
+{
+}
+
+ICPDigest::~ICPDigest()
+{
+  if (_bits)
+    xfree(_bits);
+}
+
+void
+ICPDigest::init(int nbytes, int nhashes)
+{
+  _nbits = nbytes * 8;
+  _nhashes = nhashes;
+  _bits = (unsigned char *) xmalloc(nbytes);
+  memset(_bits, 0, nbytes);
+}
+
+int
+ICPDigest::AddGeometry(int segments, int buckets)
+{
+  for (int i = 0; i < _ngeometry; i++) {
+    if (_segments[i] == (uint32_t) segments && _buckets[i] == (uint32_t) buckets)
+      return i;
+  }
+  if (_ngeometry >= MAX_GEOMETRY)
+    return -1;
+  _segments[_ngeometry] = segments;
+  _buckets[_ngeometry] = buckets;
+  return _ngeometry++;
+}
+
+void
+ICPDigest::Hash(uint64_t x, uint32_t * h1, uint32_t * h2)
+{
+  // 64 bit finalizer from MurmurHash3, the two halves seed
+  // the double hashing of the probe positions
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  *h1 = (uint32_t) x;
+  *h2 = (uint32_t) (x >> 32) | 1;
+}
+
+void
+ICPDigest::Add(int g, uint32_t segment, uint32_t bucket, uint32_t tag)
+{
+  uint32_t h1, h2;
+  Hash((((uint64_t) segment * _buckets[g] + bucket) << DIR_TAG_WIDTH) | tag, &h1, &h2);
+  for (int i = 0; i < _nhashes; i++) {
+    uint32_t bit = (h1 + i * h2) % _nbits;
+    _bits[bit >> 3] |= (1 << (bit & 7));
+  }
+  _nentries++;
+}
+
+bool
+ICPDigest::Lookup(INK_MD5 * key)
+{
+  for (int g = 0; g < _ngeometry; g++) {
+    uint32_t segment = key->word(0) % _segments[g];
+    uint32_t bucket = key->word(1) % _buckets[g];
+    uint32_t h1, h2;
+    Hash((((uint64_t) segment * _buckets[g] + bucket) << DIR_TAG_WIDTH) | DIR_MASK_TAG(key->word(2)), &h1, &h2);
+    int i;
+    for (i = 0; i < _nhashes; i++) {
+      uint32_t bit = (h1 + i * h2) % _nbits;
+      if (!(_bits[bit >> 3] & (1 << (bit & 7))))
+        break;
+    }
+    if (i == _nhashes)
+      return true;
+  }
+  return false;
+}
+
+double
+ICPDigest::FalsePositiveRate()
+{
+  // Probability that all probes of an absent key land on set bits
+  uint64_t set = 0;
+  for (uint32_t i = 0; i < _nbits / 8; i++) {
+    for (unsigned char b = _bits[i]; b; b &= b - 1)
+      set++;
+  }
+  return _nbits ? pow((double) set / _nbits, _nhashes) * (_ngeometry ? _ngeometry : 1) : 0.0;
+}
+
+int
+ICPDigest::MarshalLength()
+{
+  return (DIGEST_HEADER_WORDS + 2 * _ngeometry) * sizeof(uint32_t) + _nbits / 8;
+}
+
+void
+ICPDigest::Marshal(char *buf)
+{
+  uint32_t *w = (uint32_t *) buf;
+  *w++ = htonl(DIGEST_VERSION);
+  *w++ = htonl(_nbits);
+  *w++ = htonl(_nhashes);
+  *w++ = htonl(_nentries);
+  *w++ = htonl(_ngeometry);
+  for (int g = 0; g < _ngeometry; g++) {
+    *w++ = htonl(_segments[g]);
+    *w++ = htonl(_buckets[g]);
+  }
+  memcpy((char *) w, _bits, _nbits / 8);
+}
+
+int
+ICPDigest::Unmarshal(char *buf, int len)
+{
+  // Returns 1 on success, 0 on a malformed image
+  uint32_t hdr[DIGEST_HEADER_WORDS + 2 * MAX_GEOMETRY];
+  if (len < (int) (DIGEST_HEADER_WORDS * sizeof(uint32_t)))
+    return 0;
+  memcpy(hdr, buf, DIGEST_HEADER_WORDS * sizeof(uint32_t));
+  uint32_t nbits = ntohl(hdr[1]);
+  int nhashes = ntohl(hdr[2]);
+  int ngeometry = ntohl(hdr[4]);
+  if ((ntohl(hdr[0]) != DIGEST_VERSION) || !nbits || (nbits % 8) || (nbits / 8 > MAX_DIGEST_SIZE) ||
+      (nhashes < 1) || (nhashes > 32) || (ngeometry < 1) || (ngeometry > MAX_GEOMETRY))
+    return 0;
+  int hdr_len = (DIGEST_HEADER_WORDS + 2 * ngeometry) * sizeof(uint32_t);
+  if (len != (int) (hdr_len + nbits / 8))
+    return 0;
+  memcpy(hdr, buf, hdr_len);
+
+  _ngeometry = 0;
+  for (int g = 0; g < ngeometry; g++) {
+    uint32_t segments = ntohl(hdr[DIGEST_HEADER_WORDS + 2 * g]);
+    uint32_t buckets = ntohl(hdr[DIGEST_HEADER_WORDS + 2 * g + 1]);
+    if (!segments || !buckets)
+      return 0;
+    AddGeometry(segments, buckets);
+  }
+  init(nbits / 8, nhashes);
+  _nentries = ntohl(hdr[3]);
+  memcpy(_bits, buf + hdr_len, nbits / 8);
+  return 1;
+}
+
+//------------------------------------------------------------------------
+// Class ICPDigestImage member functions
+//------------------------------------------------------------------------
+ICPDigestImage::ICPDigestImage()
+  : _image(NULL), _len(0), _chunks(NULL), _nchunks(0), _received(0), _generation(0), _done(false)
+{
+}
+
+ICPDigestImage::~ICPDigestImage()
+{
+  Clear();
+}
+
+void
+ICPDigestImage::Clear()
+{
+  if (_image)
+    xfree(_image);
+  if (_chunks)
+    delete _chunks;
+  _image = NULL;
+  _chunks = NULL;
+  _len = 0;
+  _nchunks = 0;
+  _received = 0;
+}
+
+int
+ICPDigestImage::AddChunk(uint32_t generation, uint32_t offset, uint32_t total, const char *data, uint32_t len)
+{
+  // Returns 1 when the chunk completes the image, -1 for a malformed
+  // chunk and 0 otherwise.
+  if (!total || (total > ICPDigest::MAX_DIGEST_SIZE + 1024) || (offset >= total) || (len > total - offset) ||
+      (offset % ICP_DIGEST_CHUNK_SIZE) ||
+      ((len != ICP_DIGEST_CHUNK_SIZE) && (offset + len != total)))
+    return -1;
+
+  if (_image && (generation == _generation) && (total != _len))
+    return -1;
+  if (!_image || (generation != _generation)) {
+    if ((generation == _generation) && _done)
+      return 0;                 // late duplicate of a generation already complete
+    // first chunk of a new generation, drop any partial image
+    Clear();
+    _image = (char *) xmalloc(total);
+    _len = total;
+    _nchunks = (total + ICP_DIGEST_CHUNK_SIZE - 1) / ICP_DIGEST_CHUNK_SIZE;
+    _chunks = NEW(new BitMap(_nchunks));
+    _generation = generation;
+    _done = false;
+  }
+
+  uint32_t chunk = offset / ICP_DIGEST_CHUNK_SIZE;
+  if (_chunks->IsBitSet(chunk))
+    return 0;
+  _chunks->SetBit(chunk);
+  memcpy(_image + offset, data, len);
+  if (++_received < _nchunks)
+    return 0;
+  _done = true;
+  return 1;
+}
+
+//------------------------------------------------------------------------
+// Class Peer cache digest member functions
+//------------------------------------------------------------------------
+int
+Peer::ReceiveDigestChunk(ICPMsg_t * m)
+{
+  // Returns 1 when the chunk completes a digest, -1 for a malformed
+  // chunk and 0 otherwise.
+  int res;
+
+  ink_mutex_acquire(&_digest_lock);
+  res = _digest_image.AddChunk(m->h.requestno, m->h.optionflags, m->h.optiondata, m->un.digest.data,
+                               m->h.msglen - sizeof(ICPMsgHdr_t));
+  if (res > 0) {
+    Ptr<ICPDigest> d = NEW(new ICPDigest());
+    if (d->Unmarshal(_digest_image.GetImage(), _digest_image.GetLength())) {
+      _digest = d;
+      _digest_time = ink_get_hrtime();
+    } else {
+      res = -1;
+    }
+    _digest_image.Clear();
+  }
+  ink_mutex_release(&_digest_lock);
+  return res;
+}
+
+int
+Peer::DigestLookup(INK_MD5 * key, ink_hrtime since)
+{
+  // Returns 1 on a digest hit, 0 on a miss and -1 if we have
+  // no current digest for this peer.
+  Ptr<ICPDigest> d;
+  ink_mutex_acquire(&_digest_lock);
+  if (_digest_time >= since)
+    d = _digest;
+  ink_mutex_release(&_digest_lock);
+
+  if (!d)
+    return -1;
+  return d->Lookup(key) ? 1 : 0;
+}
+
+//------------------------------------------------------------------------
+// Class ICPDigestCont member functions
+//------------------------------------------------------------------------
+ICPDigestCont::ICPDigestCont(ICPProcessor * icpP)
+  : PeriodicCont(icpP), _vol(0), _segment(0), _geometry(-1), _last_build(0),
+    _generation((uint32_t) time(NULL)), _image(NULL), _image_len(0), _send_offset(0)
+{
+}
+
+ICPDigestCont::~ICPDigestCont()
+{
+  if (_image)
+    xfree(_image);
+}
+
+int
+ICPDigestCont::PeriodicEvent(int event, Event * e)
+{
+  NOWARN_UNUSED(e);
+
+  // Completion callouts for the chunk sends
+  if ((event == NET_EVENT_DATAGRAM_WRITE_COMPLETE) || (event == NET_EVENT_DATAGRAM_WRITE_ERROR))
+    return EVENT_DONE;
+
+  ICPConfigData *cfg = _ICPpr->GetConfig()->globalConfig();
+  if (!cfg->ICPconfigured() || !cfg->ICPDigestEnabled()) {
+    _building = NULL;
+    return EVENT_CONT;
+  }
+
+  if (_building) {
+    if (BuildDigest())
+      FinishBuild();
+  } else if (_image && (_send_offset < _image_len)) {
+    SendDigest();
+  } else if ((cacheProcessor.IsCacheEnabled() == CACHE_INITIALIZED) && (gnvol > 0) &&
+             (!_last_build || (ink_get_hrtime() - _last_build >= HRTIME_SECONDS(cfg->ICPDigestRebuildInterval())))) {
+    StartBuild(cfg);
+  }
+  return EVENT_CONT;
+}
+
+void
+ICPDigestCont::StartBuild(ICPConfigData * cfg)
+{
+  // Size the filter for a full directory so that the size does
+  // not change from one generation to the next.
+  int64_t entries = 0;
+  for (int i = 0; i < gnvol; i++)
+    entries += (int64_t) gvol[i]->segments * gvol[i]->buckets * DIR_DEPTH;
+
+  int bits_per_entry = cfg->ICPDigestBitsPerEntry() > 0 ? cfg->ICPDigestBitsPerEntry() : 8;
+  int64_t nbytes = (entries * bits_per_entry + 7) / 8;
+  int64_t max_size = cfg->ICPDigestMaxSize();
+  if (max_size <= 0 || max_size > ICPDigest::MAX_DIGEST_SIZE)
+    max_size = ICPDigest::MAX_DIGEST_SIZE;
+  if (nbytes > max_size)
+    nbytes = max_size;
+  if (nbytes < ICP_DIGEST_CHUNK_SIZE)
+    nbytes = ICP_DIGEST_CHUNK_SIZE;
+
+  // k = m/n ln 2 minimizes the false positive rate of a full directory
+  int nhashes = (bits_per_entry * 69) / 100;
+  if (nhashes < 1)
+    nhashes = 1;
+
+  _building = NEW(new ICPDigest());
+  _building->init((int) nbytes, nhashes);
+  _vol = 0;
+  _segment = 0;
+  _last_build = ink_get_hrtime();
+  Debug("icp_digest", "Building digest, %d bytes %d hashes", (int) nbytes, nhashes);
+}
+
+int
+ICPDigestCont::BuildDigest()
+{
+  // Add the valid head entries of up to SEGMENTS_PER_EVENT directory
+  // segments.  Returns 1 once every volume has been walked.
+  int budget = SEGMENTS_PER_EVENT;
+
+  while ((_vol < gnvol) && (budget > 0)) {
+    Vol *d = gvol[_vol];
+    if (!_segment)
+      _geometry = _building->AddGeometry(d->segments, d->buckets);
+    if (_geometry < 0) {
+      // Too many distinct geometries, leave this volume out
+      _vol++;
+      continue;
+    }
+
+    MUTEX_TRY_LOCK(lock, d->mutex, this_ethread());
+    if (!lock)
+      return 0;                 // try again next period
+
+    for (; (_segment < d->segments) && (budget > 0); _segment++, budget--) {
+      Dir *seg = dir_segment(_segment, d);
+      for (int b = 0; b < d->buckets; b++) {
+        Dir *e = dir_bucket(b, seg);
+        while (e) {
+          if (dir_offset(e) && dir_head(e) && dir_valid(d, e))
+            _building->Add(_geometry, _segment, b, dir_tag(e));
+          e = next_dir(e, seg);
+        }
+      }
+    }
+    if (_segment >= d->segments) {
+      _vol++;
+      _segment = 0;
+    }
+  }
+  return (_vol >= gnvol);
+}
+
+void
+ICPDigestCont::FinishBuild()
+{
+  if (_image)
+    xfree(_image);
+  _image_len = _building->MarshalLength();
+  _image = (char *) xmalloc(_image_len);
+  _building->Marshal(_image);
+  _send_offset = 0;
+  _generation++;
+
+  double fpp = _building->FalsePositiveRate();
+  ICP_INCREMENT_DYN_STAT(icp_digest_builds_stat);
+  RecSetGlobalRawStatSum(icp_rsb, icp_digest_size_stat, _building->GetSize());
+  RecSetGlobalRawStatSum(icp_rsb, icp_digest_entries_stat, _building->GetEntries());
+  RecSetGlobalRawStatSum(icp_rsb, icp_digest_false_positive_ppm_stat, (int64_t) (fpp * 1000000));
+  Debug("icp_digest", "Built digest generation %u, %d entries %d bytes, estimated false positive rate %f",
+        _generation, _building->GetEntries(), _building->GetSize(), fpp);
+  _building = NULL;
+}
+
+void
+ICPDigestCont::SendDigest()
+{
+  // Send up to CHUNKS_PER_EVENT chunks of the digest to every
+  // parent and sibling peer.
+  ICPMsg_t msg;
+  struct msghdr mhdr;
+  struct iovec iov[MSG_IOVECS];
+
+  if (!_ICPpr->Lock())
+    return;                     // try again next period
+  if (!_ICPpr->AllowICPQueries()) {
+    _ICPpr->Unlock();
+    return;
+  }
+
+  for (int chunks = 0; (chunks < CHUNKS_PER_EVENT) && (_send_offset < _image_len); chunks++) {
+    int len = _image_len - _send_offset;
+    if (len > ICP_DIGEST_CHUNK_SIZE)
+      len = ICP_DIGEST_CHUNK_SIZE;
+
+    memset((void *) &msg, 0, sizeof(msg));
+    int status = ICPRequestCont::BuildICPMsg(ICP_OP_DIGEST, _generation,
+                                             _send_offset /* optflags */ , _image_len /* optdata */ ,
+                                             0 /* shostid */ ,
+                                             _image + _send_offset, len, &mhdr, iov, &msg);
+    ink_assert(status == 0);
+
+    for (int n = 0; n <= _ICPpr->_nPeerList; n++) {
+      Peer *P = _ICPpr->IdToPeer(n);
+      if (!P || ((P->GetType() != PEER_PARENT) && (P->GetType() != PEER_SIBLING)))
+        continue;
+      if (P->SendMsg_re(this, P, &mhdr, (struct sockaddr_in *) 0) == ACTION_RESULT_DONE)
+        ICP_INCREMENT_DYN_STAT(icp_digest_chunks_sent_stat);
+    }
+    _send_offset += len;
+  }
+  _ICPpr->Unlock();
+}
+
+#if TS_HAS_TESTS
+REGRESSION_TEST(ICP_DigestReassembly) (RegressionTest * t, int atype, int *pstatus) {
+  NOWARN_UNUSED(atype);
+  const uint32_t chunk = ICP_DIGEST_CHUNK_SIZE;
+  Ptr<ICPDigest> sent = NEW(new ICPDigest());
+  INK_MD5 key;
+  int g, i;
+
+  *pstatus = REGRESSION_TEST_PASSED;
+  // An image of three chunks, the last one short
+  sent->init(2 * chunk + 1000, 4);
+  g = sent->AddGeometry(16, 4096);
+  for (i = 0; i < 100; i++) {
+    key.encodeBuffer((char *) &i, sizeof(i));
+    sent->Add(g, key.word(0) % 16, key.word(1) % 4096, DIR_MASK_TAG(key.word(2)));
+  }
+  uint32_t total = sent->MarshalLength();
+  char *image = (char *) xmalloc(total);
+  sent->Marshal(image);
+  uint32_t last = 2 * chunk, last_len = total - last;
+
+#define CHECK(_cond, _what) \
+  if (!(_cond)) { \
+    rprintf(t, "%s\n", _what); \
+    *pstatus = REGRESSION_TEST_FAILED; \
+  }
+
+  {
+    // in order, then a late duplicate
+    ICPDigestImage r;
+    CHECK(r.AddChunk(1, 0, total, image, chunk) == 0, "first chunk completed the image");
+    CHECK(r.AddChunk(1, chunk, total, image + chunk, chunk) == 0, "second chunk completed the image");
+    CHECK(r.AddChunk(1, last, total, image + last, last_len) == 1, "last chunk did not complete the image");
+    CHECK(r.GetLength() == total && !memcmp(r.GetImage(), image, total), "image differs");
+    Ptr<ICPDigest> d = NEW(new ICPDigest());
+    CHECK(d->Unmarshal(r.GetImage(), r.GetLength()), "image does not unmarshal");
+    for (i = 0; i < 100; i++) {
+      key.encodeBuffer((char *) &i, sizeof(i));
+      CHECK(d->Lookup(&key), "added key missing from the digest");
+    }
+    r.Clear();
+    CHECK(r.AddChunk(1, chunk, total, image + chunk, chunk) == 0, "late duplicate not ignored");
+    CHECK(!r.GetImage(), "late duplicate started a new image");
+  }
+  {
+    // duplicates must not stand in for a missing chunk
+    ICPDigestImage r;
+    CHECK(r.AddChunk(2, last, total, image + last, last_len) == 0, "out of order chunk completed the image");
+    CHECK(r.AddChunk(2, last, total, image + last, last_len) == 0, "duplicate chunk completed the image");
+    CHECK(r.AddChunk(2, 0, total, image, chunk) == 0, "image with a hole completed");
+    CHECK(r.AddChunk(2, 0, total, image, chunk) == 0, "duplicate chunk completed the image");
+    CHECK(r.AddChunk(2, chunk, total, image + chunk, chunk) == 1, "reordered image did not complete");
+    CHECK(!memcmp(r.GetImage(), image, total), "reordered image differs");
+  }
+  {
+    // a new generation drops the partial one
+    ICPDigestImage r;
+    CHECK(r.AddChunk(3, 0, total, image, chunk) == 0, "first chunk completed the image");
+    CHECK(r.AddChunk(3, chunk, total, image + chunk, chunk) == 0, "second chunk completed the image");
+    CHECK(r.AddChunk(4, last, total, image + last, last_len) == 0, "new generation reused old chunks");
+    CHECK(r.AddChunk(4, 0, total, image, chunk) == 0, "new generation reused old chunks");
+    CHECK(r.AddChunk(4, chunk, total, image + chunk, chunk) == 1, "new generation did not complete");
+  }
+  {
+    // malformed chunks
+    ICPDigestImage r;
+    CHECK(r.AddChunk(5, 1, total, image, chunk) == -1, "misaligned chunk accepted");
+    CHECK(r.AddChunk(5, 0, total, image, chunk - 1) == -1, "short chunk accepted");
+    CHECK(r.AddChunk(5, total, total, image, 0) == -1, "chunk past the end accepted");
+    CHECK(r.AddChunk(5, last, total, image + last, last_len + 1) == -1, "overlong chunk accepted");
+    CHECK(r.AddChunk(5, 0, 0, image, 0) == -1, "empty image accepted");
+    CHECK(r.AddChunk(5, 0, total, image, chunk) == 0, "good chunk rejected");
+    CHECK(r.AddChunk(5, chunk, total + chunk, image + chunk, chunk) == -1, "size change accepted");
+  }
+#undef CHECK
+  xfree(image);
+}
+#endif
+
+// End of ICPDigest.cc
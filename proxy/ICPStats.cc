@@ -121,6 +121,33 @@ ICPProcessor::InitICPStatCallbacks()
   RecRegisterRawStat(icp_rsb, RECT_PROCESS,
                      "proxy.process.icp.total_icp_request_time",
                      RECD_FLOAT, RECP_NULL, (int) total_icp_request_time_stat, RecRawStatSyncMHrTimeAvg);
+  RecRegisterRawStat(icp_rsb, RECT_PROCESS,
+                     "proxy.process.icp.digest_builds",
+                     RECD_INT, RECP_NULL, (int) icp_digest_builds_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(icp_rsb, RECT_PROCESS,
+                     "proxy.process.icp.digest_size",
+                     RECD_INT, RECP_NULL, (int) icp_digest_size_stat, RecRawStatSyncSum);
+  RecRegisterRawStat(icp_rsb, RECT_PROCESS,
+                     "proxy.process.icp.digest_entries",
+                     RECD_INT, RECP_NULL, (int) icp_digest_entries_stat, RecRawStatSyncSum);
+  RecRegisterRawStat(icp_rsb, RECT_PROCESS,
+                     "proxy.process.icp.digest_false_positive_ppm",
+                     RECD_INT, RECP_NULL, (int) icp_digest_false_positive_ppm_stat, RecRawStatSyncSum);
+  RecRegisterRawStat(icp_rsb, RECT_PROCESS,
+                     "proxy.process.icp.digest_chunks_sent",
+                     RECD_INT, RECP_NULL, (int) icp_digest_chunks_sent_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(icp_rsb, RECT_PROCESS,
+                     "proxy.process.icp.digest_chunks_received",
+                     RECD_INT, RECP_NULL, (int) icp_digest_chunks_received_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(icp_rsb, RECT_PROCESS,
+                     "proxy.process.icp.digests_received",
+                     RECD_INT, RECP_NULL, (int) icp_digests_received_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(icp_rsb, RECT_PROCESS,
+                     "proxy.process.icp.digest_hits",
+                     RECD_INT, RECP_NULL, (int) icp_digest_hits_stat, RecRawStatSyncCount);
+  RecRegisterRawStat(icp_rsb, RECT_PROCESS,
+                     "proxy.process.icp.digest_queries_avoided",
+                     RECD_INT, RECP_NULL, (int) icp_digest_queries_avoided_stat, RecRawStatSyncSum);
 
 }
 
@@ -139,7 +139,6 @@ reloadIPAllow()
 
 
 IpAllow::IpAllow(const char *config_var, const char *name, const char *action_val):
-IpLookup(name),
 config_file_var(config_var),
 module_name(name),
 action(action_val),
@@ -159,16 +158,24 @@ err_allow_all(false)
 
 IpAllow::~IpAllow()
 {
+  xfree((char *) config_file_var);
 }
 
 void
 IpAllow::Print()
 {
-  printf("IpAllow Table with %d entries\n", num_el);
+  printf("IpAllow Table with %d entries, %d ranges\n", records.n, ip_map.getCount4());
   if (err_allow_all == true) {
     printf("\t err_allow_all is true\n");
   }
-  IpLookup::Print();
+  for (int i = 0; i < records.n; i++) {
+    printf("\tLine %d: %u.%u.%u.%u - %u.%u.%u.%u %s\n", records[i].line_num,
+           (unsigned) (records[i].min >> 24) & 0xff, (unsigned) (records[i].min >> 16) & 0xff,
+           (unsigned) (records[i].min >> 8) & 0xff, (unsigned) records[i].min & 0xff,
+           (unsigned) (records[i].max >> 24) & 0xff, (unsigned) (records[i].max >> 16) & 0xff,
+           (unsigned) (records[i].max >> 8) & 0xff, (unsigned) records[i].max & 0xff,
+           (records[i].access == IP_ALLOW) ? "ip_allow" : "ip_deny");
+  }
 }
 
 int
@@ -186,7 +193,7 @@ IpAllow::BuildTable()
   bool alarmAlready = false;
 
   // Table should be empty
-  ink_assert(num_el == 0);
+  ink_assert(records.n == 0);
 
   file_buf = readIntoBuffer(config_file_path, module_name, NULL);
 
@@ -228,23 +235,22 @@ IpAllow::BuildTable()
           // INKqa05845
           // Search for "action=ip_allow" or "action=ip_deny".
           char *label, *val;
-          IpAllowRecord *rec;
+          IpAllowRecord rec;
           for (int i = 0; i < MATCHER_MAX_TOKENS; i++) {
             label = line_info.line[0][i];
             val = line_info.line[1][i];
             if (label == NULL)
               continue;
             if (strcasecmp(label, "action") == 0) {
+              rec.min = addr1;
+              rec.max = addr2;
+              rec.line_num = line_num;
               if (strcasecmp(val, "ip_allow") == 0) {
-                rec = (IpAllowRecord *) xmalloc(sizeof(IpAllowRecord));
-                rec->access = IP_ALLOW;
-                rec->line_num = line_num;
-                this->NewEntry(addr1, addr2, (void *) rec);
+                rec.access = IP_ALLOW;
+                records.add(rec);
               } else if (strcasecmp(val, "ip_deny") == 0) {
-                rec = (IpAllowRecord *) xmalloc(sizeof(IpAllowRecord));
-                rec->access = IP_DENY;
-                rec->line_num = line_num;
-                this->NewEntry(addr1, addr2, (void *) rec);
+                rec.access = IP_DENY;
+                records.add(rec);
               } else {
                 snprintf(errBuf, sizeof(errBuf), "%s discarding %s entry at line %d : %s", module_name, config_file_path, line_num, "Invalid action specified");        //changed by YTS Team, yamsat bug id -59022
                 SignalError(errBuf, alarmAlready);
@@ -259,7 +265,16 @@ IpAllow::BuildTable()
     line = tokLine(NULL, &tok_state);
   }
 
-  if (num_el == 0) {
+  // Mark the rules last to first so that where rules overlap the
+  //   earliest one is left in the map.  The records array does not
+  //   change from here on, so the map can point into it.
+  IpMap rule_map;
+  for (int i = records.n - 1; i >= 0; i--) {
+    rule_map.mark(htonl((uint32_t) records[i].min), htonl((uint32_t) records[i].max), &records[i]);
+  }
+  ip_map.load(rule_map);
+
+  if (records.n == 0) {
     Warning("%s No entries in %s. All IP Addresses will be blocked", module_name, config_file_path);
     err_allow_all = false;
   }
@@ -32,6 +32,7 @@
 #define _IP_ALLOW_H_
 
 #include "IpLookup.h"
+#include "IpMap.h"
 #include "Main.h"
 
 void initIPAllow();
@@ -50,11 +51,22 @@ void reloadIPAllow();
 class IpAllowRecord
 {
 public:
+  ip_addr_t min;                // host order
+  ip_addr_t max;
   int access;
   int line_num;
 };
 
-class IpAllow:public IpLookup
+//
+// class IpAllow
+//
+//   The rules are compiled into an IpMapArray that holds, for every
+//     range of addresses, the rule that decides it.  The first rule in
+//     the file wins, so the rules are marked in reverse order.  A table
+//     is not changed once built; a reload builds a new table and swaps
+//     the pointer.
+//
+class IpAllow
 {
 public:
   IpAllow(const char *config_var, const char *name, const char *action_val);
@@ -68,6 +80,8 @@ private:
   const char *module_name;
   const char *action;
   bool err_allow_all;
+  Vec<IpAllowRecord> records;   // rules in file order
+  IpMapArray ip_map;            // address to deciding rule
 };
 
 extern IpAllow *ip_allow_table;
@@ -79,18 +93,9 @@ IpAllow::match(ip_addr_t ip)
   if (err_allow_all == true) {
     return true;
   } else {
-    IpAllowRecord *cur = NULL, *result = NULL;
-    IpLookupState s;
-    bool found;
-    found = IpLookup::MatchFirst(ip, &s, (void **) &cur);
-    result = cur;
-    while (found) {
-      if (cur->line_num < result->line_num) {
-        result = cur;
-      }
-      found = IpLookup::MatchNext(&s, (void **) &cur);
-    }
-    return ((result != NULL) && (result->access == IP_ALLOW));
+    void *result = NULL;
+
+    return ip_map.contains((uint32_t) ip, &result) && ((IpAllowRecord *) result)->access == IP_ALLOW;
   }
 }
 
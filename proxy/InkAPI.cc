@@ -40,6 +40,7 @@
 #include "HttpClientSession.h"
 #include "HttpSM.h"
 #include "HttpConfig.h"
+#include "HttpCacheGeneration.h"
 #include "P_Net.h"
 #include "P_HostDB.h"
 #include "StatSystem.h"
@@ -1236,6 +1237,7 @@ APIHooks::get()
 HttpAPIHooks::HttpAPIHooks():
 hooks_set(0)
 {
+  ink_assert(TS_HTTP_LAST_HOOK <= (int) (sizeof(hooks_set) * 8));
 }
 
 HttpAPIHooks::~HttpAPIHooks()
@@ -1266,14 +1268,14 @@ HttpAPIHooks::clear()
 void
 HttpAPIHooks::prepend(TSHttpHookID id, INKContInternal *cont)
 {
-  hooks_set = 1;
+  hooks_set |= hook_bit(id);
   m_hooks[id].prepend(cont);
 }
 
 void
 HttpAPIHooks::append(TSHttpHookID id, INKContInternal *cont)
 {
-  hooks_set = 1;
+  hooks_set |= hook_bit(id);
   m_hooks[id].append(cont);
 }
 
@@ -6353,6 +6355,56 @@ TSCacheScan(TSCont contp, TSCacheKey key, int KB_per_second)
   return reinterpret_cast<TSAction>(cacheProcessor.scan(i, 0, 0, KB_per_second));
 }
 
+TSAction
+TSCachePurge(TSCont contp, TSCachePurgeType type, const char *pattern, int KB_per_second)
+{
+  sdk_assert(sdk_sanity_check_iocore_structure(contp) == TS_SUCCESS);
+  sdk_assert(sdk_sanity_check_null_ptr((void*)pattern) == TS_SUCCESS);
+  sdk_assert(KB_per_second > 0);
+
+  FORCE_PLUGIN_MUTEX(contp);
+
+  INKContInternal *i = (INKContInternal *) contp;
+
+  return reinterpret_cast<TSAction>(cacheProcessor.purge(i, (CachePurgeMatch) type, pattern, KB_per_second));
+}
+
+TSReturnCode
+TSCacheInvalidateHost(const char *host, int length)
+{
+  sdk_assert(sdk_sanity_check_null_ptr((void*)host) == TS_SUCCESS);
+
+  if (length < 0)
+    length = strlen(host);
+  return (httpCacheGenerations.invalidate_host(host, length) < 0) ? TS_ERROR : TS_SUCCESS;
+}
+
+TSReturnCode
+TSCacheInvalidateTag(const char *tag, int length)
+{
+  sdk_assert(sdk_sanity_check_null_ptr((void*)tag) == TS_SUCCESS);
+
+  if (length < 0)
+    length = strlen(tag);
+  return (httpCacheGenerations.invalidate_tag(tag, length) < 0) ? TS_ERROR : TS_SUCCESS;
+}
+
+TSReturnCode
+TSCacheDiskAdd(const char *path, int64_t size, int fast)
+{
+  sdk_assert(sdk_sanity_check_null_ptr((void*)path) == TS_SUCCESS);
+
+  return (cacheProcessor.add_disk(path, size, fast ? STORE_TIER_FAST : STORE_TIER_SLOW) < 0) ? TS_ERROR : TS_SUCCESS;
+}
+
+TSReturnCode
+TSCacheDiskRemove(const char *path)
+{
+  sdk_assert(sdk_sanity_check_null_ptr((void*)path) == TS_SUCCESS);
+
+  return (cacheProcessor.remove_disk(path) < 0) ? TS_ERROR : TS_SUCCESS;
+}
+
 
 /************************   REC Stats API    **************************/
 int
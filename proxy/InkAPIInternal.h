@@ -149,10 +149,14 @@ public:
   void append(TSHttpHookID id, INKContInternal * cont);
   APIHook *get(TSHttpHookID id);
 
-  // A boolean value to quickly see if
-  //   any hooks are set
+  // One bit per hook id that has at least one hook, so a caller
+  //   can skip a hook point with a single test.  Zero means no
+  //   hooks are set at all.
   int hooks_set;
 
+  static int hook_bit(TSHttpHookID id) { return 1 << id; }
+  bool has_hooks_for(TSHttpHookID id) const { return (hooks_set & hook_bit(id)) != 0; }
+
 private:
   APIHooks m_hooks[TS_HTTP_LAST_HOOK];
 };
@@ -7639,3 +7639,111 @@ REGRESSION_TEST(SDK_API_OVERRIDABLE_CONFIGS) (RegressionTest * test, int atype,
 
   return;
 }
+
+
+////////////////////////////////////////////////
+// SDK_API_HOOK_DISPATCH
+//
+// Unit Test for: HttpAPIHooks::hooks_set
+//
+// Checks that the per hook bit mask agrees with
+// the hook lists, and times the hook checkpoints
+// of a cache hit with 8 plugins loaded, walking
+// the lists versus testing the mask first.
+////////////////////////////////////////////////
+
+static int
+hook_dispatch_handler(TSCont contp, TSEvent event, void *edata)
+{
+  NOWARN_UNUSED(contp);
+  NOWARN_UNUSED(event);
+  NOWARN_UNUSED(edata);
+  return 0;
+}
+
+REGRESSION_TEST(SDK_API_HOOK_DISPATCH) (RegressionTest * test, int atype, int *pstatus)
+{
+  NOWARN_UNUSED(atype);
+  // The hook points a cache hit goes through, in order
+  const TSHttpHookID checkpoints[] = {
+    TS_HTTP_TXN_START_HOOK, TS_HTTP_PRE_REMAP_HOOK, TS_HTTP_POST_REMAP_HOOK,
+    TS_HTTP_READ_REQUEST_HDR_HOOK, TS_HTTP_CACHE_LOOKUP_COMPLETE_HOOK,
+    TS_HTTP_READ_CACHE_HDR_HOOK, TS_HTTP_SEND_RESPONSE_HDR_HOOK, TS_HTTP_TXN_CLOSE_HOOK
+  };
+  // Where 8 typical plugins hang their global hooks
+  const TSHttpHookID plugin_hooks[] = {
+    TS_HTTP_READ_REQUEST_HDR_HOOK, TS_HTTP_READ_REQUEST_HDR_HOOK, TS_HTTP_SEND_RESPONSE_HDR_HOOK,
+    TS_HTTP_READ_RESPONSE_HDR_HOOK, TS_HTTP_SEND_REQUEST_HDR_HOOK, TS_HTTP_OS_DNS_HOOK,
+    TS_HTTP_TXN_CLOSE_HOOK, TS_HTTP_SSN_START_HOOK
+  };
+  const int n_checkpoints = sizeof(checkpoints) / sizeof(checkpoints[0]);
+  const int n_plugins = sizeof(plugin_hooks) / sizeof(plugin_hooks[0]);
+  const int loops = 100000;
+  TSCont conts[n_plugins];
+  HttpAPIHooks global, session, txn;
+  ink_hrtime start, walk_time, mask_time;
+  int walk_found = 0, mask_found = 0;
+
+  *pstatus = REGRESSION_TEST_INPROGRESS;
+
+  for (int i = 0; i < n_plugins; i++) {
+    conts[i] = TSContCreate(hook_dispatch_handler, NULL);
+    global.append(plugin_hooks[i], (INKContInternal *) conts[i]);
+  }
+  txn.append(TS_HTTP_SEND_RESPONSE_HDR_HOOK, (INKContInternal *) conts[0]);
+
+  int hooks_set = global.hooks_set | session.hooks_set | txn.hooks_set;
+  for (int id = 0; id < TS_HTTP_LAST_HOOK; id++) {
+    bool listed = global.get((TSHttpHookID) id) || session.get((TSHttpHookID) id) || txn.get((TSHttpHookID) id);
+    if (listed != ((hooks_set & HttpAPIHooks::hook_bit((TSHttpHookID) id)) != 0)) {
+      SDK_RPRINT(test, "HttpAPIHooks", "TestCase1", TC_FAIL, "hooks_set disagrees with the hook list for hook %d", id);
+      *pstatus = REGRESSION_TEST_FAILED;
+    }
+  }
+
+  start = ink_get_hrtime_internal();
+  for (int l = 0; l < loops; l++) {
+    for (int c = 0; c < n_checkpoints; c++) {
+      HttpAPIHooks *levels[3] = { &global, &session, &txn };
+      for (int h = 0; h < 3; h++) {
+        for (APIHook * hook = levels[h]->get(checkpoints[c]); hook; hook = hook->next())
+          walk_found++;
+      }
+    }
+  }
+  walk_time = ink_get_hrtime_internal() - start;
+
+  start = ink_get_hrtime_internal();
+  for (int l = 0; l < loops; l++) {
+    for (int c = 0; c < n_checkpoints; c++) {
+      if (!(hooks_set & HttpAPIHooks::hook_bit(checkpoints[c])))
+        continue;
+      HttpAPIHooks *levels[3] = { &global, &session, &txn };
+      for (int h = 0; h < 3; h++) {
+        for (APIHook * hook = levels[h]->get(checkpoints[c]); hook; hook = hook->next())
+          mask_found++;
+      }
+    }
+  }
+  mask_time = ink_get_hrtime_internal() - start;
+
+  // rprintf has no floating point, so report ns per 100 checkpoints
+  rprintf(test, "%d hook checkpoints: list walk %d ns, mask test %d ns per 100 checkpoints\n", n_checkpoints,
+          (int) (walk_time * 100 / (loops * n_checkpoints)), (int) (mask_time * 100 / (loops * n_checkpoints)));
+
+  if (walk_found != mask_found || walk_found != loops * 5) {
+    SDK_RPRINT(test, "HttpAPIHooks", "TestCase2", TC_FAIL, "found %d hooks walking, %d with the mask", walk_found, mask_found);
+    *pstatus = REGRESSION_TEST_FAILED;
+  }
+
+  global.clear();
+  session.clear();
+  txn.clear();
+  for (int i = 0; i < n_plugins; i++)
+    TSContDestroy(conts[i]);
+
+  if (*pstatus == REGRESSION_TEST_INPROGRESS) {
+    SDK_RPRINT(test, "HttpAPIHooks", "TestCase1", TC_PASS, "ok");
+    *pstatus = REGRESSION_TEST_PASSED;
+  }
+}
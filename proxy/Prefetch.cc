@@ -27,6 +27,7 @@
 #include "HdrUtils.h"
 #include "HttpCompat.h"
 #include "I_Layout.h"
+#include "HttpTransactHeaders.h"
 
 #ifdef PREFETCH
 
@@ -303,7 +304,8 @@ PrefetchTransform::PrefetchTransform(HttpSM *sm, HTTPHdr *resp)
 
   Debug("PrefetchParser", "Created: transform for %s\n", url);
 
-  memset(&hash_table[0], 0, HASH_TABLE_LENGTH * sizeof(hash_table[0]));
+  memset(url_filter, 0, sizeof(url_filter));
+  n_urls = 0;
 
   udp_url_list = blasterUrlListAllocator.alloc();
   udp_url_list->init(UDP_BLAST, prefetch_config.url_buffer_timeout, prefetch_config.url_buffer_size);
@@ -334,20 +336,7 @@ PrefetchTransform::~PrefetchTransform()
   this_ethread()->schedule_imm_local(udp_url_list);
   this_ethread()->schedule_imm_local(tcp_url_list);
 
-  Debug("PrefetchParserURLs", "Unique URLs 0x%p (%s):\n", this, url);
-  int nurls = 0;
-  for (int i = 0; i < HASH_TABLE_LENGTH; i++) {
-    PrefetchUrlEntry *e = hash_table[i];
-    while (e) {
-      Debug("PrefetchParserURLs", "(0x%p) %d: %s\n", this, i, e->url);
-      nurls++;
-      PrefetchUrlEntry *next = e->hash_link;
-      e->free();
-      e = next;
-    }
-  }
-
-  Debug("PrefetchParserURLs", "Number of embedded objects extracted for %s: %d\n", url, nurls);
+  Debug("PrefetchParserURLs", "Number of embedded objects extracted for %s: %d\n", url, n_urls);
 
   if (m_output_buf)
     free_MIOBuffer(m_output_buf);
@@ -525,7 +514,9 @@ PrefetchTransform::redirect(HTTPHdr *resp)
       entry->req_ip = m_sm->t_state.client_info.ip;
 
       PrefetchBlaster *blaster = prefetchBlasterAllocator.alloc();
+      blaster->urgent = true;
       blaster->init(entry, &m_sm->t_state.hdr_info.client_request, this);
+      entry->free();
       if (req_url)
         xfree(req_url);
     }
@@ -553,34 +544,45 @@ PrefetchTransform::parse_data(IOBufferReader *reader)
 
     PrefetchBlaster *blaster = prefetchBlasterAllocator.alloc();
     blaster->init(entry, &m_sm->t_state.hdr_info.client_request, this);
+    entry->free();
   }
 
   return 0;
 }
 
+// Returns a new entry, which the caller owns a reference to, or NULL if
+// the url has (probably) been seen on this page already.
 PrefetchUrlEntry *
 PrefetchTransform::hash_add(char *s)
 {
-  uint32_t index = 0;
   int str_len = strlen(s);
+  bool seen = true;
 
   if (normalize_url(s, &str_len) > 0)
     Debug("PrefetchParserURLs", "Normalized URL: %s\n", s);
 
-
   INK_MD5 md5;
-  md5.encodeBuffer(s, str_len);
-  index = md5.word(1) % HASH_TABLE_LENGTH;
+  ink_code_murmur3(s, str_len, (char *) &md5);
+
+  for (int i = 0; i < URL_FILTER_HASHES; i++) {
+    uint32_t bit = md5.word(i) % URL_FILTER_BITS;
+    uint32_t mask = 1U << (bit % 32);
+
+    if (!(url_filter[bit / 32] & mask)) {
+      url_filter[bit / 32] |= mask;
+      seen = false;
+    }
+  }
+  if (seen)
+    return NULL;
 
-  PrefetchUrlEntry **e = &hash_table[index];
-  for (; *e; e = &(*e)->hash_link)
-    if (strcmp((*e)->url, s) == 0)
-      return NULL;
+  Debug("PrefetchParserURLs", "(0x%p) %d: %s\n", this, n_urls, s);
+  n_urls++;
 
-  *e = prefetchUrlEntryAllocator.alloc();
-  (*e)->init(xstrdup(s), md5);
+  PrefetchUrlEntry *e = prefetchUrlEntryAllocator.alloc();
+  e->init(xstrdup(s), md5);
 
-  return *e;
+  return e;
 }
 
 #define IS_RECURSIVE_PREFETCH(req_ip) (prefetch_config.max_recursion > 0 &&\
@@ -1033,6 +1035,9 @@ PrefetchBlaster::free()
   if (serverVC)
     serverVC->do_io_close();
 
+  if (origin)
+    prefetchScheduler.release(this);
+
   if (url_ent)
     url_ent->free();
   if (transform)
@@ -1509,6 +1514,18 @@ PrefetchBlaster::httpClient(int event, void *data)
   switch (event) {
 
   case EVENT_IMMEDIATE:{
+      if (!origin) {
+        int admitted = prefetchScheduler.admit(this);
+        if (admitted < 0) {
+          Debug("PrefetchBlaster", "Too many fetches queued for %s, dropping it\n", url_ent->url);
+          free();
+          break;
+        }
+        if (admitted == 0) {
+          // prefetchScheduler reschedules us when our turn comes
+          break;
+        }
+      }
       netProcessor.connect_re(this, htonl((127 << 24) | 1), prefetch_config.local_http_server_port);
       break;
     }
@@ -1703,9 +1720,70 @@ PrefetchBlaster::blastObject(int event, void *data)
   return EVENT_DONE;
 }
 
+// Whether a cached object can be pushed as it is, as opposed to being
+// revalidated through the local http port. This follows
+// HttpTransact::calculate_document_freshness_limit(), minus what needs
+// a transaction.
+static bool
+cached_object_is_fresh(CacheHTTPInfo *info)
+{
+  HTTPHdr *resp = info->response_get();
+  uint32_t cc_mask = resp->get_cooked_cc_mask();
+  ink_time_t request_time = info->request_sent_time_get();
+  ink_time_t response_time = info->response_received_time_get();
+  ink_time_t date = resp->get_date();
+  MgmtInt min_limit, max_limit;
+  ink_time_t age, limit;
+
+  if (cc_mask & (MIME_COOKED_MASK_CC_NO_CACHE | MIME_COOKED_MASK_CC_NEED_REVALIDATE_ONCE))
+    return false;
+
+  if (date <= 0)
+    date = request_time;
+  age = HttpTransactHeaders::calculate_document_age(request_time, response_time, resp, date, ink_cluster_time());
+
+  HttpConfigParams *http_config_params = HttpConfig::acquire();
+  min_limit = max((MgmtInt) 0, http_config_params->oride.cache_guaranteed_min_lifetime);
+  max_limit = min((MgmtInt) NUM_SECONDS_IN_ONE_YEAR, http_config_params->oride.cache_guaranteed_max_lifetime);
+
+  if (cc_mask & MIME_COOKED_MASK_CC_S_MAXAGE) {
+    limit = resp->get_cooked_cc_s_maxage();
+  } else if (cc_mask & MIME_COOKED_MASK_CC_MAX_AGE) {
+    limit = resp->get_cooked_cc_max_age();
+  } else if (resp->presence(MIME_PRESENCE_EXPIRES)) {
+    limit = resp->get_expires() - date;
+  } else {
+    ink_time_t last_modified = resp->get_last_modified();
+
+    if (resp->presence(MIME_PRESENCE_LAST_MODIFIED) && last_modified > 0 && last_modified <= date)
+      limit = (ink_time_t) ((date - last_modified) * http_config_params->oride.cache_heuristic_lm_factor);
+    else
+      limit = http_config_params->oride.cache_heuristic_min_lifetime;
+    min_limit = max(min_limit, http_config_params->oride.cache_heuristic_min_lifetime);
+    max_limit = min(max_limit, http_config_params->oride.cache_heuristic_max_lifetime);
+  }
+  HttpConfig::release(http_config_params);
+
+  if (limit > max_limit)
+    limit = max_limit;
+  if (limit < min_limit)
+    limit = min_limit;
+
+  return age < limit;
+}
+
 int
 PrefetchBlaster::invokeBlaster()
 {
+  if (cache_http_info && !cached_object_is_fresh(cache_http_info)) {
+    // a stale copy is as good as none: fetch it through the local
+    // http port, which revalidates it
+    Debug("PrefetchBlaster", "Cached copy of %s is stale\n", url_ent->url);
+    serverVC->do_io_close();
+    serverVC = NULL;
+    cache_http_info = 0;
+  }
+
   int ret = (cache_http_info && !prefetch_config.push_cached_objects)
     ? TS_PREFETCH_DISCONTINUE : TS_PREFETCH_CONTINUE;
 
@@ -1847,6 +1925,16 @@ PrefetchConfiguration::readConfiguration()
 
   TS_ReadConfigInteger(redirection, "proxy.config.prefetch.redirection");
 
+  TS_ReadConfigInteger(max_fetches, "proxy.config.prefetch.max_fetches");
+  if (max_fetches <= 0)
+    max_fetches = INT_MAX;
+  TS_ReadConfigInteger(max_fetches_per_origin, "proxy.config.prefetch.max_fetches_per_origin");
+  if (max_fetches_per_origin <= 0)
+    max_fetches_per_origin = INT_MAX;
+  TS_ReadConfigInteger(max_queued_per_origin, "proxy.config.prefetch.max_queued_per_origin");
+  if (max_queued_per_origin < 0)
+    max_queued_per_origin = INT_MAX;
+
   char *tstr = TS_ConfigReadString("proxy.config.prefetch.default_url_proto");
   if (config_read_proto(default_url_proto, tstr))
     goto Lerror;
@@ -1962,6 +2050,142 @@ PrefetchConfiguration::readHtmlTags(int fd, html_tag ** ptags, html_tag ** pattr
   *pattrs = NULL;
 }
 
+/* Fetch scheduling */
+
+PrefetchScheduler prefetchScheduler;
+
+static inline unsigned int
+origin_hash(const char *host, int host_len, int port)
+{
+  unsigned int hash = port;
+
+  for (int i = 0; i < host_len; i++)
+    hash = hash * 31 + ParseRules::ink_tolower(host[i]);
+  return hash % PrefetchScheduler::ORIGIN_BUCKETS;
+}
+
+PrefetchScheduler::PrefetchScheduler()
+  : active(0)
+{
+  ink_mutex_init(&lock, "PrefetchScheduler");
+}
+
+PrefetchOrigin *
+PrefetchScheduler::get_origin(const char *host, int host_len, int port)
+{
+  DLL<PrefetchOrigin, PrefetchOrigin::Link_hash_link> &bucket = buckets[origin_hash(host, host_len, port)];
+  PrefetchOrigin *origin;
+
+  for (origin = bucket.head; origin; origin = origin->hash_link.next) {
+    if (origin->port == port && origin->host_len == host_len && strncasecmp(origin->host, host, host_len) == 0)
+      return origin;
+  }
+
+  origin = NEW(new PrefetchOrigin);
+  origin->host = (char *) xmalloc(host_len + 1);
+  memcpy(origin->host, host, host_len);
+  origin->host[host_len] = '\0';
+  origin->host_len = host_len;
+  origin->port = port;
+  bucket.push(origin);
+  return origin;
+}
+
+void
+PrefetchScheduler::put_origin(PrefetchOrigin *origin)
+{
+  if (origin->active || origin->n_waiting)
+    return;
+
+  ink_debug_assert(!origin->ready);
+  buckets[origin_hash(origin->host, origin->host_len, origin->port)].remove(origin);
+  xfree(origin->host);
+  delete origin;
+}
+
+int
+PrefetchScheduler::admit(PrefetchBlaster *blaster)
+{
+  URL *u = blaster->request->url_get();
+  int host_len = 0;
+  const char *host = u->host_get(&host_len);
+  int ret;
+
+  if (!host)
+    host_len = 0;
+
+  ink_mutex_acquire(&lock);
+  PrefetchOrigin *origin = get_origin(host, host_len, u->port_get());
+
+  if (origin->active < prefetch_config.max_fetches_per_origin && active < prefetch_config.max_fetches) {
+    origin->active++;
+    active++;
+    blaster->origin = origin;
+    ret = 1;
+  } else if (origin->n_waiting >= prefetch_config.max_queued_per_origin) {
+    put_origin(origin);
+    ret = -1;
+  } else {
+    if (blaster->urgent)
+      origin->waiting.push(blaster);
+    else
+      origin->waiting.enqueue(blaster);
+    origin->n_waiting++;
+    blaster->origin = origin;
+    if (!origin->ready && origin->active < prefetch_config.max_fetches_per_origin) {
+      // only the global limit is holding it back
+      ready.enqueue(origin);
+      origin->ready = true;
+    }
+    ret = 0;
+  }
+  ink_mutex_release(&lock);
+
+  return ret;
+}
+
+void
+PrefetchScheduler::release(PrefetchBlaster *blaster)
+{
+  ink_mutex_acquire(&lock);
+  PrefetchOrigin *origin = blaster->origin;
+
+  blaster->origin = NULL;
+  origin->active--;
+  active--;
+  if (origin->n_waiting && !origin->ready) {
+    ready.enqueue(origin);
+    origin->ready = true;
+  }
+  dispatch();
+  put_origin(origin);
+  ink_mutex_release(&lock);
+}
+
+// Start waiting fetches while there is room, one from each ready
+// origin in turn.
+void
+PrefetchScheduler::dispatch()
+{
+  PrefetchOrigin *origin;
+
+  while (active < prefetch_config.max_fetches && (origin = ready.dequeue())) {
+    PrefetchBlaster *blaster = origin->waiting.dequeue();
+
+    origin->n_waiting--;
+    origin->active++;
+    active++;
+
+    // its handler is still httpClient, waiting for EVENT_IMMEDIATE
+    eventProcessor.schedule_imm(blaster);
+
+    if (origin->n_waiting && origin->active < prefetch_config.max_fetches_per_origin)
+      ready.enqueue(origin);
+    else
+      origin->ready = false;
+  }
+}
+
 /* Keep Alive stuff */
 
 #define CONN_ARR_SIZE 256
@@ -75,6 +75,10 @@ struct PrefetchConfiguration
   unsigned int max_recursion;   //limit on depth of recursive prefetch
   unsigned int redirection;     //limit on depth of redirect prefetch
 
+  int max_fetches;              //fetches through the local http port at once
+  int max_fetches_per_origin;   //...of which against any one origin
+  int max_queued_per_origin;    //fetches waiting for an origin
+
   TSPrefetchHook pre_parse_hook;
   TSPrefetchHook embedded_url_hook;
   TSPrefetchHook embedded_obj_hook;
@@ -90,7 +94,7 @@ public:
   PrefetchUrlEntry()
     : url(0), len(INT_MAX), resp_blaster(0),
       object_buf_status(TS_PREFETCH_OBJ_BUF_NOT_NEEDED),
-      req_ip(0), child_ip(0), url_multicast_ip(0), data_multicast_ip(0), blaster_link(0), hash_link(0)
+      req_ip(0), child_ip(0), url_multicast_ip(0), data_multicast_ip(0), blaster_link(0)
   {
     refcount_inc();
   }
@@ -124,7 +128,6 @@ public:
   uint32_t data_multicast_ip;
 
   PrefetchUrlEntry *blaster_link;
-  PrefetchUrlEntry *hash_link;
 
 private:
   // this private copy ctor is set to prevent from being used
@@ -148,8 +151,11 @@ PrefetchUrlEntry::free()
 
 class PrefetchTransform:public INKVConnInternal, public RefCountObj
 {
+  // Bloom filter of the URLs seen on this page: URL_FILTER_BITS bits,
+  // URL_FILTER_HASHES probes. At 500 distinct URLs roughly 1 in 400
+  // is mistaken for a duplicate and not prefetched.
   enum
-  { HASH_TABLE_LENGTH = 61 /*127, 511 */  };
+  { URL_FILTER_BITS = 8192, URL_FILTER_HASHES = 4 };
 public:
 
     PrefetchTransform(HttpSM * sm, HTTPHdr * resp);
@@ -185,7 +191,8 @@ public:
   //unsigned int                child_ip;
   HtmlParser html_parser;
 
-  PrefetchUrlEntry *hash_table[HASH_TABLE_LENGTH];
+  uint32_t url_filter[URL_FILTER_BITS / 32];
+  int n_urls;
 
   BlasterUrlList *udp_url_list;
   BlasterUrlList *tcp_url_list;
@@ -289,6 +296,8 @@ BlasterUrlList::invokeUrlBlaster()
   cur_len = 0;
 }
 
+class PrefetchOrigin;
+
 class PrefetchBlaster:public Continuation
 {
 
@@ -297,7 +306,8 @@ public:
 
     PrefetchBlaster()
   : Continuation(), url_ent(0), transform(0), url_list(0), request(0),
-    cache_http_info(0), buf(0), reader(0), serverVC(0), data_proto(0), n_pkts_sent(0), seq_no(0), io_block(0)
+    cache_http_info(0), buf(0), reader(0), serverVC(0), data_proto(0), origin(0), urgent(false),
+    n_pkts_sent(0), seq_no(0), io_block(0)
   {
   };
   ~PrefetchBlaster() {
@@ -335,6 +345,11 @@ public:
 
   CacheLookupHttpConfig cache_lookup_config;
 
+  //fetch scheduling:
+  PrefetchOrigin *origin;       //set once admitted or queued by prefetchScheduler
+  bool urgent;                  //goes to the head of its origin's queue
+  LINK(PrefetchBlaster, sched_link);
+
   //udp related:
   uint32_t n_pkts_sent;
   uint32_t seq_no;
@@ -343,6 +358,63 @@ public:
 
 extern ClassAllocator<PrefetchBlaster> prefetchBlasterAllocator;
 
+/*Fetch scheduling*/
+
+class PrefetchOrigin
+{
+public:
+  PrefetchOrigin()
+    : host(0), host_len(0), port(0), active(0), n_waiting(0), ready(false)
+  { }
+
+  char *host;
+  int host_len;
+  int port;
+
+  int active;                   //fetches in progress
+  int n_waiting;
+  Queue<PrefetchBlaster, PrefetchBlaster::Link_sched_link> waiting;
+  bool ready;                   //on the scheduler's ready queue
+
+  LINK(PrefetchOrigin, hash_link);
+  LINK(PrefetchOrigin, ready_link);
+};
+
+/**
+  Admission control for the fetches the blasters make through the
+  local http port. At most max_fetches_per_origin of them run against
+  one origin host, and max_fetches in all; the rest wait on their
+  origin's queue (up to max_queued_per_origin, beyond which they are
+  dropped) and are started as running fetches finish, taking the
+  origins with waiting fetches in turn.
+*/
+class PrefetchScheduler
+{
+public:
+  enum
+  { ORIGIN_BUCKETS = 256 };
+
+  PrefetchScheduler();
+
+  /// Returns 1 if the fetch may start now, 0 if it was queued and
+  /// will be rescheduled later, -1 if it was refused.
+  int admit(PrefetchBlaster * blaster);
+  /// Called when an admitted fetch is done.
+  void release(PrefetchBlaster * blaster);
+
+private:
+  PrefetchOrigin *get_origin(const char *host, int host_len, int port);
+  void put_origin(PrefetchOrigin * origin);
+  void dispatch();
+
+  ink_mutex lock;
+  int active;
+  DLL<PrefetchOrigin, PrefetchOrigin::Link_hash_link> buckets[ORIGIN_BUCKETS];
+  Queue<PrefetchOrigin, PrefetchOrigin::Link_ready_link> ready;
+};
+
+extern PrefetchScheduler prefetchScheduler;
+
 /*Conncetion keep alive*/
 
 #define PRELOAD_HEADER_LEN 12   //this is the new header
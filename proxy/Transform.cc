@@ -736,8 +736,8 @@ TransformTest::run()
 
 
 ///////////////////////////////////////////////////////////////////
-/// RangeTransform implementation
-/// handling Range requests from clients
+/// Range request support
+/// parsing and multipart/byteranges framing of Range responses
 ///////////////////////////////////////////////////////////////////
 
 /*-------------------------------------------------------------------------
@@ -761,77 +761,38 @@ num_chars_for_int(int64_t i)
 /*-------------------------------------------------------------------------
   -------------------------------------------------------------------------*/
 
-RangeTransform::RangeTransform(ProxyMutex *mut, MIMEField *range_field, HTTPInfo *cache_obj, HTTPHdr *transform_resp)
-  : INKVConnInternal(NULL, reinterpret_cast<TSMutex>(mut)),
-    m_output_buf(NULL),
-    m_output_reader(NULL),
-    m_range_field(range_field),
-    m_transform_resp(transform_resp),
-    m_output_vio(NULL),
-    m_unsatisfiable_range(true),
-    m_not_handle_range(false),
-    m_num_range_fields(0),
-    m_current_range(0), m_content_type(NULL), m_content_type_len(0), m_ranges(NULL), m_output_cl(0), m_done(0)
-{
-  SET_HANDLER(&RangeTransform::handle_event);
-
-  m_content_type = cache_obj->
-    response_get()->value_get(MIME_FIELD_CONTENT_TYPE, MIME_LEN_CONTENT_TYPE, &m_content_type_len);
-
-  m_content_length = cache_obj->object_size_get();
-  m_num_chars_for_cl = num_chars_for_int(m_content_length);
-
-  parse_range_and_compare();
-  calculate_output_cl();
-
-  Debug("transform_range", "RangeTransform creation finishes");
-}
-
-
-/*-------------------------------------------------------------------------
-  -------------------------------------------------------------------------*/
-
-RangeTransform::~RangeTransform()
-{
-  if (m_ranges)
-    delete[]m_ranges;
-  if (m_output_buf)
-    free_MIOBuffer(m_output_buf);
-}
-
-
-/*-------------------------------------------------------------------------
-  -------------------------------------------------------------------------*/
-
-void
-RangeTransform::parse_range_and_compare()
+int
+range_parse(MIMEField *range_field, int64_t content_length, RangeRecord **ranges, bool *unsatisfiable, bool *not_handled)
 {
-  // note: unsatisfiable_range is initialized to true in constructor
-  int prev_good_range, i;
+  int num_range_fields, prev_good_range, i;
   const char *value;
   int value_len;
   HdrCsvIter csv;
   const char *s, *e;
 
-  if (m_content_length <= 0)
-    return;
+  *ranges = NULL;
+  *unsatisfiable = true;
+  *not_handled = false;
+
+  if (content_length <= 0)
+    return 0;
 
-  ink_assert(m_range_field != NULL);
+  ink_assert(range_field != NULL);
 
-  m_num_range_fields = 0;
-  value = csv.get_first(m_range_field, &value_len);
+  num_range_fields = 0;
+  value = csv.get_first(range_field, &value_len);
 
   while (value) {
-    m_num_range_fields++;
+    num_range_fields++;
     value = csv.get_next(&value_len);
   }
 
-  if (m_num_range_fields <= 0)
-    return;
+  if (num_range_fields <= 0)
+    return 0;
 
-  m_ranges = NEW(new RangeRecord[m_num_range_fields]);
+  RangeRecord *r = *ranges = NEW(new RangeRecord[num_range_fields]);
 
-  value = csv.get_first(m_range_field, &value_len);
+  value = csv.get_first(range_field, &value_len);
 
   i = 0;
   prev_good_range = -1;
@@ -840,66 +801,64 @@ RangeTransform::parse_range_and_compare()
     while (value) {
       // If delimiter '-' is missing
       if (!(e = (const char *) memchr(value, '-', value_len))) {
-        m_unsatisfiable_range = true;
-        return;
+        *unsatisfiable = true;
+        return num_range_fields;
       }
-      
+
       if ( memcmp(value,"bytes=",6) == 0 ) {
         s = value + 6;
       }
       else {
         s = value;
       }
-      
-      m_ranges[i]._start = ((s==e)?-1:mime_parse_int64(s, e));
+
+      r[i]._start = ((s==e)?-1:mime_parse_int64(s, e));
 
       e++;
       s = e;
       e = value + value_len;
       if ( e && *(e-1) == '-') { //open-ended Range: bytes=10-\r\n\r\n should be supported
-        m_ranges[i]._end = -1;
+        r[i]._end = -1;
       }
       else {
-        m_ranges[i]._end = mime_parse_int64(s, e);
+        r[i]._end = mime_parse_int64(s, e);
       }
 
       // check and change if necessary whether this is a right entry
       // the last _end bytes are required
-      if (m_ranges[i]._start == -1 && m_ranges[i]._end > 0) {
-        if (m_ranges[i]._end > m_content_length)
-          m_ranges[i]._end = m_content_length;
+      if (r[i]._start == -1 && r[i]._end > 0) {
+        if (r[i]._end > content_length)
+          r[i]._end = content_length;
 
-        m_ranges[i]._start = m_content_length - m_ranges[i]._end;
-        m_ranges[i]._end = m_content_length - 1;
+        r[i]._start = content_length - r[i]._end;
+        r[i]._end = content_length - 1;
       }
       // open start
-      else if (m_ranges[i]._start >= 0 && m_ranges[i]._end == -1) {
-        if (m_ranges[i]._start >= m_content_length)
-          m_ranges[i]._start = -1;
+      else if (r[i]._start >= 0 && r[i]._end == -1) {
+        if (r[i]._start >= content_length)
+          r[i]._start = -1;
         else
-          m_ranges[i]._end = m_content_length - 1;
+          r[i]._end = content_length - 1;
       }
       // "normal" Range - could be wrong if _end<_start
-      else if (m_ranges[i]._start >= 0 && m_ranges[i]._end >= 0) {
-        if (m_ranges[i]._start > m_ranges[i]._end || m_ranges[i]._start >= m_content_length)
-          m_ranges[i]._start = m_ranges[i]._end = -1;
-        else if (m_ranges[i]._end >= m_content_length)
-          m_ranges[i]._end = m_content_length - 1;
+      else if (r[i]._start >= 0 && r[i]._end >= 0) {
+        if (r[i]._start > r[i]._end || r[i]._start >= content_length)
+          r[i]._start = r[i]._end = -1;
+        else if (r[i]._end >= content_length)
+          r[i]._end = content_length - 1;
       }
 
       else
-        m_ranges[i]._start = m_ranges[i]._end = -1;
+        r[i]._start = r[i]._end = -1;
 
       // this is a good Range entry
-      if (m_ranges[i]._start != -1) {
-        if (m_unsatisfiable_range) {
-          m_unsatisfiable_range = false;
-          // initialize m_current_range to the first good Range
-          m_current_range = i;
+      if (r[i]._start != -1) {
+        if (*unsatisfiable) {
+          *unsatisfiable = false;
         }
         // currently we don't handle out-of-order Range entry
-        else if (prev_good_range >= 0 && m_ranges[i]._start <= m_ranges[prev_good_range]._end) {
-          m_not_handle_range = true;
+        else if (prev_good_range >= 0 && r[i]._start <= r[prev_good_range]._end) {
+          *not_handled = true;
           break;
         }
 
@@ -910,6 +869,203 @@ RangeTransform::parse_range_and_compare()
       i++;
     }
   }
+
+  return num_range_fields;
+}
+
+
+/*-------------------------------------------------------------------------
+  -------------------------------------------------------------------------*/
+
+/*
+ * these two need be changed at the same time
+ */
+
+static char bound[] = "RANGE_SEPARATOR";
+static char range_type[] = "multipart/byteranges; boundary=RANGE_SEPARATOR";
+static char cont_type[] = "Content-type: ";
+static char cont_range[] = "Content-range: bytes ";
+static int sub_header_size = sizeof(cont_type) - 1 + 2 + sizeof(cont_range) - 1 + 4;
+static int boundary_size = 2 + sizeof(bound) - 1 + 2;
+
+/*
+ * the length of the Range response body, including the multipart
+ * framing when there is more than one range
+ */
+
+int64_t
+range_content_length(RangeRecord *ranges, int num_ranges, int64_t content_length, int content_type_len)
+{
+  int64_t output_cl = 0;
+  int num_chars_for_cl = num_chars_for_int(content_length);
+  int i;
+
+  if (num_ranges == 1)
+    output_cl = ranges[0]._end - ranges[0]._start + 1;
+
+  else {
+    for (i = 0; i < num_ranges; i++) {
+      if (ranges[i]._start >= 0) {
+        output_cl += boundary_size;
+        output_cl += sub_header_size + content_type_len;
+        output_cl += num_chars_for_int(ranges[i]._start)
+          + num_chars_for_int(ranges[i]._end) + num_chars_for_cl + 2;
+        output_cl += ranges[i]._end - ranges[i]._start + 1;
+        output_cl += 2;
+      }
+    }
+
+    output_cl += boundary_size + 2;
+  }
+
+  Debug("transform_range", "Pre-calculated Content-Length for Range response is %" PRId64 "", output_cl);
+  return output_cl;
+}
+
+
+/*-------------------------------------------------------------------------
+  -------------------------------------------------------------------------*/
+
+int64_t
+range_write_boundary(MIOBuffer *buf, bool end)
+{
+  int64_t n = 0;
+
+  n += buf->write("--", 2);
+  n += buf->write(bound, sizeof(bound) - 1);
+
+  if (end)
+    n += buf->write("--", 2);
+
+  n += buf->write("\r\n", 2);
+  return n;
+}
+
+
+/*-------------------------------------------------------------------------
+  -------------------------------------------------------------------------*/
+
+#define RANGE_NUMBERS_LENGTH 60
+
+int64_t
+range_write_sub_header(MIOBuffer *buf, const char *content_type, int content_type_len, RangeRecord *range, int64_t content_length)
+{
+  // this should be large enough to hold three integers!
+  char numbers[RANGE_NUMBERS_LENGTH];
+  int64_t n = 0;
+  int len;
+
+  n += buf->write(cont_type, sizeof(cont_type) - 1);
+  if (content_type)
+    n += buf->write(content_type, content_type_len);
+  n += buf->write("\r\n", 2);
+  n += buf->write(cont_range, sizeof(cont_range) - 1);
+
+  snprintf(numbers, sizeof(numbers), "%" PRId64 "-%" PRId64 "/%" PRId64 "", range->_start, range->_end, content_length);
+  len = strlen(numbers);
+  if (len < RANGE_NUMBERS_LENGTH)
+    n += buf->write(numbers, len);
+  n += buf->write("\r\n\r\n", 4);
+  return n;
+}
+
+/*-------------------------------------------------------------------------
+  -------------------------------------------------------------------------*/
+
+/*
+ * this function changes the response header to reflect this is
+ * a Range response.
+ */
+
+void
+range_set_response_header(HTTPHdr *resp, RangeRecord *ranges, int num_ranges, int64_t content_length)
+{
+  MIMEField *field;
+  char *reason_phrase;
+  HTTPStatus status_code;
+
+  ink_assert(resp->field_find(MIME_FIELD_CONTENT_RANGE, MIME_LEN_CONTENT_RANGE) == NULL);
+
+  status_code = HTTP_STATUS_PARTIAL_CONTENT;
+  resp->status_set(status_code);
+  reason_phrase = (char *) (HttpMessageBody::StatusCodeName(status_code));
+  resp->reason_set(reason_phrase, strlen(reason_phrase));
+
+  // set the right Content-Type for multiple entry Range
+  if (num_ranges > 1) {
+    field = resp->field_find(MIME_FIELD_CONTENT_TYPE, MIME_LEN_CONTENT_TYPE);
+
+    if (field != NULL)
+      resp->field_delete(MIME_FIELD_CONTENT_TYPE, MIME_LEN_CONTENT_TYPE);
+
+
+    field = resp->field_create(MIME_FIELD_CONTENT_TYPE, MIME_LEN_CONTENT_TYPE);
+    field->value_append(resp->m_heap, resp->m_mime, range_type, sizeof(range_type) - 1);
+
+    resp->field_attach(field);
+  }
+
+  else {
+    char numbers[RANGE_NUMBERS_LENGTH];
+
+    field = resp->field_create(MIME_FIELD_CONTENT_RANGE, MIME_LEN_CONTENT_RANGE);
+    snprintf(numbers, sizeof(numbers), "bytes %" PRId64 "-%" PRId64 "/%" PRId64 "", ranges[0]._start, ranges[0]._end, content_length);
+    field->value_append(resp->m_heap, resp->m_mime, numbers, strlen(numbers));
+    resp->field_attach(field);
+  }
+}
+
+#undef RANGE_NUMBERS_LENGTH
+
+
+///////////////////////////////////////////////////////////////////
+/// RangeTransform implementation
+/// handling Range requests from clients
+///////////////////////////////////////////////////////////////////
+
+/*-------------------------------------------------------------------------
+  -------------------------------------------------------------------------*/
+
+RangeTransform::RangeTransform(ProxyMutex *mut, MIMEField *range_field, HTTPInfo *cache_obj, HTTPHdr *transform_resp)
+  : INKVConnInternal(NULL, reinterpret_cast<TSMutex>(mut)),
+    m_output_buf(NULL),
+    m_output_reader(NULL),
+    m_range_field(range_field),
+    m_transform_resp(transform_resp),
+    m_output_vio(NULL),
+    m_unsatisfiable_range(true),
+    m_not_handle_range(false),
+    m_num_range_fields(0),
+    m_current_range(0), m_content_type(NULL), m_content_type_len(0), m_ranges(NULL), m_output_cl(0), m_done(0)
+{
+  SET_HANDLER(&RangeTransform::handle_event);
+
+  m_content_type = cache_obj->
+    response_get()->value_get(MIME_FIELD_CONTENT_TYPE, MIME_LEN_CONTENT_TYPE, &m_content_type_len);
+
+  m_content_length = cache_obj->object_size_get();
+
+  m_num_range_fields = range_parse(m_range_field, m_content_length, &m_ranges, &m_unsatisfiable_range, &m_not_handle_range);
+  if (!m_unsatisfiable_range) {
+    // start with the first good Range
+    while (m_ranges[m_current_range]._start == -1)
+      m_current_range++;
+    m_output_cl = range_content_length(m_ranges, m_num_range_fields, m_content_length, m_content_type_len);
+  }
+
+  Debug("transform_range", "RangeTransform creation finishes");
+}
+
+
+/*-------------------------------------------------------------------------
+  -------------------------------------------------------------------------*/
+
+RangeTransform::~RangeTransform()
+{
+  if (m_ranges)
+    delete[]m_ranges;
+  if (m_output_buf)
+    free_MIOBuffer(m_output_buf);
 }
 
 
@@ -944,7 +1100,7 @@ RangeTransform::handle_event(int event, void *edata)
         m_output_reader = m_output_buf->alloc_reader();
         m_output_vio = m_output_vc->do_io_write(this, m_output_cl, m_output_reader);
 
-        change_response_header();
+        range_set_response_header(m_transform_resp, m_ranges, m_num_range_fields, m_content_length);
 
         if (m_num_range_fields > 1) {
           add_boundary(false);
@@ -1085,134 +1241,20 @@ RangeTransform::transform_to_range()
 /*-------------------------------------------------------------------------
   -------------------------------------------------------------------------*/
 
-/*
- * these two need be changed at the same time
- */
-
-static char bound[] = "RANGE_SEPARATOR";
-static char range_type[] = "multipart/byteranges; boundary=RANGE_SEPARATOR";
-static char cont_type[] = "Content-type: ";
-static char cont_range[] = "Content-range: bytes ";
-static int sub_header_size = sizeof(cont_type) - 1 + 2 + sizeof(cont_range) - 1 + 4;
-static int boundary_size = 2 + sizeof(bound) - 1 + 2;
-
 void
 RangeTransform::add_boundary(bool end)
 {
-  m_done += m_output_buf->write("--", 2);
-  m_done += m_output_buf->write(bound, sizeof(bound) - 1);
-
-  if (end)
-    m_done += m_output_buf->write("--", 2);
-
-  m_done += m_output_buf->write("\r\n", 2);
+  m_done += range_write_boundary(m_output_buf, end);
 }
 
 
 /*-------------------------------------------------------------------------
   -------------------------------------------------------------------------*/
 
-#define RANGE_NUMBERS_LENGTH 60
-
 void
 RangeTransform::add_sub_header(int index)
 {
-  // this should be large enough to hold three integers!
-  char numbers[RANGE_NUMBERS_LENGTH];
-  int len;
-
-  m_done += m_output_buf->write(cont_type, sizeof(cont_type) - 1);
-  if (m_content_type)
-    m_done += m_output_buf->write(m_content_type, m_content_type_len);
-  m_done += m_output_buf->write("\r\n", 2);
-  m_done += m_output_buf->write(cont_range, sizeof(cont_range) - 1);
-
-  snprintf(numbers, sizeof(numbers), "%" PRId64 "d-%" PRId64 "d/%" PRId64 "d", m_ranges[index]._start, m_ranges[index]._end, m_content_length);
-  len = strlen(numbers);
-  if (len < RANGE_NUMBERS_LENGTH)
-    m_done += m_output_buf->write(numbers, len);
-  m_done += m_output_buf->write("\r\n\r\n", 4);
-}
-
-/*-------------------------------------------------------------------------
-  -------------------------------------------------------------------------*/
-
-/*
- * this function changes the response header to reflect this is
- * a Range response.
- */
-
-void
-RangeTransform::change_response_header()
-{
-  MIMEField *field;
-  char *reason_phrase;
-  HTTPStatus status_code;
-
-  ink_assert(m_transform_resp->field_find(MIME_FIELD_CONTENT_RANGE, MIME_LEN_CONTENT_RANGE) == NULL);
-
-  status_code = HTTP_STATUS_PARTIAL_CONTENT;
-  m_transform_resp->status_set(status_code);
-  reason_phrase = (char *) (HttpMessageBody::StatusCodeName(status_code));
-  m_transform_resp->reason_set(reason_phrase, strlen(reason_phrase));
-
-  // set the right Content-Type for multiple entry Range
-  if (m_num_range_fields > 1) {
-    field = m_transform_resp->field_find(MIME_FIELD_CONTENT_TYPE, MIME_LEN_CONTENT_TYPE);
-
-    if (field != NULL)
-      m_transform_resp->field_delete(MIME_FIELD_CONTENT_TYPE, MIME_LEN_CONTENT_TYPE);
-
-
-    field = m_transform_resp->field_create(MIME_FIELD_CONTENT_TYPE, MIME_LEN_CONTENT_TYPE);
-    field->value_append(m_transform_resp->m_heap, m_transform_resp->m_mime, range_type, sizeof(range_type) - 1);
-
-    m_transform_resp->field_attach(field);
-  }
-
-  else {
-    char numbers[RANGE_NUMBERS_LENGTH];
-
-    field = m_transform_resp->field_create(MIME_FIELD_CONTENT_RANGE, MIME_LEN_CONTENT_RANGE);
-    snprintf(numbers, sizeof(numbers), "bytes %" PRId64 "-%" PRId64 "/%" PRId64 "", m_ranges[0]._start, m_ranges[0]._end, m_content_length);
-    field->value_append(m_transform_resp->m_heap, m_transform_resp->m_mime, numbers, strlen(numbers));
-    m_transform_resp->field_attach(field);
-  }
-}
-
-#undef RANGE_NUMBERS_LENGTH
-
-
-/*-------------------------------------------------------------------------
-  -------------------------------------------------------------------------*/
-
-void
-RangeTransform::calculate_output_cl()
-{
-  int i;
-
-  if (m_unsatisfiable_range)
-    return;
-
-  if (m_num_range_fields == 1)
-    m_output_cl = m_ranges[0]._end - m_ranges[0]._start + 1;
-
-  else {
-    for (i = 0; i < m_num_range_fields; i++) {
-      if (m_ranges[i]._start >= 0) {
-        m_output_cl += boundary_size;
-        m_output_cl += sub_header_size + m_content_type_len;
-        m_output_cl += num_chars_for_int(m_ranges[i]._start)
-          + num_chars_for_int(m_ranges[i]._end) + m_num_chars_for_cl + 2;
-        m_output_cl += m_ranges[i]._end - m_ranges[i]._start + 1;
-        m_output_cl += 2;
-      }
-    }
-
-    m_output_cl += boundary_size + 2;
-  }
-
-  Debug("transform_range", "Pre-calculated Content-Length for Range response is %d", m_output_cl);
+  m_done += range_write_sub_header(m_output_buf, m_content_type, m_content_type_len, &m_ranges[index], m_content_length);
 }
 
 #endif // TS_NO_TRANSFORM
@@ -46,6 +46,29 @@ public:
 };
 
 
+struct RangeRecord
+{
+  RangeRecord() :
+    _start(-1), _end(-1), _done_byte(-1)
+  { }
+
+  int64_t _start;
+  int64_t _end;
+  int64_t _done_byte;
+};
+
+// Range request support shared by RangeTransform and HttpSM, which serves
+// Range requests on cached documents by seeking the cache read instead.
+// Bad entries are kept in the parsed array with _start == -1.
+int range_parse(MIMEField * range_field, int64_t content_length, RangeRecord ** ranges,
+                bool * unsatisfiable, bool * not_handled);
+int64_t range_content_length(RangeRecord * ranges, int num_ranges, int64_t content_length, int content_type_len);
+void range_set_response_header(HTTPHdr * resp, RangeRecord * ranges, int num_ranges, int64_t content_length);
+int64_t range_write_boundary(MIOBuffer * buf, bool end);
+int64_t range_write_sub_header(MIOBuffer * buf, const char *content_type, int content_type_len,
+                               RangeRecord * range, int64_t content_length);
+
+
 #ifdef TS_HAS_TESTS
 class TransformTest
 {
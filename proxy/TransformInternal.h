@@ -118,14 +118,11 @@ public:
   RangeTransform(ProxyMutex * mutex, MIMEField * range_field, HTTPInfo * cache_obj, HTTPHdr * transform_resp);
   ~RangeTransform();
 
-  void parse_range_and_compare();
   int handle_event(int event, void *edata);
 
   void transform_to_range();
   void add_boundary(bool end);
   void add_sub_header(int index);
-  void change_response_header();
-  void calculate_output_cl();
   bool is_this_range_not_handled()
   {
     return m_not_handle_range;
@@ -135,17 +132,6 @@ public:
     return m_unsatisfiable_range;
   }
 
-  typedef struct _RangeRecord
-  {
-  _RangeRecord() :
-    _start(-1), _end(-1), _done_byte(-1)
-    { }
-
-    int64_t _start;
-    int64_t _end;
-    int64_t _done_byte;
-  } RangeRecord;
-
 public:
   MIOBuffer * m_output_buf;
   IOBufferReader *m_output_reader;
@@ -155,7 +141,6 @@ public:
   bool m_unsatisfiable_range;
   bool m_not_handle_range;
   int64_t m_content_length;
-  int m_num_chars_for_cl;
   int m_num_range_fields;
   int m_current_range;
   const char *m_content_type;
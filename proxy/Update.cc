@@ -1827,13 +1827,90 @@ HtmlParser::ParseHtml(IOBufferReader * r, char **url, char **url_end)
   }
 }
 
+// Character classes the URL scanner stops on.
+enum
+{
+  HTML_CC_SPACE = 0x01,                 // isspace()
+  HTML_CC_TAG_END = 0x02,               // '>'
+  HTML_CC_EQUALS = 0x04,                // '='
+  HTML_CC_HASH = 0x08                   // '#'
+};
+
+static unsigned char html_char_class[256];
+
+static struct HtmlCharClassInit
+{
+  HtmlCharClassInit()
+  {
+    for (int c = 0; c < 256; c++) {
+      html_char_class[c] = isspace(c) ? HTML_CC_SPACE : 0;
+    }
+    html_char_class[(unsigned char) '>'] = HTML_CC_TAG_END;
+    html_char_class[(unsigned char) '='] = HTML_CC_EQUALS;
+    html_char_class[(unsigned char) '#'] = HTML_CC_HASH;
+  }
+} html_char_class_init;
+
+#define HTML_IS_SPACE(_c) (html_char_class[(unsigned char) (_c)] & HTML_CC_SPACE)
+
+// Append the n bytes at s to a (which is not NUL terminated yet).
+static inline void
+html_append(DynArray<char> &a, const char *s, intptr_t n)
+{
+  intptr_t len = a.length();
+
+  if (n > 0) {
+    a(len + n - 1);             // grow
+    memcpy((char *) a + len, s, n);
+  }
+}
+
+// True for the states which consume input, as opposed to the ones
+// which only act on what has been accumulated.
+static inline bool
+html_scan_state_reads(HtmlParser::scan_state_t state)
+{
+  switch (state) {
+  case HtmlParser::SCAN_INIT:
+  case HtmlParser::IGNORE_COMMENT_START:
+  case HtmlParser::VALIDATE_ENTRY:
+  case HtmlParser::VALIDATE_ENTRY_RESTART:
+  case HtmlParser::RESUME_ATTR_VALUE_SCAN:
+    return false;
+  default:
+    return true;
+  }
+}
+
+//
+// The scanner works on the bytes of the reader's current block where
+// they lie, a block at a time, and consumes what it has scanned
+// before it returns. Only tag names, attribute names and attribute
+// values are copied out, and each of those is bounded.
+//
 int
 HtmlParser::ScanHtmlForURL(IOBufferReader * r, char **url, char **url_end)
 {
+  const char *start = r->start();
+  const char *p = start;
+  const char *e = p ? p + r->block_read_avail() : p;
+  const char *s;
+  intptr_t n;
   unsigned char c;
-  int n = 0;
 
   while (1) {
+    if (p == e && html_scan_state_reads(_scan_state)) {
+      // done with this block, move on to the next one
+      if (start) {
+        r->consume(p - start);
+      }
+      start = p = r->start();
+      e = p ? p + r->block_read_avail() : p;
+      if (p == e) {
+        return 0;               // No more data
+      }
+    }
+
     switch (_scan_state) {
     case SCAN_INIT:
       {
@@ -1846,78 +1923,67 @@ HtmlParser::ScanHtmlForURL(IOBufferReader * r, char **url, char **url_end)
         _attr_matched = false;
 
         _scan_state = SCAN_START;
-        n = -1;
         break;
       }
     case SCAN_START:
       {
-        while ((n = r->read((char *) &c, 1))) {
-          if (c == '<') {
-            _scan_state = FIND_TAG_START;
-            break;
-          }
+        if ((s = (const char *) memchr(p, '<', e - p))) {
+          p = s + 1;
+          _scan_state = FIND_TAG_START;
+        } else {
+          p = e;
         }
         break;
       }
     case FIND_TAG_START:
       {
-        while ((n = r->read((char *) &c, 1))) {
-          if (!isspace(c)) {
+        while (p < e) {
+          c = *p++;
+          if (!HTML_IS_SPACE(c)) {
             if (c == '>') {
               ////////////////////////////////////////////////////
               // '< >' with >= 0 embedded spaces, ignore it.
               ////////////////////////////////////////////////////
               _scan_state = SCAN_INIT;
-              break;
 
             } else {
               _tag(_tag.length()) = c;
               _scan_state = COPY_TAG;
-              break;
             }
+            break;
           }
         }
         break;
       }
     case COPY_TAG:
       {
-        while ((n = r->read((char *) &c, 1))) {
-          if (!isspace(c)) {
-            if (c == '>') {
-              /////////////////////////////
-              // <tag>, ignore it
-              /////////////////////////////
-              _scan_state = SCAN_INIT;
-              break;
-
-            } else if (c == '=') {
-              ///////////////////////////////
-              // <tag=something>, ignore it
-              ///////////////////////////////
-              _scan_state = SCAN_INIT;
-              break;
-
-            } else {
-              if (_tag.length() < MAX_TAG_NAME_LENGTH) {
-                _tag(_tag.length()) = c;
-
-              } else {
-                ///////////////////////////////////
-                // Tag name to long, ignore it
-                ///////////////////////////////////
-                _scan_state = SCAN_INIT;
-                break;
-              }
-            }
+        for (s = p; p < e && !(html_char_class[(unsigned char) *p] & (HTML_CC_SPACE | HTML_CC_TAG_END | HTML_CC_EQUALS));
+             p++);
+        n = p - s;
+        if (_tag.length() + n > MAX_TAG_NAME_LENGTH) {
+          ///////////////////////////////////
+          // Tag name to long, ignore it
+          ///////////////////////////////////
+          p = s + (MAX_TAG_NAME_LENGTH - _tag.length()) + 1;
+          _scan_state = SCAN_INIT;
+          break;
+        }
+        html_append(_tag, s, n);
 
-          } else {
+        if (p < e) {
+          c = *p++;
+          if (HTML_IS_SPACE(c)) {
             _tag(_tag.length()) = 0;
             if (strcmp(_tag, HTML_COMMENT_TAG) == 0) {
               _scan_state = IGNORE_COMMENT_START;
             } else {
               _scan_state = FIND_ATTR_START;
             }
-            break;
+          } else {
+            ////////////////////////////////////////////
+            // <tag> or <tag=something>, ignore it
+            ////////////////////////////////////////////
+            _scan_state = SCAN_INIT;
           }
         }
         break;
@@ -1930,8 +1996,17 @@ HtmlParser::ScanHtmlForURL(IOBufferReader * r, char **url, char **url_end)
       }
     case IGNORE_COMMENT:
       {
-        while ((n = r->read((char *) &c, 1))) {
-          if (!isspace(c)) {
+        while (p < e) {
+          if (_comment_end_ptr == HTML_COMMENT_END) {
+            // nothing matched yet, skip to the next '-'
+            if (!(s = (const char *) memchr(p, '-', e - p))) {
+              p = e;
+              break;
+            }
+            p = s;
+          }
+          c = *p++;
+          if (!HTML_IS_SPACE(c)) {
             if (c == *_comment_end_ptr) {
               _comment_end_ptr++;
               if (!*_comment_end_ptr) {
@@ -1947,80 +2022,75 @@ HtmlParser::ScanHtmlForURL(IOBufferReader * r, char **url, char **url_end)
       }
     case FIND_ATTR_START:
       {
-        while ((n = r->read((char *) &c, 1))) {
-          if (!isspace(c)) {
+        while (p < e) {
+          c = *p++;
+          if (!HTML_IS_SPACE(c)) {
             if (c == '>') {
               ////////////////////////////////////////////////
               // <tag > with >=1 embedded spaces, ignore it
               ////////////////////////////////////////////////
               _scan_state = SCAN_INIT;
-              break;
 
             } else if (c == '=') {
               //////////////////////////////////////////////////////////
               // <tag =something> with >=1 embedded spaces, ignore it
               //////////////////////////////////////////////////////////
               _scan_state = SCAN_INIT;
-              break;
 
             } else {
               _attr(_attr.length()) = c;
               _scan_state = COPY_ATTR;
-              break;
             }
+            break;
           }
         }
         break;
       }
     case COPY_ATTR:
       {
-        while ((n = r->read((char *) &c, 1))) {
-          if (!isspace(c)) {
-            if (c == '>') {
-              /////////////////////////////
-              // <tag attr>, ignore it
-              /////////////////////////////
-              _scan_state = SCAN_INIT;
-              break;
-
-            } else if (c == '=') {
-              ///////////////////////////////
-              // <tag attr=something>
-              ///////////////////////////////
-              _attr(_attr.length()) = 0;
-              _scan_state = FIND_ATTR_VALUE_START;
-              break;
-
-            } else {
-              if (_attr.length() < MAX_ATTR_NAME_LENGTH) {
-                _attr(_attr.length()) = c;
+        for (s = p; p < e && !(html_char_class[(unsigned char) *p] & (HTML_CC_SPACE | HTML_CC_TAG_END | HTML_CC_EQUALS));
+             p++);
+        n = p - s;
+        if (_attr.length() + n > MAX_ATTR_NAME_LENGTH) {
+          ///////////////////////////////////
+          // Attr name to long, ignore it
+          ///////////////////////////////////
+          p = s + (MAX_ATTR_NAME_LENGTH - _attr.length()) + 1;
+          _scan_state = SCAN_INIT;
+          break;
+        }
+        html_append(_attr, s, n);
+
+        if (p < e) {
+          c = *p++;
+          if (c == '>') {
+            /////////////////////////////
+            // <tag attr>, ignore it
+            /////////////////////////////
+            _scan_state = SCAN_INIT;
 
-              } else {
-                ///////////////////////////////////
-                // Attr name to long, ignore it
-                ///////////////////////////////////
-                _scan_state = SCAN_INIT;
-                break;
-              }
-            }
+          } else if (c == '=') {
+            ///////////////////////////////
+            // <tag attr=something>
+            ///////////////////////////////
+            _attr(_attr.length()) = 0;
+            _scan_state = FIND_ATTR_VALUE_START;
 
           } else {
             _attr(_attr.length()) = 0;
             _scan_state = FIND_ATTR_VALUE_DELIMITER;
-            break;
           }
         }
         break;
       }
     case FIND_ATTR_VALUE_DELIMITER:
       {
-        while ((n = r->read((char *) &c, 1))) {
-          if (isspace(c) || (c == '=')) {
-            if (c == '=') {
-              _scan_state = FIND_ATTR_VALUE_START;
-              break;
-            }
-          } else {
+        while (p < e) {
+          c = *p++;
+          if (c == '=') {
+            _scan_state = FIND_ATTR_VALUE_START;
+            break;
+          } else if (!HTML_IS_SPACE(c)) {
             _scan_state = SCAN_INIT;
             break;
           }
@@ -2029,75 +2099,76 @@ HtmlParser::ScanHtmlForURL(IOBufferReader * r, char **url, char **url_end)
       }
     case FIND_ATTR_VALUE_START:
       {
-        while ((n = r->read((char *) &c, 1))) {
-          if (!isspace(c)) {
+        while (p < e) {
+          c = *p++;
+          if (!HTML_IS_SPACE(c)) {
             if (c == '>') {
               /////////////////////////////
               // <tag attr= >, ignore
               /////////////////////////////
               _scan_state = SCAN_INIT;
-              break;
 
             } else if ((c == '\'') || (c == '\"')) {
               _attr_value_quoted = c;
               _scan_state = COPY_ATTR_VALUE;
-              break;
 
             } else {
               _attr_value_quoted = 0;
               _attr_value(_attr_value.length()) = c;
+              if (c == '#') {
+                _attr_value_hash_char_index = _attr_value.length() - 1;
+              }
               _scan_state = COPY_ATTR_VALUE;
-              break;
             }
+            break;
           }
         }
         break;
       }
     case COPY_ATTR_VALUE:
       {
-        while ((n = r->read((char *) &c, 1))) {
-          if (_attr_value_quoted) {
-            if (c == _attr_value_quoted) {
-              ///////////////////////////////////////////
-              // We have a complete <tag attr='value'
-              ///////////////////////////////////////////
-              _attr_value(_attr_value.length()) = 0;
-              _scan_state = VALIDATE_ENTRY;
-              break;
-
-            } else if (c == '\n') {
-              _scan_state = TERMINATE_COPY_ATTR_VALUE;
-              break;
-            } else {
-              _attr_value(_attr_value.length()) = c;
-              if (c == '#') {
-                _attr_value_hash_char_index = _attr_value.length() - 1;
-              }
+        s = p;
+        if (_attr_value_quoted) {
+          for (; p < e && *p != _attr_value_quoted && *p != '\n'; p++) {
+            if (*p == '#') {
+              _attr_value_hash_char_index = _attr_value.length() + (p - s);
             }
+          }
+        } else {
+          for (; p < e && !(html_char_class[(unsigned char) *p] & (HTML_CC_SPACE | HTML_CC_TAG_END)); p++) {
+            if (*p == '#') {
+              _attr_value_hash_char_index = _attr_value.length() + (p - s);
+            }
+          }
+        }
+        n = p - s;
+        if (_attr_value.length() + n > MAX_ATTR_VALUE_LENGTH) {
+          ///////////////////////////////////////////
+          // Value too long to be a URL, skip it
+          ///////////////////////////////////////////
+          _scan_state = _attr_value_quoted ? TERMINATE_COPY_ATTR_VALUE : SCAN_INIT;
+          break;
+        }
+        html_append(_attr_value, s, n);
 
-          } else {
-            if (isspace(c)) {
-              ///////////////////////////////////////////
-              // We have a complete <tag attr=value
-              ///////////////////////////////////////////
-              _attr_value(_attr_value.length()) = 0;
-              _scan_state = VALIDATE_ENTRY;
-              break;
+        if (p < e) {
+          c = *p++;
+          if (c == '\n' && _attr_value_quoted) {
+            _scan_state = TERMINATE_COPY_ATTR_VALUE;
 
-            } else if (c == '>') {
-              /////////////////////////////////////////
-              // We have a complete <tag attr=value>
-              /////////////////////////////////////////
-              _attr_value(_attr_value.length()) = 0;
-              _scan_state = VALIDATE_ENTRY_RESTART;
-              break;
+          } else if (c == '>' && !_attr_value_quoted) {
+            /////////////////////////////////////////
+            // We have a complete <tag attr=value>
+            /////////////////////////////////////////
+            _attr_value(_attr_value.length()) = 0;
+            _scan_state = VALIDATE_ENTRY_RESTART;
 
-            } else {
-              _attr_value(_attr_value.length()) = c;
-              if (c == '#') {
-                _attr_value_hash_char_index = _attr_value.length() - 1;
-              }
-            }
+          } else {
+            ///////////////////////////////////////////////////////
+            // We have a complete <tag attr='value' or <tag attr=value
+            ///////////////////////////////////////////////////////
+            _attr_value(_attr_value.length()) = 0;
+            _scan_state = VALIDATE_ENTRY;
           }
         }
         break;
@@ -2112,6 +2183,9 @@ HtmlParser::ScanHtmlForURL(IOBufferReader * r, char **url, char **url_end)
         }
         if (AllowTagAttrValue()) {
           if (ExtractURL(url, url_end)) {
+            if (start) {
+              r->consume(p - start);
+            }
             return 1;           // valid URL
           }
         }
@@ -2125,16 +2199,15 @@ HtmlParser::ScanHtmlForURL(IOBufferReader * r, char **url, char **url_end)
         _attr_value_quoted = 0;
 
         _scan_state = FIND_ATTR_START;
-        n = -2;
         break;
       }
     case TERMINATE_COPY_ATTR_VALUE:
       {
-        while ((n = r->read((char *) &c, 1))) {
-          if (c == _attr_value_quoted) {
-            _scan_state = RESUME_ATTR_VALUE_SCAN;
-            break;
-          }
+        if ((s = (const char *) memchr(p, _attr_value_quoted, e - p))) {
+          p = s + 1;
+          _scan_state = RESUME_ATTR_VALUE_SCAN;
+        } else {
+          p = e;
         }
         break;
       }
@@ -2143,11 +2216,6 @@ HtmlParser::ScanHtmlForURL(IOBufferReader * r, char **url, char **url_end)
         ink_release_assert(!"HtmlParser::ScanHtmlForURL bad state");
       }
     }                           // end of switch
-
-    if (n == 0) {
-      return 0;                 // No more data
-    }
-
   }                             // end of while
 }
 
@@ -2673,4 +2741,91 @@ ObjectReloadCont::CallBackUser(int event, void *d)
   return 0;
 }
 
+#if TS_HAS_TESTS
+#include "Regression.h"
+
+static const char html_test_page[] =
+  "<html><head><base href=\"http://www.example.com/dir/\">\n"
+  "<meta http-equiv=refresh content=\"0; URL=next.html\">\n"
+  "<!-- <img src=\"commented.gif\"> -- - -->"
+  "<script language=javascript src='js/app.js'></script>\n"
+  "</head><body background=bg.jpg>\n"
+  "< ><tag> <a=b> <a href>x</a> <a name=\"top\" href=\"#top\">top</a>\n"
+  "<IMG SRC = \"/img/logo.gif#part\" ALT=\"logo\"><img src=\"broken\n\" alt=x>"
+  "<a\thref=page2.html>2</a><frame src=\"../frames/f.html\" >";
+
+static const char html_test_urls[] =
+  "http://www.example.com/dir/js/app.js\n"
+  "http://www.example.com/dir/bg.jpg\n"
+  "http://www.example.com/img/logo.gif\n"
+  "http://www.example.com/dir/page2.html\n"
+  "http://www.example.com/dir/../frames/f.html\n";
+
+// Feed @a len bytes of @a html to a parser @a piece bytes at a time, each
+// piece in its own block, collecting the URLs found, one per line.
+static void
+html_test_parse(const char *html, int len, int piece, DynArray<char> *urls, int64_t *elapsed)
+{
+  HtmlParser parser;
+  MIOBuffer *buf = new_empty_MIOBuffer();
+  IOBufferReader *reader = buf->alloc_reader();
+  char *url, *url_end;
+
+  parser.Init((char *) "http://www.example.com/index.html", update_allowable_html_tags);
+  for (int done = 0; done < len; done += piece) {
+    int n = (len - done < piece) ? len - done : piece;
+    ink_hrtime start;
+
+    buf->append_block(BUFFER_SIZE_INDEX_32K);
+    buf->write(html + done, n);
+    start = ink_get_hrtime_internal();
+    while (parser.ParseHtml(reader, &url, &url_end)) {
+      if (urls) {
+        for (; url <= url_end; url++) {
+          (*urls)(urls->length()) = *url;
+        }
+        (*urls)(urls->length()) = '\n';
+      }
+    }
+    *elapsed += ink_get_hrtime_internal() - start;
+  }
+  if (urls) {
+    (*urls)(urls->length()) = 0;
+  }
+  free_MIOBuffer(buf);
+}
+
+REGRESSION_TEST(HtmlParser) (RegressionTest * t, int atype, int *pstatus)
+{
+  NOWARN_UNUSED(atype);
+  const int pieces[] = { 1, 2, 3, 7, 64, sizeof(html_test_page) };
+  int64_t elapsed = 0;
+
+  *pstatus = REGRESSION_TEST_PASSED;
+
+  // The URLs found must not depend on how the page is split up
+  for (unsigned i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+    DynArray<char> urls(&HtmlParser::default_zero_char, 256);
+
+    html_test_parse(html_test_page, sizeof(html_test_page) - 1, pieces[i], &urls, &elapsed);
+    if (strcmp(urls, html_test_urls) != 0) {
+      rprintf(t, "%d byte pieces: got\n%s", pieces[i], (char *) urls);
+      *pstatus = REGRESSION_TEST_FAILED;
+    }
+  }
+
+  // A 1MB page, arriving 32KB at a time
+  const int page_size = 1024 * 1024;
+  char *page = (char *) xmalloc(page_size);
+  for (int i = 0; i < page_size; i += sizeof(html_test_page) - 1) {
+    int n = page_size - i < (int) sizeof(html_test_page) - 1 ? page_size - i : sizeof(html_test_page) - 1;
+    memcpy(page + i, html_test_page, n);
+  }
+  elapsed = 0;
+  html_test_parse(page, page_size, 32 * 1024, NULL, &elapsed);
+  rprintf(t, "1MB page: %d MB/s\n", (int) ((int64_t) page_size * 1000 / (elapsed + 1)));
+  xfree(page);
+}
+#endif
+
 // End of Update.cc
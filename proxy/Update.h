@@ -407,7 +407,8 @@ public:
   enum
   {
     MAX_TAG_NAME_LENGTH = 1024,
-    MAX_ATTR_NAME_LENGTH = 1024
+    MAX_ATTR_NAME_LENGTH = 1024,
+    MAX_ATTR_VALUE_LENGTH = 8192
   };
 
     HtmlParser()
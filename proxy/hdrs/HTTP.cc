@@ -1632,7 +1632,8 @@ HTTPCacheAlt::HTTPCacheAlt():
 m_magic(CACHE_ALT_MAGIC_ALIVE), m_writeable(1),
 m_unmarshal_len(-1),
 m_id(-1), m_rid(-1), m_request_hdr(),
-m_response_hdr(), m_request_sent_time(0), m_response_received_time(0), m_ext_buffer(NULL)
+m_response_hdr(), m_request_sent_time(0), m_response_received_time(0), m_generation(0),
+m_ext_buffer(NULL)
 {
 
   m_object_key[0] = 0;
@@ -1681,6 +1682,7 @@ HTTPCacheAlt::copy(HTTPCacheAlt * to_copy)
 
   m_request_sent_time = to_copy->m_request_sent_time;
   m_response_received_time = to_copy->m_response_received_time;
+  m_generation = to_copy->m_generation;
 }
 
 const int HTTP_ALT_MARSHAL_SIZE = ROUND(sizeof(HTTPCacheAlt), HDR_PTR_SIZE);
@@ -1267,6 +1267,10 @@ struct HTTPCacheAlt
   time_t m_request_sent_time;
   time_t m_response_received_time;
 
+  // Invalidation generation current when the request
+  //  that wrote this alternate started.
+  int64_t m_generation;
+
   // With clustering, our alt may be in cluster
   //  incoming channel buffer, when we are
   //  destroyed we decrement the refcount
@@ -1328,6 +1332,7 @@ public:
 
   time_t request_sent_time_get() { return m_alt->m_request_sent_time; }
   time_t response_received_time_get() { return m_alt->m_response_received_time; }
+  int64_t generation_get() { return m_alt->m_generation; }
 
   void object_key_set(INK_MD5 & md5);
   void object_size_set(int64_t size);
@@ -1337,6 +1342,7 @@ public:
 
   void request_sent_time_set(time_t t) { m_alt->m_request_sent_time = t; }
   void response_received_time_set(time_t t) { m_alt->m_response_received_time = t; }
+  void generation_set(int64_t g) { m_alt->m_generation = g; }
 
   // Sanity check functions
   static bool check_marshalled(char *buf, int len);
@@ -56,6 +56,7 @@ private:
   int test_parse_date();
   int test_format_date();
   int test_url();
+  int test_url_hash();
   int test_http_parser_eos_boundary_cases();
   int test_arena();
   int test_regex();
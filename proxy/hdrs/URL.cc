@@ -1640,6 +1640,50 @@ memcpy_tolower(char *d, const char *s, int n)
 }
 
 
+union URLDigestContext
+{
+  INK_DIGEST_CTX md5_ctx;
+  MMH_CTX mmh_ctx;
+  MURMUR3_CTX murmur3_ctx;
+};
+
+static inline void
+url_digest_init(URLDigestContext * context)
+{
+  if (url_hash_method == 0) {
+    ink_code_incr_md5_init(&context->md5_ctx);
+  } else if (url_hash_method == 1) {
+    ink_code_incr_MMH_init(&context->mmh_ctx);
+  } else {
+    ink_code_incr_murmur3_init(&context->murmur3_ctx);
+  }
+}
+
+static inline void
+url_digest_update(URLDigestContext * context, const char *s, int len)
+{
+  if (url_hash_method == 0) {
+    ink_code_incr_md5_update(&context->md5_ctx, s, len);
+  } else if (url_hash_method == 1) {
+    ink_code_incr_MMH_update(&context->mmh_ctx, s, len);
+  } else {
+    ink_code_incr_murmur3_update(&context->murmur3_ctx, s, len);
+  }
+}
+
+static inline void
+url_digest_final(URLDigestContext * context, INK_MD5 * md5)
+{
+  if (url_hash_method == 0) {
+    ink_code_incr_md5_final((char *) md5, &context->md5_ctx);
+  } else if (url_hash_method == 1) {
+    ink_code_incr_MMH_final((char *) md5, &context->mmh_ctx);
+  } else {
+    ink_code_incr_murmur3_final((char *) md5, &context->murmur3_ctx);
+  }
+}
+
+
 #define BUFSIZE 512
 
 // fast path for MMH, HTTP, no user/password/params/query,
@@ -1648,16 +1692,11 @@ memcpy_tolower(char *d, const char *s, int n)
 static inline void
 url_MMH_get_fast(URLImpl * url, INK_MD5 * md5)
 {
-  union
-  {
-    INK_DIGEST_CTX md5_ctx;
-    MMH_CTX mmh_ctx;
-  } context;
-
+  MMH_CTX context;
   char buffer[BUFSIZE];
   char *p;
 
-  ink_code_incr_MMH_init(&context.mmh_ctx);
+  ink_code_incr_MMH_init(&context);
 
   p = buffer;
   memcpy_tolower(p, url->m_ptr_scheme, url->m_len_scheme);
@@ -1684,20 +1723,45 @@ url_MMH_get_fast(URLImpl * url, INK_MD5 * md5)
   *p++ = ((char *) &port)[0];
   *p++ = ((char *) &port)[1];
 
-  ink_code_incr_MMH_update(&context.mmh_ctx, buffer, p - buffer);
-  ink_code_incr_MMH_final((char *) md5, &context.mmh_ctx);
+  ink_code_incr_MMH_update(&context, buffer, p - buffer);
+  ink_code_incr_MMH_final((char *) md5, &context);
 }
 
+// fast path for Murmur3, any scheme, any length, no unescaping needed:
+// the components are hashed where they lie, lower casing scheme and
+// host on the fly, so there is no copy into a buffer
 
 static inline void
-url_MD5_get_general(URLImpl * url, INK_MD5 * md5)
+url_murmur3_get_fast(URLImpl * url, INK_MD5 * md5)
 {
-  union
-  {
-    INK_DIGEST_CTX md5_ctx;
-    MMH_CTX mmh_ctx;
-  } context;
+  MURMUR3_CTX context;
+  uint16_t port;
+
+  ink_code_incr_murmur3_init(&context);
+  ink_code_incr_murmur3_update_tolower(&context, url->m_ptr_scheme, url->m_len_scheme);
+  ink_code_incr_murmur3_update(&context, "://", 3);
+  ink_code_incr_murmur3_update(&context, url->m_ptr_user, url->m_len_user);
+  ink_code_incr_murmur3_update(&context, ":", 1);
+  ink_code_incr_murmur3_update(&context, url->m_ptr_password, url->m_len_password);
+  ink_code_incr_murmur3_update(&context, "@", 1);
+  ink_code_incr_murmur3_update_tolower(&context, url->m_ptr_host, url->m_len_host);
+  ink_code_incr_murmur3_update(&context, "/", 1);
+  ink_code_incr_murmur3_update(&context, url->m_ptr_path, url->m_len_path);
+  ink_code_incr_murmur3_update(&context, ";", 1);
+  ink_code_incr_murmur3_update(&context, url->m_ptr_params, url->m_len_params);
+  ink_code_incr_murmur3_update(&context, "?", 1);
+  ink_code_incr_murmur3_update(&context, url->m_ptr_query, url->m_len_query);
+
+  port = url_canonicalize_port(url->m_url_type, url->m_port);
+  ink_code_incr_murmur3_update(&context, (char *) &port, sizeof(port));
+  ink_code_incr_murmur3_final((char *) md5, &context);
+}
+
 
+static inline void
+url_MD5_get_general(URLImpl * url, INK_MD5 * md5)
+{
+  URLDigestContext context;
   char buffer[BUFSIZE];
   char *p, *e;
   const char *strs[13], *ends[13];
@@ -1737,11 +1801,7 @@ url_MD5_get_general(URLImpl * url, INK_MD5 * md5)
   p = buffer;
   e = buffer + BUFSIZE;
 
-  if (url_hash_method == 0) {
-    ink_code_incr_md5_init(&context.md5_ctx);
-  } else {
-    ink_code_incr_MMH_init(&context.mmh_ctx);
-  }
+  url_digest_init(&context);
 
   for (i = 0; i < 13; i++) {
     if (strs[i]) {
@@ -1756,11 +1816,7 @@ url_MD5_get_general(URLImpl * url, INK_MD5 * md5)
         }
 
         if (p == e) {
-          if (url_hash_method == 0) {
-            ink_code_incr_md5_update(&context.md5_ctx, buffer, BUFSIZE);
-          } else {
-            ink_code_incr_MMH_update(&context.mmh_ctx, buffer, BUFSIZE);
-          }
+          url_digest_update(&context, buffer, BUFSIZE);
           p = buffer;
         }
       }
@@ -1768,31 +1824,44 @@ url_MD5_get_general(URLImpl * url, INK_MD5 * md5)
   }
 
   if (p != buffer) {
-    if (url_hash_method == 0) {
-      ink_code_incr_md5_update(&context.md5_ctx, buffer, p - buffer);
-    } else {
-      ink_code_incr_MMH_update(&context.mmh_ctx, buffer, p - buffer);
-    }
+    url_digest_update(&context, buffer, p - buffer);
   }
 
   port = url_canonicalize_port(url->m_url_type, url->m_port);
 
-  if (url_hash_method == 0) {
-    ink_code_incr_md5_update(&context.md5_ctx, (char *) &port, sizeof(port));
-    ink_code_incr_md5_final((char *) md5, &context.md5_ctx);
-  } else {
-    ink_code_incr_MMH_update(&context.mmh_ctx, (char *) &port, sizeof(port));
-    ink_code_incr_MMH_final((char *) md5, &context.mmh_ctx);
-  }
+  url_digest_update(&context, (char *) &port, sizeof(port));
+  url_digest_final(&context, md5);
 }
 
 
-
+static inline bool
+url_has_escapes(const char *s, int len)
+{
+  return len && memchr(s, '%', len) != NULL;
+}
 
 void
 url_MD5_get(URLImpl * url, INK_MD5 * md5)
 {
-  if ((url_hash_method != 0) &&
+  if (url_hash_method == 2) {
+    if (!url_has_escapes(url->m_ptr_scheme, url->m_len_scheme) &&
+        !url_has_escapes(url->m_ptr_user, url->m_len_user) &&
+        !url_has_escapes(url->m_ptr_password, url->m_len_password) &&
+        !url_has_escapes(url->m_ptr_host, url->m_len_host) &&
+        !url_has_escapes(url->m_ptr_path, url->m_len_path) &&
+        !url_has_escapes(url->m_ptr_params, url->m_len_params) &&
+        !url_has_escapes(url->m_ptr_query, url->m_len_query)) {
+      url_murmur3_get_fast(url, md5);
+
+#ifdef DEBUG
+      INK_MD5 md5_general;
+      url_MD5_get_general(url, &md5_general);
+      ink_assert(*md5 == md5_general);
+#endif
+    } else {
+      url_MD5_get_general(url, md5);
+    }
+  } else if ((url_hash_method != 0) &&
       (url->m_url_type == URL_TYPE_HTTP) &&
       ((url->m_len_user + url->m_len_password + url->m_len_params + url->m_len_query) == 0) &&
       (3 + 1 + 1 + 1 + 1 + 1 + 2 +
@@ -1821,53 +1890,24 @@ url_MD5_get(URLImpl * url, INK_MD5 * md5)
 void
 url_host_MD5_get(URLImpl * url, INK_MD5 * md5)
 {
-  union
-  {
-    INK_DIGEST_CTX md5_ctx;
-    MMH_CTX mmh_ctx;
-  } context;
+  URLDigestContext context;
 
-  if (url_hash_method == 0) {
-    ink_code_incr_md5_init(&context.md5_ctx);
-  } else {
-    ink_code_incr_MMH_init(&context.mmh_ctx);
-  }
+  url_digest_init(&context);
 
   if (url->m_ptr_scheme) {
-    if (url_hash_method == 0) {
-      ink_code_incr_md5_update(&context.md5_ctx, url->m_ptr_scheme, url->m_len_scheme);
-    } else {
-      ink_code_incr_MMH_update(&context.mmh_ctx, url->m_ptr_scheme, url->m_len_scheme);
-    }
+    url_digest_update(&context, url->m_ptr_scheme, url->m_len_scheme);
   }
 
-  if (url_hash_method == 0) {
-    ink_code_incr_md5_update(&context.md5_ctx, "://", 3);
-  } else {
-    ink_code_incr_MMH_update(&context.mmh_ctx, "://", 3);
-  }
+  url_digest_update(&context, "://", 3);
 
   if (url->m_ptr_host) {
-    if (url_hash_method == 0) {
-      ink_code_incr_md5_update(&context.md5_ctx, url->m_ptr_host, url->m_len_host);
-    } else {
-      ink_code_incr_MMH_update(&context.mmh_ctx, url->m_ptr_host, url->m_len_host);
-    }
+    url_digest_update(&context, url->m_ptr_host, url->m_len_host);
   }
 
-  if (url_hash_method == 0) {
-    ink_code_incr_md5_update(&context.md5_ctx, ":", 1);
-  } else {
-    ink_code_incr_MMH_update(&context.mmh_ctx, ":", 1);
-  }
+  url_digest_update(&context, ":", 1);
 
   int port = url_canonicalize_port(url->m_url_type, url->m_port);
 
-  if (url_hash_method == 0) {
-    ink_code_incr_md5_update(&context.md5_ctx, (char *) &port, sizeof(port));
-    ink_code_incr_md5_final((char *) md5, &context.md5_ctx);
-  } else {
-    ink_code_incr_MMH_update(&context.mmh_ctx, (char *) &port, sizeof(port));
-    ink_code_incr_MMH_final((char *) md5, &context.mmh_ctx);
-  }
+  url_digest_update(&context, (char *) &port, sizeof(port));
+  url_digest_final(&context, md5);
 }
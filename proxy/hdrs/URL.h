@@ -143,7 +143,7 @@ extern int URL_LEN_MMS;
 extern int URL_LEN_MMSU;
 extern int URL_LEN_MMST;
 
-/* 0 = INK_MD5, 1 = MMH */
+/* 0 = INK_MD5, 1 = MMH, 2 = Murmur3 */
 extern int url_hash_method;
 
 
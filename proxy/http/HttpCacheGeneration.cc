@@ -0,0 +1,236 @@
+/** @file
+
+  A brief file description
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+/****************************************************************************
+
+   HttpCacheGeneration.cc
+
+   Description:
+        The purge table is kept in memory and in an append-only file of
+        "<generation> <kind><name>" lines, kind being 'h' for a host and
+        't' for a tag.  The file is compacted to one line per name each
+        time it is opened.
+
+ ****************************************************************************/
+
+#include "libts.h"
+#include "ink_rwlock.h"
+#include "I_Layout.h"
+#include "P_RecCore.h"
+#include "HdrUtils.h"
+#include "HttpCacheGeneration.h"
+
+#define SURROGATE_KEY       "Surrogate-Key"
+#define SURROGATE_KEY_LEN   13
+
+HttpCacheGenerations httpCacheGenerations;
+
+HttpCacheGenerations::HttpCacheGenerations()
+  : m_table(NULL), m_current(0), m_fd(-1)
+{
+  ink_rwlock_init(&m_lock);
+  m_table = ink_hash_table_create(InkHashTableKeyType_String);
+}
+
+HttpCacheGenerations::~HttpCacheGenerations()
+{
+  if (m_fd >= 0)
+    ::close(m_fd);
+  ink_hash_table_destroy_and_xfree_values(m_table);
+  ink_rwlock_destroy(&m_lock);
+}
+
+// Called with the write lock held, or before the table is shared.
+void
+HttpCacheGenerations::insert(const char *key, int64_t gen)
+{
+  InkHashTableValue value;
+
+  if (ink_hash_table_lookup(m_table, key, &value)) {
+    if (*(int64_t *) value < gen)
+      *(int64_t *) value = gen;
+  } else {
+    int64_t *g = (int64_t *) xmalloc(sizeof(int64_t));
+    *g = gen;
+    ink_hash_table_insert(m_table, key, (InkHashTableValue) g);
+  }
+  if (m_current < gen)
+    m_current = gen;
+}
+
+int
+HttpCacheGenerations::open(const char *path)
+{
+  char line[HTTP_CACHE_GENERATION_NAME_MAX + 32];
+  FILE *fp = fopen(path, "r");
+
+  if (fp) {
+    while (fgets(line, sizeof(line), fp)) {
+      char *name = strchr(line, ' ');
+      int64_t gen = ink_atoi64(line);
+
+      if (!name || gen <= 0 || (name[1] != 'h' && name[1] != 't'))
+        continue;
+      name++;
+      name[strcspn(name, "\r\n")] = '\0';
+      if (name[1])
+        insert(name, gen);
+    }
+    fclose(fp);
+  }
+
+  // Rewrite the file with one line per name, then keep appending to it.
+  char *tmp_path = (char *) xmalloc(strlen(path) + 5);
+  sprintf(tmp_path, "%s.tmp", path);
+  if ((fp = fopen(tmp_path, "w")) == NULL) {
+    Warning("unable to write cache generations file '%s': %s", tmp_path, strerror(errno));
+    xfree(tmp_path);
+    return -1;
+  }
+
+  InkHashTableIteratorState state;
+  for (InkHashTableEntry *e = ink_hash_table_iterator_first(m_table, &state); e;
+       e = ink_hash_table_iterator_next(m_table, &state)) {
+    fprintf(fp, "%" PRId64 " %s\n", *(int64_t *) ink_hash_table_entry_value(m_table, e),
+            (char *) ink_hash_table_entry_key(m_table, e));
+  }
+  if (fclose(fp) != 0 || rename(tmp_path, path) < 0) {
+    Warning("unable to write cache generations file '%s': %s", path, strerror(errno));
+    unlink(tmp_path);
+    xfree(tmp_path);
+    return -1;
+  }
+  xfree(tmp_path);
+
+  if ((m_fd = ::open(path, O_WRONLY | O_APPEND)) < 0) {
+    Warning("unable to open cache generations file '%s': %s", path, strerror(errno));
+    return -1;
+  }
+  Debug("http_generation", "loaded generation %" PRId64 " from %s", m_current, path);
+  return 0;
+}
+
+int64_t
+HttpCacheGenerations::invalidate(char kind, const char *name, int len)
+{
+  char key[HTTP_CACHE_GENERATION_NAME_MAX + 2];
+  char line[HTTP_CACHE_GENERATION_NAME_MAX + 32];
+  int64_t gen;
+
+  if (!name || len <= 0 || len > HTTP_CACHE_GENERATION_NAME_MAX)
+    return -1;
+  key[0] = kind;
+  for (int i = 0; i < len; i++) {
+    // Names are stored one per line, separated by a space.
+    if (name[i] == '\n' || name[i] == '\r' || name[i] == '\0')
+      return -1;
+    key[i + 1] = (kind == 'h') ? ParseRules::ink_tolower(name[i]) : name[i];
+  }
+  key[len + 1] = '\0';
+
+  ink_rwlock_wrlock(&m_lock);
+  gen = m_current + 1;
+  insert(key, gen);
+  if (m_fd >= 0) {
+    int n = snprintf(line, sizeof(line), "%" PRId64 " %s\n", gen, key);
+    if (::write(m_fd, line, n) != n)
+      Warning("unable to record cache generation %" PRId64 ": %s", gen, strerror(errno));
+  }
+  ink_rwlock_unlock(&m_lock);
+
+  Debug("http_generation", "invalidated %s '%.*s' at generation %" PRId64,
+        kind == 'h' ? "host" : "tag", len, name, gen);
+  return gen;
+}
+
+// Called with the read lock held.
+int64_t
+HttpCacheGenerations::lookup(char kind, const char *name, int len)
+{
+  char key[HTTP_CACHE_GENERATION_NAME_MAX + 2];
+  InkHashTableValue value;
+
+  if (len <= 0 || len > HTTP_CACHE_GENERATION_NAME_MAX)
+    return 0;
+  key[0] = kind;
+  for (int i = 0; i < len; i++)
+    key[i + 1] = (kind == 'h') ? ParseRules::ink_tolower(name[i]) : name[i];
+  key[len + 1] = '\0';
+
+  if (ink_hash_table_lookup(m_table, key, &value))
+    return *(int64_t *) value;
+  return 0;
+}
+
+bool
+HttpCacheGenerations::invalidated(HTTPInfo *alt)
+{
+  int64_t gen = alt->generation_get();
+
+  // Nothing has been purged since this alternate was written.
+  if (gen >= m_current)
+    return false;
+
+  bool result = false;
+  int len;
+  // HTTPHdr::host_get() caches pointers that do not survive marshalling,
+  //  so read the stored URL, then the Host field.
+  HTTPHdr *request = alt->request_get();
+  const char *host = request->url_get()->host_get(&len);
+
+  if (!host || len <= 0)
+    host = request->value_get(MIME_FIELD_HOST, MIME_LEN_HOST, &len);
+
+  ink_rwlock_rdlock(&m_lock);
+  if (host && lookup('h', host, len) > gen) {
+    result = true;
+  } else {
+    MIMEField *field = alt->response_get()->field_find(SURROGATE_KEY, SURROGATE_KEY_LEN);
+
+    if (field) {
+      HdrCsvIter iter(' ');
+      const char *tag = iter.get_first(field, &len);
+
+      for (; tag && !result; tag = iter.get_next(&len)) {
+        if (len > 0 && lookup('t', tag, len) > gen)
+          result = true;
+      }
+    }
+  }
+  ink_rwlock_unlock(&m_lock);
+  return result;
+}
+
+void
+init_http_cache_generations()
+{
+  char *filename = NULL;
+
+  RecGetRecordString_Xmalloc("proxy.config.http.cache.generations_filename", &filename);
+  if (filename && *filename) {
+    char *path = Layout::relative_to(Layout::get()->runtimedir, filename);
+    httpCacheGenerations.open(path);
+    xfree(path);
+  }
+  xfree(filename);
+}
@@ -0,0 +1,80 @@
+/** @file
+
+  A brief file description
+
+  @section license License
+
+  Licensed to the Apache Software Foundation (ASF) under one
+  or more contributor license agreements.  See the NOTICE file
+  distributed with this work for additional information
+  regarding copyright ownership.  The ASF licenses this file
+  to you under the Apache License, Version 2.0 (the
+  "License"); you may not use this file except in compliance
+  with the License.  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+ */
+
+/****************************************************************************
+
+   HttpCacheGeneration.h
+
+   Description:
+        Logical invalidation of cached alternates by host or by
+        Surrogate-Key tag.
+
+        A purge bumps one global generation and records it against the
+        host or tag.  Every alternate records the generation its request
+        started under, and is invalid once its host or one of its tags
+        has been purged at a later generation.  Purging a host is then a
+        table update instead of a remove per object.
+
+ ****************************************************************************/
+
+#ifndef _HTTP_CACHE_GENERATION_H_
+#define _HTTP_CACHE_GENERATION_H_
+
+#include "libts.h"
+#include "HTTP.h"
+
+#define HTTP_CACHE_GENERATION_NAME_MAX   255
+
+class HttpCacheGenerations
+{
+public:
+  HttpCacheGenerations();
+  ~HttpCacheGenerations();
+
+  // Load the purges recorded in path and append new ones to it.
+  int open(const char *path);
+
+  int64_t current() const { return m_current; }
+
+  // Return the new generation, or -1 if the name is empty or too long.
+  int64_t invalidate_host(const char *host, int len) { return invalidate('h', host, len); }
+  int64_t invalidate_tag(const char *tag, int len) { return invalidate('t', tag, len); }
+
+  bool invalidated(HTTPInfo *alt);
+
+private:
+  int64_t invalidate(char kind, const char *name, int len);
+  int64_t lookup(char kind, const char *name, int len);
+  void insert(const char *key, int64_t gen);
+
+  ink_rwlock m_lock;
+  InkHashTable *m_table;
+  volatile int64_t m_current;
+  int m_fd;
+};
+
+extern HttpCacheGenerations httpCacheGenerations;
+
+void init_http_cache_generations();
+
+#endif
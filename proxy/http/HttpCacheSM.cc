@@ -67,7 +67,7 @@ HttpCacheSM::HttpCacheSM():
   readwhilewrite_inprogress(false),
   master_sm(NULL), pending_action(NULL),
   captive_action(),
-  open_read_cb(false), open_write_cb(false), open_read_tries(0),
+  open_read_cb(false), open_write_cb(false), open_read_tries(0), open_read_collapsed(false),
   read_request_hdr(NULL), read_config(NULL),
   read_pin_in_cache(0), retry_write(true), open_write_tries(0),
   lookup_url(NULL), lookup_max_recursive(0), current_lookup_level(0)
@@ -111,6 +111,12 @@ HttpCacheSM::state_cache_open_read(int event, void *data)
   switch (event) {
   case CACHE_EVENT_OPEN_READ:
     HTTP_INCREMENT_DYN_STAT(http_current_cache_connections_stat);
+    readwhilewrite_inprogress = ((CacheVConnection *) data)->is_read_from_writer();
+    if (readwhilewrite_inprogress)
+      collapse_read();
+    // Served from the object another transaction fetched.
+    if (open_read_collapsed)
+      HTTP_INCREMENT_DYN_STAT(http_cache_origin_fetches_saved_stat);
     ink_assert(cache_read_vc == NULL);
     open_read_cb = true;
     cache_read_vc = (CacheVConnection *) data;
@@ -120,6 +126,7 @@ HttpCacheSM::state_cache_open_read(int event, void *data)
   case CACHE_EVENT_OPEN_READ_FAILED:
     if (data == (void *) -ECACHE_DOC_BUSY) {
       // Somebody else is writing the object
+      collapse_read();
       if (open_read_tries <= master_sm->t_state.txn_conf->max_cache_open_read_retries) {
         // Retry to read; maybe the update finishes in time
         open_read_cb = false;
@@ -244,6 +251,7 @@ HttpCacheSM::open_read(URL * url, HTTPHdr * hdr, CacheLookupHttpConfig * params,
   lookup_max_recursive++;
   current_lookup_level++;
   open_read_cb = false;
+  open_read_collapsed = false;
   act_return = do_cache_open_read();
   // the following logic is based on the assumption that the secnod
   // lookup won't happen if the HttpSM hasn't been called back for the
@@ -268,7 +276,7 @@ HttpCacheSM::open_read(URL * url, HTTPHdr * hdr, CacheLookupHttpConfig * params,
 
 Action *
 HttpCacheSM::open_write(URL * url, HTTPHdr * request, CacheHTTPInfo * old_info, time_t pin_in_cache,
-                        bool retry, bool allow_multiple)
+                        bool retry, bool allow_multiple, int admission_hits)
 {
   SET_HANDLER(&HttpCacheSM::state_cache_open_write);
   ink_assert(pending_action == NULL);
@@ -304,7 +312,9 @@ HttpCacheSM::open_write(URL * url, HTTPHdr * request, CacheHTTPInfo * old_info,
                                                     // INKqa11166
                                                     allow_multiple ? (CacheHTTPInfo *) CACHE_ALLOW_MULTIPLE_WRITES :
                                                     old_info,
-                                                    pin_in_cache);
+                                                    pin_in_cache,
+                                                    CACHE_FRAG_TYPE_HTTP,
+                                                    admission_hits);
 
   if (action_handle != ACTION_RESULT_DONE) {
     pending_action = action_handle;
@@ -70,7 +70,8 @@ public:
   Action *open_read(URL * url, HTTPHdr * hdr, CacheLookupHttpConfig * params, time_t pin_in_cache);
 
   Action *open_write(URL * url,
-                     HTTPHdr * request, CacheHTTPInfo * old_info, time_t pin_in_cache, bool retry, bool allow_multiple);
+                     HTTPHdr * request, CacheHTTPInfo * old_info, time_t pin_in_cache, bool retry, bool allow_multiple,
+                     int admission_hits = -1);
 
   CacheVConnection *cache_read_vc;
   CacheVConnection *cache_write_vc;
@@ -83,12 +84,6 @@ public:
   HttpSM *master_sm;
   Action *pending_action;
 
-  //Function to set readwhilewrite_inprogress flag
-  inline void set_readwhilewrite_inprogress(bool value)
-  {
-    readwhilewrite_inprogress = value;
-  }
-
   //Function to get the readwhilewrite_inprogress flag
   inline bool is_readwhilewrite_inprogress()
   {
@@ -148,6 +143,15 @@ private:
   void do_schedule_in();
   Action *do_cache_open_read();
 
+  // Count a lookup that found another transaction writing the object.
+  inline void collapse_read()
+  {
+    if (!open_read_collapsed) {
+      open_read_collapsed = true;
+      HTTP_INCREMENT_DYN_STAT(http_cache_read_collapsed_stat);
+    }
+  }
+
   int state_cache_open_read(int event, void *data);
   int state_cache_open_write(int event, void *data);
 
@@ -157,6 +161,7 @@ private:
 
   // Open read parameters
   int open_read_tries;
+  bool open_read_collapsed;
   HTTPHdr *read_request_hdr;
   CacheLookupHttpConfig *read_config;
   time_t read_pin_in_cache;
@@ -115,10 +115,10 @@ void
 HttpClientSession::ssn_hook_append(TSHttpHookID id, INKContInternal * cont)
 {
   api_hooks.append(id, cont);
-  hooks_set = 1;
+  hooks_set |= HttpAPIHooks::hook_bit(id);
 
   if (current_reader) {
-    current_reader->hooks_set = 1;
+    current_reader->hooks_set |= HttpAPIHooks::hook_bit(id);
   }
 }
 
@@ -126,10 +126,10 @@ void
 HttpClientSession::ssn_hook_prepend(TSHttpHookID id, INKContInternal * cont)
 {
   api_hooks.prepend(id, cont);
-  hooks_set = 1;
+  hooks_set |= HttpAPIHooks::hook_bit(id);
 
   if (current_reader) {
-    current_reader->hooks_set = 1;
+    current_reader->hooks_set |= HttpAPIHooks::hook_bit(id);
   }
 }
 
@@ -165,7 +165,7 @@ HttpClientSession::do_api_callout(TSHttpHookID id)
   cur_hook_id = id;
   ink_assert(cur_hook_id == TS_HTTP_SSN_START_HOOK || cur_hook_id == TS_HTTP_SSN_CLOSE_HOOK);
 
-  if (hooks_set && backdoor_connect == 0) {
+  if (((hooks_set | http_global_hooks->hooks_set) & HttpAPIHooks::hook_bit(id)) && backdoor_connect == 0) {
     SET_HANDLER(&HttpClientSession::state_api_callout);
     cur_hook = NULL;
     cur_hooks = 0;
@@ -215,8 +215,9 @@ HttpClientSession::new_connection(NetVConnection * new_vc, bool backdoor)
     break;
   }
 
-  // Record api hook set state
-  hooks_set = http_global_hooks->hooks_set;
+  // Record api hook set state; global hooks are checked
+  //  when each hook point is reached
+  hooks_set = 0;
 
 #ifdef USE_HTTP_DEBUG_LISTS
   ink_mutex_acquire(&debug_cs_list_mutex);
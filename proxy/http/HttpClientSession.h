@@ -137,7 +137,8 @@ private:
 
   // api_hooks must not be changed directly
   //  Use ssn_hook_{ap,pre}pend so hooks_set is
-  //  updated
+  //  updated.  hooks_set holds only session hook
+  //  bits; global hooks are checked live
   HttpAPIHooks api_hooks;
 
 public:
@@ -368,6 +368,14 @@ register_stat_callbacks()
                      "proxy.process.http.cache_deletes",
                      RECD_COUNTER, RECP_NULL, (int) http_cache_deletes_stat, RecRawStatSyncCount);
 
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.cache_read_collapsed",
+                     RECD_COUNTER, RECP_NULL, (int) http_cache_read_collapsed_stat, RecRawStatSyncCount);
+
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.cache_origin_fetches_saved",
+                     RECD_COUNTER, RECP_NULL, (int) http_cache_origin_fetches_saved_stat, RecRawStatSyncCount);
+
   RecRegisterRawStat(http_rsb, RECT_PROCESS,
                      "proxy.process.http.tunnels",
                      RECD_COUNTER, RECP_NULL, (int) http_tunnels_stat, RecRawStatSyncCount);
@@ -640,6 +648,18 @@ register_stat_callbacks()
                      "proxy.process.http.cache_hit_stale_served",
                      RECD_COUNTER, RECP_NULL, (int) http_cache_hit_stale_served_stat, RecRawStatSyncCount);
 
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.cache_stale_while_revalidate",
+                     RECD_COUNTER, RECP_NULL, (int) http_cache_stale_while_revalidate_stat, RecRawStatSyncCount);
+
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.cache_stale_if_error",
+                     RECD_COUNTER, RECP_NULL, (int) http_cache_stale_if_error_stat, RecRawStatSyncCount);
+
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.background_revalidations",
+                     RECD_COUNTER, RECP_NULL, (int) http_background_revalidations_stat, RecRawStatSyncCount);
+
   RecRegisterRawStat(http_rsb, RECT_PROCESS,
                      "proxy.process.http.cache_miss_cold",
                      RECD_COUNTER, RECP_NULL, (int) http_cache_miss_cold_stat, RecRawStatSyncCount);
@@ -804,6 +824,10 @@ register_stat_callbacks()
                      "proxy.process.http.background_fill_bytes_completed_stat",
                      RECD_INT, RECP_NULL, (int) http_background_fill_bytes_completed_stat, RecRawStatSyncSum);
 
+  RecRegisterRawStat(http_rsb, RECT_PROCESS,
+                     "proxy.process.http.cache_admission_bytes_saved_stat",
+                     RECD_INT, RECP_NULL, (int) http_cache_admission_bytes_saved_stat, RecRawStatSyncSum);
+
   RecRegisterRawStat(http_rsb, RECT_PROCESS,
                      "proxy.process.http.cache_write_errors",
                      RECD_INT, RECP_NULL, (int) http_cache_write_errors, RecRawStatSyncSum);
@@ -1338,6 +1362,10 @@ HttpConfig::startup()
   HttpEstablishStaticConfigByte(c.negative_revalidating_enabled, "proxy.config.http.negative_revalidating_enabled");
   HttpEstablishStaticConfigLongLong(c.negative_revalidating_lifetime, "proxy.config.http.negative_revalidating_lifetime");
 
+  // Cache-Control stale-while-revalidate / stale-if-error
+  HttpEstablishStaticConfigByte(c.cache_stale_while_revalidate, "proxy.config.http.cache.stale_while_revalidate");
+  HttpEstablishStaticConfigByte(c.cache_stale_if_error, "proxy.config.http.cache.stale_if_error");
+
   // Negative response caching
   HttpEstablishStaticConfigByte(c.oride.negative_caching_enabled, "proxy.config.http.negative_caching_enabled");
   HttpEstablishStaticConfigLongLong(c.oride.negative_caching_lifetime, "proxy.config.http.negative_caching_lifetime");
@@ -1593,6 +1621,9 @@ HttpConfig::reconfigure()
   params->negative_revalidating_enabled = INT_TO_BOOL(m_master.negative_revalidating_enabled);
   params->negative_revalidating_lifetime = m_master.negative_revalidating_lifetime;
 
+  params->cache_stale_while_revalidate = INT_TO_BOOL(m_master.cache_stale_while_revalidate);
+  params->cache_stale_if_error = INT_TO_BOOL(m_master.cache_stale_if_error);
+
   params->oride.negative_caching_enabled = INT_TO_BOOL(m_master.oride.negative_caching_enabled);
   params->oride.negative_caching_lifetime = m_master.oride.negative_caching_lifetime;
 
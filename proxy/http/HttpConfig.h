@@ -143,6 +143,8 @@ enum
   http_cache_writes_stat,
   http_cache_updates_stat,
   http_cache_deletes_stat,
+  http_cache_read_collapsed_stat,
+  http_cache_origin_fetches_saved_stat,
 
   http_tunnels_stat,
   http_throttled_proxy_only_stat,
@@ -178,6 +180,8 @@ enum
   http_background_fill_bytes_aborted_stat,
   http_background_fill_bytes_completed_stat,
 
+  http_cache_admission_bytes_saved_stat,
+
   http_response_document_size_100_stat,
   http_response_document_size_1K_stat,
   http_response_document_size_3K_stat,
@@ -215,6 +219,9 @@ enum
   http_cache_hit_reval_stat,
   http_cache_hit_ims_stat,
   http_cache_hit_stale_served_stat,
+  http_cache_stale_while_revalidate_stat,
+  http_cache_stale_if_error_stat,
+  http_background_revalidations_stat,
   http_cache_miss_cold_stat,
   http_cache_miss_changed_stat,
   http_cache_miss_client_no_cache_stat,
@@ -743,6 +750,12 @@ public:
   MgmtByte negative_revalidating_enabled;
   MgmtInt negative_revalidating_lifetime;
 
+  ////////////////////////////////////////////////////
+  //  Cache-Control stale extensions (RFC 5861)     //
+  ////////////////////////////////////////////////////
+  MgmtByte cache_stale_while_revalidate;
+  MgmtByte cache_stale_if_error;
+
   ///////////////////
   // cop access    //
   ///////////////////
@@ -959,6 +972,8 @@ HttpConfigParams::HttpConfigParams()
     server_transparency_enabled(0),
     negative_revalidating_enabled(0),
     negative_revalidating_lifetime(0),
+    cache_stale_while_revalidate(0),
+    cache_stale_if_error(0),
     record_cop_page(0),
     record_tcp_mem_hit(0),
     errors_log_error_pages(0),
@@ -30,6 +30,7 @@
 #include "ReverseProxy.h"
 #include "HttpSessionManager.h"
 #include "HttpUpdateSM.h"
+#include "HttpCacheGeneration.h"
 #include "HttpClientSession.h"
 #include "HttpPages.h"
 #include "HttpTunnel.h"
@@ -218,10 +219,10 @@ init_HttpProxyServer(void)
   http_pages_init();
   ink_mutex_init(&debug_sm_list_mutex, "HttpSM Debug List");
   ink_mutex_init(&debug_cs_list_mutex, "HttpCS Debug List");
+  init_http_stale_revalidate();
+  init_http_cache_generations();
   // DI's request to disable/reenable ICP on the fly
   icp_dynamic_enabled = 1;
-  // INKqa11918
-  init_max_chunk_buf();
 
 #ifndef TS_NO_API
   // Used to give plugins the ability to create http requests
@@ -28,6 +28,7 @@
 #include "HttpServerSession.h"
 #include "HttpDebugNames.h"
 #include "HttpSessionManager.h"
+#include "HttpUpdateSM.h"
 #include "P_Cache.h"
 #include "P_Net.h"
 #include "StatPages.h"
@@ -493,7 +494,7 @@ HttpSM::set_ua_half_close_flag()
 inline void
 HttpSM::do_api_callout()
 {
-  if (hooks_set) {
+  if (has_hooks()) {
     do_api_callout_internal();
   } else {
     handle_api_return();
@@ -614,7 +615,7 @@ HttpSM::attach_client_session(HttpClientSession * client_vc, IOBufferReader * bu
   HTTP_INCREMENT_DYN_STAT(http_current_client_transactions_stat);
 
   // Record api hook set state
-  hooks_set = http_global_hooks->hooks_set | client_vc->hooks_set;
+  hooks_set = client_vc->hooks_set;
 
   // Setup for parsing the header
   ua_buffer_reader = buffer_reader;
@@ -1317,7 +1318,9 @@ HttpSM::state_api_callout(int event, void *data)
     // FALLTHROUGH
   case EVENT_NONE:
   case HTTP_API_CONTINUE:
-    if ((cur_hook_id >= 0) && (cur_hook_id < TS_HTTP_LAST_HOOK)) {
+    // a hook point with no global, session or transaction hook is
+    //  skipped without walking any of the hook lists
+    if ((cur_hook_id >= 0) && (cur_hook_id < TS_HTTP_LAST_HOOK) && has_hooks_for(cur_hook_id)) {
       if (!cur_hook) {
         if (cur_hooks == 0) {
           cur_hook = http_global_hooks->get(cur_hook_id);
@@ -2284,6 +2287,8 @@ STATE_ENTER(&HttpSM:state_cache_open_write, event);
     // Failed on the write lock and retrying the vector
     //  for reading
     t_state.cache_info.write_lock_state = HttpTransact::CACHE_WL_FAIL;
+    if (data == (void *) -ECACHE_NOT_ADMITTED)
+      t_state.cache_info.write_status = HttpTransact::CACHE_WRITE_NOT_ADMITTED;
     break;
 
   case CACHE_EVENT_OPEN_READ:
@@ -3836,7 +3841,9 @@ HttpSM::do_hostdb_update_if_necessary()
 // this function first checks if cached response has Accept-Ranges and
 // Content-Length header and is HTTP/1.1. && There is no other plugins
 // hooked to TS_HTTP_RESPONSE_TRANSFORM_HOOK.
-// Then setup Range transformation if necessary
+// Then setup Range transformation if necessary. When the cache read
+// can seek, the ranges are read directly from their fragments instead
+// of transforming the whole document.
 void
 HttpSM::do_range_setup_if_necessary()
 {
@@ -3851,7 +3858,28 @@ HttpSM::do_range_setup_if_necessary()
 
   t_state.range_setup = HttpTransact::RANGE_NONE;
   if (t_state.method == HTTP_WKSIDX_GET && t_state.hdr_info.client_request.version_get() == HTTPVersion(1, 1)) {
-    if (api_hooks.get(TS_HTTP_RESPONSE_TRANSFORM_HOOK) == NULL) {
+    if (api_hooks.get(TS_HTTP_RESPONSE_TRANSFORM_HOOK) == NULL &&
+        cache_sm.cache_read_vc != NULL && cache_sm.cache_read_vc->is_pread_capable()) {
+      HTTPInfo *obj = t_state.cache_info.object_read;
+      int64_t content_length = obj->object_size_get();
+      bool not_handled = false;
+      int content_type_len = 0;
+
+      if (t_state.ranges)
+        delete[]t_state.ranges;
+      t_state.num_range_fields = range_parse(field, content_length, &t_state.ranges, &res, &not_handled);
+      if (res)
+        t_state.range_setup = HttpTransact::RANGE_NOT_SATISFIABLE;
+      else if (not_handled)
+        t_state.range_setup = HttpTransact::RANGE_NOT_HANDLED;
+      else {
+        obj->response_get()->value_get(MIME_FIELD_CONTENT_TYPE, MIME_LEN_CONTENT_TYPE, &content_type_len);
+        t_state.range_output_cl = range_content_length(t_state.ranges, t_state.num_range_fields,
+                                                       content_length, content_type_len);
+        t_state.current_range = -1;
+        t_state.range_setup = HttpTransact::RANGE_CACHE_SEEK;
+      }
+    } else if (api_hooks.get(TS_HTTP_RESPONSE_TRANSFORM_HOOK) == NULL) {
       // We may still not do Range if it is out of order Range.
       range_trans = transformProcessor.range_transform(mutex, field,
                                                        t_state.cache_info.object_read,
@@ -4024,13 +4052,16 @@ HttpSM::do_cache_prepare_action(HttpCacheSM * c_sm, CacheHTTPInfo * object_read_
     s_url->copy(c_url);
   }
 
+  // a PUSH must be stored, write admission is only for misses
+  int admission_hits = (t_state.method == HTTP_WKSIDX_PUSH) ? 0 : t_state.cache_control.cache_admission_hits;
+
   ink_debug_assert(s_url != NULL && s_url->valid());
   Debug("http_cache_write", "[%" PRId64 "] writing to cache with URL %s", sm_id, s_url->string_get(&t_state.arena));
   Action *cache_action_handle = c_sm->open_write(s_url, &t_state.hdr_info.client_request,
                                                  object_read_info,
                                                  (time_t) ((t_state.cache_control.pin_in_cache_for < 0) ?
                                                            0 : t_state.cache_control.pin_in_cache_for),
-                                                 retry, allow_multiple);
+                                                 retry, allow_multiple, admission_hits);
 
   if (cache_action_handle != ACTION_RESULT_DONE) {
     ink_assert(!pending_action);
@@ -5240,7 +5271,11 @@ HttpSM::setup_cache_read_transfer()
 
   ink_assert(cache_sm.cache_read_vc != NULL);
 
-  doc_size = t_state.cache_info.object_read->object_size_get();
+  // a Range response read by seeking carries only the requested bytes
+  if (t_state.range_setup == HttpTransact::RANGE_CACHE_SEEK)
+    doc_size = t_state.range_output_cl;
+  else
+    doc_size = t_state.cache_info.object_read->object_size_get();
   alloc_index = buffer_size_to_index(doc_size + HTTP_HEADER_BUFFER_SIZE);
 
 #ifndef USE_NEW_EMPTY_MIOBUFFER
@@ -5943,7 +5978,7 @@ HttpSM::kill_this()
     //   but the hook never executed due to a client abort
     //   In that case, we need to manually close all the
     //   transforms to prevent memory leaks (INKqa06147)
-    if (hooks_set) {
+    if (has_hooks()) {
       transform_cleanup(TS_HTTP_RESPONSE_TRANSFORM_HOOK, &transform_info);
       transform_cleanup(TS_HTTP_REQUEST_TRANSFORM_HOOK, &post_transform_info);
     }
@@ -6345,6 +6380,15 @@ HttpSM::call_transact_and_set_next_state(TransactEntryFunc_t f)
 void
 HttpSM::set_next_state()
 {
+  // A stale hit is served under stale-while-revalidate, hand the
+  //  revalidation over to a background state machine
+  if (t_state.stale_while_revalidate &&
+      (t_state.next_action == HttpTransact::SERVE_FROM_CACHE ||
+       t_state.next_action == HttpTransact::PROXY_INTERNAL_CACHE_NOOP)) {
+    t_state.stale_while_revalidate = false;
+    http_stale_revalidate(&t_state);
+  }
+
   ///////////////////////////////////////////////////////////////////////
   // Use the returned "next action" code to set the next state handler //
   ///////////////////////////////////////////////////////////////////////
@@ -6500,7 +6544,7 @@ HttpSM::set_next_state()
         ink_assert((t_state.hdr_info.client_response.valid()? true : false) == true);
         t_state.api_next_action = HttpTransact::HTTP_API_SEND_REPONSE_HDR;
 
-        if (hooks_set) {
+        if (has_hooks_for(TS_HTTP_SEND_RESPONSE_HDR_HOOK)) {
           do_api_callout_internal();
         } else {
           do_redirect();
@@ -6529,7 +6573,7 @@ HttpSM::set_next_state()
         ink_assert((t_state.hdr_info.client_response.valid()? true : false) == true);
         perform_cache_write_action();
         t_state.api_next_action = HttpTransact::HTTP_API_SEND_REPONSE_HDR;
-        if (hooks_set) {
+        if (has_hooks_for(TS_HTTP_SEND_RESPONSE_HDR_HOOK)) {
           do_api_callout_internal();
         } else {
           do_redirect();
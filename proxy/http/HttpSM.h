@@ -476,10 +476,15 @@ public:
   int64_t pushed_response_body_bytes;
   TransactionMilestones milestones;
 
-  // hooks_set records whether there are any hooks relevant
-  //  to this transaction.  Used to avoid costly calls
-  //  do_api_callout_internal()
+  // hooks_set records which hook ids have session or
+  //  transaction hooks, one bit per id.  Global hooks can be
+  //  added at any time, so has_hooks() and has_hooks_for() add
+  //  in http_global_hooks->hooks_set when called.  Used to avoid
+  //  costly calls to do_api_callout_internal() and to skip hook
+  //  points nobody is listening on.
   int hooks_set;
+  bool has_hooks() const;
+  bool has_hooks_for(TSHttpHookID id) const;
 
 protected:
   TSHttpHookID cur_hook_id;
@@ -580,14 +585,26 @@ inline void
 HttpSM::txn_hook_append(TSHttpHookID id, INKContInternal * cont)
 {
   api_hooks.append(id, cont);
-  hooks_set = 1;
+  hooks_set |= HttpAPIHooks::hook_bit(id);
 }
 
 inline void
 HttpSM::txn_hook_prepend(TSHttpHookID id, INKContInternal * cont)
 {
   api_hooks.prepend(id, cont);
-  hooks_set = 1;
+  hooks_set |= HttpAPIHooks::hook_bit(id);
+}
+
+inline bool
+HttpSM::has_hooks() const
+{
+  return hooks_set || http_global_hooks->hooks_set;
+}
+
+inline bool
+HttpSM::has_hooks_for(TSHttpHookID id) const
+{
+  return ((hooks_set | http_global_hooks->hooks_set) & HttpAPIHooks::hook_bit(id)) != 0;
 }
 
 inline APIHook *
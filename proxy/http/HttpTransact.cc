@@ -46,6 +46,7 @@
 #include "HttpBodyFactory.h"
 #include "StatPages.h"
 #include "HttpClientSession.h"
+#include "HttpCacheGeneration.h"
 #include "I_Machine.h"
 
 static const char *URL_MSG = "Unable to process requested URL.\n";
@@ -941,7 +942,10 @@ HttpTransact::EndRemapRequest(State* s)
     }
   }
   s->reverse_proxy = true;
-  s->server_info.is_transparent = s->state_machine->ua_session->get_netvc()->get_is_other_side_transparent();
+  // ua_session is NULL for scheduled updates and background revalidations
+  if (s->state_machine->ua_session) {
+    s->server_info.is_transparent = s->state_machine->ua_session->get_netvc()->get_is_other_side_transparent();
+  }
 
 done:
   /**
@@ -1177,6 +1181,9 @@ HttpTransact::HandleRequest(State* s)
   // initialize some state variables from the request (client version,
   // client keep-alive, cache action, etc.
   initialize_state_variables_from_request(s, &s->hdr_info.client_request);
+  // A purge that lands while this request is in flight has to cover
+  //  the response it stores, so take the generation before any lookup.
+  s->cache_generation = httpCacheGenerations.current();
 
   // Cache lookup or not will be decided later at DecideCacheLookup().
   // Before it's decided to do a cache lookup,
@@ -2278,6 +2285,12 @@ HttpTransact::HandleCacheOpenReadHitFreshness(State* s)
       s->cache_lookup_result = HttpTransact::CACHE_LOOKUP_HIT_WARNING;
       break;
     case FRESHNESS_STALE:
+      if (is_stale_while_revalidate_returnable(s)) {
+        Debug("http_seq", "[HttpTransact::HandleCacheOpenReadHitFreshness] " "Stale in cache, serve while revalidating");
+        s->cache_lookup_result = HttpTransact::CACHE_LOOKUP_HIT_WARNING;
+        s->stale_while_revalidate = true;
+        break;
+      }
       Debug("http_seq", "[HttpTransact::HandleCacheOpenReadHitFreshness] " "Stale in cache");
       s->cache_lookup_result = HttpTransact::CACHE_LOOKUP_HIT_STALE;
       s->is_revalidation_necessary = true;      // to identify a revalidation occurrence
@@ -2511,6 +2524,7 @@ HttpTransact::HandleCacheOpenReadHit(State* s)
   if (send_revalidate) {
     Debug("http_trans", "CacheOpenRead --- HIT-STALE");
     s->dns_info.attempts = 0;
+    s->stale_while_revalidate = false;
 
     Debug("http_seq", "[HttpTransact::HandleCacheOpenReadHit] " "Revalidate document with server");
 
@@ -2630,7 +2644,11 @@ HttpTransact::HandleCacheOpenReadHit(State* s)
     SET_VIA_STRING(VIA_CACHE_RESULT, VIA_IN_CACHE_FRESH);
   }
 
-  if (s->cache_lookup_result == CACHE_LOOKUP_HIT_WARNING) {
+  if (s->cache_lookup_result == CACHE_LOOKUP_HIT_WARNING && s->stale_while_revalidate) {
+    // HttpSM starts the background revalidation
+    HTTP_INCREMENT_TRANS_STAT(http_cache_stale_while_revalidate_stat);
+    build_response_from_cache(s, HTTP_WARNING_CODE_RESPONSE_STALE);
+  } else if (s->cache_lookup_result == CACHE_LOOKUP_HIT_WARNING) {
     build_response_from_cache(s, HTTP_WARNING_CODE_HERUISTIC_EXPIRATION);
   } else if (s->cache_lookup_result == CACHE_LOOKUP_HIT_STALE) {
     ink_debug_assert(server_up == false);
@@ -2753,6 +2771,11 @@ HttpTransact::build_response_from_cache(State* s, HTTPWarningCode warning_code)
         to_warn = &s->hdr_info.transform_response;
       } else {
         build_response(s, cached_response, &s->hdr_info.client_response, s->client_info.http_version);
+        if (s->range_setup == RANGE_CACHE_SEEK) {
+          range_set_response_header(&s->hdr_info.client_response, s->ranges, s->num_range_fields,
+                                    s->cache_info.object_read->object_size_get());
+          s->hdr_info.client_response.set_content_length(s->range_output_cl);
+        }
       }
       s->next_action = SERVE_FROM_CACHE;
     }
@@ -2812,7 +2835,8 @@ HttpTransact::handle_cache_write_lock(State* s)
     // No write lock, ignore the cache and proxy only;
     // FIX: Should just serve from cache if this is a revalidate
     s->cache_info.action = CACHE_DO_NO_ACTION;
-    s->cache_info.write_status = CACHE_WRITE_LOCK_MISS;
+    if (s->cache_info.write_status != CACHE_WRITE_NOT_ADMITTED)
+      s->cache_info.write_status = CACHE_WRITE_LOCK_MISS;
     remove_ims = true;
     break;
   case CACHE_WL_READ_RETRY:
@@ -4264,6 +4288,21 @@ HttpTransact::handle_cache_operation_on_forward_server_response(State* s)
       return;
     }
 
+    // stale-if-error: the origin failed while revalidating, serve the
+    // stale copy as is and leave the cached object alone
+    if ((server_response_code == HTTP_STATUS_INTERNAL_SERVER_ERROR ||
+         server_response_code == HTTP_STATUS_GATEWAY_TIMEOUT ||
+         server_response_code == HTTP_STATUS_BAD_GATEWAY ||
+         server_response_code == HTTP_STATUS_SERVICE_UNAVAILABLE) &&
+        s->cache_info.action == CACHE_DO_UPDATE && is_stale_if_error_returnable(s)) {
+      Debug("http_trans", "[hcoofsr] stale-if-error: serving stale object from cache");
+
+      SET_VIA_STRING(VIA_SERVER_RESULT, VIA_SERVER_ERROR);
+      HTTP_INCREMENT_TRANS_STAT(http_cache_stale_if_error_stat);
+      build_response_from_cache(s, HTTP_WARNING_CODE_REVALIDATION_FAILED);
+      return;
+    }
+
     s->next_action = SERVER_READ;
     client_response_code = server_response_code;
     base_response = &s->hdr_info.server_response;
@@ -4769,6 +4808,7 @@ HttpTransact::set_headers_for_cache_write(State* s, HTTPInfo* cache_info, HTTPHd
     request->url_set(s->hdr_info.client_request.url_get());
   }
   cache_info->request_set(request);
+  cache_info->generation_set(s->cache_generation);
   if (!s->negative_caching)
     cache_info->response_set(response);
   else {
@@ -4799,6 +4839,8 @@ HttpTransact::set_headers_for_cache_write(State* s, HTTPInfo* cache_info, HTTPHd
   if (s->http_config_param->wuts_enabled)
     HttpTransactHeaders::convert_wuts_code_to_normal_reason(cache_info->response_get());
 
+  HttpTransactCache::set_vary_key(cache_info->request_get(), cache_info->response_get());
+
   if (!s->cop_test_page)
     DUMP_HEADER("http_hdrs", cache_info->request_get(), s->state_machine_id, "Cached Request Hdr");
 }
@@ -5917,6 +5959,130 @@ HttpTransact::is_stale_cache_response_returnable(State* s)
 }
 
 
+// Returns the delta-seconds of a Cache-Control extension directive
+// (eg. stale-while-revalidate=60) of the response, or -1 if absent.
+static int
+cache_control_extension_value(HTTPHdr* response, const char* directive, int directive_len)
+{
+  MIMEField *field = response->field_find(MIME_FIELD_CACHE_CONTROL, MIME_LEN_CACHE_CONTROL);
+
+  if (field) {
+    HdrCsvIter iter;
+    int val_len;
+    const char *val = iter.get_first(field, &val_len);
+
+    while (val) {
+      if (val_len > directive_len + 1 && val[directive_len] == '=' &&
+          strncasecmp(val, directive, directive_len) == 0) {
+        int secs = 0;
+
+        for (int i = directive_len + 1; i < val_len; i++) {
+          if (!ParseRules::is_digit(val[i]))
+            return -1;
+          secs = secs * 10 + (val[i] - '0');
+          if (secs > NUM_SECONDS_IN_ONE_YEAR)
+            return NUM_SECONDS_IN_ONE_YEAR;
+        }
+        return secs;
+      }
+      val = iter.get_next(&val_len);
+    }
+  }
+  return -1;
+}
+
+// Is the cached response no older than its freshness lifetime plus the
+// extra staleness granted by a RFC 5861 Cache-Control extension?
+static bool
+is_within_stale_extension(HttpTransact::State* s, const char* directive, int directive_len)
+{
+  CacheHTTPInfo *obj = s->cache_info.object_read;
+  HTTPHdr *cached_response = obj->response_get();
+  int window = cache_control_extension_value(cached_response, directive, directive_len);
+
+  if (window <= 0)
+    return false;
+
+  bool heuristic;
+  time_t response_date = cached_response->get_date();
+  int fresh_limit = HttpTransact::calculate_document_freshness_limit(s, cached_response, response_date, &heuristic);
+  time_t current_age = HttpTransactHeaders::calculate_document_age(obj->request_sent_time_get(),
+                                                                   obj->response_received_time_get(),
+                                                                   cached_response, response_date, s->current.now);
+
+  Debug("http_trans", "[is_within_stale_extension] %.*s=%d fresh_limit: %d current_age: %d",
+        directive_len, directive, window, fresh_limit, (int) current_age);
+  return current_age >= 0 && current_age <= fresh_limit + window;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Name       : is_stale_while_revalidate_returnable()
+// Description: check if a stale cached response may be served right away
+//              while it is revalidated in the background
+//
+// Input      : State
+// Output     : true or false
+//
+// Details    :
+//
+// The cached response must carry Cache-Control: stale-while-revalidate
+// and still be inside that window. Clients asking for an end-to-end
+// revalidation or a minimum freshness are never served this way, which
+// also keeps the background revalidation itself from taking this path.
+//
+///////////////////////////////////////////////////////////////////////////////
+bool
+HttpTransact::is_stale_while_revalidate_returnable(State* s)
+{
+  HTTPHdr *client_request = &s->hdr_info.client_request;
+
+  if (!s->http_config_param->cache_stale_while_revalidate) {
+    return false;
+  }
+  if (s->method != HTTP_WKSIDX_GET && s->method != HTTP_WKSIDX_HEAD) {
+    return false;
+  }
+  if (s->api_update_cached_object == HttpTransact::UPDATE_CACHED_OBJECT_CONTINUE) {
+    return false;
+  }
+  if (client_request->is_pragma_no_cache_set() ||
+      (client_request->get_cooked_cc_mask() &
+       (MIME_COOKED_MASK_CC_NO_CACHE | MIME_COOKED_MASK_CC_MAX_AGE | MIME_COOKED_MASK_CC_MIN_FRESH))) {
+    Debug("http_trans", "[is_stale_while_revalidate_returnable] client requires revalidation");
+    return false;
+  }
+  // cache.config freshness rules override the document's own
+  if (s->cache_control.ttl_in_cache > 0 || s->cache_control.revalidate_after >= 0) {
+    return false;
+  }
+  if (!is_stale_cache_response_returnable(s)) {
+    return false;
+  }
+  return is_within_stale_extension(s, "stale-while-revalidate", sizeof("stale-while-revalidate") - 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Name       : is_stale_if_error_returnable()
+// Description: check if a stale cached response may be served because the
+//              origin server failed with a 5xx while revalidating it
+//
+// Input      : State
+// Output     : true or false
+//
+///////////////////////////////////////////////////////////////////////////////
+bool
+HttpTransact::is_stale_if_error_returnable(State* s)
+{
+  if (!s->http_config_param->cache_stale_if_error) {
+    return false;
+  }
+  if (!is_stale_cache_response_returnable(s)) {
+    return false;
+  }
+  return is_within_stale_extension(s, "stale-if-error", sizeof("stale-if-error") - 1);
+}
+
+
 bool
 HttpTransact::url_looks_dynamic(URL* url)
 {
@@ -8717,6 +8883,10 @@ HttpTransact::update_size_and_time_stats(State* s, ink_hrtime total_time, ink_hr
     ink_assert(0);
   }
 
+  // Disk writes skipped by cache write admission
+  if (s->cache_info.write_status == CACHE_WRITE_NOT_ADMITTED)
+    HTTP_SUM_TRANS_STAT(http_cache_admission_bytes_saved_stat, origin_server_response_body_size);
+
   // Bandwidth Savings
   switch (s->squid_codes.log_code) {
   case SQUID_LOG_TCP_HIT:
@@ -506,7 +506,8 @@ public:
     CACHE_WRITE_LOCK_MISS,
     CACHE_WRITE_IN_PROGRESS,
     CACHE_WRITE_ERROR,
-    CACHE_WRITE_COMPLETE
+    CACHE_WRITE_COMPLETE,
+    CACHE_WRITE_NOT_ADMITTED
   };
 
   enum HttpRequestFlavor_t
@@ -652,6 +653,7 @@ public:
   {
     RANGE_NONE,
     RANGE_TRANSFORM,
+    RANGE_CACHE_SEEK,
     RANGE_NOT_SATISFIABLE,
     RANGE_NOT_HANDLED,
     RANGE_REVALIDATE
@@ -986,9 +988,19 @@ public:
     // for Range: to avoid write transfomed Range response into cache
     RangeSetup_t range_setup;
 
+    // for Range served by seeking the cache read (RANGE_CACHE_SEEK)
+    RangeRecord *ranges;
+    int num_range_fields;
+    int current_range;
+    int64_t range_output_cl;
+
     // for negative caching
     bool negative_caching;
 
+    // invalidation generation when the request started, recorded in
+    //  the alternate it writes
+    int64_t cache_generation;
+
     // for authenticated content caching
     CacheAuth_t www_auth_content;
 
@@ -1031,6 +1043,7 @@ public:
     StateMachineAction_t saved_update_next_action;
     CacheAction_t saved_update_cache_action;
     bool stale_icp_lookup;
+    bool stale_while_revalidate;        // serving a stale hit, refresh it in the background
 
     // Remap plugin processor support
     UrlMappingContainer url_map;
@@ -1105,7 +1118,12 @@ public:
         first_stats(),
         current_stats(NULL),
         range_setup(RANGE_NONE),
+        ranges(NULL),
+        num_range_fields(0),
+        current_range(-1),
+        range_output_cl(0),
         negative_caching(false),
+        cache_generation(0),
         www_auth_content(CACHE_AUTH_NONE),
         client_connection_enabled(true),
         acl_filtering_performed(false),
@@ -1135,6 +1153,7 @@ public:
         saved_update_next_action(STATE_MACHINE_ACTION_UNDEFINED),
         saved_update_cache_action(CACHE_DO_UNDEFINED),
         stale_icp_lookup(false),
+        stale_while_revalidate(false),
         url_map(),
         pCongestionEntry(NULL),
         congest_saved_next_action(STATE_MACHINE_ACTION_UNDEFINED),
@@ -1222,6 +1241,11 @@ public:
       redirect_info.original_url.destroy();
       redirect_info.redirect_url.destroy();
 
+      if (ranges) {
+        delete[]ranges;
+        ranges = NULL;
+      }
+
       if (pCongestionEntry) {
         if (congestion_connection_opened == 1) {
           pCongestionEntry->connection_closed();
@@ -1341,6 +1365,8 @@ public:
   static bool is_server_negative_cached(State* s);
   static bool is_cache_response_returnable(State* s);
   static bool is_stale_cache_response_returnable(State* s);
+  static bool is_stale_while_revalidate_returnable(State* s);
+  static bool is_stale_if_error_returnable(State* s);
   static bool need_to_revalidate(State* s);
   static bool url_looks_dynamic(URL* url);
   static bool is_request_cache_lookupable(State* s, HTTPHdr* incoming);
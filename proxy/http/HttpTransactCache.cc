@@ -29,9 +29,11 @@
 #include "time.h"
 #include "HTTP.h"
 #include "HttpCompat.h"
+#include "HdrUtils.h"
 #include "HttpMessageBody.h"
 #include "Error.h"
 #include "InkErrno.h"
+#include "HttpCacheGeneration.h"
 
 ClassAllocator<CacheLookupHttpConfig> CacheLookupHttpConfigAllocator("CacheLookupHttpConfigAllocator");
 
@@ -153,6 +155,239 @@ is_empty(char *s)
   return (s[0] == NUL);
 }
 
+/**
+  Hash the comma-separated values of a request field for the Vary key.
+
+  Values are folded to lower case and stop at the first terminator, so
+  any two fields that do_header_values_rfc2068_14_43_match() considers
+  equal hash the same; a differing hash is therefore a sure mismatch.
+  An absent field hashes to 0, a present one never does.
+
+*/
+static uint32_t
+vary_hash_field(MIMEField * field)
+{
+  HdrCsvIter iter;
+  const char *value;
+  int len;
+  uint32_t h = 2166136261U;     // FNV-1a
+
+  if (field == NULL)
+    return 0;
+
+  for (value = iter.get_first(field, &len); value != NULL; value = iter.get_next(&len)) {
+    for (int i = 0; i < len && !ParseRules::is_eow(value[i]); i++) {
+      h ^= (unsigned char) ParseRules::ink_tolower(value[i]);
+      h *= 16777619U;
+    }
+    h ^= ',';
+    h *= 16777619U;
+  }
+  return h | 1;
+}
+
+// The names in every Vary field of a response, duplicate fields included.
+static int
+vary_get_comma_list(HTTPHdr * obj_origin_server_response, StrList * vary_list)
+{
+  MIMEField *field = obj_origin_server_response->field_find(MIME_FIELD_VARY, MIME_LEN_VARY);
+
+  for (; field != NULL; field = field->m_next_dup)
+    field->value_get_comma_list(vary_list);
+  return vary_list->count;
+}
+
+inline static MIMEField *
+vary_field_find(HTTPHdr * hdr, const char *name, int len)
+{
+  const char *wks = hdrtoken_string_to_wks(name, len);
+
+  return hdr->field_find(wks ? wks : name, len);
+}
+
+// State kept across one SelectFromAlternates() call. Alternates of an
+// object normally share the same Vary, so its split and the client's hash
+// of each field it names are carried from one alternate to the next.
+struct VaryKeyMemo
+{
+  enum { MAX_VARY = 256, MAX_NAMES = 16 };
+  char vary[MAX_VARY];          // raw Vary values the names were split from, joined by commas
+  int vary_len;                 // -1 if nothing is cached
+  char name_buf[MAX_VARY];
+  int num_names;
+  struct
+  {
+    const char *str;
+    int len;
+    bool hashed;
+    uint32_t hash;
+  } name[MAX_NAMES];
+
+  VaryKeyMemo():vary_len(-1), num_names(0) { }
+
+  // Split the Vary of a cached response exactly as CalcVariability() does.
+  bool split(HTTPHdr * obj_origin_server_response)
+  {
+    MIMEField *field = obj_origin_server_response->field_find(MIME_FIELD_VARY, MIME_LEN_VARY);
+    char raw[MAX_VARY];
+    int raw_len = 0, used = 0;
+    StrList vary_list;
+
+    if (field == NULL)
+      return false;
+    for (; field != NULL; field = field->m_next_dup) {
+      int len;
+      const char *value = field->value_get(&len);
+
+      if (raw_len + len + 1 > MAX_VARY) {
+        vary_len = -1;
+        num_names = 0;
+        return false;
+      }
+      if (raw_len > 0)
+        raw[raw_len++] = ',';
+      memcpy(raw + raw_len, value, len);
+      raw_len += len;
+    }
+    if (raw_len == vary_len && memcmp(raw, vary, raw_len) == 0)
+      return num_names > 0;
+
+    vary_len = -1;
+    num_names = 0;
+    if (vary_get_comma_list(obj_origin_server_response, &vary_list) <= 0)
+      return false;
+    for (Str * s = vary_list.head; s != NULL; s = s->next) {
+      if (s->len == 0)
+        continue;
+      if (num_names == MAX_NAMES || used + (int) s->len > MAX_VARY) {
+        num_names = 0;
+        return false;
+      }
+      memcpy(name_buf + used, s->str, s->len);
+      name[num_names].str = name_buf + used;
+      name[num_names].len = s->len;
+      name[num_names].hashed = false;
+      used += s->len;
+      num_names++;
+    }
+    memcpy(vary, raw, raw_len);
+    vary_len = raw_len;
+    return num_names > 0;
+  }
+
+  uint32_t client_hash(HTTPHdr * client_request, int i)
+  {
+    if (!name[i].hashed) {
+      name[i].hash = vary_hash_field(vary_field_find(client_request, name[i].str, name[i].len));
+      name[i].hashed = true;
+    }
+    return name[i].hash;
+  }
+};
+
+/**
+  Use the Vary key stored with an alternate to decide, without scoring
+  it, that the alternate cannot match the client request.
+
+  The key is only trusted while its field names still line up with the
+  Vary header of the cached response; otherwise (or if there is no key,
+  as for objects written by older versions) this returns false and the
+  alternate goes through calculate_quality_of_match() as before. A true
+  return means CalcVariability() would report a mismatch.
+
+*/
+static bool
+vary_key_excludes(CacheLookupHttpConfig * http_config_params, HTTPHdr * client_request,
+                  HTTPHdr * obj_client_request, HTTPHdr * obj_origin_server_response, VaryKeyMemo * memo)
+{
+  const char *key, *key_end;
+  int key_len;
+
+  // calculate_quality_of_match() skips the variability check for these.
+  if (obj_origin_server_response->status_get() != HTTP_STATUS_OK)
+    return false;
+
+  key = obj_client_request->value_get(HTTP_VARY_KEY_FIELD, HTTP_VARY_KEY_LEN, &key_len);
+  if (key == NULL || !memo->split(obj_origin_server_response))
+    return false;
+
+  key_end = key + key_len;
+  for (int n = 0; n < memo->num_names; n++) {
+    const char *name = memo->name[n].str;
+    int len = memo->name[n].len;
+    uint32_t stored = 0;
+
+    // Each entry is "<name>=<8 hex digits>", separated by single spaces.
+    if (key_end - key < len + 9 || strncasecmp(key, name, len) != 0 || key[len] != '=')
+      return false;
+    key += len + 1;
+    for (int i = 0; i < 8; i++, key++) {
+      if (!ParseRules::is_hex(*key))
+        return false;
+      stored = (stored << 4) | (uint32_t) (ParseRules::is_digit(*key) ? *key - '0' : ParseRules::ink_tolower(*key) - 'a' + 10);
+    }
+    if (key < key_end && *key++ != ' ')
+      return false;
+
+    // Same exemptions as CalcVariability().
+    if (http_config_params->cache_global_user_agent_header && len == MIME_LEN_USER_AGENT &&
+        strncasecmp(name, MIME_FIELD_USER_AGENT, len) == 0)
+      continue;
+    if (http_config_params->ignore_accept_encoding_mismatch && len == MIME_LEN_ACCEPT_ENCODING &&
+        strncasecmp(name, MIME_FIELD_ACCEPT_ENCODING, len) == 0)
+      continue;
+
+    if (memo->client_hash(client_request, n) != stored)
+      return true;
+  }
+  return false;
+}
+
+/**
+  Record the Vary key for an alternate about to be written to cache.
+
+  Any existing key is dropped first, so a cache update never leaves a
+  stale one behind. No key is stored for responses that CalcVariability()
+  would handle specially (non-200, no Vary, "Vary: *").
+
+*/
+void
+HttpTransactCache::set_vary_key(HTTPHdr * obj_client_request, HTTPHdr * obj_origin_server_response)
+{
+  char key[HTTP_VARY_KEY_MAX];
+  int key_len = 0;
+  StrList vary_list;
+  Str *field;
+
+  obj_client_request->field_delete(HTTP_VARY_KEY_FIELD, HTTP_VARY_KEY_LEN);
+
+  if (obj_origin_server_response->status_get() != HTTP_STATUS_OK)
+    return;
+  if (vary_get_comma_list(obj_origin_server_response, &vary_list) <= 0)
+    return;
+
+  for (field = vary_list.head; field != NULL; field = field->next) {
+    const char *name = field->str;
+    int len = field->len;
+
+    if (len == 0)
+      continue;
+    if (len == 1 && name[0] == '*')
+      return;
+    for (int i = 0; i < len; i++) {
+      if (name[i] == ' ' || name[i] == '=' || ParseRules::is_eow(name[i]))
+        return;
+    }
+    if (key_len + len + 11 > (int) sizeof(key))
+      return;
+    key_len += snprintf(key + key_len, sizeof(key) - key_len, "%s%.*s=%08x", key_len ? " " : "", len, name,
+                        vary_hash_field(vary_field_find(obj_client_request, name, len)));
+  }
+
+  if (key_len > 0)
+    obj_client_request->value_set(HTTP_VARY_KEY_FIELD, HTTP_VARY_KEY_LEN, key, key_len);
+}
+
 /**
   Given a set of alternates, select the best match.
 
@@ -175,6 +410,8 @@ HttpTransactCache::SelectFromAlternates(CacheHTTPInfoVector * cache_vector,
   int best_index = -1;
   float best_Q = -1.0;
   float unacceptable_Q = 0.0;
+  VaryKeyMemo vary_memo;
+  bool use_vary_key, is_purge;
 
   int alt_count = cache_vector->count();
   if (alt_count == 0) {
@@ -203,6 +440,11 @@ HttpTransactCache::SelectFromAlternates(CacheHTTPInfoVector * cache_vector,
   if (!client_request->valid()) {
     return 0;
   }
+  // For PURGE requests any alternate will do, see calculate_quality_of_match().
+  is_purge = (client_request->method_get_wksidx() == HTTP_WKSIDX_PURGE);
+  // A SELECT_ALT hook is called for alternates the Vary key would skip,
+  // so with one installed every alternate is scored.
+  use_vary_key = (alt_count > 1) && !is_purge && !http_global_hooks->get(TS_HTTP_SELECT_ALT_HOOK);
 
   for (int i = 0; i < alt_count; i++) {
     float Q;
@@ -214,6 +456,21 @@ HttpTransactCache::SelectFromAlternates(CacheHTTPInfoVector * cache_vector,
       ink_debug_assert(cached_request->valid());
       ink_debug_assert(cached_response->valid());
 
+      // Alternates written before their host or one of their tags was
+      // invalidated are treated as gone, so they are refetched.
+      if (!is_purge && httpCacheGenerations.invalidated(obj)) {
+        Debug("http_match", "[SelectFromAlternates] alternate #%d invalidated", i + 1);
+        continue;
+      }
+
+      // An alternate ruled out by its Vary key would score Q = -1, which
+      // can never be selected; skip it without scoring.
+      if (use_vary_key &&
+          vary_key_excludes(http_config_params, client_request, cached_request, cached_response, &vary_memo)) {
+        Debug("http_match", "[SelectFromAlternates] alternate #%d excluded by Vary key", i + 1);
+        continue;
+      }
+
       Q = calculate_quality_of_match(http_config_params, client_request, cached_request, cached_response);
 
       if (alt_count > 1) {
@@ -1171,7 +1428,7 @@ HttpTransactCache::CalcVariability(CacheLookupHttpConfig * http_config_params,
     // treat as 1.0 with no Vary header.                                 //
     ///////////////////////////////////////////////////////////////////////
 
-    int num_vary_values = obj_origin_server_response->value_get_comma_list(MIME_FIELD_VARY, MIME_LEN_VARY, &vary_list);
+    int num_vary_values = vary_get_comma_list(obj_origin_server_response, &vary_list);
 
     if (num_vary_values <= 0)   // no vary hdr, so use defaults if enabled
     {
@@ -1570,3 +1827,225 @@ CacheLookupHttpConfig::unmarshal(Arena * arena, const char *buf, int buflen)
 
   return (p - buf);
 }
+
+#if TS_HAS_TESTS
+#include "Regression.h"
+
+static void
+vary_test_hdr(HTTPHdr * hdr, HTTPType type, const char *str)
+{
+  HTTPParser parser;
+  const char *end = str + strlen(str);
+
+  hdr->create(type);
+  http_parser_init(&parser);
+  if (type == HTTP_TYPE_REQUEST)
+    hdr->parse_req(&parser, &str, end, true);
+  else
+    hdr->parse_resp(&parser, &str, end, true);
+  http_parser_clear(&parser);
+}
+
+// An object negotiated on language and encoding: 32 languages x 2
+// encodings = 64 alternates.
+static void
+vary_test_fill(CacheHTTPInfoVector * vec, bool with_key)
+{
+  static const char *encodings[2] = { "gzip", "identity" };
+  char buf[512];
+
+  for (int i = 0; i < 64; i++) {
+    HTTPHdr req, resp;
+    CacheHTTPInfo info;
+    INK_MD5 md5;
+
+    snprintf(buf, sizeof(buf), "GET http://www.example.com/index.html HTTP/1.1\r\n"
+             "Accept-Language: x%02d\r\nAccept-Encoding: %s\r\n\r\n", i / 2, encodings[i % 2]);
+    vary_test_hdr(&req, HTTP_TYPE_REQUEST, buf);
+    snprintf(buf, sizeof(buf), "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Language: x%02d\r\n"
+             "Vary: Accept-Language, Accept-Encoding\r\n\r\n", i / 2);
+    vary_test_hdr(&resp, HTTP_TYPE_RESPONSE, buf);
+
+    info.create();
+    info.request_set(&req);
+    info.response_set(&resp);
+    if (with_key)
+      HttpTransactCache::set_vary_key(info.request_get(), info.response_get());
+    md5.encodeBuffer(buf, strlen(buf));
+    info.object_key_set(md5);
+    vec->insert(&info);
+
+    req.destroy();
+    resp.destroy();
+  }
+}
+
+REGRESSION_TEST(HttpTransactCache_VaryKey) (RegressionTest * t, int atype, int *pstatus)
+{
+  NOWARN_UNUSED(atype);
+  const int loops = 1000;
+  const char *requests[2] = {
+    "GET http://www.example.com/index.html HTTP/1.1\r\nAccept-Language: x31\r\nAccept-Encoding: identity\r\n\r\n",
+    "GET http://www.example.com/index.html HTTP/1.1\r\nAccept-Language: x99\r\nAccept-Encoding: gzip\r\n\r\n"
+  };
+  const int expected[2] = { 63, -1 };
+  CacheHTTPInfoVector plain, keyed;
+  CacheLookupHttpConfig config;
+  HTTPHdr client;
+  ink_hrtime start, plain_time, keyed_time;
+  int plain_index = 0, keyed_index = 0;
+
+  *pstatus = REGRESSION_TEST_PASSED;
+  vary_test_fill(&plain, false);
+  vary_test_fill(&keyed, true);
+
+  for (int r = 0; r < 2; r++) {
+    vary_test_hdr(&client, HTTP_TYPE_REQUEST, requests[r]);
+
+    start = ink_get_hrtime_internal();
+    for (int i = 0; i < loops; i++)
+      plain_index = HttpTransactCache::SelectFromAlternates(&plain, &client, &config);
+    plain_time = ink_get_hrtime_internal() - start;
+
+    start = ink_get_hrtime_internal();
+    for (int i = 0; i < loops; i++)
+      keyed_index = HttpTransactCache::SelectFromAlternates(&keyed, &client, &config);
+    keyed_time = ink_get_hrtime_internal() - start;
+
+    rprintf(t, "64 alternates: %d ns/lookup without Vary key, %d ns/lookup with (selected %d, %d)\n",
+            (int) (plain_time / loops), (int) (keyed_time / loops),
+            plain_index, keyed_index);
+    if (plain_index != expected[r] || keyed_index != expected[r])
+      *pstatus = REGRESSION_TEST_FAILED;
+    client.destroy();
+  }
+
+  plain.clear();
+  keyed.clear();
+}
+
+// A response may name its Vary headers in several Vary fields, each counts.
+REGRESSION_TEST(HttpTransactCache_VaryFields) (RegressionTest * t, int atype, int *pstatus)
+{
+  NOWARN_UNUSED(atype);
+  static const char *variants[2] = { "a", "b" };
+  CacheHTTPInfoVector vec[2];
+  CacheLookupHttpConfig config;
+  char buf[512];
+
+  *pstatus = REGRESSION_TEST_PASSED;
+  for (int k = 0; k < 2; k++) {
+    for (int i = 0; i < 2; i++) {
+      HTTPHdr req, resp;
+      CacheHTTPInfo info;
+      INK_MD5 md5;
+
+      snprintf(buf, sizeof(buf), "GET http://www.example.com/index.html HTTP/1.1\r\n"
+               "Accept-Language: en\r\nX-Variant: %s\r\n\r\n", variants[i]);
+      vary_test_hdr(&req, HTTP_TYPE_REQUEST, buf);
+      vary_test_hdr(&resp, HTTP_TYPE_RESPONSE, "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n"
+                    "Vary: Accept-Language\r\nVary: X-Variant\r\n\r\n");
+      info.create();
+      info.request_set(&req);
+      info.response_set(&resp);
+      if (k == 1)
+        HttpTransactCache::set_vary_key(info.request_get(), info.response_get());
+      md5.encodeBuffer(buf, strlen(buf));
+      info.object_key_set(md5);
+      vec[k].insert(&info);
+      req.destroy();
+      resp.destroy();
+    }
+  }
+
+  for (int k = 0; k < 2; k++) {
+    for (int i = 0; i < 2; i++) {
+      HTTPHdr client;
+      int index;
+
+      snprintf(buf, sizeof(buf), "GET http://www.example.com/index.html HTTP/1.1\r\n"
+               "Accept-Language: en\r\nX-Variant: %s\r\n\r\n", variants[i]);
+      vary_test_hdr(&client, HTTP_TYPE_REQUEST, buf);
+      index = HttpTransactCache::SelectFromAlternates(&vec[k], &client, &config);
+      if (index != i) {
+        rprintf(t, "X-Variant %s %s Vary key: selected %d\n", variants[i], k ? "with" : "without", index);
+        *pstatus = REGRESSION_TEST_FAILED;
+      }
+      client.destroy();
+    }
+    vec[k].clear();
+  }
+}
+
+REGRESSION_TEST(HttpTransactCache_Generation) (RegressionTest * t, int atype, int *pstatus)
+{
+  NOWARN_UNUSED(atype);
+  char path[PATH_NAME_MAX];
+  CacheHTTPInfo a, b;
+  HTTPHdr req, resp;
+  int fd;
+
+  *pstatus = REGRESSION_TEST_FAILED;
+  snprintf(path, sizeof(path), "/tmp/generationsXXXXXX");
+  if ((fd = mkstemp(path)) < 0) {
+    rprintf(t, "unable to create %s\n", path);
+    return;
+  }
+  close(fd);
+
+  // a is tagged "red blue" on www.example.com, b is untagged on other.example.com
+  vary_test_hdr(&req, HTTP_TYPE_REQUEST, "GET http://www.example.com/a HTTP/1.1\r\n\r\n");
+  vary_test_hdr(&resp, HTTP_TYPE_RESPONSE, "HTTP/1.1 200 OK\r\nSurrogate-Key: red  blue\r\n\r\n");
+  a.create();
+  a.request_set(&req);
+  a.response_set(&resp);
+  req.destroy();
+  resp.destroy();
+  vary_test_hdr(&req, HTTP_TYPE_REQUEST, "GET http://other.example.com/b HTTP/1.1\r\n\r\n");
+  vary_test_hdr(&resp, HTTP_TYPE_RESPONSE, "HTTP/1.1 200 OK\r\n\r\n");
+  b.create();
+  b.request_set(&req);
+  b.response_set(&resp);
+  req.destroy();
+  resp.destroy();
+
+  {
+    HttpCacheGenerations gens;
+    bool ok = (gens.open(path) == 0);
+
+    a.generation_set(gens.current());
+    b.generation_set(gens.current());
+    ok = ok && !gens.invalidated(&a) && !gens.invalidated(&b);
+    ok = ok && gens.invalidate_tag("green", 5) > 0 && !gens.invalidated(&a);
+    ok = ok && gens.invalidate_tag("blue", 4) > 0 && gens.invalidated(&a) && !gens.invalidated(&b);
+    a.generation_set(gens.current());
+    ok = ok && !gens.invalidated(&a);
+    ok = ok && gens.invalidate_host("OTHER.example.com", 17) > 0 && gens.invalidated(&b) && !gens.invalidated(&a);
+    b.generation_set(gens.current());
+    if (!ok) {
+      rprintf(t, "wrong result invalidating by tag or host\n");
+      goto Ldone;
+    }
+  }
+  {
+    // The purges survive a reload; new alternates are not affected.
+    HttpCacheGenerations gens;
+
+    if (gens.open(path) != 0 || gens.current() != b.generation_get() || gens.invalidated(&a) || gens.invalidated(&b)) {
+      rprintf(t, "wrong result after reload, generation %" PRId64 "\n", gens.current());
+      goto Ldone;
+    }
+    a.generation_set(0);
+    if (!gens.invalidated(&a) || gens.invalidate_host("", 0) != -1) {
+      rprintf(t, "reloaded purges not applied\n");
+      goto Ldone;
+    }
+  }
+  *pstatus = REGRESSION_TEST_PASSED;
+
+Ldone:
+  a.destroy();
+  b.destroy();
+  unlink(path);
+}
+#endif
@@ -35,6 +35,14 @@
 
 struct CacheHTTPInfoVector;
 
+// Internal (never sent) header on a cached request recording the hash of
+// each request field named by the response Vary. It lets
+// SelectFromAlternates rule out an alternate with a few integer compares
+// before scoring it.
+#define HTTP_VARY_KEY_FIELD "@Vary-Key"
+#define HTTP_VARY_KEY_LEN   9
+#define HTTP_VARY_KEY_MAX   512
+
 class CacheLookupHttpConfig
 {
 public:
@@ -138,6 +146,8 @@ public:
 
   static HTTPStatus match_response_to_request_conditionals(HTTPHdr * ua_request, HTTPHdr * c_response);
 
+  static void set_vary_key(HTTPHdr * obj_client_request, HTTPHdr * obj_origin_server_response);
+
 };
 
 #endif
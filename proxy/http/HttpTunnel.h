@@ -119,7 +119,7 @@ struct ChunkedHandler
   int last_server_event;
 
   // Parsing Info
-  int running_sum;
+  int64_t running_sum;
   int num_digits;
 
   ChunkedHandler();
@@ -267,6 +267,7 @@ private:
   void finish_all_internal(HttpTunnelProducer * p, bool chain);
   void update_stats_after_abort(HttpTunnelType_t t);
   void producer_run(HttpTunnelProducer * p);
+  bool producer_range_seek(HttpTunnelProducer * p);
 
   HttpTunnelProducer *get_producer(VIO * vio);
   HttpTunnelConsumer *get_consumer(VIO * vio);
@@ -286,8 +287,6 @@ public:
   PostDataBuffers * postbuf;
 };
 
-extern void init_max_chunk_buf();
-
 // void HttpTunnel::abort_cache_write_finish_others
 //
 //    Abort all downstream cache writes and finsish
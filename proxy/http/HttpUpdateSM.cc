@@ -156,12 +156,32 @@ HttpUpdateSM::handle_api_return()
       break;
     }
 #endif //TS_NO_TRANSFORM
-  case HttpTransact::PROXY_INTERNAL_CACHE_WRITE:
   case HttpTransact::SERVER_READ:
+    if (t_state.cache_info.action == HttpTransact::CACHE_DO_WRITE ||
+        t_state.cache_info.action == HttpTransact::CACHE_DO_REPLACE) {
+      // There is no user agent, the body only goes to the cache
+      cache_sm.close_read();
+      t_state.cache_info.write_status = HttpTransact::CACHE_WRITE_IN_PROGRESS;
+      setup_server_transfer_to_cache_only();
+      tunnel.tunnel_run();
+
+      cb_event = HTTP_SCH_UPDATE_EVENT_WRITTEN;
+      t_state.squid_codes.log_code = SQUID_LOG_TCP_REFRESH_MISS;
+      return;
+    }
+    // fall through
+  case HttpTransact::PROXY_INTERNAL_CACHE_WRITE:
   case HttpTransact::PROXY_INTERNAL_CACHE_NOOP:
   case HttpTransact::PROXY_SEND_ERROR_CACHE_NOOP:
   case HttpTransact::SERVE_FROM_CACHE:
     {
+      if (t_state.cache_info.action == HttpTransact::CACHE_DO_SERVE_AND_UPDATE) {
+        // The headers were already updated by perform_cache_write_action()
+        cb_event = HTTP_SCH_UPDATE_EVENT_UPDATED;
+        t_state.squid_codes.log_code = SQUID_LOG_TCP_REFRESH_HIT;
+        terminate_sm = true;
+        return;
+      }
       cb_event = HTTP_SCH_UPDATE_EVENT_NOT_CACHED;
       t_state.squid_codes.log_code = SQUID_LOG_TCP_MISS;
       terminate_sm = true;
@@ -234,3 +254,116 @@ HttpUpdateSM::kill_this_async_hook(int event, void *data)
 
   return HttpSM::kill_this_async_hook(EVENT_NONE, NULL);
 }
+
+/////////////////////////////////////////////////////////////////////////////
+//
+//  Background revalidation
+//
+//  A stale hit served under Cache-Control: stale-while-revalidate is
+//  revalidated by an HttpUpdateSM with no user agent.  Only one
+//  revalidation per URL is in flight at a time; later stale hits for
+//  that URL are served without starting another one.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static ink_mutex stale_revalidate_mutex;
+static InkHashTable *stale_revalidate_table = NULL;
+
+struct HttpStaleRevalidate:public Continuation
+{
+  HTTPHdr request;
+  char *url;
+
+  int start_event(int event, void *data);
+  int done_event(int event, void *data);
+
+  HttpStaleRevalidate(char *a_url)
+    : Continuation(new_ProxyMutex()), url(a_url)
+  {
+    SET_HANDLER(&HttpStaleRevalidate::start_event);
+  }
+
+  ~HttpStaleRevalidate()
+  {
+    request.destroy();
+    xfree(url);
+  }
+};
+
+int
+HttpStaleRevalidate::start_event(int event, void *data)
+{
+  NOWARN_UNUSED(event);
+  NOWARN_UNUSED(data);
+  HttpUpdateSM *sm = HttpUpdateSM::allocate();
+
+  Debug("http_revalidate", "starting background revalidation of %s", url);
+  HTTP_INCREMENT_DYN_STAT(http_background_revalidations_stat);
+  SET_HANDLER(&HttpStaleRevalidate::done_event);
+  sm->init();
+  // may call us back, and delete us, before it returns
+  sm->start_scheduled_update(this, &request);
+  return EVENT_DONE;
+}
+
+int
+HttpStaleRevalidate::done_event(int event, void *data)
+{
+  NOWARN_UNUSED(data);
+  Debug("http_revalidate", "background revalidation of %s done: %s", url, HttpDebugNames::get_event_name(event));
+
+  ink_mutex_acquire(&stale_revalidate_mutex);
+  ink_hash_table_delete(stale_revalidate_table, url);
+  ink_mutex_release(&stale_revalidate_mutex);
+
+  delete this;
+  return EVENT_DONE;
+}
+
+void
+init_http_stale_revalidate()
+{
+  ink_mutex_init(&stale_revalidate_mutex, "HttpStaleRevalidate");
+  stale_revalidate_table = ink_hash_table_create(InkHashTableKeyType_String);
+}
+
+void
+http_stale_revalidate(HttpTransact::State * s)
+{
+  URL *url = s->pristine_url.valid() ? &s->pristine_url : s->hdr_info.client_request.url_get();
+  char *url_str = url->string_get(NULL);
+
+  if (url_str == NULL)
+    return;
+
+  ink_mutex_acquire(&stale_revalidate_mutex);
+  if (ink_hash_table_isbound(stale_revalidate_table, url_str)) {
+    ink_mutex_release(&stale_revalidate_mutex);
+    Debug("http_revalidate", "revalidation of %s already in progress", url_str);
+    xfree(url_str);
+    return;
+  }
+  ink_hash_table_insert(stale_revalidate_table, url_str, NULL);
+  ink_mutex_release(&stale_revalidate_mutex);
+
+  // An unconditional GET for the full document from the client's
+  //  request.  max-age=0 forces HttpTransact to revalidate the stale
+  //  copy instead of serving it.
+  HttpStaleRevalidate *r = NEW(new HttpStaleRevalidate(url_str));
+  HTTPHdr *req = &r->request;
+
+  req->create(HTTP_TYPE_REQUEST);
+  req->copy(&s->hdr_info.client_request);
+  req->url_set(url);
+  req->method_set(HTTP_METHOD_GET, HTTP_LEN_GET);
+  req->field_delete(MIME_FIELD_IF_MODIFIED_SINCE, MIME_LEN_IF_MODIFIED_SINCE);
+  req->field_delete(MIME_FIELD_IF_UNMODIFIED_SINCE, MIME_LEN_IF_UNMODIFIED_SINCE);
+  req->field_delete(MIME_FIELD_IF_NONE_MATCH, MIME_LEN_IF_NONE_MATCH);
+  req->field_delete(MIME_FIELD_IF_MATCH, MIME_LEN_IF_MATCH);
+  req->field_delete(MIME_FIELD_IF_RANGE, MIME_LEN_IF_RANGE);
+  req->field_delete(MIME_FIELD_RANGE, MIME_LEN_RANGE);
+  req->field_delete(MIME_FIELD_PRAGMA, MIME_LEN_PRAGMA);
+  req->value_set(MIME_FIELD_CACHE_CONTROL, MIME_LEN_CACHE_CONTROL, "max-age=0", sizeof("max-age=0") - 1);
+
+  eventProcessor.schedule_imm(r, ET_NET);
+}
@@ -81,4 +81,8 @@ HttpUpdateSM::allocate()
 // Regression/Testing Routing
 void init_http_update_test();
 
+// Background revalidation of stale-while-revalidate hits
+void init_http_stale_revalidate();
+void http_stale_revalidate(HttpTransact::State * s);
+
 #endif
@@ -1946,7 +1946,7 @@ UrlRewrite::_destroyList(RegexMappingList &mappings)
       pcre_free(list_iter->re);
     }
     if (list_iter->re_extra) {
-      pcre_free(list_iter->re_extra);
+      regex_free_study(list_iter->re_extra);
     }
     if (list_iter->to_url_host_template) {
       ink_free(list_iter->to_url_host_template);
@@ -1987,7 +1987,7 @@ UrlRewrite::_processRegexMappingConfig(const char *from_host_lower, url_mapping
     goto lFail;
   }
 
-  reg_map->re_extra = pcre_study(reg_map->re, 0, &str);
+  reg_map->re_extra = regex_study(reg_map->re, &str);
   if ((reg_map->re_extra == NULL) && (str != NULL)) {
     Error("pcre_study failed with message [%s]", str);
     goto lFail;
@@ -2040,7 +2040,7 @@ UrlRewrite::_processRegexMappingConfig(const char *from_host_lower, url_mapping
     reg_map->re = NULL;
   }
   if (reg_map->re_extra) {
-    pcre_free(reg_map->re_extra);
+    regex_free_study(reg_map->re_extra);
     reg_map->re_extra = NULL;
   }
   if (reg_map->to_url_host_template) {
@@ -839,6 +839,7 @@ convert_cache_write_code(HttpTransact::CacheWriteStatus_t t)
   LogCacheWriteCodeType code;
   switch (t) {
   case HttpTransact::NO_CACHE_WRITE:
+  case HttpTransact::CACHE_WRITE_NOT_ADMITTED:
     code = LOG_CACHE_WRITE_NONE;
     break;
   case HttpTransact::CACHE_WRITE_LOCK_MISS: